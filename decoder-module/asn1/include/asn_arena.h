@@ -0,0 +1,71 @@
+/*
+ * Arena (bump) allocator for the ASN.1 run-time support code.
+ * Redistribution and modifications are permitted subject to BSD license.
+ */
+#ifndef	ASN_ARENA_H
+#define	ASN_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An arena hands out memory from large blocks with a simple pointer bump, and
+ * releases everything at once when it is reset. It is meant to hold the
+ * structures built by a decoder for a single message, which are all released
+ * together after the message has been processed, instead of walking them with
+ * ASN_STRUCT_FREE() and calling free() on each nested member.
+ *
+ * While an arena is active in a thread (see asn_arena_activate()), the CALLOC,
+ * MALLOC, REALLOC and FREEMEM macros used by the run-time support code allocate
+ * from it; otherwise, they fall back to the standard library allocator.
+ * Memory allocated from an arena must never be passed to free() (e.g., through
+ * ASN_STRUCT_FREE() after the arena has been deactivated): it is only released
+ * by asn_arena_reset() or asn_arena_delete().
+ *
+ * An arena is not thread-safe: each thread (e.g., each decoder) must use its own.
+ */
+typedef struct asn_arena_s asn_arena_t;
+
+/* Default size, in bytes, of each block of memory of an arena */
+#define	ASN_ARENA_DEFAULT_BLOCK_SIZE	65536
+
+/*
+ * Create a new, empty arena, allocating its blocks of (at least) block_size
+ * bytes (0 selects ASN_ARENA_DEFAULT_BLOCK_SIZE). Returns NULL on failure.
+ */
+asn_arena_t *asn_arena_new(size_t block_size);
+
+/* Release all the memory of the arena and the arena itself */
+void asn_arena_delete(asn_arena_t *arena);
+
+/*
+ * Release at once everything allocated from the arena. If the last message
+ * needed more than one block, the blocks are merged into a single larger one,
+ * so that the following messages of the same size fit in it.
+ */
+void asn_arena_reset(asn_arena_t *arena);
+
+/*
+ * Make the arena the one used by the allocation macros in the calling thread
+ * (NULL restores the standard library allocator). Returns the arena which was
+ * previously active, to be restored afterwards.
+ */
+asn_arena_t *asn_arena_activate(asn_arena_t *arena);
+
+/* Total number of bytes currently allocated from the arena */
+size_t asn_arena_used(const asn_arena_t *arena);
+
+/* Allocation functions behind the CALLOC, MALLOC, REALLOC and FREEMEM macros */
+void *asn_arena_calloc(size_t nmemb, size_t size);
+void *asn_arena_malloc(size_t size);
+void *asn_arena_realloc(void *ptr, size_t size);
+void asn_arena_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* ASN_ARENA_H */
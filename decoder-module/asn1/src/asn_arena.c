@@ -0,0 +1,234 @@
+/*
+ * Arena (bump) allocator for the ASN.1 run-time support code.
+ * Redistribution and modifications are permitted subject to BSD license.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asn_arena.h"
+
+/* Alignment of the returned memory (enough for any type used by the generated code) */
+#define	ARENA_ALIGN	16
+#define	ARENA_ALIGN_UP(x)	(((x) + (ARENA_ALIGN - 1)) & ~((size_t)ARENA_ALIGN - 1))
+/* Each allocation is preceded by its size, which is needed by REALLOC */
+#define	ARENA_HDR_SIZE	ARENA_ALIGN_UP(sizeof(size_t))
+
+typedef struct asn_arena_block_s {
+    struct asn_arena_block_s *next;
+    size_t size;    /* Capacity of the block, in bytes */
+    size_t used;    /* Bytes handed out so far */
+    size_t last;    /* Offset of the header of the last allocation */
+} asn_arena_block_t;
+
+#define	ARENA_BLOCK_DATA(b)	((char *)(b) + ARENA_ALIGN_UP(sizeof(asn_arena_block_t)))
+
+struct asn_arena_s {
+    asn_arena_block_t *blocks;  /* Newest block first */
+    size_t block_size;
+};
+
+/* Arena used by the allocation macros in the current thread (NULL = standard library allocator) */
+static _Thread_local asn_arena_t *asn_arena_current;
+
+static asn_arena_block_t *
+arena_block_new(size_t size) {
+    asn_arena_block_t *b = malloc(ARENA_ALIGN_UP(sizeof(asn_arena_block_t)) + size);
+    if(!b) return NULL;
+
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    b->last = 0;
+
+    return b;
+}
+
+static void *
+arena_alloc(asn_arena_t *arena, size_t size) {
+    asn_arena_block_t *b = arena->blocks;
+    size_t need;
+    char *hdr;
+
+    if(size > SIZE_MAX / 2) return NULL;
+    need = ARENA_HDR_SIZE + ARENA_ALIGN_UP(size);
+
+    if(!b || b->size - b->used < need) {
+        /* The free space left in the previous block (if any) is not used anymore */
+        b = arena_block_new(need > arena->block_size ? need : arena->block_size);
+        if(!b) return NULL;
+        b->next = arena->blocks;
+        arena->blocks = b;
+    }
+
+    hdr = ARENA_BLOCK_DATA(b) + b->used;
+    memcpy(hdr, &size, sizeof(size));
+    b->last = b->used;
+    b->used += need;
+
+    return hdr + ARENA_HDR_SIZE;
+}
+
+/* Block holding ptr, or NULL if it has not been allocated from the arena */
+static asn_arena_block_t *
+arena_find(const asn_arena_t *arena, const void *ptr) {
+    uintptr_t p = (uintptr_t)ptr;
+    asn_arena_block_t *b;
+
+    for(b = arena->blocks; b; b = b->next) {
+        uintptr_t data = (uintptr_t)ARENA_BLOCK_DATA(b);
+        if(p >= data && p < data + b->used) return b;
+    }
+
+    return NULL;
+}
+
+/* Non-zero if ptr is the last allocation of the newest block (which can be resized or given back in place) */
+static int
+arena_is_last(const asn_arena_t *arena, const asn_arena_block_t *b, const void *ptr) {
+    return b == arena->blocks && (const char *)ptr - ARENA_HDR_SIZE == ARENA_BLOCK_DATA(b) + b->last;
+}
+
+asn_arena_t *
+asn_arena_new(size_t block_size) {
+    asn_arena_t *arena = malloc(sizeof(*arena));
+    if(!arena) return NULL;
+
+    arena->blocks = NULL;
+    arena->block_size = ARENA_ALIGN_UP(block_size ? block_size : ASN_ARENA_DEFAULT_BLOCK_SIZE);
+
+    return arena;
+}
+
+void
+asn_arena_delete(asn_arena_t *arena) {
+    asn_arena_block_t *b;
+
+    if(!arena) return;
+
+    if(asn_arena_current == arena) asn_arena_current = NULL;
+
+    while((b = arena->blocks)) {
+        arena->blocks = b->next;
+        free(b);
+    }
+
+    free(arena);
+}
+
+void
+asn_arena_reset(asn_arena_t *arena) {
+    asn_arena_block_t *b;
+    size_t total = 0;
+
+    if(!arena || !arena->blocks) return;
+
+    if(!arena->blocks->next) {
+        arena->blocks->used = 0;
+        arena->blocks->last = 0;
+        return;
+    }
+
+    while((b = arena->blocks)) {
+        total += b->size;
+        arena->blocks = b->next;
+        free(b);
+    }
+
+    /* If this allocation fails, a new block is allocated by the next arena_alloc() */
+    arena->blocks = arena_block_new(total);
+}
+
+asn_arena_t *
+asn_arena_activate(asn_arena_t *arena) {
+    asn_arena_t *previous = asn_arena_current;
+    asn_arena_current = arena;
+    return previous;
+}
+
+size_t
+asn_arena_used(const asn_arena_t *arena) {
+    const asn_arena_block_t *b;
+    size_t used = 0;
+
+    if(!arena) return 0;
+
+    for(b = arena->blocks; b; b = b->next) {
+        used += b->used;
+    }
+
+    return used;
+}
+
+void *
+asn_arena_calloc(size_t nmemb, size_t size) {
+    asn_arena_t *arena = asn_arena_current;
+    void *ptr;
+
+    if(!arena) return calloc(nmemb, size);
+
+    if(size && nmemb > SIZE_MAX / size) return NULL;
+
+    ptr = arena_alloc(arena, nmemb * size);
+    if(ptr) memset(ptr, 0, nmemb * size);
+
+    return ptr;
+}
+
+void *
+asn_arena_malloc(size_t size) {
+    asn_arena_t *arena = asn_arena_current;
+
+    if(!arena) return malloc(size);
+
+    return arena_alloc(arena, size);
+}
+
+void *
+asn_arena_realloc(void *ptr, size_t size) {
+    asn_arena_t *arena = asn_arena_current;
+    asn_arena_block_t *b;
+    size_t old_size;
+    void *new_ptr;
+
+    if(!arena) return realloc(ptr, size);
+    if(!ptr) return arena_alloc(arena, size);
+
+    b = arena_find(arena, ptr);
+    /* Memory allocated before the arena was activated */
+    if(!b) return realloc(ptr, size);
+
+    memcpy(&old_size, (char *)ptr - ARENA_HDR_SIZE, sizeof(old_size));
+
+    /* Growing buffers (e.g., the arrays of the SEQUENCE OFs) are usually the last allocation: extend them in place */
+    if(arena_is_last(arena, b, ptr) && size <= SIZE_MAX / 2) {
+        size_t need = ARENA_HDR_SIZE + ARENA_ALIGN_UP(size);
+
+        if(b->size - b->last >= need) {
+            memcpy((char *)ptr - ARENA_HDR_SIZE, &size, sizeof(size));
+            b->used = b->last + need;
+            return ptr;
+        }
+    }
+
+    new_ptr = arena_alloc(arena, size);
+    if(new_ptr) memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+
+    return new_ptr;
+}
+
+void
+asn_arena_free(void *ptr) {
+    asn_arena_t *arena = asn_arena_current;
+    asn_arena_block_t *b;
+
+    if(!ptr) return;
+
+    if(arena && (b = arena_find(arena, ptr))) {
+        /* Only the last allocation can be given back; the rest is released by asn_arena_reset() */
+        if(arena_is_last(arena, b, ptr)) b->used = b->last;
+        return;
+    }
+
+    free(ptr);
+}
@@ -14,13 +14,16 @@
 #define CP_PORT 2009
 #define VA_PORT 2018
 
+// Size, in bytes, of the BTP-A and BTP-B headers
+#define BTP_HEADER_LEN 4
+
 namespace etsiDecoder {
     class btp {
 
     public :
         btp();
         ~btp();
-        btpError_e decodeBTP(GNDataIndication_t dataIndication, BTPDataIndication_t* btpDataIndication);
+        btpError_e decodeBTP(const GNDataIndication_t &dataIndication, BTPDataIndication_t* btpDataIndication);
 
     };
 }
@@ -0,0 +1,59 @@
+#ifndef S_LDM_CAMFASTDECODER_H
+#define S_LDM_CAMFASTDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+	#include "CAM.h"
+}
+
+namespace etsiDecoder {
+	// Allocation-free UPER reader for the CAMs, which decodes only the fields used by the S-LDM (ITS PDU header, generation
+	// delta time, basic container, basic vehicle high frequency container and the exterior lights of the basic vehicle low
+	// frequency container) into a CAM_t owned by this object, instead of building the whole asn1c tree
+	// The other parts of the message are skipped: the optional members of the high frequency container and the path history
+	// are left empty (as if they were absent), and the part of the message following the exterior lights is not read at all
+	// (thus, it is not validated either)
+	// Messages containing extensions, an RSU high frequency container or a special vehicle container are not supported, and
+	// must be decoded with the full asn1c decoder
+	class camFastDecoder {
+		public:
+			camFastDecoder();
+
+			camFastDecoder(const camFastDecoder &) = delete;
+			camFastDecoder &operator=(const camFastDecoder &) = delete;
+
+			// This function returns a pointer to the decoded CAM (valid until the next call), or nullptr if the message is
+			// not supported by the fast path, or if it is truncated
+			CAM_t *decode(const uint8_t *buffer,size_t buflen);
+
+		private:
+			// Big-endian bit reader over the UPER-encoded message
+			class bitReader {
+				public:
+					bitReader(const uint8_t *buffer,size_t buflen) : m_buf(buffer), m_len(buflen), m_pos(0) {}
+
+					// This function reads "nbits" bits (at most 32), and returns 'false' if the message is too short
+					bool read(unsigned int nbits,uint32_t &value);
+					// This function reads a constrained whole number encoded with "nbits" bits, with lower bound "lb"
+					bool readConstrained(unsigned int nbits,long lb,long &value);
+					// This function reads the index of a non-extensible enumeration with "count" root values (all the enumerations
+					// read here have contiguous values starting from 0), returning 'false' if it is not a valid index
+					bool readEnum(unsigned int nbits,long count,long &value);
+					bool skip(unsigned int nbits);
+
+				private:
+					const uint8_t *m_buf;
+					size_t m_len;
+					size_t m_pos; // Position, in bits
+			};
+
+			// Storage of the decoded CAM (the low frequency container and the exterior lights are pointed by m_cam when present)
+			CAM_t m_cam;
+			LowFrequencyContainer_t m_lowFrequencyContainer;
+			uint8_t m_exteriorLights;
+	};
+}
+
+#endif // S_LDM_CAMFASTDECODER_H
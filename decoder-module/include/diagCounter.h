@@ -0,0 +1,57 @@
+#ifndef SLDM_DIAGCOUNTER_H
+#define SLDM_DIAGCOUNTER_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <cstdio>
+
+// Default minimum interval, in seconds, between two prints of the same diagnostic event
+#define DIAGCOUNTER_DEFAULT_INTERVAL_S 10
+
+// Rate-limited counter of a diagnostic event which may happen for each received message (e.g., a message which cannot be
+// decoded), to be used instead of printing a line for each message, as writing on the (synchronized) standard streams at
+// thousands of messages per second has a measurable cost
+// The first occurrence of the event is printed immediately; then, the event is printed at most once every "interval_s" seconds,
+// together with the number of occurrences since the previous print
+// report() is lock-free and it can be called by any thread: the DiagCounter objects are usually defined as static variables of
+// the module reporting the event
+// All the DiagCounter objects are registered in a global list, so that the total number of occurrences of all the events can be
+// printed at once with printSummary()
+class DiagCounter {
+	public:
+		// "prefix" (e.g., "[WARN] [Decoder]") and "description" must be string literals (or, anyway, they must outlive this object)
+		DiagCounter(const char *prefix, const char *description, FILE *stream = stderr, unsigned int interval_s = DIAGCOUNTER_DEFAULT_INTERVAL_S);
+
+		DiagCounter(const DiagCounter &) = delete;
+		DiagCounter &operator=(const DiagCounter &) = delete;
+
+		// This function counts an occurrence of the event, printing it if it is the first one or if at least "interval_s" seconds
+		// have passed since the last print
+		void report() {report(nullptr);}
+		// Same as report(), with additional printf-like details of the current occurrence (e.g., the stationID of the sender),
+		// which are formatted only if the event is actually printed
+		void report(const char *details_fmt, ...) __attribute__((format(printf,2,3)));
+
+		uint64_t getCount() const {return m_count.load(std::memory_order_relaxed);}
+
+		// This function prints the total number of occurrences of each event which happened at least once (it prints nothing if
+		// no event happened)
+		static void printSummary(FILE *outfile);
+	private:
+		const char *m_prefix;
+		const char *m_description;
+		FILE *m_stream;
+		uint64_t m_interval_ns;
+
+		std::atomic<uint64_t> m_count;
+		// Value of m_count when the event has been printed the last time
+		std::atomic<uint64_t> m_printed_count;
+		// Earliest time (steady clock, in nanoseconds) at which the event can be printed again
+		std::atomic<uint64_t> m_next_print_ns;
+
+		// Next object in the global list of the registered counters
+		DiagCounter *m_next;
+		static std::atomic<DiagCounter *> m_head;
+};
+
+#endif // SLDM_DIAGCOUNTER_H
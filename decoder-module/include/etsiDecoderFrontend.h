@@ -1,14 +1,30 @@
 #ifndef S_LDM_ETSIDECODERFRONTEND_H
 #define S_LDM_ETSIDECODERFRONTEND_H
 
+#include <atomic>
 #include <cinttypes>
 #include <cstddef>
+#include <memory>
 #include "named_enums.h"
 #include "geonet.h"
+#include "asn_arena.h"
 
 #define ETSI_DECODER_OK 	0
 #define ETSI_DECODER_ERROR 	1
 
+// Size, in bytes, of the blocks of the arena where the Facilities layer messages are decoded (large enough for most CPMs)
+#define ETSI_DECODER_ARENA_BLOCK_SIZE 65536
+// Number of consecutive messages of a source which must be detected as being of the same type (full ITS messages or Facilities
+// layer only messages) before the type is stored in its msgTypeCache
+#define ETSI_DECODER_MSGTYPE_LEARN_COUNT 16
+
+struct asn_TYPE_descriptor_s;
+
+namespace etsiDecoder {
+	class camFastDecoder;
+	class msgTypeCache;
+}
+
 // Defined as "named enum" (see named_enums.h)
 // Only the supported message types should be listed here
 // The format to add a new supported type for decoding is:
@@ -70,12 +86,90 @@ namespace etsiDecoder {
 			} msgType_e;
 
 			decoderFrontend();
+			~decoderFrontend();
+
+			decoderFrontend(const decoderFrontend &) = delete;
+			decoderFrontend &operator=(const decoderFrontend &) = delete;
+
+			// The decoded message (decoded_data.decoded_msg) is allocated in the arena of this decoder: it must not be released
+			// with ASN_STRUCT_FREE(), and it remains valid until it is released with releaseDecoded() (usually through a
+			// decodedMsgOwner object) or until the next call to decodeEtsi()
 			int decodeEtsi(uint8_t *buffer,size_t buflen,etsiDecodedData_t &decoded_data, Security::Security_error_t &sec_retval,storedCertificate_t &certificateData, msgType_e msgtype = MSGTYPE_ITS);
+			// Same as decodeEtsi() with MSGTYPE_AUTO, but the type of the messages of the source is learned and stored in "cache",
+			// so that the following messages of the same source are decoded directly with that type
+			int decodeEtsi(uint8_t *buffer,size_t buflen,etsiDecodedData_t &decoded_data, Security::Security_error_t &sec_retval,storedCertificate_t &certificateData, msgTypeCache &cache);
+			// This function releases, at once, the message decoded by the last call to decodeEtsi()
+			void releaseDecoded(etsiDecodedData_t &decoded_data);
 			void setPrintPacket(bool print_pkt) {m_print_pkt=print_pkt;}
+			// If enabled, the CAMs are decoded by camFastDecoder (falling back to the full asn1c decoder for the CAMs it does not
+			// support), which decodes only the fields used by the S-LDM: it should be enabled only if the optional members of the
+			// high frequency container and the path history are not needed (default: disabled)
+			void setFastCAMDecoding(bool fast_cam) {m_fast_cam=fast_cam;}
+
+			// This function detects (with the algorithm of MSGTYPE_AUTO) whether a message is a full ITS message or a Facilities
+			// layer only message, returning either MSGTYPE_ITS or MSGTYPE_FACILITYONLY
+			static msgType_e detectMsgType(const uint8_t *buffer,size_t buflen);
 
 		private:
+			// This function decodes a CAM, with camFastDecoder if enabled and supported, and with decodeFacilities() otherwise
+			bool decodeCAM(const void *buffer,size_t buflen,void **decoded);
+
+			// This function decodes a Facilities layer message of type "type" (e.g., asn_DEF_CAM) in the arena, and returns
+			// 'false' (releasing any partially decoded data) if the message cannot be decoded
+			bool decodeFacilities(struct asn_TYPE_descriptor_s *type,void **decoded,const void *buffer,size_t buflen);
+
 			bool m_print_pkt;
 			GeoNet geonet;
+			// Arena where the Facilities layer messages are decoded (each decoder is used by a single thread)
+			asn_arena_t *m_arena;
+
+			bool m_fast_cam;
+			std::unique_ptr<camFastDecoder> m_camFastDecoder;
+			// 'true' if the last decoded message is stored by m_camFastDecoder (and not in the arena)
+			bool m_fast_decoded;
+	};
+
+	// Type of the messages (full ITS messages or Facilities layer only messages) carried by a source, e.g., by an AMQP broker
+	// and topic, learned from the messages decoded by decoderFrontend::decodeEtsi()
+	// Until the type is learned, the messages are decoded with the automatic detection of MSGTYPE_AUTO; then, they are decoded
+	// directly with the stored type, and a message is decoded again with automatic detection (and the type is learned again)
+	// only if it cannot be decoded with the stored type and it is detected as being of the other type
+	// The same cache can be used, at the same time, by the decoders of different threads (e.g., of the ingest pipeline workers)
+	class msgTypeCache {
+		public:
+			msgTypeCache() : m_type(decoderFrontend::MSGTYPE_AUTO), m_last_detected(decoderFrontend::MSGTYPE_AUTO), m_streak(0) {}
+
+			msgTypeCache(const msgTypeCache &) = delete;
+			msgTypeCache &operator=(const msgTypeCache &) = delete;
+
+			// This function returns the type of the messages of the source, or MSGTYPE_AUTO if it has not been learned yet
+			decoderFrontend::msgType_e get() const {return m_type.load(std::memory_order_relaxed);}
+			// This function counts a message successfully decoded with the "detected" type (MSGTYPE_ITS or MSGTYPE_FACILITYONLY),
+			// storing the type after ETSI_DECODER_MSGTYPE_LEARN_COUNT consecutive messages of the same type
+			void learn(decoderFrontend::msgType_e detected);
+			// This function forgets the stored type (e.g., because the source started sending messages of the other type)
+			void reset();
+
+		private:
+			std::atomic<decoderFrontend::msgType_e> m_type;
+			// Type of the last decoded message, and number of consecutive messages of that type
+			std::atomic<decoderFrontend::msgType_e> m_last_detected;
+			std::atomic<unsigned int> m_streak;
+	};
+
+	// RAII owner of a message decoded by decoderFrontend::decodeEtsi(), which releases it when going out of scope, on any
+	// return path of the function processing it
+	class decodedMsgOwner {
+		public:
+			decodedMsgOwner(decoderFrontend &frontend, etsiDecodedData_t &decoded_data) : m_frontend(frontend), m_decoded_data(decoded_data) {}
+			~decodedMsgOwner() {m_frontend.releaseDecoded(m_decoded_data);}
+
+			decodedMsgOwner(const decodedMsgOwner &) = delete;
+			decodedMsgOwner &operator=(const decodedMsgOwner &) = delete;
+
+		private:
+			decoderFrontend &m_frontend;
+			etsiDecodedData_t &m_decoded_data;
 	};
 }
 
@@ -16,6 +16,12 @@
 #include "gbcHeader.h"
 #include "security.h"
 
+// Size, in bytes, of the GeoNetworking headers (ETSI EN 302 636-4-1)
+#define GN_BASIC_HEADER_LEN 4
+#define GN_COMMON_HEADER_LEN 8
+#define GN_SHB_HEADER_LEN 28
+#define GN_GBC_HEADER_LEN 44
+
 namespace etsiDecoder
 {
     class GeoNet {
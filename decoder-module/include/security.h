@@ -134,6 +134,8 @@ public:
   }GNsignMaterial;
 
   etsiDecoder::GNDataRequest_t createSecurePacket(etsiDecoder::GNDataRequest_t dataRequest, bool &isCertificate);
+  // On return, "dataIndication" references the unsecured payload of the packet (starting from the GeoNetworking common header),
+  // without any copy of it (i.e., "data" points into the packet, and it must not be freed)
   Security_error_t extractSecurePacket(etsiDecoder::GNDataIndication_t &dataIndication, storedCertificate_t &certificateData);
 
 
@@ -195,6 +197,9 @@ private:
   GNsignMaterial signatureCreation( const std::string& tbsData_hex,  const std::string& certificate_hex);
   bool signatureVerification( const std::string& tbsData_hex,  const std::string& certificate_hex, const GNsgtrDC& signatureRS, const std::string& verifyKeyIndicator);
   void mapCleaner();
+  // This function returns a pointer to the "size" bytes of "content" inside the packet referenced by "dataIndication", which
+  // remain valid as long as the packet
+  unsigned char *locateInPacket(const etsiDecoder::GNDataIndication_t &dataIndication, const uint8_t *content, size_t size);
 
   //EventId m_eventCleaner;
 
@@ -226,5 +231,8 @@ private:
   std::string m_bitmapSsp2;
   std::string m_p256_x_only_Cert;
   std::string m_SsigCert;
+
+  // Fallback storage of the unsecured payload, used only if it cannot be located inside the packet
+  std::vector<unsigned char> m_unsecuredDataBuffer;
 };
 #endif // SECURITY_H
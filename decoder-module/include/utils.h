@@ -17,6 +17,7 @@ namespace etsiDecoder {
 		GN_LIFETIME_ERROR = 3,
 		GN_HOP_LIMIT_ERROR = 4,
 		GN_TYPE_ERROR = 5,
+		GN_LENGTH_ERROR = 6,
 	} gnError_e;
 
 	typedef enum {
@@ -92,7 +93,7 @@ namespace etsiDecoder {
 	    uint8_t GNTraClass; // GN Traffic Class
 	    double GNRemPLife; // GN Reamianing Packet Lifetime /OPCIONAL/
 	    uint32_t lenght; // Payload size
-	    unsigned char* data;
+	    unsigned char* data; // Payload (non-owning: it points into the received packet)
 	} BTPDataIndication_t;
 
 	typedef struct gndataIndication {
@@ -104,7 +105,7 @@ namespace etsiDecoder {
 	    int16_t GNRemainingHL; // GN Remaining Hop Limit /OPCIONAL/
 	    uint8_t GNType; // GN Packet transport type -- GeoUnicast, SHB, TSB, GeoBroadcast or GeoAnycast
 	    uint32_t lenght; // Payload size
-	    unsigned char* data; // Payload
+	    unsigned char* data; // Payload (non-owning: it points into the received packet)
 	} GNDataIndication_t;
 
 	typedef struct _gndataRequest {
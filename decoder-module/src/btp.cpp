@@ -1,29 +1,41 @@
 //
 // Created by carlos on 11/05/21.
 //
-#include <iostream>
 #include "btp.h"
+#include "diagCounter.h"
+
+namespace {
+	// Per-packet diagnostics (printed at most once every DIAGCOUNTER_DEFAULT_INTERVAL_S seconds each)
+	DiagCounter diag_port_not_supported("[ERROR] [Decoder]","BTP port not supported");
+	DiagCounter diag_protocol_error("[ERROR] [Decoder]","Incorrect transport protocol");
+	DiagCounter diag_length_error("[ERROR] [Decoder]","BTP packet shorter than the BTP header. Bytes:");
+}
+
 namespace etsiDecoder{
 	btp::btp() = default;
 
 	btp::~btp() = default;
 
 	btpError_e
-	btp::decodeBTP(GNDataIndication_t dataIndication, BTPDataIndication_t* btpDataIndication) {
+	btp::decodeBTP(const GNDataIndication_t &dataIndication, BTPDataIndication_t* btpDataIndication) {
 		btpHeader header;
 
+		if(dataIndication.lenght < BTP_HEADER_LEN) {
+			diag_length_error.report("%u",dataIndication.lenght);
+			return BTP_ERROR;
+		}
 
 		btpDataIndication->data = dataIndication.data;
 
 		header.removeHeader(btpDataIndication->data);
-		btpDataIndication->data += 4;
+		btpDataIndication->data += BTP_HEADER_LEN;
 
 		btpDataIndication->BTPType = dataIndication.upperProtocol;
 
 		if((header.getDestPort ()!= CA_PORT) && (header.getDestPort ()!= DEN_PORT) 
 			&& (header.getDestPort ()!= CP_PORT) && (header.getDestPort ()!= VA_PORT))
 		{
-			std::cerr << "[ERROR] [Decoder] BTP port not supported" << std::endl;
+			diag_port_not_supported.report();
 			return BTP_ERROR;
 		}
 
@@ -41,7 +53,7 @@ namespace etsiDecoder{
 		}
 		else
 		{
-			std::cerr << "[ERROR] [Decoder] Incorrect transport protocol " << std::endl;
+			diag_protocol_error.report();
 			return BTP_ERROR;
 		}
 
@@ -49,8 +61,8 @@ namespace etsiDecoder{
 		btpDataIndication->GNTraClass = dataIndication.GNTraClass;
 		btpDataIndication->GNRemPLife = dataIndication.GNRemainingLife;
 		btpDataIndication->GNPositionV = dataIndication.SourcePV;
-		btpDataIndication->data = dataIndication.data + 4;
-		btpDataIndication->lenght = dataIndication.lenght - 4;
+		// The facilities layer message is not copied: it is passed as a pointer into the received packet
+		btpDataIndication->lenght = dataIndication.lenght - BTP_HEADER_LEN;
 
 		return BTP_OK;
 	}
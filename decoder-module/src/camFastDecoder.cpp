@@ -0,0 +1,198 @@
+#include <cstring>
+#include "camFastDecoder.h"
+
+namespace etsiDecoder {
+	bool
+	camFastDecoder::bitReader::read(unsigned int nbits,uint32_t &value) {
+		if(m_pos+nbits>m_len*8) {
+			return false;
+		}
+
+		// Up to 32 bits starting at any bit offset are always contained in the next 5 bytes
+		size_t byte=m_pos>>3;
+		uint64_t word=0;
+
+		for(size_t i=0;i<5;i++) {
+			word<<=8;
+			if(byte+i<m_len) {
+				word|=m_buf[byte+i];
+			}
+		}
+
+		value=static_cast<uint32_t>((word>>(40-(m_pos&7)-nbits)) & ((UINT64_C(1)<<nbits)-1));
+		m_pos+=nbits;
+
+		return true;
+	}
+
+	bool
+	camFastDecoder::bitReader::readConstrained(unsigned int nbits,long lb,long &value) {
+		uint32_t raw;
+
+		if(read(nbits,raw)==false) {
+			return false;
+		}
+
+		value=lb+static_cast<long>(raw);
+
+		return true;
+	}
+
+	bool
+	camFastDecoder::bitReader::readEnum(unsigned int nbits,long count,long &value) {
+		// asn1c rejects the indexes outside the enumeration, so the message is not accepted here either
+		return readConstrained(nbits,0,value)==true && value<count;
+	}
+
+	bool
+	camFastDecoder::bitReader::skip(unsigned int nbits) {
+		if(m_pos+nbits>m_len*8) {
+			return false;
+		}
+
+		m_pos+=nbits;
+
+		return true;
+	}
+
+	camFastDecoder::camFastDecoder() {
+		memset(&m_cam,0,sizeof(m_cam));
+		memset(&m_lowFrequencyContainer,0,sizeof(m_lowFrequencyContainer));
+		m_exteriorLights=0;
+
+		m_cam.cam.camParameters.highFrequencyContainer.present=HighFrequencyContainer_PR_basicVehicleContainerHighFrequency;
+		m_lowFrequencyContainer.present=LowFrequencyContainer_PR_basicVehicleContainerLowFrequency;
+		m_lowFrequencyContainer.choice.basicVehicleContainerLowFrequency.exteriorLights.buf=&m_exteriorLights;
+		m_lowFrequencyContainer.choice.basicVehicleContainerLowFrequency.exteriorLights.size=1;
+	}
+
+	// The number of bits and the lower bound of each field are the ones of the UPER encoding of the constraints of the CAM
+	// ASN.1 definition (see the asn_PER_* constraints in the corresponding asn1c generated files)
+	CAM_t *
+	camFastDecoder::decode(const uint8_t *buffer,size_t buflen) {
+		bitReader rd(buffer,buflen);
+		uint32_t bit;
+		uint32_t raw;
+
+		CAM_t *cam=&m_cam;
+		CamParameters_t &params=cam->cam.camParameters;
+		BasicVehicleContainerHighFrequency_t &hf=params.highFrequencyContainer.choice.basicVehicleContainerHighFrequency;
+
+		// ItsPduHeader: protocolVersion (0..255), messageID (0..255), stationID (0..4294967295)
+		if(rd.readConstrained(8,0,cam->header.protocolVersion)==false ||
+			rd.readConstrained(8,0,cam->header.messageID)==false ||
+			rd.read(32,raw)==false) {
+			return nullptr;
+		}
+		cam->header.stationID=raw;
+
+		// CoopAwareness: generationDeltaTime (0..65535)
+		if(rd.readConstrained(16,0,cam->cam.generationDeltaTime)==false) {
+			return nullptr;
+		}
+
+		// CamParameters: extension bit, then the presence bits of the low frequency and special vehicle containers
+		uint32_t lfc_present;
+		uint32_t svc_present;
+		if(rd.read(1,bit)==false || bit!=0 ||
+			rd.read(1,lfc_present)==false ||
+			rd.read(1,svc_present)==false || svc_present!=0) {
+			return nullptr;
+		}
+
+		// BasicContainer: extension bit, stationType (0..255), referencePosition
+		ReferencePosition_t &refpos=params.basicContainer.referencePosition;
+		if(rd.read(1,bit)==false || bit!=0 ||
+			rd.readConstrained(8,0,params.basicContainer.stationType)==false ||
+			rd.readConstrained(31,-900000000,refpos.latitude)==false ||
+			rd.readConstrained(32,-1800000000,refpos.longitude)==false ||
+			rd.readConstrained(12,0,refpos.positionConfidenceEllipse.semiMajorConfidence)==false ||
+			rd.readConstrained(12,0,refpos.positionConfidenceEllipse.semiMinorConfidence)==false ||
+			rd.readConstrained(12,0,refpos.positionConfidenceEllipse.semiMajorOrientation)==false ||
+			rd.readConstrained(20,-100000,refpos.altitude.altitudeValue)==false ||
+			rd.readEnum(4,16,refpos.altitude.altitudeConfidence)==false) {
+			return nullptr;
+		}
+
+		// HighFrequencyContainer: extension bit and index of the alternative (only basicVehicleContainerHighFrequency is supported)
+		if(rd.read(1,bit)==false || bit!=0 ||
+			rd.read(1,bit)==false || bit!=0) {
+			return nullptr;
+		}
+
+		// BasicVehicleContainerHighFrequency: presence bits of the 7 optional members, then the mandatory ones
+		uint32_t hf_optionals;
+		if(rd.read(7,hf_optionals)==false ||
+			rd.readConstrained(12,0,hf.heading.headingValue)==false ||
+			rd.readConstrained(7,1,hf.heading.headingConfidence)==false ||
+			rd.readConstrained(14,0,hf.speed.speedValue)==false ||
+			rd.readConstrained(7,1,hf.speed.speedConfidence)==false ||
+			rd.readEnum(2,3,hf.driveDirection)==false ||
+			rd.readConstrained(10,1,hf.vehicleLength.vehicleLengthValue)==false ||
+			rd.readEnum(3,5,hf.vehicleLength.vehicleLengthConfidenceIndication)==false ||
+			rd.readConstrained(6,1,hf.vehicleWidth)==false ||
+			rd.readConstrained(9,-160,hf.longitudinalAcceleration.longitudinalAccelerationValue)==false ||
+			rd.readConstrained(7,0,hf.longitudinalAcceleration.longitudinalAccelerationConfidence)==false ||
+			rd.readConstrained(11,-1023,hf.curvature.curvatureValue)==false ||
+			rd.readEnum(3,8,hf.curvature.curvatureConfidence)==false ||
+			rd.read(1,bit)==false || bit!=0 ||
+			rd.readEnum(2,3,hf.curvatureCalculationMode)==false ||
+			rd.readConstrained(16,-32766,hf.yawRate.yawRateValue)==false ||
+			rd.readEnum(4,9,hf.yawRate.yawRateConfidence)==false) {
+			return nullptr;
+		}
+
+		// The optional members are skipped, as they are not used by the S-LDM (most significant presence bit first):
+		// accelerationControl (BIT STRING (SIZE(7))), lanePosition (-1..14), steeringWheelAngle (-511..512 + 1..127),
+		// lateralAcceleration and verticalAcceleration (-160..161 + 0..102), performanceClass (0..7), cenDsrcTollingZone
+		static const unsigned int hf_optional_bits[6] = {7,4,10+7,9+7,9+7,3};
+		for(int i=0;i<6;i++) {
+			if((hf_optionals & (1<<(6-i))) && rd.skip(hf_optional_bits[i])==false) {
+				return nullptr;
+			}
+		}
+
+		if(hf_optionals & 0x01) {
+			// CenDsrcTollingZone: extension bit, presence bit of cenDsrcTollingZoneID (0..134217727), protectedZoneLatitude
+			// and protectedZoneLongitude
+			uint32_t id_present;
+			if(rd.read(1,bit)==false || bit!=0 ||
+				rd.read(1,id_present)==false ||
+				rd.skip(31+32+(id_present ? 27 : 0))==false) {
+				return nullptr;
+			}
+		}
+
+		hf.accelerationControl=nullptr;
+		hf.lanePosition=nullptr;
+		hf.steeringWheelAngle=nullptr;
+		hf.lateralAcceleration=nullptr;
+		hf.verticalAcceleration=nullptr;
+		hf.performanceClass=nullptr;
+		hf.cenDsrcTollingZone=nullptr;
+
+		if(lfc_present) {
+			// LowFrequencyContainer: extension bit (the only alternative in the root needs no index bits), then
+			// BasicVehicleContainerLowFrequency: vehicleRole (16 values), exteriorLights (BIT STRING (SIZE(8)))
+			BasicVehicleContainerLowFrequency_t &lf=m_lowFrequencyContainer.choice.basicVehicleContainerLowFrequency;
+
+			if(rd.read(1,bit)==false || bit!=0 ||
+				rd.readEnum(4,16,lf.vehicleRole)==false ||
+				rd.read(8,raw)==false) {
+				return nullptr;
+			}
+
+			m_exteriorLights=static_cast<uint8_t>(raw);
+			// The path history is not decoded
+			lf.pathHistory.list.count=0;
+
+			params.lowFrequencyContainer=&m_lowFrequencyContainer;
+		} else {
+			params.lowFrequencyContainer=nullptr;
+		}
+
+		params.specialVehicleContainer=nullptr;
+
+		return cam;
+	}
+}
@@ -0,0 +1,75 @@
+#include <cstdarg>
+#include <ctime>
+#include "diagCounter.h"
+
+std::atomic<DiagCounter *> DiagCounter::m_head(nullptr);
+
+namespace {
+	// A coarse clock is enough for intervals of seconds, and it is cheaper to read than CLOCK_MONOTONIC (report() reads it for
+	// each occurrence of the event)
+	uint64_t coarse_timestamp_ns(void) {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+
+		return static_cast<uint64_t>(ts.tv_sec)*1000000000ULL+static_cast<uint64_t>(ts.tv_nsec);
+	}
+}
+
+DiagCounter::DiagCounter(const char *prefix, const char *description, FILE *stream, unsigned int interval_s) :
+	m_prefix(prefix), m_description(description), m_stream(stream), m_interval_ns(interval_s*1000000000ULL),
+	m_count(0), m_printed_count(0), m_next_print_ns(0) {
+
+	// Lock-free insertion at the head of the global list (the counters defined as static local variables may be constructed
+	// by different threads at the same time)
+	m_next=m_head.load();
+	while(m_head.compare_exchange_weak(m_next,this)==false);
+}
+
+void
+DiagCounter::report(const char *details_fmt, ...) {
+	uint64_t count=m_count.fetch_add(1,std::memory_order_relaxed)+1;
+	uint64_t now=coarse_timestamp_ns();
+	uint64_t next_print=m_next_print_ns.load(std::memory_order_relaxed);
+
+	// Only one of the threads reporting the event at the same time prints it
+	if(now<next_print || m_next_print_ns.compare_exchange_strong(next_print,now+m_interval_ns)==false) {
+		return;
+	}
+
+	uint64_t occurrences=count-m_printed_count.exchange(count);
+	char details[256]="";
+
+	if(details_fmt!=nullptr) {
+		va_list args;
+
+		va_start(args,details_fmt);
+		vsnprintf(details,sizeof(details),details_fmt,args);
+		va_end(args);
+	}
+
+	if(occurrences<=1) {
+		fprintf(m_stream,"%s %s%s%s\n",m_prefix,m_description,details_fmt!=nullptr ? " " : "",details);
+	} else {
+		fprintf(m_stream,"%s %s%s%s [%" PRIu64 " occurrences since the last report]\n",m_prefix,m_description,
+			details_fmt!=nullptr ? " " : "",details,occurrences);
+	}
+}
+
+void
+DiagCounter::printSummary(FILE *outfile) {
+	bool header_printed=false;
+
+	for(DiagCounter *diag=m_head.load();diag!=nullptr;diag=diag->m_next) {
+		if(diag->getCount()==0) {
+			continue;
+		}
+
+		if(header_printed==false) {
+			fprintf(outfile,"%10s  %s\n","Count","Diagnostic event");
+			header_printed=true;
+		}
+
+		fprintf(outfile,"%10" PRIu64 "  %s %s\n",diag->getCount(),diag->m_prefix,diag->m_description);
+	}
+}
@@ -5,6 +5,8 @@
 #include "basicHeader.h"
 #include "commonHeader.h"
 #include "shbHeader.h"
+#include "camFastDecoder.h"
+#include "diagCounter.h"
 
 extern "C" {
 	#include "CAM.h"
@@ -15,14 +17,160 @@ extern "C" {
 
 NAMED_ENUM_DEFINE_FCNS(etsi_message_t,MSGTYPES);
 
+namespace {
+	// Per-message diagnostics (printed at most once every DIAGCOUNTER_DEFAULT_INTERVAL_S seconds each)
+	DiagCounter diag_auto_its("[INFO] [Decoder]","Automatic detection of message type enabled. Message type: Full ITS message",stdout);
+	DiagCounter diag_auto_facility("[INFO] [Decoder]","Automatic detection of message type enabled. Message type: Pure Facilities layer message",stdout);
+	DiagCounter diag_learned_its("[INFO] [Decoder]","Message type of the source detected: Full ITS messages",stdout);
+	DiagCounter diag_learned_facility("[INFO] [Decoder]","Message type of the source detected: Pure Facilities layer messages",stdout);
+	DiagCounter diag_gn_error("[WARN] [Decoder]","Warning: GeoNet unable to decode a received packet.");
+	DiagCounter diag_btp_error("[WARN] [Decoder]","Warning: BTP unable to decode a received packet.");
+	DiagCounter diag_cam_error("[WARN] [Decoder]","Warning: unable to decode a received CAM.");
+	DiagCounter diag_denm_error("[WARN] [Decoder]","Warning: unable to decode a received DENM.");
+	DiagCounter diag_cpm_error("[WARN] [Decoder]","Warning: unable to decode a received CPM.");
+	DiagCounter diag_vam_error("[WARN] [Decoder]","Warning: unable to decode a received VAM.");
+	DiagCounter diag_cam_nogn_error("[WARN] [Decoder]","Warning: unable to decode a received CAM (no BTP/GN).");
+	DiagCounter diag_denm_nogn_error("[WARN] [Decoder]","Warning: unable to decode a received DENM (no BTP/GN).");
+	DiagCounter diag_cpm_nogn_error("[WARN] [Decoder]","Warning: unable to decode a received CPM (no BTP/GN).");
+	DiagCounter diag_vam_nogn_error("[WARN] [Decoder]","Warning: unable to decode a received VAM (no BTP/GN).");
+	DiagCounter diag_unknown_msgid("[WARN] [Decoder]","Unable to decode a reveived message with unknown/unsupported messageID:");
+}
+
 namespace etsiDecoder {
 	decoderFrontend::decoderFrontend() {
 		m_print_pkt = false;
+		m_arena = asn_arena_new(ETSI_DECODER_ARENA_BLOCK_SIZE);
+		m_fast_cam = false;
+		m_camFastDecoder = std::unique_ptr<camFastDecoder>(new camFastDecoder());
+		m_fast_decoded = false;
+	}
+
+	decoderFrontend::~decoderFrontend() {
+		asn_arena_delete(m_arena);
+	}
+
+	bool decoderFrontend::decodeFacilities(asn_TYPE_descriptor_t *type,void **decoded,const void *buffer,size_t buflen) {
+		// If the arena could not be allocated, the message is decoded with the standard library allocator (and released with
+		// ASN_STRUCT_FREE() by releaseDecoded())
+		asn_arena_t *previous_arena = asn_arena_activate(m_arena);
+		asn_dec_rval_t decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, type, decoded, buffer, buflen);
+
+		if(decode_result.code!=RC_OK || *decoded==nullptr) {
+			// Any partially decoded data is released while the arena is still active
+			if(*decoded!=nullptr) {
+				ASN_STRUCT_FREE(*type,*decoded);
+				*decoded=nullptr;
+			}
+		}
+
+		asn_arena_activate(previous_arena);
+
+		if(*decoded==nullptr) {
+			asn_arena_reset(m_arena);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool decoderFrontend::decodeCAM(const void *buffer,size_t buflen,void **decoded) {
+		if(m_fast_cam==true) {
+			*decoded = m_camFastDecoder->decode(static_cast<const uint8_t *>(buffer),buflen);
+
+			if(*decoded!=nullptr) {
+				m_fast_decoded = true;
+				return true;
+			}
+		}
+
+		return decodeFacilities(&asn_DEF_CAM,decoded,buffer,buflen);
+	}
+
+	void decoderFrontend::releaseDecoded(etsiDecodedData_t &decoded_data) {
+		if(decoded_data.decoded_msg==nullptr) {
+			return;
+		}
+
+		if(m_fast_decoded==true) {
+			// Nothing to release: the CAM is stored by m_camFastDecoder
+			m_fast_decoded = false;
+		} else if(m_arena!=nullptr) {
+			asn_arena_reset(m_arena);
+		} else {
+			switch(decoded_data.type) {
+				case ETSI_DECODED_CAM:
+				case ETSI_DECODED_CAM_NOGN:
+					ASN_STRUCT_FREE(asn_DEF_CAM,decoded_data.decoded_msg);
+					break;
+				case ETSI_DECODED_DENM:
+				case ETSI_DECODED_DENM_NOGN:
+					ASN_STRUCT_FREE(asn_DEF_DENM,decoded_data.decoded_msg);
+					break;
+				case ETSI_DECODED_CPM:
+				case ETSI_DECODED_CPM_NOGN:
+					ASN_STRUCT_FREE(asn_DEF_CPM,decoded_data.decoded_msg);
+					break;
+				case ETSI_DECODED_VAM:
+				case ETSI_DECODED_VAM_NOGN:
+					ASN_STRUCT_FREE(asn_DEF_VAM,decoded_data.decoded_msg);
+					break;
+				default:
+					break;
+			}
+		}
+
+		decoded_data.decoded_msg = nullptr;
+	}
+
+	decoderFrontend::msgType_e decoderFrontend::detectMsgType(const uint8_t *buffer,size_t buflen) {
+		// We are considering here that GeoNetworking should contain at least 40 bytes (for TSB - for GBC this value should be even higher), plus 4 bytes due to BTP
+		// We check then if the second byte in the buffer corresponds to a valid ITS message; if yes, we detect the absence of BTP + GN, otherwise we consider this message
+		// as a full ITS one (with BTP and GN)
+		if(buflen<44 || is_enum_valid_etsi_message_t(static_cast<etsi_message_t>(buffer[1]))) {
+			return MSGTYPE_FACILITYONLY;
+		}
+
+		return MSGTYPE_ITS;
+	}
+
+	int decoderFrontend::decodeEtsi(uint8_t *buffer,size_t buflen,etsiDecodedData_t &decoded_data,Security::Security_error_t &sec_retval,storedCertificate_t &certificateData,msgTypeCache &cache) {
+		msgType_e cached = cache.get();
+
+		if(cached != MSGTYPE_AUTO) {
+			if(decodeEtsi(buffer,buflen,decoded_data,sec_retval,certificateData,cached)==ETSI_DECODER_OK) {
+				return ETSI_DECODER_OK;
+			}
+
+			// A message detected as being of the stored type is just a message which cannot be decoded: decode it again only if
+			// the source may have started sending messages of the other type
+			if(buflen==0 || detectMsgType(buffer,buflen)==cached) {
+				return ETSI_DECODER_ERROR;
+			}
+
+			cache.reset();
+		}
+
+		msgType_e detected = detectMsgType(buffer,buflen);
+
+		if(decodeEtsi(buffer,buflen,decoded_data,sec_retval,certificateData,detected)!=ETSI_DECODER_OK) {
+			return ETSI_DECODER_ERROR;
+		}
+
+		cache.learn(detected);
+
+		return ETSI_DECODER_OK;
 	}
 
 	int decoderFrontend::decodeEtsi(uint8_t *buffer,size_t buflen,etsiDecodedData_t &decoded_data,Security::Security_error_t &sec_retval,storedCertificate_t &certificateData,msgType_e msgtype) {
 		bool isGeoNet = true;
 
+		// The message decoded by the previous call, if not released yet, is invalidated by the arena reset
+		if(m_arena!=nullptr) {
+			asn_arena_reset(m_arena);
+		}
+		m_fast_decoded = false;
+		decoded_data.decoded_msg = nullptr;
+
 		if(buflen<=0) {
 			return ETSI_DECODER_ERROR;
 		}
@@ -37,23 +185,19 @@ namespace etsiDecoder {
 
 		// If msgtype is set to MSGTYPE_AUTO, try to automatically detect if the message is a full ITS message, or a simple CAM/DENM, without the BTP and GeoNetworking layers
 		if(msgtype == MSGTYPE_AUTO) {
-			// We are considering here that GeoNetworking should contain at least 40 bytes (for TSB - for GBC this value should be even higher), plus 4 bytes due to BTP
-			// We check then if the second byte in the buffer corresponds to a valid ITS message; if yes, we detect the absence of BTP + GN, otherwise we consider this message
-			// as a full ITS one (with BTP and GN)
-			if(buflen<44 || (buflen>=44 && is_enum_valid_etsi_message_t(static_cast<etsi_message_t>(*((uint8_t *) buffer+1))))) {
+			if(detectMsgType(buffer,buflen)==MSGTYPE_FACILITYONLY) {
 				isGeoNet=false;
+				diag_auto_facility.report();
 			} else {
 				isGeoNet=true;
+				diag_auto_its.report();
 			}
-
-			std::cout << "[INFO] [Decoder] Automatic detection of message type enabled. Message type: " << (isGeoNet == true ? "Full ITS message" : "Pure Facilities layer message") << std::endl;
 		} else if(msgtype == MSGTYPE_FACILITYONLY) {
 			isGeoNet=false;
 		}
 		// There is no need to check for else if(msgtype == MSGTYPE_ITS), as it is always the default option, which would just set "isGeoNet" to true, which is already true thanks to its initialization
 
 		void *decoded_=nullptr;
-		asn_dec_rval_t decode_result;
 
 		if(isGeoNet == true) {
 			btp BTP;
@@ -62,13 +206,13 @@ namespace etsiDecoder {
 			gndataIndication.lenght=buflen;
 			if(geonet.decodeGN(buffer,&gndataIndication,sec_retval,certificateData)!= GN_OK)
 			  {
-			    std::cerr << "[WARN] [Decoder] Warning: GeoNet unable to decode a received packet." << std::endl;
+			    diag_gn_error.report();
 			    return ETSI_DECODER_ERROR;
 			  }
 
 			if(BTP.decodeBTP(gndataIndication,&btpDataIndication)!= BTP_OK)
 			  {
-			    std::cerr << "[WARN] [Decoder] Warning: BTP unable to decode a received packet." << std::endl;
+			    diag_btp_error.report();
 			    return ETSI_DECODER_ERROR;
 			  }
 
@@ -89,11 +233,8 @@ namespace etsiDecoder {
 			if(btpDataIndication.destPort == CA_PORT) {
 				decoded_data.type = ETSI_DECODED_CAM;
 
-				decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_CAM, &decoded_, btpDataIndication.data, btpDataIndication.lenght);
-
-				if(decode_result.code!=RC_OK || decoded_==nullptr) {
-					std::cerr << "[WARN] [Decoder] Warning: unable to decode a received CAM." << std::endl;
-					if(decoded_) free(decoded_);
+				if(decodeCAM(btpDataIndication.data, btpDataIndication.lenght, &decoded_)==false) {
+					diag_cam_error.report();
 					return ETSI_DECODER_ERROR;
 				}
 			} else if(btpDataIndication.destPort == DEN_PORT) {
@@ -106,33 +247,24 @@ namespace etsiDecoder {
 
 				decoded_data.type = ETSI_DECODED_DENM;
 
-				decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_DENM, &decoded_, btpDataIndication.data, btpDataIndication.lenght);
-
-				if(decode_result.code!=RC_OK || decoded_==nullptr) {
-					std::cerr << "[WARN] [Decoder] Warning: unable to decode a received DENM." << std::endl;
-					if(decoded_) free(decoded_);
+				if(decodeFacilities(&asn_DEF_DENM, &decoded_, btpDataIndication.data, btpDataIndication.lenght)==false) {
+					diag_denm_error.report();
 					return ETSI_DECODER_ERROR;
 				}
 			} else if(btpDataIndication.destPort == CP_PORT) {
 
 				decoded_data.type = ETSI_DECODED_CPM;
 
-				decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_CPM, &decoded_, btpDataIndication.data, btpDataIndication.lenght);
-				
-				if (decode_result.code!=RC_OK || decoded_==nullptr) {
-					std::cerr <<"[WARN] [Decoder] Warning: unable to decode a received CPM." << std::endl;
-					if(decoded_) free(decoded_);
+				if(decodeFacilities(&asn_DEF_CPM, &decoded_, btpDataIndication.data, btpDataIndication.lenght)==false) {
+					diag_cpm_error.report();
 					return ETSI_DECODER_ERROR;
 				}
 			} else if (btpDataIndication.destPort == VA_PORT) {
 
 				decoded_data.type = ETSI_DECODED_VAM;
 
-				decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_VAM, &decoded_, btpDataIndication.data, btpDataIndication.lenght);
-
-				if (decode_result.code!=RC_OK || decoded_==nullptr) {
-					std::cerr <<"[WARN] [Decoder] Warning: unable to decode a received VAM." << std::endl;
-					if(decoded_) free(decoded_);
+				if(decodeFacilities(&asn_DEF_VAM, &decoded_, btpDataIndication.data, btpDataIndication.lenght)==false) {
+					diag_vam_error.report();
 					return ETSI_DECODER_ERROR;
 				}
 			// CPMs and VAMs supported now
@@ -150,51 +282,39 @@ namespace etsiDecoder {
 				if(messageID==CAM) {
 					decoded_data.type = ETSI_DECODED_CAM_NOGN;
 
-					decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_CAM, &decoded_, buffer, buflen);
-
-					if(decode_result.code!=RC_OK || decoded_==nullptr) {
-						std::cerr << "[WARN] [Decoder] Warning: unable to decode a received CAM (no BTP/GN)." << std::endl;
-						if(decoded_) free(decoded_);
+					if(decodeCAM(buffer, buflen, &decoded_)==false) {
+						diag_cam_nogn_error.report();
 						return ETSI_DECODER_ERROR;
 					}
 				} else if(messageID==DENM) {
 					decoded_data.type = ETSI_DECODED_DENM_NOGN;
 
-					decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_DENM, &decoded_, buffer, buflen);
-
-					if(decode_result.code!=RC_OK || decoded_==nullptr) {
-						std::cerr << "[WARN] [Decoder] Warning: unable to decode a received DENM (no BTP/GN)." << std::endl;
-						if(decoded_) free(decoded_);
+					if(decodeFacilities(&asn_DEF_DENM, &decoded_, buffer, buflen)==false) {
+						diag_denm_nogn_error.report();
 						return ETSI_DECODER_ERROR;
 					}
 				} else if (messageID==CPM) {
-					decoded_data.type = ETSI_DECODED_CAM_NOGN;
-
-					decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_CPM, &decoded_, buffer, buflen);
+					decoded_data.type = ETSI_DECODED_CPM_NOGN;
 
-					if(decode_result.code!=RC_OK || decoded_==nullptr) {
-						std::cerr << "[WARN] [Decoder] Warning: unable to decode a received CPM (no BTP/GN)." << std::endl;
-						if(decoded_) free(decoded_);
+					if(decodeFacilities(&asn_DEF_CPM, &decoded_, buffer, buflen)==false) {
+						diag_cpm_nogn_error.report();
 						return ETSI_DECODER_ERROR;
 					}
 				} else if (messageID==VAM) {
-					decoded_data.type = ETSI_DECODED_CAM_NOGN;
-
-					decode_result = asn_decode(0, ATS_UNALIGNED_BASIC_PER, &asn_DEF_VAM, &decoded_, buffer, buflen);
+					decoded_data.type = ETSI_DECODED_VAM_NOGN;
 
-					if(decode_result.code!=RC_OK || decoded_==nullptr) {
-						std::cerr << "[WARN] [Decoder] Warning: unable to decode a received VAM (no BTP/GN)." << std::endl;
-						if(decoded_) free(decoded_);
+					if(decodeFacilities(&asn_DEF_VAM, &decoded_, buffer, buflen)==false) {
+						diag_vam_nogn_error.report();
 						return ETSI_DECODER_ERROR;
 					}
 				} else {
-					std::cerr << "[WARN] [Decoder] Unable to decode a reveived message with unknown/unsupported messageID: " << messageID << std::endl;
+					diag_unknown_msgid.report("%d",static_cast<int>(messageID));
 					std::cerr << "[ERROR] [Decoder] Error: this point in the code should never be reached. Please report this bug to the developers. Thank you!" << std::endl;
 					decoded_data.type = ETSI_DECODED_ERROR;
 					return ETSI_DECODER_ERROR;
 				}
 			} else {
-				std::cerr << "[WARN] [Decoder] Unable to decode a reveived message with unknown/unsupported messageID: " << messageID << std::endl;
+				diag_unknown_msgid.report("%d",static_cast<int>(messageID));
 				decoded_data.type = ETSI_DECODED_ERROR;
 				return ETSI_DECODER_ERROR;
 			}
@@ -204,4 +324,30 @@ namespace etsiDecoder {
 
 		return ETSI_DECODER_OK;
 	}
+
+	void msgTypeCache::learn(decoderFrontend::msgType_e detected) {
+		if(m_type.load(std::memory_order_relaxed)==detected) {
+			return;
+		}
+
+		if(m_last_detected.exchange(detected,std::memory_order_relaxed)!=detected) {
+			m_streak.store(1,std::memory_order_relaxed);
+			return;
+		}
+
+		if(m_streak.fetch_add(1,std::memory_order_relaxed)+1==ETSI_DECODER_MSGTYPE_LEARN_COUNT) {
+			m_type.store(detected,std::memory_order_relaxed);
+
+			if(detected==decoderFrontend::MSGTYPE_ITS) {
+				diag_learned_its.report();
+			} else {
+				diag_learned_facility.report();
+			}
+		}
+	}
+
+	void msgTypeCache::reset() {
+		m_type.store(decoderFrontend::MSGTYPE_AUTO,std::memory_order_relaxed);
+		m_streak.store(0,std::memory_order_relaxed);
+	}
 }
@@ -3,6 +3,19 @@
 //
 #include <iostream>
 #include "geonet.h"
+#include "diagCounter.h"
+
+namespace {
+    // Per-packet diagnostics (printed at most once every DIAGCOUNTER_DEFAULT_INTERVAL_S seconds each)
+    DiagCounter diag_version_error("[ERROR] [Decoder]","Incorrect version of GN protocol");
+    DiagCounter diag_security_failed("[INFO] [Decoder]","Security extraction failed",stdout);
+    DiagCounter diag_security_ok("[INFO] [Decoder]","Security extraction successful",stdout);
+    DiagCounter diag_lifetime_error("[ERROR] [Decoder]","Unable to decode lifetime field");
+    DiagCounter diag_hop_limit_error("[ERROR] [Decoder]","Max hop limit greater than remaining hop limit");
+    DiagCounter diag_tsb_not_supported("[ERROR] [Decoder]","GeoNet packet not supported");
+    DiagCounter diag_type_not_supported("[ERROR] [Decoder]","GeoNet packet not supported. GNType:");
+    DiagCounter diag_length_error("[ERROR] [Decoder]","GeoNet packet shorter than its headers or than its payload length. Bytes:");
+}
 
 namespace etsiDecoder {
     GeoNet::GeoNet() {
@@ -46,11 +59,19 @@ namespace etsiDecoder {
         commonHeader commonH;
         gnError_e retval=GN_OK;
 
+        // No header and no payload is copied: "data" is moved forward over the received packet (or over the unsecured payload
+        // of a secured packet, which is located inside the packet too) as each header is parsed, and "lenght", initially set
+        // by the caller to the size of the packet, always contains the number of bytes available from "data"
         dataIndication->data = packet;
 
+        if(dataIndication->lenght < GN_BASIC_HEADER_LEN)
+        {
+            diag_length_error.report("%u",dataIndication->lenght);
+            return GN_LENGTH_ERROR;
+        }
         basicH.removeHeader(dataIndication->data);
-        dataIndication->data += 4;
-        dataIndication->lenght-=4;
+        dataIndication->data += GN_BASIC_HEADER_LEN;
+        dataIndication->lenght-=GN_BASIC_HEADER_LEN;
         dataIndication->GNRemainingLife = basicH.GetLifeTime ();
         dataIndication->GNRemainingHL = basicH.GetRemainingHL ();
 
@@ -58,7 +79,7 @@ namespace etsiDecoder {
         //1)Check version field
         if(basicH.GetVersion() != m_GnPtotocolVersion && basicH.GetVersion() != 0)
         {
-            std::cerr<< "[ERROR] [Decoder] Incorrect version of GN protocol" << std::endl;
+            diag_version_error.report();
             return GN_VERSION_ERROR;
 
         } 
@@ -73,10 +94,10 @@ namespace etsiDecoder {
             //Secured packet
             sec_retval=m_security.extractSecurePacket (*dataIndication, certificateData);
             if (sec_retval == Security::SECURITY_VERIFICATION_FAILED) {
-                std::cout << "[INFO] [Decoder] Security extraction failed" << std::endl;
+                diag_security_failed.report();
                 retval=GN_SECURED_ERROR;
             } else {
-                std::cout << "[INFO] [Decoder] Security extraction successful" << std::endl;
+                diag_security_ok.report();
             }
             
         } else {
@@ -84,41 +105,67 @@ namespace etsiDecoder {
         }
         if(!decodeLT(basicH.GetLifeTime(),&dataIndication->GNRemainingLife))
         {
-            std::cerr << "[ERROR] [Decoder] Unable to decode lifetime field" << std::endl;
+            diag_lifetime_error.report();
             return GN_LIFETIME_ERROR;
         }
         //Common Header Processing according to ETSI EN 302 636-4-1 [10.3.5]
+        if(dataIndication->lenght < GN_COMMON_HEADER_LEN)
+        {
+            diag_length_error.report("%u",dataIndication->lenght);
+            return GN_LENGTH_ERROR;
+        }
         commonH.removeHeader(dataIndication->data);
-        dataIndication->data += 8;
+        dataIndication->data += GN_COMMON_HEADER_LEN;
+        dataIndication->lenght-=GN_COMMON_HEADER_LEN;
         dataIndication->upperProtocol = commonH.GetNextHeader (); //!Information needed for step 7
         dataIndication->GNTraClass = commonH.GetTrafficClass (); //!Information needed for step 7
         //1) Check MHL field
         if(commonH.GetMaxHopLimit() < basicH.GetRemainingHL())
         {
-            std::cerr << "[ERROR] [Decoder] Max hop limit greater than remaining hop limit" << std::endl; //a) if MHL<RHL discard packet and omit execution of further steps
+            diag_hop_limit_error.report(); //a) if MHL<RHL discard packet and omit execution of further steps
             return GN_HOP_LIMIT_ERROR;
         }
         //2) process the BC forwarding buffer, for now not implemented (SCF in traffic class disabled)
         //3) check HT field
         dataIndication->GNType = commonH.GetHeaderType();
-        dataIndication->lenght = commonH.GetPayload ();
 
         switch(dataIndication->GNType)
         {
             case GBC:
+                if(dataIndication->lenght < GN_GBC_HEADER_LEN)
+                {
+                    diag_length_error.report("%u",dataIndication->lenght);
+                    return GN_LENGTH_ERROR;
+                }
                 dataIndication = processGBC (dataIndication, commonH.GetHeaderSubType ());
                 break;
             case TSB:
-                if((commonH.GetHeaderSubType ()==0)) dataIndication = processSHB(dataIndication);
-                else {
-                    std::cerr << "[ERROR] [Decoder] GeoNet packet not supported" << std::endl;
+                if((commonH.GetHeaderSubType ()==0)) {
+                    if(dataIndication->lenght < GN_SHB_HEADER_LEN)
+                    {
+                        diag_length_error.report("%u",dataIndication->lenght);
+                        return GN_LENGTH_ERROR;
+                    }
+                    dataIndication = processSHB(dataIndication);
+                } else {
+                    diag_tsb_not_supported.report();
                     return GN_TYPE_ERROR;
                   }
                 break;
             default:
-                std::cerr << "[ERROR] [Decoder] GeoNet packet not supported. GNType: " << static_cast<unsigned int>(dataIndication->GNType) << std::endl;
+                diag_type_not_supported.report("%u",static_cast<unsigned int>(dataIndication->GNType));
                 return GN_TYPE_ERROR;
         }
+
+        // The payload (i.e., the BTP header and the facilities layer message) is passed to the upper layer as a pointer into
+        // the packet, after checking that the payload length declared in the common header does not exceed the received bytes
+        if(commonH.GetPayload () > dataIndication->lenght)
+        {
+            diag_length_error.report("%u (payload length: %u)",dataIndication->lenght,static_cast<unsigned int>(commonH.GetPayload ()));
+            return GN_LENGTH_ERROR;
+        }
+        dataIndication->lenght = commonH.GetPayload ();
+
         return retval;
     }
 
@@ -129,7 +176,8 @@ namespace etsiDecoder {
         shbHeader shbH;
 
         shbH.removeHeader(dataIndication->data);
-        dataIndication->data += 28;
+        dataIndication->data += GN_SHB_HEADER_LEN;
+        dataIndication->lenght -= GN_SHB_HEADER_LEN;
         dataIndication->SourcePV = shbH.GetLongPositionV ();
         dataIndication->GNType = TSB;
         
@@ -144,7 +192,8 @@ namespace etsiDecoder {
         gbcHeader gbcH;
 
         gbcH.removeHeader(dataIndication->data);
-        dataIndication->data += 44;
+        dataIndication->data += GN_GBC_HEADER_LEN;
+        dataIndication->lenght -= GN_GBC_HEADER_LEN;
         dataIndication->SourcePV = gbcH.GetLongPositionV ();
         dataIndication->GnAddressDest = gbcH.GetGeoArea ();
         dataIndication->GnAddressDest.shape = shape;
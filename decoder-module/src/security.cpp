@@ -15,6 +15,7 @@
 #include <iomanip>
 #include <sstream>
 #include <openssl/ec.h>
+#include "diagCounter.h"
 
 extern "C" {
 #include "CAM.h"
@@ -25,6 +26,12 @@ extern "C" {
 #
 }
 
+namespace {
+    // Per-packet diagnostics (printed at most once every DIAGCOUNTER_DEFAULT_INTERVAL_S seconds each)
+    DiagCounter diag_bad_decode("[WARNING]","BAD DECODE - NO DECODED DATA",stdout);
+    DiagCounter diag_no_certificate("[INFO]","No certificate received");
+}
+
 Security::~Security ()
 {
     if (m_ecKey != nullptr)
@@ -575,16 +582,25 @@ Security::extractSecurePacket (etsiDecoder::GNDataIndication_t &dataIndication,
     Security_error_t retval=SECURITY_VERIFICATION_FAILED;
     bool isCertificate;
     asn1cpp::Seq<Ieee1609Dot2Data> ieeeData_decoded;
-    std::vector<unsigned char> bufferCopy(dataIndication.data, dataIndication.data + dataIndication.lenght);
-    uint32_t sizeB = dataIndication.lenght;
-    std::string packetContent((char *) bufferCopy.data(), sizeB);
-    ieeeData_decoded = asn1cpp::oer::decode(packetContent, Ieee1609Dot2Data);
+    // The packet is decoded in place, instead of through asn1cpp::oer::decode(), which requires a copy of it in an std::string
+    Ieee1609Dot2Data_t *ieeeData_ptr = nullptr;
+    if (dataIndication.lenght > 0) {
+        asn_dec_rval_t dr = oer_decode (nullptr, &asn_DEF_Ieee1609Dot2Data, (void **) &ieeeData_ptr, dataIndication.data, dataIndication.lenght);
+        if (dr.code == RC_OK) {
+            ieeeData_decoded = asn1cpp::Seq<Ieee1609Dot2Data>(&asn_DEF_Ieee1609Dot2Data, ieeeData_ptr);
+        } else {
+            ASN_STRUCT_FREE (asn_DEF_Ieee1609Dot2Data, ieeeData_ptr);
+        }
+    }
+    // Unsecured payload (i.e., the rest of the GeoNetworking packet), which is not copied, as it is located inside the packet
+    unsigned char *unsecuredData = nullptr;
+    uint32_t unsecuredDataLen = 0;
     GNsecDP secureDataPacket;
     uint64_t expiryTimestamp;
 
     // Secured DENM bad decode protection
     if (ieeeData_decoded.operator bool()==false) {
-        std::cout <<"[WARNING] BAD DECODE - NO DECODED DATA" <<std::endl;
+        diag_bad_decode.report();
         return retval;
     }
 
@@ -607,7 +623,8 @@ Security::extractSecurePacket (etsiDecoder::GNDataIndication_t &dataIndication,
         auto contentContainerDecoded =  asn1cpp::getSeqOpt (dataContainerDecoded->content, Ieee1609Dot2Content);
         auto present2 = asn1cpp::getField (contentContainerDecoded->present, Ieee1609Dot2Content_PR);
         if (present2 == Ieee1609Dot2Content_PR_unsecuredData) {
-            secureDataPacket.content.signData.tbsData.unsecureData = asn1cpp::getField (contentContainerDecoded->choice.unsecuredData, std::string);
+            unsecuredData = locateInPacket (dataIndication, contentContainerDecoded->choice.unsecuredData.buf, contentContainerDecoded->choice.unsecuredData.size);
+            unsecuredDataLen = contentContainerDecoded->choice.unsecuredData.size;
         }
         // else if( present2 == ??) Is it needed? Never present
         secureDataPacket.content.signData.tbsData.headerInfo_psid = asn1cpp::getField (tbsDecoded->headerInfo.psid, unsigned long);
@@ -817,7 +834,7 @@ Security::extractSecurePacket (etsiDecoder::GNDataIndication_t &dataIndication,
         //If it's certificates verify certificates otherwise verify the digest
         if (isCertificate) {
             if (m_receivedCertificates.empty()) {
-                std::cerr << "[INFO] No certificate received" << std::endl;
+                diag_no_certificate.report();
                 retval=SECURITY_VERIFICATION_FAILED;
             } else {
                 //for every item in map do signature verification
@@ -839,8 +856,23 @@ Security::extractSecurePacket (etsiDecoder::GNDataIndication_t &dataIndication,
     } else if (present1 == Ieee1609Dot2Content_PR_unsecuredData) { // Is it needed? Never present
         secureDataPacket.content.unsecuredData = asn1cpp::getField (contentDecoded->choice.unsecuredData, std::string);
     }
-    dataIndication.data = new unsigned char[secureDataPacket.content.signData.tbsData.unsecureData.size()];
-    std::memcpy(dataIndication.data, secureDataPacket.content.signData.tbsData.unsecureData.data(), secureDataPacket.content.signData.tbsData.unsecureData.size());
-    dataIndication.lenght = secureDataPacket.content.signData.tbsData.unsecureData.size();
+    dataIndication.data = unsecuredData;
+    dataIndication.lenght = unsecuredDataLen;
     return retval;
 }
+
+unsigned char *
+Security::locateInPacket (const etsiDecoder::GNDataIndication_t &dataIndication, const uint8_t *content, size_t size) {
+    // An OER OCTET STRING is encoded as its length followed by its content, unchanged: thus, the content decoded by asn1c can
+    // always be found in the packet, and any occurrence of it is byte-by-byte identical to the decoded one
+    void *found = memmem (dataIndication.data, dataIndication.lenght, content, size);
+
+    if (found != nullptr) {
+        return static_cast<unsigned char *>(found);
+    }
+
+    // Never expected to happen: the content is copied in a buffer reused for all the packets, so that it is still not
+    // necessary to allocate (and free) a buffer for each packet
+    m_unsecuredDataBuffer.assign (content, content + size);
+    return m_unsecuredDataBuffer.data ();
+}
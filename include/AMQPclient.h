@@ -11,9 +11,13 @@
 #include <proton/types.hpp>
 #include <proton/source_options.hpp>
 #include <proton/receiver_options.hpp>
+#include <proton/receiver.hpp>
+#include <proton/work_queue.hpp>
 
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 #include "etsiDecoderFrontend.h"
 #include "areaFilter.h"
@@ -21,6 +25,48 @@
 #include "utils.h"
 #include "triggerManager.h"
 #include "MisbehaviourDetector.h"
+#include "ingestPipeline.h"
+#include "localProjection.h"
+#include "binLogger.h"
+#include "metricsSink.h"
+#include "latencyStats.h"
+#include "replayIngest.h"
+
+// Arguments of the callback used to merge the data of a new CAM with the data stored in the database
+typedef struct camMergeArgs {
+	bool ageCheck; // If 'true', the new data is discarded if its GN timestamp is older than the stored one
+	bool keepStoredLights; // If 'true', the stored exterior lights status is kept (the CAM does not contain the low frequency container)
+	double inst_period_ms; // Set by the callback: time elapsed since the last update of the vehicle, in milliseconds (-1 for a new vehicle)
+} camMergeArgs_t;
+
+// Arguments of the callback used to merge the perceived objects of a new CPM with the data stored in the database
+typedef struct cpmMergeArgs {
+	bool ageCheck; // If 'true', each object is discarded if its GN timestamp is older than the stored one
+	std::vector<double> inst_period_ms; // Set by the callback for each object: as in camMergeArgs_t (-1 for a new object)
+	std::vector<uint64_t> stored_gnTimestamp; // Set by the callback for each discarded object: GN timestamp of the stored data
+} cpmMergeArgs_t;
+
+// Entry of the map of the objects received through CPMs (see m_recvCPMmap)
+typedef struct CPMobjectEntry {
+	uint64_t ldmID; // ID used to store the object in the database
+	uint64_t lastseen_us; // Last time the object has been received, in microseconds
+} CPMobjectEntry_t;
+
+// Time, in microseconds, after which an object which is no longer received through CPMs is removed from m_recvCPMmap (and its ID,
+// if it was allocated by the database, is released)
+// It must be longer than the time after which the object is removed from the database, so that a released ID is not reused
+// while the old object is still stored
+#define AMQP_CPM_OBJECT_EXPIRY_US 5000000
+// Minimum interval, in microseconds, between two scans of m_recvCPMmap looking for expired objects
+#define AMQP_CPM_MAP_CLEANUP_INTERVAL_US 1000000
+
+// Interval, in milliseconds, between two updates of the adaptive AMQP credit window
+#define AMQP_CREDIT_UPDATE_INTERVAL_MS 100
+// Target processing latency (from the reception of a message to the end of its processing), in microseconds
+// Above this value the credit window is halved; below half this value it is gradually increased again
+#define AMQP_CREDIT_TARGET_LATENCY_US 50000
+// Minimum distance, in messages, between the low watermark and the credit window (i.e., minimum amount of credit granted at once)
+#define AMQP_CREDIT_MIN_BATCH 16
 
 class AMQPClient : public proton::messaging_handler {
 	private:
@@ -34,10 +80,15 @@ class AMQPClient : public proton::messaging_handler {
 		bool m_printMsg; // If 'true' each received message will be printed (default: 'false' - enable only for debugging purposes)
 
 		etsiDecoder::decoderFrontend m_decodeFrontend;
+		// Type of the messages received by this client (learned from the received messages and shared by all its decoders)
+		etsiDecoder::msgTypeCache m_msgTypeCache;
 		areaFilter m_areaFilter;
 		struct options *m_opts_ptr;
 		ldmmap::LDMMap *m_db_ptr;
-		std::map<uint64_t, std::map<uint64_t,uint64_t>> m_recvCPMmap;  //! Structure mapping, for each CV that we have received a CPM from, the CPM's PO ids with the ego LDM's PO ids
+		std::map<uint64_t, std::map<uint64_t,CPMobjectEntry_t>> m_recvCPMmap;  //! Structure mapping, for each CV that we have received a CPM from, the CPM's PO ids with the ego LDM's PO ids
+		std::mutex m_recvCPMmap_mtx; // Protects m_recvCPMmap, as CPMs from different vehicles may be processed in parallel by the ingest pipeline
+		uint64_t m_recvCPMmap_lastcleanup_us; // Last time m_recvCPMmap has been scanned looking for expired objects
+		std::map<uint64_t,localProjection> m_CPMprojections; // Projection of the reference position of each CPM sender, reused until the sender moves (protected by m_recvCPMmap_mtx)
 		MisbehaviourDetector *m_MBDetector_ptr;
 		bool m_MBDetection_enabled;
 
@@ -46,6 +97,8 @@ class AMQPClient : public proton::messaging_handler {
 
 		std::string m_logfile_name;
 		FILE *m_logfile_file;
+		BinLogger *m_binlog_ptr; // Logger of the per-message records (nullptr if logging is disabled)
+		uint8_t m_binlog_src; // Index of this client among the sources of m_binlog_ptr
 
 		std::string m_username;
 		std::string m_password;
@@ -54,17 +107,77 @@ class AMQPClient : public proton::messaging_handler {
 		bool m_allow_insecure;
 		long m_idle_timeout_ms;
 
-		std::string m_eventclient_id;
 		std::string m_client_id;
 
 		std::string m_quadKey_filter="";
 
 		std::atomic<proton::container *> m_cont;
 
-		bool decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata);
-		bool decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::eventData_t &evedata);
-		bool decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id, std::vector<ldmmap::vehicleData_t> &PO_vec);
-		bool decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata);
+		// Ingest pipeline (if set, the received messages are processed by its worker threads instead of the event loop thread)
+		IngestPipeline *m_ingest_ptr;
+		// One decoder per worker of the ingest pipeline, as the decoder frontend is not thread-safe
+		std::vector<std::unique_ptr<etsiDecoder::decoderFrontend>> m_workerDecodeFrontends;
+		// Number of messages pushed to the ingest pipeline and not yet processed
+		std::atomic<uint64_t> m_ingest_inflight;
+
+		// Asynchronous sink for the timing metrics (nullptr if disabled) and index of the stream with the DENM processing times
+		MetricsSink *m_metrics_ptr;
+		int m_denm_metrics_stream;
+
+		// Latency statistics of the processing stages (nullptr if disabled)
+		LatencyStats *m_latstats_ptr;
+		// Recorder of the received messages (nullptr if disabled)
+		IngestRecorder *m_recorder_ptr;
+
+		// Adaptive flow control: the link credit is granted explicitly (instead of relying on the automatic credit window of Proton),
+		// depending on the number of pending messages (queued in the ingest pipeline, or which the broker is still allowed to send)
+		// and on the observed processing latency, so that bursts are buffered by the broker instead of inside the S-LDM
+		// m_receiver, m_receiver_open, m_credit_window and m_last_proc_cnt are accessed only by the event loop thread
+		proton::receiver m_receiver;
+		bool m_receiver_open;
+		std::atomic<proton::work_queue *> m_work_queue;
+		std::atomic<bool> m_credit_update_pending;
+		uint64_t m_credit_low_wm;
+		uint64_t m_credit_high_wm;
+		uint64_t m_credit_window; // Current maximum number of pending messages (between m_credit_low_wm+AMQP_CREDIT_MIN_BATCH and m_credit_high_wm)
+		std::atomic<uint64_t> m_proc_latency_us; // Exponential moving average of the processing latency, in microseconds
+		std::atomic<uint64_t> m_proc_cnt;
+		uint64_t m_last_proc_cnt;
+
+		// This function grants new credit to the broker, if the number of pending messages fell to the low watermark
+		// It must be called by the event loop thread
+		void updateCredit();
+		// This function asks the event loop thread to call updateCredit() (it can be called by any thread)
+		void requestCreditUpdate();
+		// This function adapts the credit window to the processing latency (it is called periodically by the event loop thread)
+		void creditTimerCallback();
+		void updateProcessingLatency(uint64_t on_msg_timestamp_us);
+
+		// This function removes from m_recvCPMmap the objects not received for more than AMQP_CPM_OBJECT_EXPIRY_US, releasing
+		// their derived IDs, and from m_CPMprojections the senders without any object left (to be called with m_recvCPMmap_mtx held)
+		void expireCPMObjects(uint64_t now_us);
+
+		// The timestamps of the processing stages are read only if they are logged or if the latency statistics are enabled
+		inline bool timingEnabled() {return m_binlog_ptr!=nullptr || m_latstats_ptr!=nullptr;}
+		// These functions read the timestamp of the beginning of a stage, and record its latency, only if the latency statistics are enabled
+		inline uint64_t statsTimestamp() {return m_latstats_ptr!=nullptr ? get_timestamp_ns() : 0;}
+		inline void recordLatency(latencyStatsStage_t stage, uint64_t bf_ns) {
+			if(m_latstats_ptr!=nullptr) {
+				m_latstats_ptr->record(stage,get_timestamp_ns()-bf_ns);
+			}
+		}
+
+		// This function hands a received message (from the broker, or from another ingest source) over to the ingest pipeline, if set,
+		// or processes it in the calling thread
+		void dispatchMessage(ingestMessage_t &ingestmsg);
+		// This function decodes a received message and updates the database (it is called either by on_message() or by a worker of the ingest pipeline)
+		void processMessage(ingestMessage_t &msg, etsiDecoder::decoderFrontend &decodeFrontend);
+		// decodeCAM() also checks the CAM with the misbehaviour detector (if enabled) and updates the database
+		bool decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata,
+			const proton::binary &message_bin, Security::Security_error_t sec_retval, storedCertificate_t &certificateData);
+		bool decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::eventData_t &evedata);
+		bool decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id, std::vector<ldmmap::vehicleData_t> &PO_vec);
+		bool decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata);
 
 	public:
 		AMQPClient(const std::string &u,const std::string &a,const double &latmin,const double &latmax,const double &lonmin, const double &lonmax, struct options *opts_ptr, ldmmap::LDMMap *db_ptr, std::string logfile_name) :
@@ -73,6 +186,8 @@ class AMQPClient : public proton::messaging_handler {
 			m_areaFilter.setOptions(m_opts_ptr);
 			m_indicatorTrgMan_enabled=false;
 			m_logfile_file=nullptr;
+			m_binlog_ptr=nullptr;
+			m_binlog_src=0;
 			m_reconnect=false;
 			m_allow_sasl=false;
 			m_allow_insecure=false;
@@ -80,6 +195,23 @@ class AMQPClient : public proton::messaging_handler {
 			m_cont=nullptr;
 			m_idle_timeout_ms=-1;
 			m_MBDetection_enabled=m_opts_ptr->MBDetector_enabled;
+			m_ingest_ptr=nullptr;
+			m_metrics_ptr=nullptr;
+			m_latstats_ptr=nullptr;
+			m_recorder_ptr=nullptr;
+			m_denm_metrics_stream=-1;
+			m_ingest_inflight=0;
+			m_recvCPMmap_lastcleanup_us=0;
+			m_receiver_open=false;
+			m_work_queue=nullptr;
+			m_credit_update_pending=false;
+			m_credit_low_wm=m_opts_ptr->amqp_credit_low_watermark;
+			m_credit_high_wm=m_opts_ptr->amqp_credit_high_watermark;
+			m_credit_window=m_credit_high_wm;
+			m_proc_latency_us=0;
+			m_proc_cnt=0;
+			m_last_proc_cnt=0;
+			m_decodeFrontend.setFastCAMDecoding(m_opts_ptr->fast_cam_decoding);
 		}
 
 		AMQPClient(const std::string &u,const std::string &a,const double &latmin,const double &latmax,const double &lonmin, const double &lonmax, struct options *opts_ptr, ldmmap::LDMMap *db_ptr) :
@@ -89,6 +221,8 @@ class AMQPClient : public proton::messaging_handler {
 			m_indicatorTrgMan_enabled=false;
 			m_logfile_name = "";
 			m_logfile_file=nullptr;
+			m_binlog_ptr=nullptr;
+			m_binlog_src=0;
 			m_reconnect=false;
 			m_allow_sasl=false;
 			m_allow_insecure=false;
@@ -96,6 +230,23 @@ class AMQPClient : public proton::messaging_handler {
 			m_cont=nullptr;
 			m_idle_timeout_ms=-1;
 			m_MBDetection_enabled=m_opts_ptr->MBDetector_enabled;
+			m_ingest_ptr=nullptr;
+			m_metrics_ptr=nullptr;
+			m_latstats_ptr=nullptr;
+			m_recorder_ptr=nullptr;
+			m_denm_metrics_stream=-1;
+			m_ingest_inflight=0;
+			m_recvCPMmap_lastcleanup_us=0;
+			m_receiver_open=false;
+			m_work_queue=nullptr;
+			m_credit_update_pending=false;
+			m_credit_low_wm=m_opts_ptr->amqp_credit_low_watermark;
+			m_credit_high_wm=m_opts_ptr->amqp_credit_high_watermark;
+			m_credit_window=m_credit_high_wm;
+			m_proc_latency_us=0;
+			m_proc_cnt=0;
+			m_last_proc_cnt=0;
+			m_decodeFrontend.setFastCAMDecoding(m_opts_ptr->fast_cam_decoding);
 		}
 
 		void setMisbehaviourDetector(MisbehaviourDetector *MBDetector_ptr) {
@@ -107,6 +258,51 @@ class AMQPClient : public proton::messaging_handler {
 			m_indicatorTrgMan_enabled=true;
 		}
 
+		// The same ingest pipeline can be shared by more AMQPClient objects
+		// The pipeline must be created with AMQPClient::ingestProcessMessage() as processing function
+		void setIngestPipeline(IngestPipeline *ingest_ptr) {
+			m_ingest_ptr=ingest_ptr;
+			m_workerDecodeFrontends.clear();
+
+			if(m_ingest_ptr!=nullptr) {
+				for(unsigned int i=0;i<m_ingest_ptr->getNumWorkers();i++) {
+					m_workerDecodeFrontends.emplace_back(new etsiDecoder::decoderFrontend());
+					m_workerDecodeFrontends.back()->setFastCAMDecoding(m_opts_ptr->fast_cam_decoding);
+				}
+			}
+		}
+
+		// The same metrics sink can be shared by more AMQPClient objects (which write into the same streams)
+		void setMetricsSink(MetricsSink *metrics_ptr) {
+			m_metrics_ptr=metrics_ptr;
+			m_denm_metrics_stream=-1;
+
+			if(m_metrics_ptr!=nullptr) {
+				m_denm_metrics_stream=m_metrics_ptr->registerStream("DENMtimestamps_25v",{
+					"TotalMessageProcessingTimeDENM [us]","DatabaseUpdateDENM [us]",
+					"LookupAndUpdateEvent_Time [us]","InsertEvent_Time [us]","DecodedMessageProcessingTime [us]"});
+			}
+		}
+
+		// The same latency statistics can be shared by more AMQPClient objects
+		void setLatencyStats(LatencyStats *latstats_ptr) {m_latstats_ptr=latstats_ptr;}
+		// If set, all the received messages are also written to "recorder_ptr" (which can be shared by more AMQPClient objects)
+		void setIngestRecorder(IngestRecorder *recorder_ptr) {m_recorder_ptr=recorder_ptr;}
+
+		// Receive function for the other ingest sources, i.e., UDPIngest and ReplayIngest ("additional_args" is the AMQPClient which
+		// will process the messages)
+		// The messages are then processed exactly as the ones received from the AMQP broker
+		static void sourceIngestMessage(ingestMessage_t &msg, void *additional_args);
+
+		// These functions open and close the log file (if any) and are called when the event loop starts and stops
+		// They must be called explicitly when the client only processes the messages of other ingest sources (e.g., UDPIngest),
+		// without running its event loop
+		void openLogFile();
+		void closeLogFile();
+
+		// Processing function for the ingest pipeline workers ("msg.owner" is the AMQPClient which received the message)
+		static void ingestProcessMessage(ingestMessage_t &msg, unsigned int worker_idx, void *additional_args);
+
 		void setUsername(std::string username) {
 			m_username=username;
 		}
@@ -141,10 +337,13 @@ class AMQPClient : public proton::messaging_handler {
 			m_quadKey_filter=filter;
 		}
 		
-		inline ldmmap::OptionalDataItem<uint8_t> manage_LowfreqContainer(CAM_t *decoded_cam,uint32_t stationID);
+		// If the CAM does not contain the low frequency container, "keepStoredLights" is set to 'true' (and the exterior lights
+		// are returned as unavailable), to keep the exterior lights status stored in the database, if any
+		inline ldmmap::OptionalDataItem<uint8_t> manage_LowfreqContainer(CAM_t *decoded_cam,bool &keepStoredLights);
 
 		void on_container_start(proton::container &c) override;
 		void on_connection_open(proton::connection &conn) override;
+		void on_receiver_open(proton::receiver &r) override;
 		void on_message(proton::delivery &d, proton::message &msg) override;
 		void on_container_stop(proton::container &c) override;
 		void on_connection_close(proton::connection &conn) override;
@@ -2,6 +2,10 @@
 #define LDMMAP_H
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <shared_mutex>
@@ -10,11 +14,37 @@
 #include "dendatadef.h" 
 #include "etsiDecoderFrontend.h"
 #include "timers.h"
+#include "spatialGrid.h"
 #include <thread>
 
 
 extern std::atomic<bool> eventMapModified;
 
+// Default number of shards of the vehicle database (a power of two)
+#define LDMMAP_DEFAULT_NUM_SHARDS 16
+// Maximum number of shards of the vehicle database
+#define LDMMAP_MAX_NUM_SHARDS 1024
+// Size of a cache line, used to pad the metadata of each shard, avoiding false sharing between different shards
+#define LDMMAP_CACHE_LINE_SIZE 64
+// Width, in microseconds, of each bucket of the expiry index of the vehicle database (see vehicleShard_t)
+#define LDMMAP_EXPIRY_BUCKET_US 100000
+// Default maximum number of entries of the change log of the vehicle database (split evenly among the shards)
+#define LDMMAP_CHANGELOG_DEFAULT_SIZE 65536
+// Minimum number of entries of the change log of each shard
+#define LDMMAP_CHANGELOG_MIN_SHARD_SIZE 256
+// Size of each cell of the spatial index over the events, in meters (smaller than the one used for vehicles, as events are
+// mostly looked up within a few meters, to find an existing event close to the position of a newly received one)
+#define LDMMAP_EVENT_GRID_CELL_SIZE_M 50.0
+// Maximum distance, in meters, between a new event and an existing one with the same cause code, for them to be considered as
+// the same event (see lookupAndUpdateEvent())
+#define LDMMAP_NEAR_EVENT_RANGE_M 10.0
+// First ID of the range reserved to the objects which are not identified by their own stationID (e.g., the objects perceived by
+// other vehicles and received through CPMs), when their original ID collides with a stored one
+// The range starts right after the 32-bit ETSI stationIDs, so that these IDs never collide with the ones of real stations
+#define LDMMAP_DERIVED_ID_BASE UINT64_C(0x100000000)
+// Number of IDs in the reserved range
+#define LDMMAP_DERIVED_ID_RANGE (1 << 20)
+
 namespace ldmmap {
 	class LDMMap {
 		public:
@@ -23,18 +53,107 @@ namespace ldmmap {
 	    		LDMMAP_UPDATED,
 	    		LDMMAP_ITEM_NOT_FOUND,
 	    		LDMMAP_MAP_FULL,
+	    		LDMMAP_CHANGES_LOST,
+	    		LDMMAP_DISCARDED,
 	    		LDMMAP_UNKNOWN_ERROR
 	    	} LDMMap_error_t;
 
 	    	typedef struct {
 	    		vehicleData_t vehData;
-	    		PHpoints *phData;
+	    		// The PHpoints object is shared with the database: it is destroyed (and its points are given back to the
+	    		// PHpointsPool) only when the vehicle has been removed from the database and no reader is still using it
+	    		std::shared_ptr<PHpoints> phData;
 	    	} returnedVehicleData_t;
 
+	    	// Fields which can be requested to rangeSelectVehicleFields() (to be combined in a bitmask)
+	    	typedef enum {
+	    		LDMMAP_FIELD_STATIONID = 1 << 0,
+	    		LDMMAP_FIELD_LAT = 1 << 1,
+	    		LDMMAP_FIELD_LON = 1 << 2,
+	    		LDMMAP_FIELD_ELEVATION = 1 << 3,
+	    		LDMMAP_FIELD_HEADING = 1 << 4,
+	    		LDMMAP_FIELD_SPEED = 1 << 5,
+	    		LDMMAP_FIELD_GNTIMESTAMP = 1 << 6,
+	    		LDMMAP_FIELD_CAMTIMESTAMP = 1 << 7,
+	    		LDMMAP_FIELD_TIMESTAMP = 1 << 8,
+	    		LDMMAP_FIELD_ON_MSG_TIMESTAMP = 1 << 9,
+	    		LDMMAP_FIELD_VEHICLEWIDTH = 1 << 10,
+	    		LDMMAP_FIELD_VEHICLELENGTH = 1 << 11,
+	    		LDMMAP_FIELD_STATIONTYPE = 1 << 12,
+	    		LDMMAP_FIELD_EXTERIORLIGHTS = 1 << 13,
+	    		LDMMAP_FIELD_PHDATA = 1 << 14,
+	    		LDMMAP_FIELD_ALL = (1 << 15) - 1
+	    	} vehicleField_t;
+
+	    	// Compact copy of the numeric fields of a vehicle, returned by rangeSelectVehicleFields()
+	    	// Only the fields requested to rangeSelectVehicleFields() are filled in, the other ones are left untouched
+	    	// This structure contains no string and it is never allocated on the heap on a per-vehicle basis
+	    	typedef struct {
+	    		uint64_t stationID;
+	    		double lat;
+	    		double lon;
+	    		double elevation;
+	    		double heading;
+	    		double speed_ms;
+	    		uint64_t gnTimestamp;
+	    		long camTimestamp;
+	    		uint64_t timestamp_us;
+	    		uint64_t on_msg_timestamp_us;
+	    		OptionalDataItem<long> vehicleWidth;
+	    		OptionalDataItem<long> vehicleLength;
+	    		e_StationTypeLDM stationType;
+	    		OptionalDataItem<uint8_t> exteriorLights;
+	    		// PHpoints of the vehicle (only valid inside the callback of rangeSelectVehicleFields(), as the PHpoints object
+	    		// is owned by the database)
+	    		PHpoints *phData;
+	    	} projectedVehicleData_t;
+
+	    	// Type of change of a vehicle entry, as reported by subscribe()
+	    	typedef enum {
+	    		LDMMAP_CHANGE_INSERT,
+	    		LDMMAP_CHANGE_UPDATE,
+	    		LDMMAP_CHANGE_DELETE
+	    	} changeType_t;
+
+	    	// Change of a vehicle entry, returned by subscribe()
+	    	typedef struct {
+	    		// Version of the database at which the entry was last changed
+	    		uint64_t version;
+	    		changeType_t type;
+	    		uint64_t stationID;
+	    		// Current data of the vehicle (not meaningful for LDMMAP_CHANGE_DELETE)
+	    		returnedVehicleData_t vehicle;
+	    	} vehicleChange_t;
+
 			typedef struct {
 				eventData_t eventData;
 			}returnedEventData_t;
 
+			// Immutable copy of the whole database content (vehicles and events), taken at a given time
+			// Snapshots are shared (through snapshotPtr_t) between all the readers, which can then read (and serialize) the whole
+			// database content without taking any lock and, thus, without ever blocking the threads updating the database
+			// The snapshot is consistent within each shard (i.e., each shard is copied atomically with respect to the updates)
+			// Snapshots are taken only by publishSnapshot(), which should be called periodically by a thread on the writers' side,
+			// so that the readers never wait for (or delay) the database updates
+			typedef struct {
+				// Sequential number of the snapshot (the first published snapshot has version 1, the initial empty one version 0)
+				uint64_t version;
+				// Time at which the snapshot was taken
+				uint64_t timestamp_us;
+				std::vector<vehicleData_t> vehicles;
+				// Latitude and longitude of each vehicle (same order as "vehicles"), to perform range selects on the snapshot
+				std::vector<double> lat;
+				std::vector<double> lon;
+				// Path History of each vehicle (same order as "vehicles")
+				// The PHpoints objects are shared with the database (they are thread safe, but they keep being updated after the
+				// snapshot is taken)
+				std::vector<std::shared_ptr<PHpoints>> phData;
+				// Events, each one with its key
+				std::vector<std::pair<uint64_t,eventData_t>> events;
+			} snapshot_t;
+
+			typedef std::shared_ptr<const snapshot_t> snapshotPtr_t;
+
 	    	typedef enum {
 	    		event_LDMMAP_OK,
 	    		event_LDMMAP_ITEM_EXIST,
@@ -55,6 +174,11 @@ namespace ldmmap {
 
 
 	    	LDMMap();
+	    	// This constructor can be used to set the number of shards of the vehicle database
+	    	// Each vehicle is stored inside one of the shards, depending on a hash of its stationID, and each shard is protected by
+	    	// its own lock, allowing multiple threads to update the database concurrently
+	    	// num_shards should be a power of two: if it is not, it is rounded up to the next power of two (up to LDMMAP_MAX_NUM_SHARDS)
+	    	LDMMap(unsigned int num_shards);
 	    	~LDMMap();
 
 	    	// This function clears the whole database (to be used only when the dabatase and its content is not going to be accessed again)
@@ -64,6 +188,29 @@ namespace ldmmap {
 	    	// This function returns LDMMAP_OK is a new vehicle has been inserted, LDMMAP_UPDATED is an existing vehicle entry has been updated,
 	    	// LDMMAP_MAP_FULL if the database if full and the insert operation failed (this should never happen, in any case)
 	    	LDMMap_error_t insertVehicle(vehicleData_t newVehicleData);
+	    	// This function inserts or updates the vehicle with station ID == stationID, like insertVehicle(), but it first calls the
+	    	// "merge_fcn" callback with the shard storing the vehicle locked in exclusive mode, so that the new data can be checked
+	    	// against (and merged with) the stored one atomically, without any additional lookup
+	    	// The callback receives a pointer to the data currently stored for the vehicle (nullptr if the vehicle is not stored in
+	    	// the database yet), the new data (which can be modified by the callback, and which is then stored in the database) and
+	    	// the "additional_args" pointer; it returns 'false' to discard the update
+	    	// The callback is called with a lock held, thus it should be short and it must never call any other function of the database
+	    	// This function returns LDMMAP_DISCARDED if the update has been discarded by the callback, otherwise it returns the
+	    	// same values as insertVehicle()
+	    	LDMMap_error_t upsertVehicle(uint64_t stationID, vehicleData_t &newVehicleData,
+	    		bool (*merge_fcn)(const vehicleData_t *,vehicleData_t &,void *), void *additional_args);
+	    	// This function inserts or updates all the vehicles in "newVehicles" (e.g., the perceived objects of a CPM), like
+	    	// insertVehicle(), but it groups them by shard and locks each shard only once
+	    	// The updates of the same vehicle are applied in the order in which they appear in "newVehicles"
+	    	// If "merge_fcn" is not nullptr, it is called for each vehicle, as in upsertVehicle(), with the shard storing the vehicle
+	    	// locked in exclusive mode; it also receives the index of the vehicle inside "newVehicles", and it returns 'false' to
+	    	// discard the update of that vehicle
+	    	// The result of each insert/update is stored in the element of "results" with the same index (the vector is resized
+	    	// to the size of "newVehicles"), and it is LDMMAP_DISCARDED for the updates discarded by the callback
+	    	// This function returns LDMMAP_OK if all the vehicles have been inserted, updated or discarded, otherwise it returns
+	    	// the first error which occurred (the other vehicles are inserted anyway)
+	    	LDMMap_error_t insertVehicles(std::vector<vehicleData_t> &newVehicles, std::vector<LDMMap_error_t> &results,
+	    		bool (*merge_fcn)(const vehicleData_t *,vehicleData_t &,size_t,void *) = nullptr, void *additional_args = nullptr);
 	    	// This function removes from the database the vehicle entry with station ID == stationID
 	    	// It returns LDMMAP_ITEM_NOT_FOUND if no vehicle with the given stationID was found for removal
 	    	// It returns LDMMAP_OK if the vehicle entry was succesfully removed
@@ -76,15 +223,51 @@ namespace ldmmap {
 	    	// centered on a given latitude and longitude
 	    	// For the time being, this function should always return LDMMAP_OK (i.e. to understand if no vehicles are returned, 
 	    	// you should check the size of the selectedVehicles vector)
+	    	// Only the vehicles located in the cells of the spatial index overlapping the requested area are checked
 	    	LDMMap_error_t rangeSelectVehicle(double range_m, double lat, double lon, std::vector<returnedVehicleData_t> &selectedVehicles);
 	    	// This function is the same as the other method with the same name, but it will return all the vehicles around another
 	    	// vehicle (which is also included in the returned vector), given it stationID
 	    	// This function may return LDMMAP_ITEM_NOT_FOUND if the specified stationID is not stored inside the database
 	    	LDMMap_error_t rangeSelectVehicle(double range_m, uint64_t stationID, std::vector<returnedVehicleData_t> &selectedVehicles);
+	    	// These functions select the same vehicles as rangeSelectVehicle(), but they only read the fields specified in "fields" (a
+	    	// bitmask of vehicleField_t values), without copying the full vehicle data (including its strings)
+	    	// The first two functions call the "oper_fcn" callback for each selected vehicle, passing to it the projected data and
+	    	// the "additional_args" pointer; the callback is called with the shard storing the vehicle locked in shared mode,
+	    	// thus it should be short and it must never call any function modifying the database
+	    	// The last function appends the projected data to "selectedVehicles", releasing each shard lock as soon as its vehicles
+	    	// have been copied, so that the data can be processed (e.g., serialized) without blocking the database updates
+	    	// phData is always set to nullptr by this function: if LDMMAP_FIELD_PHDATA is requested and "selectedPHpoints" is not
+	    	// nullptr, the PHpoints objects of the selected vehicles are appended to "selectedPHpoints" instead (in the same order);
+	    	// they are shared with the database, and they can be read without holding any lock
+	    	// The functions centered on a stationID may return LDMMAP_ITEM_NOT_FOUND if the vehicle is not stored inside the database
+	    	LDMMap_error_t rangeSelectVehicleFields(double range_m, double lat, double lon, uint32_t fields,
+	    		void (*oper_fcn)(const projectedVehicleData_t &,void *), void *additional_args);
+	    	LDMMap_error_t rangeSelectVehicleFields(double range_m, uint64_t stationID, uint32_t fields,
+	    		void (*oper_fcn)(const projectedVehicleData_t &,void *), void *additional_args);
+	    	LDMMap_error_t rangeSelectVehicleFields(double range_m, double lat, double lon, uint32_t fields, std::vector<projectedVehicleData_t> &selectedVehicles,
+	    		std::vector<std::shared_ptr<PHpoints>> *selectedPHpoints = nullptr);
+
+	    	// Change feed
+	    	// Every insertion, update and deletion of a vehicle increments the version of the database and it is recorded, together
+	    	// with the new version, inside a bounded change log (kept per shard, and containing at most about
+	    	// LDMMAP_CHANGELOG_DEFAULT_SIZE entries overall, the oldest entries being discarded first)
+	    	// This function returns the current version of the database
+	    	uint64_t getCurrentVersion() {return m_version.load();}
+	    	// This function appends to "changes" all the vehicle entries which changed after "sinceVersion", with their current data
+	    	// Each vehicle is reported only once: as LDMMAP_CHANGE_DELETE if it is no longer stored in the database, as
+	    	// LDMMAP_CHANGE_INSERT if it was not stored in the database at "sinceVersion", or as LDMMAP_CHANGE_UPDATE otherwise
+	    	// (a vehicle inserted and then deleted after "sinceVersion" may thus be reported as deleted)
+	    	// "currentVersion" is set to the version to be passed to the next call: changes which happen concurrently with this call
+	    	// may be reported twice, but never missed
+	    	// This function returns LDMMAP_CHANGES_LOST if some of the changes after "sinceVersion" have already been discarded from
+	    	// the change log (or the database has been cleared): in this case, the caller should read again the whole database
+	    	// (after calling getCurrentVersion(), to know the version from which the next call should start), and "changes" should
+	    	// be ignored
+	    	LDMMap_error_t subscribe(uint64_t sinceVersion, std::vector<vehicleChange_t> &changes, uint64_t &currentVersion);
 	    	// This function deletes from the database all the entries older than time_milliseconds ms
-	    	// The entries are deleted if their age is > time_milliseconds ms if greater_equal == false, 
-	    	// or >= time_milliseconds ms if greater_equal == true
-	    	// This function performs a full database read operation
+	    	// The entries are deleted if their age is > time_milliseconds ms
+	    	// Thanks to the expiry index kept by each shard, this function only visits the entries which were last updated
+	    	// more than (about) time_milliseconds ms ago, without scanning the whole database
 	    	void deleteVehicleOlderThan(double time_milliseconds);
 	    	// This function is a combination of deleteOlderThan() and executeOnAllContents(), calling the open_fcn()
 	    	// callback for every deleted entry
@@ -108,8 +291,35 @@ namespace ldmmap {
 	    	void setCentralLatLon(double lat, double lon) {m_central_lat = lat; m_central_lon = lon;}
 	    	std::pair<double,double> getCentralLatLon() {return std::make_pair(m_central_lat,m_central_lon);}
 
-	    	int getVehicleCardinality() {return m_card;};
+	    	// This function changes the size (in meters) of the cells of the spatial indices used to speed up the range queries
+	    	// (rangeSelectVehicle()), rebuilding the indices if they already contain some vehicles
+	    	// It returns 'false' if the specified size is too small (i.e., less than SPATIALGRID_MIN_CELL_SIZE_M)
+	    	bool setSpatialIndexCellSize(double cell_size_m);
+
+	    	// This function returns (in O(1), without taking any lock on the database) the last published snapshot of the database
+	    	// The returned snapshot is never modified and it remains valid as long as the caller keeps the returned pointer
+	    	snapshotPtr_t getSnapshot() {return std::atomic_load(&m_snapshot);}
+	    	// This function takes a new snapshot of the database, publishes it (making it available to getSnapshot()) and returns it
+	    	// It takes the lock of one shard at a time, and it should be called periodically by a single thread (not by the readers)
+	    	snapshotPtr_t publishSnapshot();
+	    	// This function selects, from a snapshot, the vehicles within "range_m" meters from the specified position, appending
+	    	// to "selectedIdxs" their indices inside snapshot->vehicles
+	    	static void rangeSelectSnapshot(const snapshotPtr_t &snapshot, double range_m, double lat, double lon, std::vector<size_t> &selectedIdxs);
+
+	    	int getVehicleCardinality();
+	    	unsigned int getNumShards() {return m_num_shards;}
 			LDMMap_error_t getAllIDsVehicles(std::set<uint64_t> &selectedIDs);
+
+			// Derived IDs allocator
+			// This function returns, in O(1), an unused ID of the range reserved to derived objects (see LDMMAP_DERIVED_ID_BASE)
+			// The released IDs are reused in FIFO order, so that an ID is given to a new object as late as possible after its release
+			// It returns 0 if all the IDs of the range are currently allocated
+			uint64_t allocateDerivedID();
+			// This function gives back an ID obtained with allocateDerivedID() (any other ID is ignored)
+			// The allocator does not track the vehicles stored in the database: the owner of the ID should release it only when it
+			// will no longer use it to store any object
+			void releaseDerivedID(uint64_t id);
+			static bool isDerivedID(uint64_t id) {return id>=LDMMAP_DERIVED_ID_BASE && id-LDMMAP_DERIVED_ID_BASE<LDMMAP_DERIVED_ID_RANGE;}
 	    	
 	    	//Event functions
 
@@ -128,6 +338,7 @@ namespace ldmmap {
 			// event_LDMMAP_UPDATED and fills the retEveData structure with the event data. Otherwise, it seeks for an existing event in a radius
 			// of 10m with the same cause code. If such an event is found, it updates the event data and returns event_LDMMAP_NEAR_EVENT_UPDATED.
 			// If no event is found, it returns event_LDMMAP_ITEM_NOT_FOUND.
+			// The search for a close event only considers the events stored in the cells of the spatial index around the new event
 			event_LDMMap_error_t lookupAndUpdateEvent(uint64_t eventkey_map,double LatNewEve, double LonNewEve, uint64_t NewCauseCode,
 				eventData_t &UpEveData,returnedEventData_t &UpEventData, uint64_t &nearEvent_key);
 
@@ -136,7 +347,10 @@ namespace ldmmap {
 
 			//event_LDMMap_error_t updateEvent(uint64_t EventKey, returnedEventData_t &updateEventData);
 
-	    	//event_LDMMap_error_t eventrangeselect(double eventrange_m, double evelat, double evelon, double elevation, std::vector<returnedVehicleData_t> &selectedVehicles);
+			// This function appends to "selectedEvents" all the events located within "eventrange_m" meters from the specified position
+			// Only the events stored in the cells of the spatial index overlapping the requested area are checked
+			// It returns event_LDMMAP_OK if at least one event has been selected, event_LDMMAP_ITEM_NOT_FOUND otherwise
+	    	event_LDMMap_error_t eventrangeselect(double eventrange_m, double evelat, double evelon, std::vector<returnedEventData_t> &selectedEvents);
 
 	    	void deleteEventOlderThan(returnedEventData_t validityDuration);
 
@@ -161,17 +375,123 @@ namespace ldmmap {
 
 	    	int getEventCardinality() {return m_eventcard;};
 
-			//static std::size_t KEY_EVENT(double latitude, double longitude, double elevation, e_EventTypeLDM TypeEvent);
-	    	int KEY_EVENT(double latitude, double longitude, double elevation, e_EventTypeLDM TypeEvent);
+			// This function returns the key identifying an event in the event database, computed from its position (latitude and longitude
+			// truncated to 1e-6 degrees, elevation truncated to 1e-2 meters) and cause code
+			// The returned key is never 0
+	    	static uint64_t KEY_EVENT(double latitude, double longitude, double elevation, e_EventTypeLDM TypeEvent);
 
 		private:
-			// Main database structure
-			std::unordered_map<uint32_t,std::pair<std::shared_mutex*,std::unordered_map<uint32_t,returnedVehicleData_t>>> m_ldmmap;
-			// Database cardinality (number of entries stored in the database)
-			uint64_t m_card;
-			// Shared mutex protecting the main database structure
-			std::shared_mutex m_mainmapmut;
-
+			// Entry of the change log of a shard
+			typedef struct {
+				uint64_t version;
+				uint64_t stationID;
+				changeType_t type;
+			} changeLogEntry_t;
+
+			// Single shard of the main database structure
+			// Each shard is aligned to (and thus padded to a multiple of) the cache line size, so that the lock and the
+			// cardinality counter of a shard never share a cache line with the ones of another shard
+			// The vehicles of each shard are stored inside "slots": the fields which are accessed when scanning the whole
+			// shard (e.g., for range selects and for the removal of old entries) are stored in separate, contiguous, arrays
+			// (structure of arrays, one element per slot), while the full vehicle data ("cold" data, including the strings and
+			// the PHpoints) is kept in a separate array of records, which is accessed only for the selected vehicles
+			// The slots left free by removed vehicles are kept in a free list and reused by the next insertions
+			typedef struct alignas(LDMMAP_CACHE_LINE_SIZE) vehicleShard {
+				// Shared mutex protecting the shard
+				std::shared_mutex shardmut;
+				// Slot index of each vehicle stored in the shard, indexed by stationID
+				std::unordered_map<uint64_t,uint32_t> slotmap;
+
+				// Hot fields (one element per slot)
+				// The latitude and longitude of the free slots are set to NaN, so that they never match any range select
+				std::vector<double> lat;
+				std::vector<double> lon;
+				std::vector<double> heading;
+				std::vector<double> speed_ms;
+				std::vector<uint64_t> timestamp_us;
+				std::vector<uint64_t> stationID;
+				std::vector<e_StationTypeLDM> stationType;
+				// 1 if the slot is currently storing a vehicle, 0 if the slot is free
+				std::vector<uint8_t> used;
+				// Version of the database at which the vehicle stored in the slot was last changed
+				std::vector<uint64_t> version;
+
+				// Cold data (one element per slot)
+				std::vector<returnedVehicleData_t> records;
+
+				// Free slots, which can be reused for new vehicles
+				std::vector<uint32_t> freeslots;
+
+				// Expiry index (calendar queue): the slots of the vehicles are grouped in buckets, depending on their timestamp_us
+				// (bucket = timestamp_us/LDMMAP_EXPIRY_BUCKET_US), and the buckets are ordered from the oldest to the newest one
+				// A slot is added to a new bucket every time its vehicle is updated with a timestamp_us falling in a different bucket,
+				// while the old entries are not removed: they are discarded when their bucket is visited, as the timestamp_us of the
+				// corresponding slot (or the slot itself) is no longer matching the bucket
+				// When the number of entries in the index becomes too big with respect to the number of vehicles (e.g. if
+				// the old entries are never discarded because no deletion is performed), the index is rebuilt from scratch
+				std::map<uint64_t,std::vector<uint32_t>> expirybuckets;
+				// Total number of entries stored in "expirybuckets"
+				size_t expiryentries;
+
+				// Change log (one entry per change of a vehicle stored in the shard, in increasing version order)
+				std::deque<changeLogEntry_t> changelog;
+				// Highest version discarded from the change log (subscribers asking for the changes after an older version will
+				// get LDMMAP_CHANGES_LOST)
+				uint64_t changeloglost;
+
+				// Shard cardinality (number of entries stored in the shard)
+				std::atomic<uint64_t> card;
+
+				// Secondary spatial index (uniform grid) over the positions of the vehicles stored in the shard, updated together
+				// with the slots (with the shard lock held in exclusive mode) and used to limit range queries to the vehicles
+				// located in the cells overlapping the query area
+				SpatialGrid grid;
+			} vehicleShard_t;
+
+			void initShards(unsigned int num_shards);
+			inline vehicleShard_t &getShard(uint64_t stationID);
+			inline unsigned int getShardIdx(uint64_t stationID);
+
+			// Slot management functions (to be called with the shard lock held in exclusive mode)
+			// allocSlot() returns a free slot (possibly growing the shard arrays), storeSlot() copies the hot fields of "vehData"
+			// in the hot arrays and freeSlot() marks a slot as free again, releasing the cold data stored in it (including the PHpoints)
+			static uint32_t allocSlot(vehicleShard_t &shard);
+			static inline void storeSlot(vehicleShard_t &shard, uint32_t slot, const vehicleData_t &vehData);
+			static void freeSlot(vehicleShard_t &shard, uint32_t slot);
+			// This function stores "newVehicleData" in the shard, either in the slot pointed by "slotit", or in a new slot if
+			// slotit == shard.slotmap.end() (to be called with the shard lock held in exclusive mode)
+			LDMMap_error_t storeVehicle(vehicleShard_t &shard, std::unordered_map<uint64_t,uint32_t>::iterator slotit, const vehicleData_t &newVehicleData);
+			// This function increments the version of the database and records a change of the vehicle stored in "slot"
+			// (to be called with the shard lock held in exclusive mode, after the change has been applied to the shard)
+			void logChange(vehicleShard_t &shard, uint64_t stationID, uint32_t slot, changeType_t type);
+			// This function calls visit(shard,slot) for each vehicle within "range_m" meters from the specified position, with the
+			// lock of its shard held in shared mode
+			// It is the common implementation of all the range select functions (defined in LDMmap.cpp, and instantiated there only)
+			template <typename visitFcn> void rangeVisitVehicle(double range_m, double lat, double lon, visitFcn &&visit);
+			// This function performs a linear sweep over the hot arrays of a shard, calling visit(shard,slot) for each vehicle
+			// within "range_m" meters from the specified position (to be called with the shard lock held)
+			// "matchMask" is only used as a scratch buffer
+			template <typename visitFcn> static void rangeSweepShard(const vehicleShard_t &shard, double range_m, double lat, double lon,
+				std::vector<uint64_t> &matchMask, visitFcn &&visit);
+			// This function copies the fields specified in "fields" of the vehicle stored in "slot" into "proj"
+			static inline void projectSlot(const vehicleShard_t &shard, uint32_t slot, uint32_t fields, projectedVehicleData_t &proj);
+			// This function deletes from a shard all the entries older than time_milliseconds ms, visiting only the expired buckets
+			// of the expiry index, and calls oper_fcn() (if not nullptr) for each deleted entry (to be called with the shard lock
+			// held in exclusive mode)
+			void expireShard(vehicleShard_t &shard, uint64_t now, double time_milliseconds, void (*oper_fcn)(uint64_t,void *), void *additional_args);
+			// This function adds a slot to the expiry index, rebuilding the index when it contains too many old entries (to be
+			// called with the shard lock held in exclusive mode)
+			static void addExpiryEntry(vehicleShard_t &shard, uint32_t slot, uint64_t timestamp_us);
+
+			// Main database structure (array of m_num_shards shards)
+			std::unique_ptr<vehicleShard_t[]> m_shards;
+			unsigned int m_num_shards;
+			// Mask used to select a shard from a hash of the stationID (m_num_shards-1)
+			uint64_t m_shard_mask;
+			// Current version of the vehicle database (incremented at every change)
+			std::atomic<uint64_t> m_version;
+			// Maximum number of entries of the change log of each shard
+			size_t m_changelog_shard_size;
 			// Facility variables representing a central point around which all vehicle entries are ideally located
 			// They can be gathered and set using the setCentralLatLon() and getCentralLatLon() methods
 			// By default, they are both set to 0.0
@@ -184,10 +504,28 @@ namespace ldmmap {
 			std::shared_mutex m_eventmapmut;
 			// Cardinality of the event database
 			uint64_t m_eventcard;
+			// Secondary spatial index (uniform grid) over the event positions, updated together with m_eventldmmap (with
+			// m_eventmapmut locked in exclusive mode) and used to find the events close to a given position
+			SpatialGrid m_eventgrid;
 			//std::shared_mutex m_eventcardmut;
 
+			// Last published snapshot (always accessed with std::atomic_load() and std::atomic_store())
+			snapshotPtr_t m_snapshot;
+			// Mutex serializing the creation of new snapshots (in case publishSnapshot() is called by more than one thread)
+			std::mutex m_snapshotmut;
+
 			double m_eventcentral_lat;
 			double m_eventcentral_lon;
+
+			// Derived IDs allocator (all the IDs are stored as offsets from LDMMAP_DERIVED_ID_BASE)
+			std::mutex m_derivedidmut;
+			// Next offset which has never been allocated (all the offsets from m_derivedid_next on are free)
+			uint32_t m_derivedid_next;
+			// Offsets released after being allocated, in release order
+			std::deque<uint32_t> m_derivedid_freelist;
+			// One bit per offset below m_derivedid_next, set if the corresponding ID is currently allocated (used to ignore
+			// multiple releases of the same ID)
+			std::vector<uint64_t> m_derivedid_bitmap;
 	};
 }
 
@@ -213,6 +213,12 @@ class MisbehaviourDetector {
 		CertificateStore *m_certStore_ptr;
 		OSMStore *m_osmStore;
 
+		// Mutex protecting all the detector state below (caches, pending events, counters and log files), as processCAM(),
+		// processVAM(), processCPM() and processDENM() are called concurrently by the ingest workers, and cleanupPendingEvents()
+		// by the DB cleaner thread
+		// It is always taken before m_already_reported_mutex and before any database lock
+		std::mutex m_state_mutex;
+
 		std::map<uint64_t, ldmmap::vehicleData_t> m_lastMessageCache;
 		std::map<uint64_t, proton::binary> m_lastBinMessageCache;
 		// to keep tracking of events still in active verification
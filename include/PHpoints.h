@@ -4,15 +4,20 @@
 #include <inttypes.h>
 #include <cfloat>
 #include <vector>
+#include <mutex>
 #include "vehicleDataDef.h"
+#include "PHpointsPool.h"
 
 #define INVALID_PHDATA DBL_MAX
-#define PHDATAITER_INITIALIZER(var) ldmmap::PHpoints::PHDataIter_t var = {.ptrDataArray=NULL}
+// Number of points allocated for the Path History of a vehicle when its first point is inserted
+#define PHPOINTS_INITIAL_CAPACITY 8
+#define PHDATAITER_INITIALIZER(var) ldmmap::PHpoints::PHDataIter_t var = {.ptrPHpoints=NULL}
 
 namespace ldmmap {
 	class PHpoints {
 		public:
-			// Information stored for each PH point in this object
+			// Information returned for each PH point stored in this object
+			// Internally, each point is stored with a more compact encoding (see PHCompactData_t)
 			typedef struct PHData {
 				double lat;
 				double lon;
@@ -23,11 +28,13 @@ namespace ldmmap {
 
 			// Structure used to iterate over the PH points of a vehicle
 			typedef struct PHDataIter {
-				std::vector<PHData_t> *ptrDataArray;
+				PHpoints *ptrPHpoints;
 				PHData_t data;
 				int idx;
 				int cyclic_idx;
 				int pDataArraySize;
+				// Capacity of the storage when the iteration started: if the storage grows during the iteration, the iteration is terminated
+				int capacity;
 			} PHDataIter_t;
 
 			typedef enum {
@@ -46,8 +53,8 @@ namespace ldmmap {
 			PHpoints_retval_t iterate(PHDataIter_t &PHDataIter, PHData_t *nextPHData);
 			void clear(void);
 
-			// These are the only two parameters which can be set after construcing a PHpoints objects, as it reserves
-			// a vector whose size depends on m_distance_limit and m_min_dist_m
+			// These are the only two parameters which can be set after construcing a PHpoints objects, as the maximum
+			// number of stored points depends on m_distance_limit and m_min_dist_m
 			void setPHMaxDist(double max_distance_meters) {m_max_dist_m = max_distance_meters;}
 			void setPHMaxHeadingDiff(double max_heading_diff_degs) {m_max_heading_diff_degs = max_heading_diff_degs;}
 
@@ -58,8 +65,17 @@ namespace ldmmap {
 			void setIterateFull(bool iterateFull) {m_iterateFull = iterateFull;}
 
 			int getCardinality(void) {return m_PHpoints_size;};
+			// This function returns the number of points which can currently be stored without growing the storage
+			int getCapacity(void) {return m_capacity;};
 
 		private:
+			// Conversion functions between PHData_t and the compact encoding used for the storage
+			static inline PHCompactData_t encodePoint(double lat, double lon, double elev, double heading, double point_distance);
+			static inline PHData_t decodePoint(const PHCompactData_t &point);
+			// This function moves the stored points to a new block, big enough to store "min_points" points
+			// The points are also re-arranged, so that the oldest point is stored at index 0
+			void grow(uint32_t min_points);
+
 			double m_distance_limit;
 			double m_min_dist_m;
 			double m_max_dist_m;
@@ -70,9 +86,20 @@ namespace ldmmap {
 			int m_oldest_idx;
 			double m_stored_distance;
 			int m_PHpoints_size;
+			// Maximum number of points which can be stored (i.e., ceil(m_distance_limit/m_min_dist_m))
 			int m_vectorReservedSize;
 
-			std::vector<PHData_t> m_pDataArray;
+			// Points storage (circular buffer), allocated from the PHpointsPool
+			// The storage starts small and it grows (doubling its capacity) up to m_vectorReservedSize points only when needed
+			PHCompactData_t *m_points;
+			// Number of points which can be stored in m_points (never greater than m_vectorReservedSize)
+			uint32_t m_capacity;
+			// Actual size of the block allocated from the pool (it may be greater than m_capacity)
+			uint32_t m_block_capacity;
+
+			// Mutex protecting the points storage, as a PHpoints object can be read (with iterate()) by threads not holding
+			// any database lock, while new points are being inserted
+			std::mutex m_pointsmut;
 
 			// "Remove Policy"
 			// Set to "true" for "remove, if needed, at most one point when a new update arrives"
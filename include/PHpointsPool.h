@@ -0,0 +1,65 @@
+#ifndef PHPOINTSPOOL_H
+#define PHPOINTSPOOL_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Number of points of the smallest block which can be allocated from the pool
+#define PHPOINTSPOOL_MIN_BLOCK_POINTS 8
+// Number of size classes managed by the pool (each size class is twice as big as the previous one: 8, 16, 32, ..., 1024 points)
+// Bigger blocks are directly allocated (and freed) with new[] (and delete[])
+#define PHPOINTSPOOL_NUM_SIZE_CLASSES 8
+// Size of each slab from which the blocks of a size class are carved, in bytes
+#define PHPOINTSPOOL_SLAB_SIZE_BYTES 65536
+
+namespace ldmmap {
+	// Compact encoding of a single PH point (16 bytes, instead of the 40 bytes of PHpoints::PHData_t)
+	typedef struct PHCompactData {
+		int32_t lat; // Latitude, in tenths of microdegrees (1e-7 degrees)
+		int32_t lon; // Longitude, in tenths of microdegrees (1e-7 degrees)
+		float point_distance; // Distance from the previous point, in meters
+		uint16_t heading; // Heading, in tenths of degree (LDM_HEADING_UNAVAILABLE is encoded as 36010)
+		int16_t elev; // Elevation, in units of 0.5 meters
+	} PHCompactData_t;
+
+	// Pool (slab allocator) of blocks of PH points, shared by all the PHpoints objects
+	// Blocks are grouped in size classes, each one with its own free list: the blocks released by a PHpoints object (e.g. when
+	// the corresponding vehicle is removed from the database, or when its PH grows and needs a bigger block) are kept in the
+	// free list and reused by the next allocations of the same size class, without going back to the system allocator
+	// All the methods of this class are thread-safe
+	class PHpointsPool {
+		public:
+			// This function returns the pool shared by all the PHpoints objects
+			static PHpointsPool &getInstance();
+
+			// This function allocates a block of at least "min_points" points
+			// The actual number of points of the returned block is stored in "capacity"
+			PHCompactData_t *allocate(uint32_t min_points, uint32_t &capacity);
+			// This function releases a block previously returned by allocate() ("capacity" must be the value set by allocate())
+			void release(PHCompactData_t *block, uint32_t capacity);
+
+			// Statistics: number of blocks currently allocated and total number of points currently allocated to the PHpoints objects
+			uint64_t getAllocatedBlocks() {return m_allocated_blocks;}
+			uint64_t getAllocatedPoints() {return m_allocated_points;}
+		private:
+			PHpointsPool();
+
+			typedef struct sizeClass {
+				std::mutex mut;
+				std::vector<PHCompactData_t *> freelist;
+				std::vector<std::unique_ptr<PHCompactData_t[]>> slabs;
+			} sizeClass_t;
+
+			static inline int getSizeClass(uint32_t points);
+
+			sizeClass_t m_classes[PHPOINTSPOOL_NUM_SIZE_CLASSES];
+
+			std::atomic<uint64_t> m_allocated_blocks;
+			std::atomic<uint64_t> m_allocated_points;
+	};
+}
+
+#endif // PHPOINTSPOOL_H
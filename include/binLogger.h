@@ -0,0 +1,267 @@
+#ifndef SLDM_BINLOGGER_H
+#define SLDM_BINLOGGER_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Maximum number of threads which can log at the same time (the records of any additional thread are dropped); the slot of a thread
+// is reused after the thread terminates
+#define BINLOGGER_MAX_THREADS 256
+// Capacity, in records, of the ring buffer of each thread (must be a power of two)
+#define BINLOGGER_RING_SIZE 16384
+// Interval, in milliseconds, between two consecutive flushes of the ring buffers by the background thread
+#define BINLOGGER_FLUSH_INTERVAL_MS 50
+// Maximum number of sources which can be registered in each BinLogger
+#define BINLOGGER_MAX_SOURCES 256
+
+// Binary log files start with a binLogFileHeader_t, followed by a sequence of binLogRecord_t
+#define BINLOGGER_FILE_MAGIC "SLDMBLOG"
+#define BINLOGGER_FILE_VERSION 1
+
+// Type of each log record
+typedef enum {
+	BINLOG_SOURCE_NAME, // Name of a source (only stored in binary files, before any record of that source)
+	BINLOG_CONNECTION_OPEN,
+	BINLOG_CONNECTION_CLOSE,
+	BINLOG_MESSAGE_DECODER, // "stage" record
+	BINLOG_CAM_DATABASE_UPDATE, // "stage" record (flags: bit 0 = low frequency container available)
+	BINLOG_CAM_TRIGGER_CHECK, // "stage" record (flags: bit 0 = trigger enabled, bit 1 = exterior lights available, bit 2 = cross-border trigger mode, bit 3 = inside the internal area)
+	BINLOG_DATA_TOO_OLD, // "discarded" record
+	BINLOG_FULL_CAM_PROCESSING, // "vehicle" record
+	BINLOG_FULL_CPM_OBJECT_PROCESSING, // "vehicle" record (only stationID, position, heading and instantaneous update period are set)
+	BINLOG_FULL_VAM_PROCESSING, // "vehicle" record (only stationID, position, heading and instantaneous update period are set)
+	BINLOG_DENM_AREA_FILTER, // "stage" record
+	BINLOG_FULL_DENM_PROCESSING, // "event" record
+	BINLOG_NUM_RECORD_TYPES
+} binLogRecordType_t;
+
+// Compact, fixed size (one cache line), log record
+// The records contain only raw values (e.g., no formatted date or string), so that logging a record only costs a copy into
+// the ring buffer of the calling thread; they are formatted later by the background thread of the logger, or by the offline
+// decoder (SLDM-binlog-decoder) when the logger is writing a binary file
+typedef struct binLogRecord {
+	uint64_t timestamp_ns; // Time at which the record has been logged (CLOCK_REALTIME, in nanoseconds)
+	uint8_t type; // binLogRecordType_t
+	uint8_t source; // Index returned by registerSource() (e.g., one per AMQP client)
+	uint16_t reserved16;
+	uint32_t reserved32;
+
+	union {
+		// Processing stage (duration of the stage, return value and type-specific flags)
+		struct {
+			uint64_t duration_ns;
+			int32_t retval;
+			uint32_t flags;
+		} stage;
+
+		// Message discarded because older than the stored data (GeoNetworking timestamps)
+		struct {
+			uint64_t rx_gn_timestamp;
+			uint64_t stored_gn_timestamp;
+		} discarded;
+
+		// Full processing of a vehicle (or object) update
+		struct {
+			uint64_t stationID;
+			uint64_t duration_ns; // Time elapsed since the reception of the message
+			int32_t lat; // Latitude, in tenths of microdegrees
+			int32_t lon; // Longitude, in tenths of microdegrees
+			float heading;
+			float inst_period_ms; // Time elapsed since the previous update of the same vehicle (-1 for new vehicles)
+			uint32_t gnTimestamp;
+			uint32_t camTimestamp;
+			uint32_t cardinality; // Number of vehicles stored in the database
+			uint16_t stationType;
+			uint16_t reserved;
+		} vehicle;
+
+		// Full processing of a DENM (the timestamp of the record is the reference time of the event)
+		struct {
+			uint64_t eventKey;
+			uint32_t duration_ns; // Time elapsed since the reception of the message (saturated to UINT32_MAX)
+			uint32_t originatingStationID;
+			int32_t lat; // Latitude, in tenths of microdegrees
+			int32_t lon; // Longitude, in tenths of microdegrees
+			int32_t elevation; // Elevation, in centimeters
+			uint32_t gnTimestamp;
+			uint32_t detection_age_us; // Time elapsed between the detection time and the reference time of the event
+			uint32_t validityDuration;
+			uint32_t cardinality; // Number of events stored in the database
+			uint16_t sequenceNumber;
+			uint16_t stationType;
+		} event;
+
+		// BINLOG_SOURCE_NAME: name of the source (NUL-terminated)
+		char name[48];
+	};
+} binLogRecord_t;
+
+static_assert(sizeof(binLogRecord_t)==64,"binLogRecord_t must be 64 bytes long");
+
+typedef struct binLogFileHeader {
+	char magic[8]; // BINLOGGER_FILE_MAGIC (without the terminating NUL)
+	uint32_t version; // BINLOGGER_FILE_VERSION
+	uint32_t record_size; // sizeof(binLogRecord_t)
+	int64_t tai_offset_ns; // Difference between CLOCK_TAI and CLOCK_REALTIME when the file was created (to compute GeoNetworking timestamps)
+} binLogFileHeader_t;
+
+// Low overhead logger for the message processing hot path
+// Each logging thread writes the records in its own single-producer single-consumer lock-free ring buffer (allocated the first time
+// the thread logs a record), while a background thread periodically collects the records of all the threads, orders them by timestamp,
+// and either formats them as text (with the same format of the previous fprintf() based logs) or dumps them as they are, in binary form,
+// to be decoded offline with SLDM-binlog-decoder
+// If the ring buffer of a thread is full, the new records are dropped (and counted), so that logging never blocks the calling thread
+class BinLogger {
+	public:
+		typedef enum {
+			BINLOGGER_FORMAT_TEXT,
+			BINLOGGER_FORMAT_BINARY
+		} binLoggerFormat_t;
+
+		// The logger writes to "outfile", which is not closed by the logger
+		BinLogger(FILE *outfile, binLoggerFormat_t format);
+		~BinLogger();
+
+		BinLogger(const BinLogger &) = delete;
+		BinLogger &operator=(const BinLogger &) = delete;
+
+		// This function starts the background thread (writing the file header, if the format is binary)
+		void start();
+		// This function writes all the records which have been logged so far and terminates the background thread
+		void stop();
+
+		// This function registers a new source of records (e.g., an AMQP client), returning its index (to be stored in the "source" field
+		// of the records); it should be called before any record of that source is logged
+		uint8_t registerSource(const std::string &name);
+
+		// This function logs a record, with timestamp "timestamp_ns" (if 0, the current time is read), and returns 'false' if the
+		// record had to be dropped
+		// It is lock-free and it can be called by any thread
+		bool log(binLogRecord_t &rec, uint64_t timestamp_ns=0);
+
+		// Helper functions filling and logging the different kinds of records (the records are zeroed first, so that no uninitialized
+		// byte, e.g. in the unused part of the union, is written to the binary files)
+		bool logEvent(binLogRecordType_t type, uint8_t source) {
+			binLogRecord_t rec;
+			memset(&rec,0,sizeof(rec));
+			rec.type=type;
+			rec.source=source;
+			return log(rec);
+		}
+		// The duration of the stage is computed from the timestamps of its beginning ("bf_ns") and of its end ("af_ns"), which is
+		// also used as timestamp of the record (to avoid reading the clock once more)
+		bool logStage(binLogRecordType_t type, uint8_t source, uint64_t bf_ns, uint64_t af_ns, int32_t retval=0, uint32_t flags=0) {
+			binLogRecord_t rec;
+			memset(&rec,0,sizeof(rec));
+			rec.type=type;
+			rec.source=source;
+			rec.stage.duration_ns=af_ns-bf_ns;
+			rec.stage.retval=retval;
+			rec.stage.flags=flags;
+			return log(rec,af_ns);
+		}
+		bool logDiscarded(uint8_t source, uint64_t rx_gn_timestamp, uint64_t stored_gn_timestamp) {
+			binLogRecord_t rec;
+			memset(&rec,0,sizeof(rec));
+			rec.type=BINLOG_DATA_TOO_OLD;
+			rec.source=source;
+			rec.discarded.rx_gn_timestamp=rx_gn_timestamp;
+			rec.discarded.stored_gn_timestamp=stored_gn_timestamp;
+			return log(rec);
+		}
+		// If "rx_ns" and "af_ns" are set, the processing time (from the reception of the message) is computed as af_ns-rx_ns, and
+		// af_ns is used as timestamp of the record
+		bool logVehicle(binLogRecordType_t type, uint8_t source, uint64_t stationID, double lat, double lon, double heading, double inst_period_ms,
+			uint64_t rx_ns=0, uint64_t af_ns=0, uint16_t stationType=0, uint32_t camTimestamp=0, uint32_t gnTimestamp=0, uint32_t cardinality=0) {
+			binLogRecord_t rec;
+			memset(&rec,0,sizeof(rec));
+			rec.type=type;
+			rec.source=source;
+			rec.vehicle.stationID=stationID;
+			rec.vehicle.duration_ns=af_ns-rx_ns;
+			rec.vehicle.lat=static_cast<int32_t>(lat*10000000.0+(lat>=0 ? 0.5 : -0.5));
+			rec.vehicle.lon=static_cast<int32_t>(lon*10000000.0+(lon>=0 ? 0.5 : -0.5));
+			rec.vehicle.heading=static_cast<float>(heading);
+			rec.vehicle.inst_period_ms=static_cast<float>(inst_period_ms);
+			rec.vehicle.gnTimestamp=gnTimestamp;
+			rec.vehicle.camTimestamp=camTimestamp;
+			rec.vehicle.cardinality=cardinality;
+			rec.vehicle.stationType=stationType;
+			return log(rec,af_ns);
+		}
+
+		// "referenceTime_us" and "detectionTime_us" are the reference and detection times of the event (in microseconds, with the
+		// same clock of get_timestamp_us()), and the processing time is computed as af_ns-rx_ns
+		bool logDENM(uint8_t source, uint64_t eventKey, uint32_t originatingStationID, uint16_t sequenceNumber, double lat, double lon, double ele,
+			uint16_t stationType, uint64_t referenceTime_us, uint32_t gnTimestamp, uint64_t detectionTime_us, uint32_t validityDuration,
+			uint64_t rx_ns, uint64_t af_ns, uint32_t cardinality) {
+			binLogRecord_t rec;
+			memset(&rec,0,sizeof(rec));
+			rec.type=BINLOG_FULL_DENM_PROCESSING;
+			rec.source=source;
+			rec.event.eventKey=eventKey;
+			rec.event.duration_ns=af_ns-rx_ns>UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(af_ns-rx_ns);
+			rec.event.originatingStationID=originatingStationID;
+			rec.event.lat=static_cast<int32_t>(lat*10000000.0+(lat>=0 ? 0.5 : -0.5));
+			rec.event.lon=static_cast<int32_t>(lon*10000000.0+(lon>=0 ? 0.5 : -0.5));
+			rec.event.elevation=static_cast<int32_t>(ele*100.0+(ele>=0 ? 0.5 : -0.5));
+			rec.event.gnTimestamp=gnTimestamp;
+			rec.event.detection_age_us=referenceTime_us>detectionTime_us ? static_cast<uint32_t>(referenceTime_us-detectionTime_us) : 0;
+			rec.event.validityDuration=validityDuration;
+			rec.event.cardinality=cardinality;
+			rec.event.sequenceNumber=sequenceNumber;
+			rec.event.stationType=stationType;
+			return log(rec,referenceTime_us*1000);
+		}
+
+		// Statistics: number of records dropped because the ring buffer of the logging thread was full
+		uint64_t getDroppedCount();
+
+		// This function writes "rec" to "outfile" as a text line
+		// "tai_offset_ns" is the difference between CLOCK_TAI and CLOCK_REALTIME, used to compute the age of the GeoNetworking timestamps
+		static void formatRecord(FILE *outfile, const binLogRecord_t &rec, const char *source_name, int64_t tai_offset_ns);
+		// This function returns the difference, in nanoseconds, between CLOCK_TAI and CLOCK_REALTIME
+		static int64_t getTAIOffset();
+	private:
+		typedef struct ring {
+			alignas(64) std::atomic<uint64_t> head; // Written only by the producer thread
+			alignas(64) std::atomic<uint64_t> tail; // Written only by the background thread
+			std::atomic<uint64_t> dropped;
+			std::unique_ptr<binLogRecord_t[]> records;
+		} ring_t;
+
+		ring_t *getThreadRing();
+		void flusherLoop();
+		// This function moves all the pending records to the output file (called only by the background thread, or after it terminated)
+		void flush(std::vector<binLogRecord_t> &batch);
+
+		FILE *m_outfile;
+		binLoggerFormat_t m_format;
+		int64_t m_tai_offset_ns;
+
+		// Ring buffer of each thread (indexed by a per-thread slot, shared by all the loggers, and reused by a new thread after the
+		// previous owner of the slot terminated)
+		std::unique_ptr<std::atomic<ring_t *>[]> m_rings;
+		// Records dropped by the threads beyond BINLOGGER_MAX_THREADS
+		std::atomic<uint64_t> m_overflow_dropped;
+
+		std::mutex m_sourcesmut;
+		std::vector<std::string> m_sources;
+		// Number of sources whose name has already been written to the output file (binary format only)
+		size_t m_sources_written;
+
+		std::thread m_flusher;
+		std::mutex m_flushermut;
+		std::condition_variable m_flushercv;
+		bool m_running;
+};
+
+#endif // SLDM_BINLOGGER_H
@@ -3,12 +3,15 @@
 
 #include <unordered_map>
 #include <vector>
+#include <memory>
 #include <shared_mutex>
 #include <string>
 #include "optionalDataItem.h"
 
 extern "C" {
 	#include "DENM.h"
+	#include "per_encoder.h"
+	#include "per_decoder.h"
 }
 
 #define eventDataVector_t(name) std::vector<ldmmap::eventData_t> name;
@@ -46,6 +49,31 @@ namespace ldmmap{
 	} e_EventTypeLDM;
 
 
+	// This function returns a deep copy of the asn1c structure "src" (of type "def"), allocated with the standard library allocator
+	// and released when the last copy of the returned pointer is destroyed (or nullptr if "src" cannot be copied)
+	// The decoded messages are stored in the arena of the decoder, which is reset as soon as each message is processed: any part of a
+	// message which is stored in the database, or kept by the misbehaviour detector, must be copied with this function
+	// It must not be called while a decoder arena is active in the calling thread
+	template <class T> std::shared_ptr<T> asnHeapCopy(asn_TYPE_descriptor_t *def, const T *src) {
+		void *buffer=nullptr;
+		T *copy=nullptr;
+
+		ssize_t len=uper_encode_to_new_buffer(def,nullptr,src,&buffer);
+		if(len<0) {
+			return nullptr;
+		}
+
+		asn_dec_rval_t dr=uper_decode_complete(nullptr,def,(void **)&copy,buffer,len);
+		free(buffer);
+
+		if(dr.code!=RC_OK) {
+			ASN_STRUCT_FREE(*def,copy);
+			return nullptr;
+		}
+
+		return std::shared_ptr<T>(copy,[def](T *ptr) {ASN_STRUCT_FREE(*def,ptr);});
+	}
+
 	//For the visualizer
 	typedef enum OperationType {
 		OperationType_LDM_unknown,
@@ -110,7 +138,7 @@ namespace ldmmap{
 		//STUATION CONTAINER
 		e_EventTypeLDM eventCauseCode;
 		long eventSubCauseCode; // matching defined subcause data type long
-		OptionalDataItem<EventHistory> eventHistory;
+		OptionalDataItem<std::shared_ptr<EventHistory_t>> eventHistory; // Heap copy (see asnHeapCopy())
 		/*
 		OptionalDataItem<long> eventInformationQuality;
 		OptionalDataItem<long> eventCauseCodeType;
@@ -118,7 +146,7 @@ namespace ldmmap{
 		*/
 
 		//LOCATION CONTAINER -> OPTIONAL
-		OptionalDataItem<Traces_t> traces;
+		OptionalDataItem<std::shared_ptr<Traces_t>> traces; // Heap copy (see asnHeapCopy())
 		OptionalDataItem<RoadType_t> roadType;
 		OptionalDataItem<long>  eventSpeed; //speed value
 		OptionalDataItem<long>  eventPositionHeading; //heading value
@@ -0,0 +1,29 @@
+#ifndef DISTANCEFILTER_H
+#define DISTANCEFILTER_H
+
+#include <cinttypes>
+#include <cstddef>
+
+// Number of 64-bit words needed to store a match bitmask for "n" positions
+#define DISTANCEFILTER_MASK_WORDS(n) (((n)+63)/64)
+
+namespace ldmmap {
+	// Batched distance filter: for each one of the "n" positions stored in "lats" and "lons" (in degrees), this function sets
+	// to 1 the corresponding bit of "mask" (bit i%64 of word i/64) if the position is within "range_m" meters (great-circle
+	// distance, computed with the same haversine formula as haversineDist()) from the center of the query circle ("lat", "lon")
+	// or to 0 otherwise
+	// "mask" must point to at least DISTANCEFILTER_MASK_WORDS(n) words
+	// Positions with a NaN latitude or longitude never match
+	// Most positions are classified by a cheap equirectangular-like pre-filter, with conservative lower and upper bounds on the
+	// haversine of the distance; the exact haversine distance is computed only for the positions lying close to the circle
+	// boundary, for which the bounds are not enough to decide
+	// The pre-filter is vectorized with AVX2 or SSE2 when supported by the CPU (the best implementation is selected at runtime),
+	// falling back to a scalar implementation otherwise
+	// This function returns the number of matching positions
+	size_t distanceFilter(const double *lats, const double *lons, size_t n, double lat, double lon, double range_m, uint64_t *mask);
+
+	// This function returns the name of the implementation selected for distanceFilter() ("avx2", "sse2" or "scalar")
+	const char *distanceFilterImplementation();
+}
+
+#endif // DISTANCEFILTER_H
@@ -0,0 +1,103 @@
+#ifndef SLDM_INGEST_PIPELINE_H
+#define SLDM_INGEST_PIPELINE_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mpmcQueue.h"
+
+// Maximum time, in milliseconds, an idle worker sleeps before checking again its queue (safety net for missed wake-ups)
+#define INGESTPIPELINE_IDLE_WAIT_MS 100
+
+// Message received by an ingest source (e.g., an AMQPClient), together with the message properties which are needed to process it
+// It contains only plain data (no reference to the objects of the messaging library), so that it can be moved from the thread
+// receiving the message to the worker which will process it
+typedef struct ingestMessage {
+	// Object which received the message and which is going to process it (passed back to the processing function of the pipeline)
+	void *owner;
+	// Binary payload of the message (e.g., GN+BTP+Facilities packet, or Facilities-only packet)
+	std::vector<uint8_t> payload;
+	// Reception timestamp of the message, in microseconds
+	uint64_t on_msg_timestamp_us;
+	// Reception timestamp of the message, in nanoseconds, used to log the total processing time (0 if logging is disabled)
+	uint64_t rx_timestamp_ns;
+	// 'true' if the received message had any application property
+	bool properties_available;
+	// GeoNetworking timestamp property (if available and of a supported type)
+	bool gn_timestamp_available;
+	uint64_t gn_timestamp;
+	// Source quadkey property ("" if not available)
+	std::string quadkey;
+} ingestMessage_t;
+
+// Pool of worker threads processing (i.e., decoding and storing in the database) the messages received by one or more ingest sources
+// The receiving threads only copy each message, together with its properties, into the lock-free queue of one of the workers, and
+// immediately go back to receiving the next message
+// Each message is assigned to a worker depending on the stationID of its sender (see getAffinityKey()): all the messages of the same
+// vehicle are thus processed, in order, by the same worker, while the messages of different vehicles are processed in parallel
+class IngestPipeline {
+	public:
+		// "process_fcn" is called by the worker threads for each message (with the index of the worker, from 0 to num_workers-1,
+		// which can be used to access any per-worker state, and with "additional_args")
+		// The capacity of each per-worker queue is set to "queue_size" (rounded up to the next power of two)
+		IngestPipeline(unsigned int num_workers, size_t queue_size, void (*process_fcn)(ingestMessage_t &,unsigned int,void *), void *additional_args);
+		~IngestPipeline();
+
+		IngestPipeline(const IngestPipeline &) = delete;
+		IngestPipeline &operator=(const IngestPipeline &) = delete;
+
+		// This function starts the worker threads
+		void start();
+		// This function processes all the messages which are still queued, and then terminates the worker threads
+		// After stop() is called, push() always returns 'false'
+		void stop();
+
+		// This function moves "msg" into the queue of the worker selected for its sender
+		// If the queue is full, it waits until some space is freed by the worker (to apply backpressure to the receiving thread,
+		// instead of dropping messages)
+		// It returns 'false' (leaving "msg" untouched, so that it can be processed by the caller) if the pipeline is not running, or
+		// if it is stopped while waiting for space in a full queue
+		bool push(ingestMessage_t &msg);
+
+		bool isRunning() {return m_running;}
+		unsigned int getNumWorkers() {return m_num_workers;}
+		// Statistics: number of times push() found the target queue full and had to wait
+		uint64_t getBackpressureCount() {return m_backpressure_cnt;}
+
+		// This function returns a key identifying the sender of the packet stored in "buf" (i.e., its stationID, read from the header
+		// of the Facilities layer message, after skipping GeoNetworking and BTP, if present), without fully decoding it
+		// It returns 0 if the stationID cannot be located (e.g., secured packets with an unexpected layout, or malformed packets)
+		static uint64_t getAffinityKey(const uint8_t *buf, size_t len);
+
+	private:
+		typedef struct worker {
+			std::unique_ptr<MPMCQueue<ingestMessage_t>> queue;
+			std::thread thread;
+
+			// Used only to put the worker to sleep when its queue is empty
+			std::mutex mut;
+			std::condition_variable cv;
+			std::atomic<bool> sleeping;
+		} worker_t;
+
+		void workerLoop(unsigned int worker_idx);
+
+		unsigned int m_num_workers;
+		std::unique_ptr<worker_t[]> m_workers;
+
+		void (*m_process_fcn)(ingestMessage_t &,unsigned int,void *);
+		void *m_additional_args;
+
+		std::atomic<bool> m_running;
+		// Number of push() calls which are currently enqueueing a message (see stop())
+		std::atomic<unsigned int> m_pushers;
+		std::atomic<uint64_t> m_backpressure_cnt;
+};
+
+#endif // SLDM_INGEST_PIPELINE_H
@@ -0,0 +1,60 @@
+#ifndef SLDM_LATENCYSTATS_H
+#define SLDM_LATENCYSTATS_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+// Each power of two is divided into 2^LATENCYSTATS_SUB_BUCKET_BITS buckets (i.e., the percentiles are computed with a relative
+// error below 1/2^LATENCYSTATS_SUB_BUCKET_BITS)
+#define LATENCYSTATS_SUB_BUCKET_BITS 4
+#define LATENCYSTATS_NUM_BUCKETS ((64-LATENCYSTATS_SUB_BUCKET_BITS+1)<<LATENCYSTATS_SUB_BUCKET_BITS)
+
+// Processing stages whose latency is measured
+typedef enum {
+	LATENCYSTATS_DECODE, // Decoding of the received message (decodeEtsi())
+	LATENCYSTATS_MBD, // Misbehaviour detection (only if the misbehaviour detector is enabled)
+	LATENCYSTATS_DB_UPDATE, // Update of the database with the data of the message
+	LATENCYSTATS_TOTAL, // From the reception of the message to the end of its processing (including the time spent in the ingest pipeline queues)
+	LATENCYSTATS_NUM_STAGES
+} latencyStatsStage_t;
+
+// Lock-free latency histograms, one for each processing stage
+// Each histogram has log-linear buckets (as in HdrHistogram): the values are grouped by power of two, and each power of two is
+// divided into 2^LATENCYSTATS_SUB_BUCKET_BITS linear buckets, so that recording a value only costs a few bit operations and an
+// atomic increment, and the percentiles of any range of values (from nanoseconds to hours) are computed with a bounded relative error
+class LatencyStats {
+	public:
+		LatencyStats();
+
+		LatencyStats(const LatencyStats &) = delete;
+		LatencyStats &operator=(const LatencyStats &) = delete;
+
+		// This function records a latency of "latency_ns" nanoseconds for the stage "stage" (it can be called by any thread)
+		void record(latencyStatsStage_t stage, uint64_t latency_ns);
+
+		uint64_t getCount(latencyStatsStage_t stage);
+		// This function returns the "percentile"-th percentile (between 0 and 100) of the latencies of "stage", in nanoseconds
+		// (0 if no latency has been recorded)
+		uint64_t getPercentile(latencyStatsStage_t stage, double percentile);
+		uint64_t getMax(latencyStatsStage_t stage) {return m_max[stage];}
+		double getMean(latencyStatsStage_t stage);
+
+		// This function prints a table with the count, mean, 50th, 90th, 99th, 99.9th percentile and maximum latency of each
+		// stage (skipping the stages without any recorded latency)
+		void print(FILE *outfile);
+
+		static const char *getStageName(latencyStatsStage_t stage);
+	private:
+		static unsigned int getBucketIndex(uint64_t value);
+		// This function returns the value in the middle of the bucket "idx"
+		static uint64_t getBucketValue(unsigned int idx);
+
+		std::unique_ptr<std::atomic<uint64_t>[]> m_buckets[LATENCYSTATS_NUM_STAGES];
+		std::atomic<uint64_t> m_count[LATENCYSTATS_NUM_STAGES];
+		std::atomic<uint64_t> m_sum[LATENCYSTATS_NUM_STAGES];
+		std::atomic<uint64_t> m_max[LATENCYSTATS_NUM_STAGES];
+};
+
+#endif // SLDM_LATENCYSTATS_H
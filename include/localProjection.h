@@ -0,0 +1,64 @@
+#ifndef SLDM_LOCALPROJECTION_H
+#define SLDM_LOCALPROJECTION_H
+
+#include <cstddef>
+#include "utmuts.h"
+
+// Conversion of local Cartesian offsets (x towards East, y towards North, in meters, as the positions of the Perceived Objects
+// inside CPMs) from an origin (e.g., the reference position of the CPM sender) to latitude and longitude
+// The origin is set once with setOrigin() (which recomputes its projection only when it changes, so that the same object can be
+// kept, and reused across messages, for each sender) and then any number of offsets can be converted, one by one or in batch
+class localProjection {
+	public:
+		typedef enum {
+			// Transverse Mercator (UTM, as done by GeographicLib), with the central meridian passing through the origin
+			// The offsets are applied to the projected coordinates of the origin and the result is projected back
+			LOCALPROJECTION_TMERC,
+			// Local tangent plane (East-North-Up) approximation: the offsets are divided by the meridional and prime vertical
+			// radii of curvature of the WGS84 ellipsoid at the origin, including the second order correction due to the
+			// convergence of the meridians
+			// With respect to an exact ellipsoidal computation (Transverse Mercator projection with unit scale centered on the
+			// origin), for offsets up to 1 km the error is below 1 mm up to 80 degrees of latitude, i.e. well below the 1 cm
+			// resolution of the CPM positions
+			// (while the Transverse Mercator mode applies the 0.9996 UTM scale factor to the offsets, i.e. up to 0.4 m at 1 km)
+			// It is several times faster than the Transverse Mercator mode
+			LOCALPROJECTION_ENU
+		} localProjection_mode_t;
+
+		localProjection(localProjection_mode_t mode=LOCALPROJECTION_TMERC);
+
+		// This function sets the origin of the offsets (latitude and longitude in degrees)
+		// Nothing is recomputed if the origin is the same as the current one
+		void setOrigin(double lat, double lon);
+
+		// This function converts a single offset (in meters) into latitude and longitude (in degrees)
+		void toLatLon(double x, double y, double &lat, double &lon);
+		// This function converts "n" offsets (in meters) into latitude and longitude values (in degrees)
+		void toLatLon(const double *x, const double *y, size_t n, double *lat, double *lon);
+
+		localProjection_mode_t getMode() {return m_mode;}
+	private:
+		// This function returns the UTM Transverse Mercator parameters, initialized only once and shared by all the objects
+		// (they are never modified by the forward and reverse projections)
+		static transverse_mercator_t &getUTMTransverseMercator();
+
+		localProjection_mode_t m_mode;
+		bool m_origin_set;
+
+		// Origin, in degrees
+		double m_lat0;
+		double m_lon0;
+
+		// LOCALPROJECTION_TMERC: projected coordinates of the origin
+		double m_x0;
+		double m_y0;
+
+		// LOCALPROJECTION_ENU: conversion factors from meters to degrees (North and East), and coefficients of the second order
+		// corrections of the latitude (applied to x^2) and of the East conversion factor (applied to y)
+		double m_northdeg_per_m;
+		double m_eastdeg_per_m;
+		double m_latcorr_coeff;
+		double m_loncorr_coeff;
+};
+
+#endif // SLDM_LOCALPROJECTION_H
@@ -0,0 +1,118 @@
+#ifndef SLDM_METRICSSINK_H
+#define SLDM_METRICSSINK_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mpmcQueue.h"
+
+// Maximum number of values (columns) of each row
+#define METRICSSINK_MAX_COLUMNS 8
+// Maximum number of streams (i.e., of output files) which can be registered in each MetricsSink
+#define METRICSSINK_MAX_STREAMS 32
+// Default capacity, in rows, of the queue between the emitting threads and the writer thread
+#define METRICSSINK_DEFAULT_QUEUE_SIZE 16384
+// Interval, in milliseconds, after which the writer thread flushes the buffered rows to the files when no new row is emitted
+#define METRICSSINK_FLUSH_INTERVAL_MS 100
+// Size, in bytes, of the stdio buffer of each output file
+#define METRICSSINK_FILE_BUFFER_SIZE 65536
+// Default number of rotated files which are kept for each stream (<name>.1.csv is the most recent one)
+#define METRICSSINK_DEFAULT_ROTATED_FILES 4
+// Interval, in seconds, after which the file of a stream which could not be opened is opened again (in the meantime, the rows
+// of the stream are discarded)
+#define METRICSSINK_OPEN_RETRY_INTERVAL_S 10
+
+// Row of numeric values emitted into a stream
+typedef struct metricsRow {
+	uint32_t stream;
+	uint32_t num_values;
+	double values[METRICSSINK_MAX_COLUMNS];
+} metricsRow_t;
+
+// Asynchronous sink for timing measurements and other metrics, in CSV format
+// Each module registers one or more "streams", each one with its own file (<directory>/<stream name>.csv) and columns, and then
+// emits rows of values into them from any thread: emitting a row only costs a push into a bounded lock-free queue, while a
+// background thread formats the rows and writes them to the files, which are opened once, buffered, and rotated when they
+// exceed a maximum size
+// If the queue is full, the new rows are dropped (and counted), so that emitting a row never blocks the calling thread
+class MetricsSink {
+	public:
+		// "max_file_size" is the size, in bytes, after which the file of each stream is rotated (0 to never rotate the files)
+		MetricsSink(const std::string &directory, uint64_t max_file_size=0, unsigned int max_rotated_files=METRICSSINK_DEFAULT_ROTATED_FILES, size_t queue_size=METRICSSINK_DEFAULT_QUEUE_SIZE);
+		~MetricsSink();
+
+		MetricsSink(const MetricsSink &) = delete;
+		MetricsSink &operator=(const MetricsSink &) = delete;
+
+		// This function starts the writer thread
+		void start();
+		// This function writes all the rows which have been emitted so far, closes the files and terminates the writer thread
+		void stop();
+
+		// This function registers a new stream, with the given name and column names, and returns its index (to be passed to emit())
+		// If a stream with the same name has already been registered (e.g., by another AMQPClient), its index is returned
+		// It returns -1 if too many streams have been registered, or if more than METRICSSINK_MAX_COLUMNS columns are specified
+		// The file of the stream is created (or appended to, if it already exists) only when the first row is written
+		int registerStream(const std::string &name, const std::vector<std::string> &columns);
+
+		// This function emits a row of "num_values" values into the stream with index "stream" (any value beyond the number of
+		// columns of the stream is ignored), and returns 'false' if the row had to be dropped
+		// It is lock-free and it can be called by any thread
+		bool emit(int stream, const double *values, size_t num_values);
+		bool emit(int stream, std::initializer_list<double> values) {
+			return emit(stream,values.begin(),values.size());
+		}
+
+		// Statistics: number of rows dropped because the queue was full
+		uint64_t getDroppedCount() {return m_dropped;}
+	private:
+		typedef struct stream {
+			std::string name;
+			std::vector<std::string> columns;
+			FILE *file;
+			std::unique_ptr<char[]> filebuf;
+			uint64_t file_size;
+			// Time (steady clock, in nanoseconds) before which the file is not opened again, after a failure (0 if the last
+			// attempt was successful)
+			uint64_t open_retry_ns;
+		} stream_t;
+
+		void writerLoop();
+		void writeRow(const metricsRow_t &row);
+		// This function opens the file of a stream, writing the header if the file is empty
+		// If the file cannot be opened, a warning is printed only for the first failure, and the file is not opened again for
+		// METRICSSINK_OPEN_RETRY_INTERVAL_S seconds
+		bool openStreamFile(stream_t &stream);
+		// This function closes the file of a stream, shifts the older files (<name>.1.csv to <name>.2.csv, and so on) and
+		// renames it to <name>.1.csv
+		void rotateStreamFile(stream_t &stream);
+		std::string getStreamFileName(const stream_t &stream, unsigned int rotation_idx);
+
+		std::string m_directory;
+		uint64_t m_max_file_size;
+		unsigned int m_max_rotated_files;
+
+		MPMCQueue<metricsRow_t> m_queue;
+		std::atomic<uint64_t> m_dropped;
+
+		// The streams are only appended (up to METRICSSINK_MAX_STREAMS, so that they are never reallocated) and their file
+		// fields are accessed only by the writer thread
+		std::mutex m_streamsmut;
+		std::unique_ptr<stream_t[]> m_streams;
+		std::atomic<unsigned int> m_num_streams;
+
+		std::thread m_writer;
+		std::mutex m_writermut;
+		std::condition_variable m_writercv;
+		std::atomic<bool> m_running;
+};
+
+#endif // SLDM_METRICSSINK_H
@@ -0,0 +1,127 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Size of a cache line, used to keep the producer and consumer positions of the queue on different cache lines
+#define MPMCQUEUE_CACHE_LINE_SIZE 64
+
+// Bounded, lock-free, multi-producer multi-consumer FIFO queue (based on Dmitry Vyukov's bounded MPMC queue)
+// Each slot of the ring buffer has its own sequence number, which tells producers and consumers whether the slot is free
+// or whether it contains an element, so that a push() or a pop() only needs a single compare-and-swap on the shared
+// position, and producers and consumers never wait for each other (unless the queue is full or empty)
+// The capacity is rounded up to the next power of two
+// "T" must be default-constructible and move-assignable
+template <typename T> class MPMCQueue {
+	public:
+		MPMCQueue(size_t capacity) {
+			m_capacity = 2;
+
+			while(m_capacity < capacity) {
+				m_capacity <<= 1;
+			}
+
+			m_mask = m_capacity - 1;
+			m_cells = std::unique_ptr<cell_t[]>(new cell_t[m_capacity]);
+
+			for(size_t i=0;i<m_capacity;i++) {
+				m_cells[i].sequence.store(i,std::memory_order_relaxed);
+			}
+
+			m_enqueue_pos.store(0,std::memory_order_relaxed);
+			m_dequeue_pos.store(0,std::memory_order_relaxed);
+		}
+
+		MPMCQueue(const MPMCQueue &) = delete;
+		MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+		// This function moves "data" into the queue
+		// It returns 'false' (leaving "data" untouched) if the queue is full
+		bool push(T &data) {
+			cell_t *cell;
+			size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+			for(;;) {
+				cell = &m_cells[pos & m_mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+				if(diff == 0) {
+					// The slot is free: try to reserve it
+					if(m_enqueue_pos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) {
+						break;
+					}
+				} else if(diff < 0) {
+					// The slot still contains an element which has not been consumed yet: the queue is full
+					return false;
+				} else {
+					// Another producer reserved this slot in the meantime
+					pos = m_enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->data = std::move(data);
+			cell->sequence.store(pos+1,std::memory_order_release);
+
+			return true;
+		}
+
+		// This function moves the oldest element of the queue into "data"
+		// It returns 'false' (leaving "data" untouched) if the queue is empty
+		bool pop(T &data) {
+			cell_t *cell;
+			size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+			for(;;) {
+				cell = &m_cells[pos & m_mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos+1);
+
+				if(diff == 0) {
+					// The slot contains an element: try to reserve it
+					if(m_dequeue_pos.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed)) {
+						break;
+					}
+				} else if(diff < 0) {
+					// The slot has not been filled yet: the queue is empty
+					return false;
+				} else {
+					// Another consumer reserved this slot in the meantime
+					pos = m_dequeue_pos.load(std::memory_order_relaxed);
+				}
+			}
+
+			data = std::move(cell->data);
+			cell->sequence.store(pos+m_mask+1,std::memory_order_release);
+
+			return true;
+		}
+
+		// Approximate number of elements stored in the queue (exact only if no push() or pop() is in progress)
+		size_t size() {
+			size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+			size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+			return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+		}
+
+		size_t capacity() {return m_capacity;}
+	private:
+		typedef struct {
+			std::atomic<size_t> sequence;
+			T data;
+		} cell_t;
+
+		std::unique_ptr<cell_t[]> m_cells;
+		size_t m_capacity;
+		size_t m_mask;
+
+		alignas(MPMCQUEUE_CACHE_LINE_SIZE) std::atomic<size_t> m_enqueue_pos;
+		alignas(MPMCQUEUE_CACHE_LINE_SIZE) std::atomic<size_t> m_dequeue_pos;
+};
+
+#endif // MPMCQUEUE_H
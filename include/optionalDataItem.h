@@ -16,7 +16,7 @@ namespace ldmmap{
 		OptionalDataItem() {m_available=false;}
 		T getData() {return m_dataitem;}
 		bool isAvailable() {return m_available;}
-		T setData(T data) {m_dataitem=data; m_available=true;}
+		void setData(T data) {m_dataitem=data; m_available=true;}
 	};
 }
 
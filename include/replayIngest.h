@@ -0,0 +1,114 @@
+#ifndef SLDM_REPLAY_INGEST_H
+#define SLDM_REPLAY_INGEST_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "ingestPipeline.h"
+
+// Recording files (written by IngestRecorder) start with this magic string, followed by a sequence of records, each one made of
+// an ingestRecordHeader_t, of the quadkey property (quadkey_len bytes, without the terminating NUL) and of the payload (payload_len bytes)
+// All the fields are stored in the byte order of the host (little endian on all the supported platforms)
+#define INGESTRECORDER_FILE_MAGIC "SLDMREC1"
+
+// Flags of each record
+#define INGESTRECORDER_FLAG_PROPERTIES_AVAILABLE 0x01
+#define INGESTRECORDER_FLAG_GN_TIMESTAMP_AVAILABLE 0x02
+
+typedef struct ingestRecordHeader {
+	uint64_t rx_timestamp_us; // Reception timestamp of the message (used to replay the messages at the recorded speed)
+	uint64_t gn_timestamp; // GeoNetworking timestamp property
+	uint32_t payload_len;
+	uint16_t quadkey_len;
+	uint8_t flags;
+	uint8_t reserved;
+} ingestRecordHeader_t;
+
+static_assert(sizeof(ingestRecordHeader_t)==24,"ingestRecordHeader_t must be 24 bytes long");
+
+// Recorder of the messages received by the ingest sources (e.g., an AMQPClient), together with the message properties which
+// are needed to process them, to be replayed later with ReplayIngest
+class IngestRecorder {
+	public:
+		IngestRecorder();
+		~IngestRecorder();
+
+		IngestRecorder(const IngestRecorder &) = delete;
+		IngestRecorder &operator=(const IngestRecorder &) = delete;
+
+		// This function creates (or overwrites) the recording file and returns 'false' if it cannot be created
+		bool open(const std::string &filename);
+		void close();
+
+		// This function appends a message to the recording (it can be called by any thread)
+		void record(const ingestMessage_t &msg);
+
+		uint64_t getRecordedCount() {return m_recorded_cnt;}
+	private:
+		std::mutex m_filemut;
+		FILE *m_file;
+		std::atomic<uint64_t> m_recorded_cnt;
+};
+
+// Ingest source replaying the messages stored in a capture file, for offline (and repeatable) throughput and latency measurements
+// Two kinds of files are supported (the kind is detected from the content of the file):
+// - pcap/pcapng captures (read with libpcap), containing GeoNetworking packets over Ethernet (EtherType 0x8947, optionally inside
+//   a VLAN tag) or Linux "cooked" captures, as the evidence.pcap file written by the misbehaviour detector; the GeoNetworking timestamp
+//   is read by the decoder from the packet itself
+// - recordings written by IngestRecorder, also including the AMQP message properties needed to process the messages
+// The messages are passed to "rx_fcn" (with the current time as reception timestamp) either as fast as possible, or spaced as they
+// were recorded, with the time scaled by a "speed" factor
+class ReplayIngest {
+	public:
+		typedef enum {
+			REPLAYINGEST_FORMAT_UNKNOWN,
+			REPLAYINGEST_FORMAT_PCAP,
+			REPLAYINGEST_FORMAT_RECORDING
+		} replayIngestFormat_t;
+
+		// "speed" is the replay speed with respect to the recorded one (e.g., 2.0 to replay the messages twice as fast), or 0 to
+		// replay them as fast as possible
+		ReplayIngest(const std::string &filename, double speed, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args);
+
+		ReplayIngest(const ReplayIngest &) = delete;
+		ReplayIngest &operator=(const ReplayIngest &) = delete;
+
+		// This function replays all the messages of the file and returns when the last one has been passed to "rx_fcn" (or when
+		// stop() is called by another thread)
+		// It returns 'false' if the file cannot be opened or if its format is not supported
+		bool run();
+		void stop() {m_stop=true;}
+
+		replayIngestFormat_t getFormat() {return m_format;}
+		// Statistics: number of messages replayed, and of packets or records skipped (e.g., non-GeoNetworking frames, truncated records)
+		uint64_t getReplayedCount() {return m_replayed_cnt;}
+		uint64_t getSkippedCount() {return m_skipped_cnt;}
+	private:
+		static replayIngestFormat_t detectFormat(const std::string &filename);
+		bool runPcap();
+		bool runRecording();
+		// This function waits until the time at which the message recorded at "recorded_us" should be replayed, and then passes
+		// it to "rx_fcn"
+		void replayMessage(ingestMessage_t &msg, uint64_t recorded_us);
+
+		std::string m_filename;
+		double m_speed;
+		replayIngestFormat_t m_format;
+
+		void (*m_rx_fcn)(ingestMessage_t &,void *);
+		void *m_additional_args;
+
+		// Recorded timestamp of the first message, and time at which it has been replayed
+		bool m_first_replayed;
+		uint64_t m_first_recorded_us;
+		uint64_t m_first_replayed_us;
+
+		std::atomic<bool> m_stop;
+		std::atomic<uint64_t> m_replayed_cnt;
+		std::atomic<uint64_t> m_skipped_cnt;
+};
+
+#endif // SLDM_REPLAY_INGEST_H
@@ -0,0 +1,74 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cinttypes>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+
+// Default size of each cell of the spatial index, in meters
+#define SPATIALGRID_DEFAULT_CELL_SIZE_M 200.0
+// Minimum cell size which can be set, in meters (smaller cells would just waste memory)
+#define SPATIALGRID_MIN_CELL_SIZE_M 10.0
+
+namespace ldmmap {
+	// Secondary spatial index used by the LDMMap to speed up range queries
+	// The index divides the world into a uniform grid of cells, each one being "cell_size_m" meters wide along the
+	// latitude axis and "cell_size_m" meters (measured at the equator) wide along the longitude axis, and keeps,
+	// for each non-empty cell, the set of IDs (e.g. stationIDs) of the objects located inside it
+	// A range query will then only return the IDs stored in the cells overlapping the bounding box of the query circle
+	// The returned IDs are just "candidates": the caller is still expected to perform an exact distance check on them
+	// All the methods of this class are thread-safe
+	class SpatialGrid {
+		public:
+			SpatialGrid();
+			SpatialGrid(double cell_size_m);
+
+			// This function inserts a new object in the index or, if it is already stored, moves it to the cell
+			// corresponding to the new lat and lon values
+			void update(uint64_t id, double lat, double lon);
+			// This function removes an object from the index
+			// It returns 'false' if the object was not stored inside the index, 'true' otherwise
+			bool remove(uint64_t id);
+			// This function appends to "ids" the IDs of all the objects stored in the cells overlapping the bounding box of the
+			// circle centered on lat and lon, with radius "range_m"
+			void query(double lat, double lon, double range_m, std::vector<uint64_t> &ids);
+			// This function clears the whole index
+			void clear();
+
+			// This function changes the size of the cells and rebuilds the whole index
+			// Values lower than SPATIALGRID_MIN_CELL_SIZE_M are ignored (and 'false' is returned)
+			bool setCellSize(double cell_size_m);
+			double getCellSize() {return m_cell_size_m;}
+
+			size_t getCardinality();
+		private:
+			typedef struct gridEntry {
+				uint64_t cellKey;
+				double lat;
+				double lon;
+			} gridEntry_t;
+
+			inline int32_t latToRow(double lat);
+			inline int32_t lonToCol(double lon);
+			static inline uint64_t composeCellKey(int32_t row, int32_t col) {return (static_cast<uint64_t>(static_cast<uint32_t>(row)) << 32) | static_cast<uint32_t>(col);}
+			static inline int32_t cellKeyRow(uint64_t cellKey) {return static_cast<int32_t>(cellKey >> 32);}
+			static inline int32_t cellKeyCol(uint64_t cellKey) {return static_cast<int32_t>(cellKey & 0xFFFFFFFF);}
+
+			void removeFromCell(uint64_t cellKey, uint64_t id);
+
+			double m_cell_size_m;
+			// Size of each cell in degrees (the same value is used for both the latitude and the longitude axes)
+			double m_cell_size_deg;
+
+			// Non-empty cells, each one with the IDs of the objects located inside it
+			std::unordered_map<uint64_t,std::vector<uint64_t>> m_cells;
+			// Reverse index, storing, for each object, the cell in which it is currently located (plus its position,
+			// which is needed to rebuild the index when the cell size is changed)
+			std::unordered_map<uint64_t,gridEntry_t> m_entries;
+
+			std::shared_mutex m_gridmut;
+	};
+}
+
+#endif // SPATIALGRID_H
@@ -0,0 +1,160 @@
+#ifndef SLDM_TRAFFIC_GENERATOR_H
+#define SLDM_TRAFFIC_GENERATOR_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <atomic>
+#include <random>
+#include <vector>
+
+#include "ingestPipeline.h"
+#include "replayIngest.h"
+
+// asn1c structures of the generated messages (defined in the decoder-module asn1 headers)
+struct CAM;
+struct CPM;
+struct VAM;
+struct DENM;
+
+// Maximum size, in bytes, of an encoded Facilities layer message
+#define TRAFFICGEN_MAX_ENCODED_SIZE 16384
+
+// Station ID of the first simulated station (the following ones are numbered sequentially)
+// It is higher than the maximum object ID of the CPMs (65535), so that the perceived objects never get the ID of a station
+#define TRAFFICGEN_FIRST_STATION_ID 100000
+
+typedef enum {
+	TRAFFICGEN_CAM,
+	TRAFFICGEN_CPM,
+	TRAFFICGEN_VAM,
+	TRAFFICGEN_DENM,
+	TRAFFICGEN_NUM_MSGTYPES
+} trafficGenMsgType_t;
+
+typedef enum {
+	TRAFFICGEN_TRAJECTORY_CIRCULAR, // Each station moves along a circle inside the area
+	TRAFFICGEN_TRAJECTORY_LINEAR // Each station moves back and forth along a segment between two points of the area
+} trafficGenTrajectory_t;
+
+typedef struct trafficGenConfig {
+	unsigned int num_stations;
+	double rate; // Total number of messages per second (0 = as fast as possible)
+	double duration_s; // Duration of the generation, in seconds (0 = until stop() is called, only when feeding the S-LDM in-process)
+
+	// Area where the stations move
+	double min_lat;
+	double min_lon;
+	double max_lat;
+	double max_lon;
+
+	trafficGenTrajectory_t trajectory;
+	// Relative weight of each message type (e.g., {80,10,9,1} for 80% of CAMs, 10% of CPMs, 9% of VAMs and 1% of DENMs)
+	unsigned int weights[TRAFFICGEN_NUM_MSGTYPES];
+	unsigned int perceived_objects; // Number of perceived objects of each CPM
+	bool facility_only; // 'true' to generate CAMs and DENMs without the GeoNetworking and BTP headers
+	uint32_t seed; // Seed of the random generator (the same seed and configuration always produce the same stations, trajectories and sequence of messages, apart from their timestamps)
+} trafficGenConfig_t;
+
+// Synthetic V2X traffic generator, for repeatable load tests without a full simulation (e.g., ms-van3t)
+// It encodes CAMs, CPMs, VAMs and DENMs with the bundled asn1c code, optionally wrapped in GeoNetworking (SHB, or GBC for the
+// DENMs) and BTP-B, for a set of simulated stations moving along synthetic trajectories inside the area
+// The vehicles send the CAMs, CPMs and DENMs, while the VRUs (whose number is proportional to the weight of the VAMs) send the VAMs
+// The messages can either be passed to "rx_fcn" at the configured rate (to feed the S-LDM in-process, as the other ingest
+// sources), or written to a recording file (to be replayed with ReplayIngest), with the timestamps they would have been
+// generated at
+class TrafficGenerator {
+	public:
+		TrafficGenerator(const trafficGenConfig_t &config, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args);
+		~TrafficGenerator();
+
+		TrafficGenerator(const TrafficGenerator &) = delete;
+		TrafficGenerator &operator=(const TrafficGenerator &) = delete;
+
+		// This function generates the messages and passes them to "rx_fcn", until the configured duration has elapsed (or until
+		// stop() is called by another thread)
+		bool run();
+		// This function writes the messages of the configured duration to "recorder" (as fast as possible) and returns 'false'
+		// if the duration or the rate are not set
+		bool dump(IngestRecorder &recorder);
+		void stop() {m_stop=true;}
+
+		// Statistics: number of generated messages (in total and per type), and of messages which could not be encoded
+		uint64_t getGeneratedCount() {return m_generated_cnt;}
+		uint64_t getGeneratedCount(trafficGenMsgType_t type) {return m_generated_type_cnt[type];}
+		uint64_t getEncodeErrorCount() {return m_encode_error_cnt;}
+
+		static const char *getMsgTypeName(trafficGenMsgType_t type);
+	private:
+		typedef struct trafficGenStation {
+			uint32_t stationID;
+			long stationType;
+			bool vru;
+			double speed_ms;
+			// Center (circular trajectory) or end points (linear trajectory) of the trajectory, in meters from the center of the area
+			double x0,y0;
+			double x1,y1;
+			double radius;
+			// Initial angle (circular trajectory) or distance from the first end point (linear trajectory)
+			double phase;
+			long denm_seq;
+		} trafficGenStation_t;
+
+		typedef struct trafficGenKinematics {
+			double lat;
+			double lon;
+			double heading; // Degrees, clockwise from North
+			double speed_ms;
+			double yaw_rate; // Degrees per second, positive to the left
+			double curvature; // 1/m, positive to the left
+		} trafficGenKinematics_t;
+
+		void createStations();
+		void allocateMessages();
+		trafficGenKinematics_t getKinematics(const trafficGenStation_t &station, uint64_t t_us);
+		trafficGenStation_t &nextStation(bool vru);
+
+		// This function generates the next message (with the type drawn according to the weights) at the time "t_us" (in
+		// microseconds since the epoch) and returns 'false' if it cannot be encoded
+		bool generateMessage(uint64_t t_us, ingestMessage_t &msg);
+		ssize_t encodeCAM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us);
+		ssize_t encodeCPM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us);
+		ssize_t encodeVAM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us);
+		ssize_t encodeDENM(trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us);
+		// This function prepends the GeoNetworking (SHB, or GBC centered on the sender if "gbc_radius_m" is greater than 0) and
+		// BTP-B headers to the first "len" bytes of the encoding buffer
+		void wrapGNBTP(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us, uint16_t btp_port,
+			uint16_t gbc_radius_m, size_t len, std::vector<uint8_t> &packet);
+
+		trafficGenConfig_t m_config;
+
+		void (*m_rx_fcn)(ingestMessage_t &,void *);
+		void *m_additional_args;
+
+		std::mt19937 m_rng;
+		std::discrete_distribution<int> m_type_dist;
+
+		std::vector<trafficGenStation_t> m_stations;
+		// The vehicles are the first m_num_vehicles stations, the VRUs the remaining ones
+		unsigned int m_num_vehicles;
+		unsigned int m_next_vehicle;
+		unsigned int m_next_vru;
+
+		// Center of the area, used as origin of the local coordinates of the trajectories
+		double m_center_lat;
+		double m_center_lon;
+		uint64_t m_start_us;
+
+		// The messages are allocated once, and only their dynamic fields are updated before encoding each of them
+		struct CAM *m_cam;
+		struct CPM *m_cpm;
+		struct VAM *m_vam;
+		struct DENM *m_denm;
+		std::vector<uint8_t> m_encbuf;
+
+		std::atomic<bool> m_stop;
+		std::atomic<uint64_t> m_generated_cnt;
+		std::atomic<uint64_t> m_generated_type_cnt[TRAFFICGEN_NUM_MSGTYPES];
+		std::atomic<uint64_t> m_encode_error_cnt;
+};
+
+#endif // SLDM_TRAFFIC_GENERATOR_H
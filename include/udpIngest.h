@@ -0,0 +1,66 @@
+#ifndef SLDM_UDP_INGEST_H
+#define SLDM_UDP_INGEST_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ingestPipeline.h"
+
+// Maximum number of datagrams which are read with a single recvmmsg() call
+#define UDPINGEST_BATCH_SIZE 64
+// Maximum size, in bytes, of each datagram (longer datagrams are truncated and discarded)
+#define UDPINGEST_MAX_DATAGRAM_SIZE 4096
+// Maximum time, in milliseconds, the receiving thread waits for new datagrams before checking if it has been stopped
+#define UDPINGEST_RECV_TIMEOUT_MS 100
+// Size, in bytes, requested for the kernel receive buffer of the socket (to absorb bursts of datagrams)
+#define UDPINGEST_SOCKET_RCVBUF_SIZE (8*1024*1024)
+
+// Ingest source receiving raw ITS messages (GeoNetworking+BTP+Facilities packets, or Facilities-only packets, one per datagram)
+// over UDP, without going through an AMQP broker
+// A dedicated thread reads the datagrams in batches of up to UDPINGEST_BATCH_SIZE with recvmmsg() (i.e., with a single system
+// call per batch) and passes each datagram to "rx_fcn" as an ingestMessage_t (without any message property), exactly as they
+// would be received by an AMQPClient
+class UDPIngest {
+	public:
+		// "bind_address" is the IPv4 address to bind to ("" or "0.0.0.0" to receive on all the interfaces)
+		UDPIngest(const std::string &bind_address, uint16_t port, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args);
+		~UDPIngest();
+
+		UDPIngest(const UDPIngest &) = delete;
+		UDPIngest &operator=(const UDPIngest &) = delete;
+
+		// This function opens the socket and starts the receiving thread
+		// It returns 'false' if the socket cannot be created or bound
+		bool start();
+		// This function terminates the receiving thread (within UDPINGEST_RECV_TIMEOUT_MS) and closes the socket
+		void stop();
+
+		bool isRunning() {return m_running;}
+
+		// Statistics: number of datagrams received, of recvmmsg() calls returning at least one datagram, and of datagrams
+		// discarded because longer than UDPINGEST_MAX_DATAGRAM_SIZE
+		uint64_t getReceivedCount() {return m_rx_cnt;}
+		uint64_t getBatchCount() {return m_batch_cnt;}
+		uint64_t getTruncatedCount() {return m_truncated_cnt;}
+	private:
+		void receiverLoop();
+
+		std::string m_bind_address;
+		uint16_t m_port;
+		int m_sockfd;
+
+		void (*m_rx_fcn)(ingestMessage_t &,void *);
+		void *m_additional_args;
+
+		std::thread m_receiver;
+		std::atomic<bool> m_running;
+
+		std::atomic<uint64_t> m_rx_cnt;
+		std::atomic<uint64_t> m_batch_cnt;
+		std::atomic<uint64_t> m_truncated_cnt;
+};
+
+#endif // SLDM_UDP_INGEST_H
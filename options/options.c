@@ -53,6 +53,31 @@
 #define LONGOPT_enable_ext_lights_hijack "enable-ext-lights-hijack"
 #define LONGOPT_enable_interop_hijack "enable-interop-hijack"
 #define LONGOPT_disable_misbehaviour_detector "disable-misbehaviour-detector"
+#define LONGOPT_spatial_index_cell_size "spatial-index-cell-size"
+#define LONGOPT_db_shards "db-shards"
+#define LONGOPT_ingest_workers "ingest-workers"
+#define LONGOPT_ingest_queue_size "ingest-queue-size"
+#define LONGOPT_amqp_credit_low_watermark "amqp-credit-low-watermark"
+#define LONGOPT_amqp_credit_high_watermark "amqp-credit-high-watermark"
+#define LONGOPT_cpm_enu_projection "cpm-enu-projection"
+#define LONGOPT_log_binary "log-binary"
+#define LONGOPT_metrics_dir "metrics-dir"
+#define LONGOPT_metrics_max_file_size "metrics-max-file-size"
+#define LONGOPT_udp_ingest_port "udp-ingest-port"
+#define LONGOPT_udp_ingest_address "udp-ingest-address"
+#define LONGOPT_replay_file "replay-file"
+#define LONGOPT_replay_speed "replay-speed"
+#define LONGOPT_record_file "record-file"
+#define LONGOPT_generator_stations "generator-stations"
+#define LONGOPT_generator_rate "generator-rate"
+#define LONGOPT_generator_duration "generator-duration"
+#define LONGOPT_generator_mix "generator-mix"
+#define LONGOPT_generator_perceived_objects "generator-perceived-objects"
+#define LONGOPT_generator_trajectory "generator-trajectory"
+#define LONGOPT_generator_facility_only "generator-facility-only"
+#define LONGOPT_generator_dump_file "generator-dump-file"
+#define LONGOPT_generator_seed "generator-seed"
+#define LONGOPT_disable_fast_cam_decoding "disable-fast-cam-decoding"
 // The corresponding "val"s are used internally and they should be set as sequential integers starting from 256 (the range 320-399 should not be used as it is reserved to the AMQP broker long options)
 #define LONGOPT_vehviz_update_interval_sec_val 256
 #define LONGOPT_indicator_trgman_disable_val 257
@@ -65,6 +90,31 @@
 #define LONGOPT_enable_ext_lights_hijack_val 264
 #define LONGOPT_enable_interop_hijack_val 265
 #define LONGOPT_disable_misbehaviour_detector_val 266
+#define LONGOPT_spatial_index_cell_size_val 267
+#define LONGOPT_db_shards_val 268
+#define LONGOPT_ingest_workers_val 269
+#define LONGOPT_ingest_queue_size_val 270
+#define LONGOPT_amqp_credit_low_watermark_val 271
+#define LONGOPT_amqp_credit_high_watermark_val 272
+#define LONGOPT_cpm_enu_projection_val 273
+#define LONGOPT_log_binary_val 274
+#define LONGOPT_metrics_dir_val 275
+#define LONGOPT_metrics_max_file_size_val 276
+#define LONGOPT_udp_ingest_port_val 277
+#define LONGOPT_udp_ingest_address_val 278
+#define LONGOPT_replay_file_val 279
+#define LONGOPT_replay_speed_val 280
+#define LONGOPT_record_file_val 281
+#define LONGOPT_generator_stations_val 282
+#define LONGOPT_generator_rate_val 283
+#define LONGOPT_generator_duration_val 284
+#define LONGOPT_generator_mix_val 285
+#define LONGOPT_generator_perceived_objects_val 286
+#define LONGOPT_generator_trajectory_val 287
+#define LONGOPT_generator_facility_only_val 288
+#define LONGOPT_generator_dump_file_val 289
+#define LONGOPT_generator_seed_val 290
+#define LONGOPT_disable_fast_cam_decoding_val 291
 
 // AMQP broker (additional)
 #define LONGOPT_amqp_enable_additionals "amqp-enable-additionals"
@@ -131,6 +181,31 @@ static const struct option long_opts[]={
 	{LONGOPT_enable_ext_lights_hijack,			no_argument,		NULL, LONGOPT_enable_ext_lights_hijack_val},
 	{LONGOPT_enable_interop_hijack,			no_argument,		NULL, LONGOPT_enable_interop_hijack_val},
 	{LONGOPT_disable_misbehaviour_detector,			no_argument,		NULL, LONGOPT_disable_misbehaviour_detector_val},
+	{LONGOPT_spatial_index_cell_size,			required_argument,	NULL, LONGOPT_spatial_index_cell_size_val},
+	{LONGOPT_db_shards,			required_argument,	NULL, LONGOPT_db_shards_val},
+	{LONGOPT_ingest_workers,			required_argument,	NULL, LONGOPT_ingest_workers_val},
+	{LONGOPT_ingest_queue_size,			required_argument,	NULL, LONGOPT_ingest_queue_size_val},
+	{LONGOPT_amqp_credit_low_watermark,			required_argument,	NULL, LONGOPT_amqp_credit_low_watermark_val},
+	{LONGOPT_amqp_credit_high_watermark,			required_argument,	NULL, LONGOPT_amqp_credit_high_watermark_val},
+	{LONGOPT_cpm_enu_projection,			no_argument,	NULL, LONGOPT_cpm_enu_projection_val},
+	{LONGOPT_log_binary,			no_argument,	NULL, LONGOPT_log_binary_val},
+	{LONGOPT_metrics_dir,			required_argument,	NULL, LONGOPT_metrics_dir_val},
+	{LONGOPT_metrics_max_file_size,			required_argument,	NULL, LONGOPT_metrics_max_file_size_val},
+	{LONGOPT_udp_ingest_port,			required_argument,	NULL, LONGOPT_udp_ingest_port_val},
+	{LONGOPT_udp_ingest_address,			required_argument,	NULL, LONGOPT_udp_ingest_address_val},
+	{LONGOPT_replay_file,			required_argument,	NULL, LONGOPT_replay_file_val},
+	{LONGOPT_replay_speed,			required_argument,	NULL, LONGOPT_replay_speed_val},
+	{LONGOPT_record_file,			required_argument,	NULL, LONGOPT_record_file_val},
+	{LONGOPT_generator_stations,			required_argument,	NULL, LONGOPT_generator_stations_val},
+	{LONGOPT_generator_rate,			required_argument,	NULL, LONGOPT_generator_rate_val},
+	{LONGOPT_generator_duration,			required_argument,	NULL, LONGOPT_generator_duration_val},
+	{LONGOPT_generator_mix,			required_argument,	NULL, LONGOPT_generator_mix_val},
+	{LONGOPT_generator_perceived_objects,			required_argument,	NULL, LONGOPT_generator_perceived_objects_val},
+	{LONGOPT_generator_trajectory,			required_argument,	NULL, LONGOPT_generator_trajectory_val},
+	{LONGOPT_generator_facility_only,			no_argument,	NULL, LONGOPT_generator_facility_only_val},
+	{LONGOPT_generator_dump_file,			required_argument,	NULL, LONGOPT_generator_dump_file_val},
+	{LONGOPT_generator_seed,			required_argument,	NULL, LONGOPT_generator_seed_val},
+	{LONGOPT_disable_fast_cam_decoding,			no_argument,	NULL, LONGOPT_disable_fast_cam_decoding_val},
 
 	// Additional AMQP clients options
 	{LONGOPT_amqp_enable_additionals,					required_argument,		NULL, LONGOPT_amqp_enable_additionals_val},
@@ -351,6 +426,126 @@ static const struct option long_opts[]={
 	"\t  any received message will be stored without running checks on it, messages can still be discarded by other checks,\n" \
 	"\t  eg. position filtering that is always enabled or ageCheck that is managed by its own option.\n" \
 
+#define OPT_spatial_index_cell_size \
+	"  --"LONGOPT_spatial_index_cell_size" <size in meters>: advanced option: set the size of the cells of the spatial\n" \
+	"\t  index used by the database to speed up the selection of the vehicles located inside a given area. Smaller cells\n" \
+	"\t  make small range queries faster, at the cost of more index updates when vehicles move. This value cannot be less\n" \
+	"\t  than 10 m. Default: ("STRINGIFY(DEFAULT_SPATIAL_INDEX_CELL_SIZE_M)" m).\n"
+
+#define OPT_db_shards \
+	"  --"LONGOPT_db_shards" <number of shards>: advanced option: set the number of shards (i.e., independently locked\n" \
+	"\t  partitions) of the vehicle database. A higher number of shards reduces lock contention when many messages are\n" \
+	"\t  processed in parallel. The value is rounded up to the next power of two and it must be between 1 and 1024.\n" \
+	"\t  Default: ("STRINGIFY(DEFAULT_DB_SHARDS)").\n"
+
+#define OPT_ingest_workers \
+	"  --"LONGOPT_ingest_workers" <number of workers>: advanced option: set the number of worker threads decoding the received\n" \
+	"\t  messages and updating the database. The AMQP clients only enqueue each message to one of the workers, selected\n" \
+	"\t  depending on the sender stationID (so that the messages of the same vehicle are always processed in order). If set\n" \
+	"\t  to 0, each message is processed directly by the AMQP client which received it. It must be between 0 and 256.\n" \
+	"\t  Default: ("STRINGIFY(DEFAULT_INGEST_WORKERS)").\n"
+
+#define OPT_ingest_queue_size \
+	"  --"LONGOPT_ingest_queue_size" <number of messages>: advanced option: set the capacity of the queue of each ingest\n" \
+	"\t  worker. When a queue is full, the AMQP client waits for the worker to free some space, instead of dropping messages.\n" \
+	"\t  The value is rounded up to the next power of two and it must be at least 2. Default: ("STRINGIFY(DEFAULT_INGEST_QUEUE_SIZE)").\n"
+
+#define OPT_amqp_credit_low_watermark \
+	"  --"LONGOPT_amqp_credit_low_watermark" <number of messages>: advanced option: set the low watermark of the AMQP flow\n" \
+	"\t  control. Each AMQP client grants new credit to its broker only when the number of pending messages (i.e., messages\n" \
+	"\t  waiting to be processed, plus the ones the broker is still allowed to send) falls to this value. It must be at least\n" \
+	"\t  1 and lower than the high watermark. Default: ("STRINGIFY(DEFAULT_AMQP_CREDIT_LOW_WATERMARK)").\n"
+
+#define OPT_amqp_credit_high_watermark \
+	"  --"LONGOPT_amqp_credit_high_watermark" <number of messages>: advanced option: set the high watermark of the AMQP flow\n" \
+	"\t  control, i.e., the maximum number of pending messages of each AMQP client. The actual limit is reduced (down to\n" \
+	"\t  slightly more than the low watermark) when the processing latency grows, and it is increased again up to this value\n" \
+	"\t  when the latency goes back to normal. It must be at most 1000000. Default: ("STRINGIFY(DEFAULT_AMQP_CREDIT_HIGH_WATERMARK)").\n"
+
+#define OPT_cpm_enu_projection \
+	"  --"LONGOPT_cpm_enu_projection": advanced option: compute the position of the objects received through CPMs with a local\n" \
+	"\t  tangent plane (East-North-Up) approximation around the sender, instead of the default Transverse Mercator projection.\n" \
+	"\t  It is much faster, and its error is below 1 mm for objects within 1 km from the sender.\n"
+
+#define OPT_log_binary \
+	"  --"LONGOPT_log_binary": advanced option: write the log file (see -L) in a compact binary format instead of text, to further\n" \
+	"\t  reduce the logging overhead. The binary log can be converted to the usual text format with SLDM-binlog-decoder.\n"
+
+#define OPT_metrics_dir \
+	"  --"LONGOPT_metrics_dir" <directory>: advanced option: set the directory where the CSV files with the timing metrics\n" \
+	"\t  (e.g., DENMtimestamps_25v.csv for the processing times of the DENMs) are written. Default: (current directory).\n"
+
+#define OPT_metrics_max_file_size \
+	"  --"LONGOPT_metrics_max_file_size" <size in MB>: advanced option: set the size after which each metrics file is rotated\n" \
+	"\t  (the most recent rotated files are kept as <name>.1.csv, <name>.2.csv, and so on).\n" \
+	"\t  0 can be specified to never rotate the files. Default: ("STRINGIFY(DEFAULT_METRICS_MAX_FILE_SIZE_MB)").\n"
+
+#define OPT_udp_ingest_port \
+	"  --"LONGOPT_udp_ingest_port" <port>: receive the ITS messages (GeoNetworking+BTP+Facilities, or Facilities-only, one per\n" \
+	"\t  datagram) directly over UDP on the specified port, instead of from the main AMQP broker (the additional AMQP clients,\n" \
+	"\t  if any, are still used). Default: (disabled).\n"
+
+#define OPT_udp_ingest_address \
+	"  --"LONGOPT_udp_ingest_address" <IPv4 address>: set the local address the UDP ingest socket is bound to (see --"LONGOPT_udp_ingest_port").\n" \
+	"\t  Default: (all the interfaces).\n"
+
+#define OPT_replay_file \
+	"  --"LONGOPT_replay_file" <file>: offline benchmark mode: instead of connecting to the main AMQP broker, process all the messages\n" \
+	"\t  stored in the specified pcap/pcapng capture (GeoNetworking over Ethernet, as evidence.pcap) or recording (see --"LONGOPT_record_file"),\n" \
+	"\t  then print the throughput and the latency percentiles of each processing stage and terminate. Default: (disabled).\n"
+
+#define OPT_replay_speed \
+	"  --"LONGOPT_replay_speed" <factor>: replay the messages (see --"LONGOPT_replay_file") spaced as they were recorded, with the\n" \
+	"\t  time scaled by the specified factor (e.g., 1 for the recorded speed, 2 for twice as fast), or as fast as possible if 0\n" \
+	"\t  is specified. Default: (0).\n"
+
+#define OPT_record_file \
+	"  --"LONGOPT_record_file" <file>: record all the messages received from the AMQP brokers (or over UDP), together with their\n" \
+	"\t  properties, in the specified file, to be replayed later with --"LONGOPT_replay_file". Default: (disabled).\n"
+
+#define OPT_generator_stations \
+	"  --"LONGOPT_generator_stations" <number>: load test mode: instead of connecting to the main AMQP broker, process the CAMs, CPMs,\n" \
+	"\t  VAMs and DENMs of the specified number of synthetic stations, moving inside the S-LDM coverage internal area (see -A),\n" \
+	"\t  then print the throughput and the latency percentiles of each processing stage and terminate. Default: (disabled).\n"
+
+#define OPT_generator_rate \
+	"  --"LONGOPT_generator_rate" <messages/s>: set the total rate of the generated messages (see --"LONGOPT_generator_stations"),\n" \
+	"\t  or 0 to generate them as fast as possible. Default: ("STRINGIFY(DEFAULT_GENERATOR_RATE)").\n"
+
+#define OPT_generator_duration \
+	"  --"LONGOPT_generator_duration" <seconds>: set the duration of the traffic generation (see --"LONGOPT_generator_stations"),\n" \
+	"\t  or 0 to generate messages until the S-LDM is terminated. Default: ("STRINGIFY(DEFAULT_GENERATOR_DURATION_S)").\n"
+
+#define OPT_generator_mix \
+	"  --"LONGOPT_generator_mix" <CAM,CPM,VAM,DENM>: set the relative weights of the generated message types (e.g., 80,10,9,1 for\n" \
+	"\t  80%% of CAMs, 10%% of CPMs, 9%% of VAMs and 1%% of DENMs). Default: ("DEFAULT_GENERATOR_MIX").\n"
+
+#define OPT_generator_perceived_objects \
+	"  --"LONGOPT_generator_perceived_objects" <number>: set the number of perceived objects of each generated CPM (0-255).\n" \
+	"\t  Default: ("STRINGIFY(DEFAULT_GENERATOR_PERCEIVED_OBJECTS)").\n"
+
+#define OPT_generator_trajectory \
+	"  --"LONGOPT_generator_trajectory" <circular|linear>: set the trajectory of the generated stations: circles or segments\n" \
+	"\t  (travelled back and forth) inside the area. Default: (circular).\n"
+
+#define OPT_generator_facility_only \
+	"  --"LONGOPT_generator_facility_only": generate the CAMs and DENMs without the GeoNetworking and BTP headers (the CPMs and\n" \
+	"\t  VAMs always include them).\n"
+
+#define OPT_generator_dump_file \
+	"  --"LONGOPT_generator_dump_file" <file>: write the generated messages (for the configured duration, at the configured rate)\n" \
+	"\t  to the specified file, to be replayed later with --"LONGOPT_replay_file", instead of processing them, then terminate.\n" \
+	"\t  Default: (disabled).\n"
+
+#define OPT_generator_seed \
+	"  --"LONGOPT_generator_seed" <seed>: set the seed of the traffic generator (the same seed produces the same stations and\n" \
+	"\t  sequence of messages). Default: ("STRINGIFY(DEFAULT_GENERATOR_SEED)").\n"
+
+#define OPT_disable_fast_cam_decoding \
+	"  --"LONGOPT_disable_fast_cam_decoding": advanced option: decode all the received CAMs with the full ASN.1 decoder. By default,\n" \
+	"\t  the CAMs are decoded by a faster decoder which extracts only the fields stored by the S-LDM, and which does not check\n" \
+	"\t  the part of the message following them (e.g., the path history).\n"
+
 static void print_long_info(char *argv0) {
 	fprintf(stdout,"\nUsage: %s [-A S-LDM coverage internal area] [options]\n"
 		"%s [-h | --"LONGOPT_h"]: print help and show options\n"
@@ -390,6 +585,31 @@ static void print_long_info(char *argv0) {
 		OPT_amqp_main_reconn_local_timeout_exp
 		OPT_brokers_enable_description
 		OPT_disable_misbehaviour_detector
+		OPT_spatial_index_cell_size
+		OPT_db_shards
+		OPT_ingest_workers
+		OPT_ingest_queue_size
+		OPT_amqp_credit_low_watermark
+		OPT_amqp_credit_high_watermark
+		OPT_cpm_enu_projection
+		OPT_log_binary
+		OPT_metrics_dir
+		OPT_metrics_max_file_size
+		OPT_udp_ingest_port
+		OPT_udp_ingest_address
+		OPT_replay_file
+		OPT_replay_speed
+		OPT_record_file
+		OPT_generator_stations
+		OPT_generator_rate
+		OPT_generator_duration
+		OPT_generator_mix
+		OPT_generator_perceived_objects
+		OPT_generator_trajectory
+		OPT_generator_facility_only
+		OPT_generator_dump_file
+		OPT_generator_seed
+		OPT_disable_fast_cam_decoding
 		,
 		argv0,argv0,argv0);
 
@@ -486,6 +706,32 @@ void options_initialize(struct options *options) {
 
 	options->od_json_interface_enabled=false;
 	options->od_json_interface_port=DEFAULT_OD_JSON_OVER_TCP_INTERFACE_PORT;
+
+	options->spatial_index_cell_size=DEFAULT_SPATIAL_INDEX_CELL_SIZE_M;
+	options->db_shards=DEFAULT_DB_SHARDS;
+	options->ingest_workers=DEFAULT_INGEST_WORKERS;
+	options->ingest_queue_size=DEFAULT_INGEST_QUEUE_SIZE;
+	options->amqp_credit_low_watermark=DEFAULT_AMQP_CREDIT_LOW_WATERMARK;
+	options->amqp_credit_high_watermark=DEFAULT_AMQP_CREDIT_HIGH_WATERMARK;
+	options->cpm_enu_projection=false;
+	options->log_binary=false;
+	options->metrics_dir=options_string_declare();
+	options->metrics_max_file_size=DEFAULT_METRICS_MAX_FILE_SIZE_MB;
+	options->udp_ingest_port=0;
+	options->udp_ingest_address=options_string_declare();
+	options->replay_file=options_string_declare();
+	options->replay_speed=0.0;
+	options->record_file=options_string_declare();
+	options->generator_stations=0;
+	options->generator_rate=DEFAULT_GENERATOR_RATE;
+	options->generator_duration=DEFAULT_GENERATOR_DURATION_S;
+	sscanf(DEFAULT_GENERATOR_MIX,"%ld,%ld,%ld,%ld",&options->generator_mix[0],&options->generator_mix[1],&options->generator_mix[2],&options->generator_mix[3]);
+	options->generator_perceived_objects=DEFAULT_GENERATOR_PERCEIVED_OBJECTS;
+	options->generator_linear_trajectory=false;
+	options->generator_facility_only=false;
+	options->generator_dump_file=options_string_declare();
+	options->generator_seed=DEFAULT_GENERATOR_SEED;
+	options->fast_cam_decoding=true;
 }
 
 unsigned int parse_options(int argc, char **argv, struct options *options) {
@@ -768,6 +1014,260 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 				options->MBDetector_enabled=false;
 				break;
 
+			case LONGOPT_spatial_index_cell_size_val:
+				errno=0; // Setting errno to 0 as suggested in the strtod() man page
+				options->spatial_index_cell_size=strtod(optarg,&sPtr);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_spatial_index_cell_size ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->spatial_index_cell_size<10.0) {
+					fprintf(stderr,"Error in parsing the spatial index cell size. Remember that it cannot be less than 10 m.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_db_shards_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->db_shards=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_db_shards ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->db_shards<1 || options->db_shards>1024) {
+					fprintf(stderr,"Error in parsing the number of database shards. Remember that it must be between 1 and 1024.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_ingest_workers_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->ingest_workers=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_ingest_workers ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->ingest_workers<0 || options->ingest_workers>256) {
+					fprintf(stderr,"Error in parsing the number of ingest workers. Remember that it must be between 0 and 256.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_ingest_queue_size_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->ingest_queue_size=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_ingest_queue_size ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->ingest_queue_size<2) {
+					fprintf(stderr,"Error in parsing the ingest queue size. Remember that it must be at least 2.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_amqp_credit_low_watermark_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->amqp_credit_low_watermark=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_amqp_credit_low_watermark ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->amqp_credit_low_watermark<1) {
+					fprintf(stderr,"Error in parsing the AMQP credit low watermark. Remember that it must be at least 1.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_amqp_credit_high_watermark_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->amqp_credit_high_watermark=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_amqp_credit_high_watermark ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->amqp_credit_high_watermark<2 || options->amqp_credit_high_watermark>1000000) {
+					fprintf(stderr,"Error in parsing the AMQP credit high watermark. Remember that it must be between 2 and 1000000.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_cpm_enu_projection_val:
+				options->cpm_enu_projection=true;
+				break;
+
+			case LONGOPT_log_binary_val:
+				options->log_binary=true;
+				break;
+
+			case LONGOPT_metrics_dir_val:
+				if(!options_string_push(&(options->metrics_dir),optarg)) {
+					fprintf(stderr,"Error in parsing the metrics directory: %s.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_metrics_max_file_size_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->metrics_max_file_size=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_metrics_max_file_size ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->metrics_max_file_size<0) {
+					fprintf(stderr,"Error in parsing the maximum size of the metrics files. Remember that it must be at least 0.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_udp_ingest_port_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->udp_ingest_port=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_udp_ingest_port ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->udp_ingest_port<1 || options->udp_ingest_port>65535) {
+					fprintf(stderr,"Error in parsing the UDP ingest port. Remember that it must be between 1 and 65535.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_udp_ingest_address_val:
+				if(!options_string_push(&(options->udp_ingest_address),optarg)) {
+					fprintf(stderr,"Error in parsing the UDP ingest address: %s.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_replay_file_val:
+				if(!options_string_push(&(options->replay_file),optarg)) {
+					fprintf(stderr,"Error in parsing the replay file name: %s.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_replay_speed_val:
+				errno=0; // Setting errno to 0 as suggested in the strtod() man page
+				options->replay_speed=strtod(optarg,&sPtr);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_replay_speed ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->replay_speed<0) {
+					fprintf(stderr,"Error in parsing the replay speed. Remember that it must be at least 0.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_record_file_val:
+				if(!options_string_push(&(options->record_file),optarg)) {
+					fprintf(stderr,"Error in parsing the record file name: %s.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_stations_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->generator_stations=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_generator_stations ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->generator_stations<1) {
+					fprintf(stderr,"Error in parsing the number of generated stations. Remember that it must be at least 1.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_rate_val:
+				errno=0; // Setting errno to 0 as suggested in the strtod() man page
+				options->generator_rate=strtod(optarg,&sPtr);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_generator_rate ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->generator_rate<0) {
+					fprintf(stderr,"Error in parsing the generation rate. Remember that it must be at least 0.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_duration_val:
+				errno=0; // Setting errno to 0 as suggested in the strtod() man page
+				options->generator_duration=strtod(optarg,&sPtr);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_generator_duration ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->generator_duration<0) {
+					fprintf(stderr,"Error in parsing the generation duration. Remember that it must be at least 0.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_mix_val:
+				if(sscanf(optarg,"%ld,%ld,%ld,%ld",
+					&options->generator_mix[0],&options->generator_mix[1],&options->generator_mix[2],&options->generator_mix[3])!=4 ||
+					options->generator_mix[0]<0 || options->generator_mix[1]<0 || options->generator_mix[2]<0 || options->generator_mix[3]<0 ||
+					options->generator_mix[0]+options->generator_mix[1]+options->generator_mix[2]+options->generator_mix[3]==0) {
+					fprintf(stderr,"Error in parsing the message mix: %s. Remember that it must be specified as <CAM>,<CPM>,<VAM>,<DENM> (non-negative weights, not all 0).\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_perceived_objects_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->generator_perceived_objects=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_generator_perceived_objects ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->generator_perceived_objects<0 || options->generator_perceived_objects>255) {
+					fprintf(stderr,"Error in parsing the number of perceived objects. Remember that it must be between 0 and 255.\n");
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_trajectory_val:
+				if(!strcmp(optarg,"circular")) {
+					options->generator_linear_trajectory=false;
+				} else if(!strcmp(optarg,"linear")) {
+					options->generator_linear_trajectory=true;
+				} else {
+					fprintf(stderr,"Error: unknown trajectory: %s. Remember that it must be either 'circular' or 'linear'.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_facility_only_val:
+				options->generator_facility_only=true;
+				break;
+
+			case LONGOPT_generator_dump_file_val:
+				if(!options_string_push(&(options->generator_dump_file),optarg)) {
+					fprintf(stderr,"Error in parsing the generator dump file name: %s.\n",optarg);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_generator_seed_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->generator_seed=strtol(optarg,&sPtr,10);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified value (--" LONGOPT_generator_seed ").\n");
+					print_short_info_err(options,argv[0]);
+				} else if(errno || options->generator_seed<0 || options->generator_seed>UINT32_MAX) {
+					fprintf(stderr,"Error in parsing the generator seed. Remember that it must be between 0 and %u.\n",UINT32_MAX);
+					print_short_info_err(options,argv[0]);
+				}
+				break;
+
+			case LONGOPT_disable_fast_cam_decoding_val:
+				options->fast_cam_decoding=false;
+				break;
+
 			// Additional AMQP clients options
 			// ----------------------------------
 			case LONGOPT_amqp_enable_additionals_val:
@@ -1024,6 +1524,13 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 		print_short_info_err(options,argv[0]);
 	}
 
+	// The AMQP flow control needs some room between the two watermarks, to grant credit in batches
+	if(options->amqp_credit_low_watermark >= options->amqp_credit_high_watermark) {
+		fprintf(stderr,"Error: the AMQP credit low watermark (%ld) must be lower than the high watermark (%ld).\n",
+			options->amqp_credit_low_watermark,options->amqp_credit_high_watermark);
+		print_short_info_err(options,argv[0]);
+	}
+
 	return 0;
 }
 
@@ -1048,5 +1555,10 @@ void options_free(struct options *options) {
 
 		options_string_free(options->ms_rest_addr);
 		options_string_free(options->vehviz_nodejs_addr);
+		options_string_free(options->metrics_dir);
+		options_string_free(options->udp_ingest_address);
+		options_string_free(options->replay_file);
+		options_string_free(options->record_file);
+		options_string_free(options->generator_dump_file);
 	}
 }
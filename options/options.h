@@ -139,6 +139,33 @@ static inline bool fill_AMQPClient_options_array_##name(char * optarg, int num_c
 // Default port for the on-demand JSON-over-TCP interface
 #define DEFAULT_OD_JSON_OVER_TCP_INTERFACE_PORT 49000
 
+// Default size, in meters, of the cells of the database spatial index
+#define DEFAULT_SPATIAL_INDEX_CELL_SIZE_M 200.0
+
+// Default number of shards of the vehicle database
+#define DEFAULT_DB_SHARDS 16
+
+// Default number of worker threads of the ingest pipeline (decoding the received messages and updating the database)
+#define DEFAULT_INGEST_WORKERS 4
+// Default capacity (in messages) of the queue of each ingest pipeline worker
+#define DEFAULT_INGEST_QUEUE_SIZE 4096
+
+// Default watermarks, in messages, for the AMQP link credit controller (messages received but not yet processed, including
+// the ones the broker is still allowed to send)
+#define DEFAULT_AMQP_CREDIT_LOW_WATERMARK 256
+#define DEFAULT_AMQP_CREDIT_HIGH_WATERMARK 1024
+
+// Default size, in MB, after which the metrics files (e.g., the DENM processing times) are rotated
+#define DEFAULT_METRICS_MAX_FILE_SIZE_MB 64
+
+// Default parameters of the synthetic traffic generator: total rate (messages per second), duration (seconds), relative weights
+// of the CAMs, CPMs, VAMs and DENMs, number of perceived objects of each CPM and seed of the random generator
+#define DEFAULT_GENERATOR_RATE 1000
+#define DEFAULT_GENERATOR_DURATION_S 60
+#define DEFAULT_GENERATOR_MIX "80,10,9,1"
+#define DEFAULT_GENERATOR_PERCEIVED_OBJECTS 10
+#define DEFAULT_GENERATOR_SEED 1
+
 // Valid options
 // Any new option should be handled in the switch-case inside parse_options() and the corresponding char should be added to VALID_OPTS
 // If an option accepts an additional argument, it is followed by ':'
@@ -204,6 +231,33 @@ typedef struct options {
 
 	bool od_json_interface_enabled; // Set to 'true' if the on-demand JSON-over-TCP interface is active on port od_json_interface_port, to 'false' otherwise
 	long od_json_interface_port; // On-demand JSON-over-TCP interface port
+
+	double spatial_index_cell_size; // Advanced option: size, in meters, of the cells of the spatial index used by the database for range queries
+	long db_shards; // Advanced option: number of shards of the vehicle database
+	long ingest_workers; // Advanced option: number of ingest pipeline worker threads (0 = process the messages in the AMQP client threads)
+	long ingest_queue_size; // Advanced option: capacity of the queue of each ingest pipeline worker
+	long amqp_credit_low_watermark; // Advanced option: number of pending messages below which new credit is granted to the AMQP brokers
+	long amqp_credit_high_watermark; // Advanced option: maximum number of pending messages (received or allowed to be sent by the AMQP brokers)
+	bool cpm_enu_projection; // Advanced option: 'true' if the position of the objects received through CPMs is computed with a local tangent plane approximation, 'false' (default) for the Transverse Mercator projection
+	bool log_binary; // Advanced option: 'true' if the log file is written in binary format (to be decoded with SLDM-binlog-decoder), 'false' (default) for text
+	options_string metrics_dir; // Advanced option: directory where the metrics CSV files are written (current directory, if not specified)
+	long metrics_max_file_size; // Advanced option: size, in MB, after which each metrics file is rotated (0 = never)
+	long udp_ingest_port; // UDP port where the ITS messages are received, instead of from the main AMQP broker (0 = disabled)
+	options_string udp_ingest_address; // Local address of the UDP ingest socket (all the interfaces, if not specified)
+	options_string replay_file; // pcap/pcapng capture or recording whose messages are processed, instead of the ones of the main AMQP broker (offline benchmark mode)
+	double replay_speed; // Replay speed with respect to the recorded one (0 = as fast as possible)
+	options_string record_file; // File where all the received messages are recorded (if specified)
+	long generator_stations; // Number of stations simulated by the synthetic traffic generator, instead of receiving the messages from the main AMQP broker (0 = disabled)
+	double generator_rate; // Total number of messages per second generated by the traffic generator (0 = as fast as possible)
+	double generator_duration; // Duration, in seconds, of the traffic generation (0 = until the S-LDM is terminated)
+	long generator_mix[4]; // Relative weights of the CAMs, CPMs, VAMs and DENMs generated by the traffic generator
+	long generator_perceived_objects; // Number of perceived objects of each generated CPM
+	bool generator_linear_trajectory; // 'true' if the generated stations move back and forth along segments, 'false' (default) along circles
+	bool generator_facility_only; // 'true' if the generated CAMs and DENMs do not include the GeoNetworking and BTP headers
+	options_string generator_dump_file; // File where the generated messages are written (as a recording to be replayed), instead of being processed (if specified)
+	long generator_seed; // Seed of the random generator of the traffic generator
+
+	bool fast_cam_decoding; // 'true' (default) if the CAMs are decoded by the fast-path decoder when possible, 'false' if they are always decoded with the full ASN.1 decoder
 } options_t;
 
 void options_initialize(struct options *options);
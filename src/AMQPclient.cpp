@@ -4,12 +4,15 @@
 #include <fstream>
 #include <iomanip>
 #include <proton/reconnect_options.hpp>
+#include <algorithm>
 #include <time.h>
+#include <chrono>
+#include <thread>
 
 #include "Seq.hpp"
 #include "SequenceOf.hpp"
 #include "asn_utils.h"
-#include "utmuts.h"
+#include "diagCounter.h"
 
 extern "C" {
 	#include "CAM.h"
@@ -20,6 +23,100 @@ extern "C" {
 
 std::atomic<bool> eventMapModified(false);
 namespace {
+	// Per-message diagnostics (printed at most once every DIAGCOUNTER_DEFAULT_INTERVAL_S seconds each, with the number of
+	// occurrences since the previous print)
+	DiagCounter diag_decode_error("[WARNING]","Cannot decode ETSI packet!");
+	DiagCounter diag_unsupported_type("[WARNING]","Message type not supported!");
+	DiagCounter diag_update_vehicle("[DEBUG]","Updating vehicle with stationID:",stdout);
+	DiagCounter diag_update_vru("[DEBUG]","Updating VRU with stationID:",stdout);
+	DiagCounter diag_update_po("[DEBUG]","Updating Perceived Object",stdout);
+	DiagCounter diag_update_event("[DEBUG]","Updating event with eventKey:",stdout);
+	DiagCounter diag_denm_start("[DEBUG]","Processing a received DENM",stdout);
+	DiagCounter diag_denm_inside("[DEBUG]","DENM inside the area filter",stdout);
+	DiagCounter diag_misbehaviour("[WARNING]","Misbehaviour detected. Message discarded. Vehicle and MB_CODE:");
+	DiagCounter diag_db_vehicle_error("[WARNING]","Insert on the database failed for vehicle");
+	DiagCounter diag_db_vru_error("[WARNING]","Insert on the database failed for VRU");
+	DiagCounter diag_db_po_error("[WARNING]","Insert on the database failed for Perceived Object");
+	DiagCounter diag_db_event_error("[WARNING]","Operation on the database failed for event");
+	DiagCounter diag_no_derived_id("[WARNING]","No derived ID available for a Perceived Object. Object and sender:");
+	DiagCounter diag_nogn_unsupported_ts("[WARNING]","Current message contains no GN and a not supported gn_timestamp property, ageCheck disabled",stdout);
+	DiagCounter diag_nogn_no_ts("[WARNING]","Current message contains no GN and no gn_timestamp property, ageCheck disabled",stdout);
+	DiagCounter diag_no_gn_timestamp("[WARNING]","Current message contains no GN timestamp, ageCheck disabled.",stdout);
+
+	// This function returns 'true' if the data with GN timestamp "rx_gnTimestamp" is older than the stored data with GN
+	// timestamp "stored_gnTimestamp", and it should thus be discarded
+	bool isStaleGNTimestamp(uint64_t rx_gnTimestamp, uint64_t stored_gnTimestamp) {
+		// According to the standard: GNTimestamp = (TAI timestamp since 2004-01-01 00:00:00) % 4294967296
+		// Due to the modulo operation, it is not enough to consider the difference between the received GNTimestamp and the one
+		// stored in the database, as this may cause issues when receiving data and the GNTimestamp values are cyclically reset
+		// at the same time
+		// We thus check the "gap" between the received numbers. Let's consider for instance: stored=4294967291, rx=3
+		// In this case the "rx" data is the most up-to-date, but a cyclical reset occurred
+		// We can then compute gap = 3 - 4294967291 = -429467288 < -300000 (-5 minutes) - ok! We keep this data even if 3 < 4294967291
+		// Let's consider instead:
+		// stored=3, rx=4294967291
+		// In this case 'rx' is not the most up to date data (it is impossible to have '3' stored in the database and then receive
+		// '4294967291', unless clock jumps occur in the car, bacause after all that time the data corresponding to '3' would have already
+		// been garbage cleaned from the database)
+		// We can then compute gap = 4294967291 - 3 = 429467288 > 300000 (5 minutes) - no! We should dicard the data we just received
+		// Let's consider now a "normal" scenario:
+		// stored=3, rx=114
+		// gap = 114 - 3 = 111 < 300000 - ok! The data is kept (it would be discarded only if gap > 300000)
+		// Finally, let's briefly analyze a final scenario:
+		// stored=4294967292, rx=4294967291
+		// It is evident how the rx data should be discarded because older than the stored one
+		// gap = rx - stored = 4294967291 - 4294967292 = -1 > -300000 (-5 minutes) - The data is correctly discarded due to the second
+		// condition in the if() clause
+		long long int gap = static_cast<long long int>(rx_gnTimestamp)-static_cast<long long int>(stored_gnTimestamp);
+
+		return (rx_gnTimestamp>stored_gnTimestamp && gap>300000) ||
+			(rx_gnTimestamp<stored_gnTimestamp && gap>-300000);
+	}
+
+	// Merge callback used by decodeCAM() to update the database with the data of a new CAM (see LDMMap::upsertVehicle())
+	bool mergeCAM(const ldmmap::vehicleData_t *oldData, ldmmap::vehicleData_t &newData, void *additional_args) {
+		camMergeArgs_t *args = static_cast<camMergeArgs_t *>(additional_args);
+
+		if(oldData==nullptr) {
+			args->inst_period_ms=-1.0;
+			return true;
+		}
+
+		if(args->ageCheck==true && isStaleGNTimestamp(newData.gnTimestamp,oldData->gnTimestamp)) {
+			return false;
+		}
+
+		// If the CAM does not contain the low frequency container, keep the last known exterior lights status
+		if(args->keepStoredLights==true) {
+			newData.exteriorLights = oldData->exteriorLights;
+		}
+
+		args->inst_period_ms=(newData.timestamp_us-oldData->timestamp_us)/1000.0;
+
+		return true;
+	}
+
+	// Merge callback used by processMessage() to update the database with the perceived objects of a new CPM, all at once
+	// (see LDMMap::insertVehicles())
+	bool mergeCPMObject(const ldmmap::vehicleData_t *oldData, ldmmap::vehicleData_t &newData, size_t idx, void *additional_args) {
+		cpmMergeArgs_t *args = static_cast<cpmMergeArgs_t *>(additional_args);
+
+		if(oldData==nullptr) {
+			args->inst_period_ms[idx]=-1.0;
+			return true;
+		}
+
+		// The age check is skipped when the CPM contains no GN timestamp
+		if(args->ageCheck==true && newData.gnTimestamp!=UINT64_MAX && isStaleGNTimestamp(newData.gnTimestamp,oldData->gnTimestamp)) {
+			args->stored_gnTimestamp[idx]=oldData->gnTimestamp;
+			return false;
+		}
+
+		args->inst_period_ms[idx]=(newData.timestamp_us-oldData->timestamp_us)/1000.0;
+
+		return true;
+	}
+
 	// Example custom function to configure an AMQP filter,
 	// specifically an APACHE.ORG:SELECTOR
 	// (http://www.amqp.org/specification/1.0/filters)
@@ -52,7 +149,7 @@ namespace {
 // if this data exists, use this data, if not, just set the exterior lights information as unavailable
 
 inline ldmmap::OptionalDataItem<uint8_t>
-AMQPClient::manage_LowfreqContainer(CAM_t *decoded_cam,uint32_t stationID){
+AMQPClient::manage_LowfreqContainer(CAM_t *decoded_cam,bool &keepStoredLights){
 
           if(decoded_cam->cam.camParameters.lowFrequencyContainer!=NULL) {
                   // In any normal, uncorrupted CAM, buf should never be NULL and it should contain at least one element (i.e. buf[0] always exists)
@@ -63,32 +160,113 @@ AMQPClient::manage_LowfreqContainer(CAM_t *decoded_cam,uint32_t stationID){
                           return ldmmap::OptionalDataItem<uint8_t>(false);
                   }
           } else {
-                  ldmmap::LDMMap::returnedVehicleData_t retveh;
+                  // The information stored in the database (if any) is kept when the vehicle is updated (see mergeCAM())
+                  keepStoredLights=true;
 
-                  if(m_db_ptr->lookupVehicle(stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
-                          return retveh.vehData.exteriorLights;
-                  } else {
-                          return ldmmap::OptionalDataItem<uint8_t>(false);
-                  }
+                  return ldmmap::OptionalDataItem<uint8_t>(false);
           }
 }
 
 void 
 AMQPClient::on_connection_open(proton::connection &conn) {
-	if(m_logfile_name!="" && m_logfile_file!=nullptr) {
-		fprintf(m_logfile_file,"[LOG - AMQPClient %s] Connection successfully established.\n",m_client_id.c_str());
-		fflush(m_logfile_file);
+	// The work queue of the connection is used by the ingest pipeline workers to ask for new credit
+	m_work_queue=&conn.work_queue();
+
+	if(m_binlog_ptr!=nullptr) {
+		m_binlog_ptr->logEvent(BINLOG_CONNECTION_OPEN,m_binlog_src);
 	}
 }
 
 void 
 AMQPClient::on_connection_close(proton::connection &conn) {
-	if(m_logfile_name!="" && m_logfile_file!=nullptr) {
-		fprintf(m_logfile_file,"[LOG - AMQPClient %s] Connection closed.\n",m_client_id.c_str());
-		fflush(m_logfile_file);
+	m_work_queue=nullptr;
+	m_receiver_open=false;
+
+	if(m_binlog_ptr!=nullptr) {
+		m_binlog_ptr->logEvent(BINLOG_CONNECTION_CLOSE,m_binlog_src);
 	}
 }
 
+void
+AMQPClient::on_receiver_open(proton::receiver &r) {
+	// This function is called again when the link is re-established after a reconnection: the credit of the new link starts from 0
+	m_receiver=r;
+	m_receiver_open=true;
+
+	updateCredit();
+}
+
+void
+AMQPClient::updateCredit() {
+	m_credit_update_pending=false;
+
+	if(m_receiver_open==false || m_receiver.active()==false) {
+		return;
+	}
+
+	uint64_t credit = m_receiver.credit()>0 ? static_cast<uint64_t>(m_receiver.credit()) : 0;
+	uint64_t pending = m_ingest_inflight+credit;
+
+	// Grant new credit only when the pending messages fall to the low watermark, so that credit is granted in batches
+	// (and not one message at a time), filling again the whole credit window
+	if(pending>m_credit_low_wm || pending>=m_credit_window) {
+		return;
+	}
+
+	m_receiver.add_credit(static_cast<int>(m_credit_window-pending));
+}
+
+void
+AMQPClient::requestCreditUpdate() {
+	// Avoid flooding the event loop with update requests, if one is already pending
+	if(m_credit_update_pending.exchange(true)==true) {
+		return;
+	}
+
+	proton::work_queue *wq = m_work_queue;
+
+	if(wq==nullptr || wq->add([this]() {updateCredit();})==false) {
+		m_credit_update_pending=false;
+	}
+}
+
+void
+AMQPClient::creditTimerCallback() {
+	uint64_t proc_cnt = m_proc_cnt;
+	uint64_t latency_us = m_proc_latency_us;
+	uint64_t min_window = std::min(m_credit_low_wm+AMQP_CREDIT_MIN_BATCH,m_credit_high_wm);
+
+	if(proc_cnt!=m_last_proc_cnt && latency_us>AMQP_CREDIT_TARGET_LATENCY_US) {
+		// The messages are waiting too long before being processed: reduce the number of pending messages (multiplicative decrease)
+		m_credit_window=std::max(min_window,m_credit_window/2);
+	} else if(proc_cnt==m_last_proc_cnt || latency_us<AMQP_CREDIT_TARGET_LATENCY_US/2) {
+		// The S-LDM is keeping up with the incoming messages (or it is idle): increase again the credit window (additive increase)
+		m_credit_window=std::min(m_credit_high_wm,m_credit_window+std::max<uint64_t>((m_credit_high_wm-min_window)/16,1));
+	}
+
+	m_last_proc_cnt=proc_cnt;
+
+	updateCredit();
+
+	proton::container *cont = m_cont;
+
+	if(cont!=nullptr) {
+		cont->schedule(proton::duration(AMQP_CREDIT_UPDATE_INTERVAL_MS),[this]() {creditTimerCallback();});
+	}
+}
+
+void
+AMQPClient::updateProcessingLatency(uint64_t on_msg_timestamp_us) {
+	uint64_t now_us = get_timestamp_us();
+	uint64_t latency_us = now_us>on_msg_timestamp_us ? now_us-on_msg_timestamp_us : 0;
+	uint64_t avg_us = m_proc_latency_us.load(std::memory_order_relaxed);
+
+	// Exponential moving average with alpha = 1/8
+	// Concurrent updates from different workers may occasionally overwrite each other, which is acceptable for an average
+	m_proc_latency_us.store(avg_us-avg_us/8+latency_us/8,std::memory_order_relaxed);
+	m_proc_cnt++;
+}
+
 void 
 AMQPClient::on_container_start(proton::container &c) {
 	m_cont.store(&c);
@@ -153,15 +331,7 @@ AMQPClient::on_container_start(proton::container &c) {
 		std::cout<<"[AMQPClient " << m_client_id.c_str() << "] No idle timeout has been explicitely set."<<std::endl;
 	}
 
-	if(m_logfile_name!="") {
-		if(m_logfile_name=="stdout") {
-			m_logfile_file=stdout;
-		} else {
-			// Opening the output file in write + append mode just to be safe in case the user does not change the file name
-			// between different executions of the S-LDM
-			m_logfile_file=fopen(m_logfile_name.c_str(),"wa");
-		}
-	}
+	openLogFile();
 
 	/* First version of the code without the caching mechanism. Kept here for reference. */
 	/*
@@ -325,25 +495,26 @@ AMQPClient::on_container_start(proton::container &c) {
 		conn = c.connect(conn_url_);
 	}
 
+	// The link credit is managed by updateCredit() (credit_window(0) disables the automatic credit management of Proton)
 	if(m_quadKey_filter!="") {
-		conn.open_receiver(addr_, proton::receiver_options().source(opts));
+		conn.open_receiver(addr_, proton::receiver_options().source(opts).credit_window(0));
 	} else{
-		conn.open_receiver(addr_);
+		conn.open_receiver(addr_, proton::receiver_options().credit_window(0));
 	}
+
+	c.schedule(proton::duration(AMQP_CREDIT_UPDATE_INTERVAL_MS),[this]() {creditTimerCallback();});
 }
 
 void 
 AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
+	ingestMessage_t ingestmsg;
 
-	uint64_t on_msg_timestamp_us = get_timestamp_us();
-
-	etsiDecoder::etsiDecodedData_t decodedData;
-
-	uint64_t bf = 0.0,af = 0.0;
-	uint64_t main_bf = 0.0,main_af = 0.0;
+	ingestmsg.owner = this;
+	ingestmsg.on_msg_timestamp_us = get_timestamp_us();
+	ingestmsg.rx_timestamp_ns = 0;
 
-	if(m_logfile_name!="") {
-		main_bf=get_timestamp_ns();
+	if(timingEnabled()) {
+		ingestmsg.rx_timestamp_ns=get_timestamp_ns();
 
 		// This additional log line has been commented out to avoid being too verbose
 		// fprintf(m_logfile_file,"[NEW MESSAGE RX]\n");
@@ -355,14 +526,13 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 
 	proton::codec::decoder qpid_decoder(msg.body());
 	proton::binary message_bin;
-	uint8_t *message_bin_buf;
 
 	// Check if a binary message has been received
 	// If no binary data has been received, just ignore the current AMQP message
 	if(qpid_decoder.next_type () == proton::BINARY) {
 		qpid_decoder >> message_bin;
 
-		message_bin_buf=message_bin.data ();
+		ingestmsg.payload = std::move(message_bin);
 	} else {
 		// This message should be ignored
 		if(m_printMsg == true) {
@@ -371,23 +541,124 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 		return;
 	}
 
-	if(m_logfile_name!="") {
+	// Copy the message properties which are needed to process the message, as "msg" is no longer valid after on_message() returns
+	ingestmsg.properties_available = msg.properties().size()>0;
+	ingestmsg.gn_timestamp_available = false;
+	ingestmsg.gn_timestamp = 0;
+	ingestmsg.quadkey = "";
+
+	if(ingestmsg.properties_available == true) {
+		proton::scalar gn_timestamp_prop = msg.properties().get(options_string_pop(m_opts_ptr->gn_timestamp_property));
+
+		if(gn_timestamp_prop.type() == proton::LONG) {
+			ingestmsg.gn_timestamp_available = true;
+			ingestmsg.gn_timestamp = static_cast<uint64_t>(proton::get<long>(gn_timestamp_prop));
+		}
+
+		proton::scalar quadkey_prop = msg.properties().get("quadkeys");
+
+		if(quadkey_prop.type() == proton::STRING) {
+			ingestmsg.quadkey = proton::get<std::string>(quadkey_prop);
+		}
+	}
+
+	dispatchMessage(ingestmsg);
+}
+
+void
+AMQPClient::sourceIngestMessage(ingestMessage_t &msg, void *additional_args) {
+	AMQPClient *client = static_cast<AMQPClient *>(additional_args);
+
+	msg.owner = client;
+
+	client->dispatchMessage(msg);
+}
+
+void
+AMQPClient::dispatchMessage(ingestMessage_t &ingestmsg) {
+	if(m_recorder_ptr!=nullptr) {
+		m_recorder_ptr->record(ingestmsg);
+	}
+
+	// Hand the message over to the ingest pipeline, if available, so that the event loop can immediately go back to receiving
+	// the next message; otherwise (or if the pipeline has already been stopped), process it in the current thread
+	if(m_ingest_ptr!=nullptr) {
+		m_ingest_inflight++;
+
+		if(m_ingest_ptr->push(ingestmsg)==true) {
+			updateCredit();
+			return;
+		}
+
+		m_ingest_inflight--;
+	}
+
+	processMessage(ingestmsg,m_decodeFrontend);
+	updateProcessingLatency(ingestmsg.on_msg_timestamp_us);
+	if(ingestmsg.rx_timestamp_ns>0) {
+		recordLatency(LATENCYSTATS_TOTAL,ingestmsg.rx_timestamp_ns);
+	}
+
+	updateCredit();
+}
+
+void
+AMQPClient::ingestProcessMessage(ingestMessage_t &msg, unsigned int worker_idx, void *additional_args) {
+	AMQPClient *client = static_cast<AMQPClient *>(msg.owner);
+
+	client->processMessage(msg,*client->m_workerDecodeFrontends[worker_idx]);
+	client->updateProcessingLatency(msg.on_msg_timestamp_us);
+	if(msg.rx_timestamp_ns>0) {
+		client->recordLatency(LATENCYSTATS_TOTAL,msg.rx_timestamp_ns);
+	}
+
+	// Ask the event loop thread for new credit as soon as the pending messages fall to the low watermark
+	if(--client->m_ingest_inflight==client->m_credit_low_wm) {
+		client->requestCreditUpdate();
+	}
+}
+
+void
+AMQPClient::processMessage(ingestMessage_t &msg, etsiDecoder::decoderFrontend &decodeFrontend) {
+	etsiDecoder::etsiDecodedData_t decodedData;
+
+	uint64_t on_msg_timestamp_us = msg.on_msg_timestamp_us;
+	uint64_t bf = 0.0,af = 0.0;
+	uint64_t main_bf = msg.rx_timestamp_ns;
+
+	// The MBD module expects the packet as a proton::binary object: a copy is performed only when the MBD is enabled
+	proton::binary message_bin;
+
+	if(m_MBDetection_enabled==true) {
+		message_bin = proton::binary(msg.payload);
+	}
+
+	if(timingEnabled()) {
 		bf=get_timestamp_ns();
 	}
 
 	Security::Security_error_t sec_retval;
 	storedCertificate_t certificateData;
 	// Decode the content of the message, using the decoder-module frontend class
-	// m_decodeFrontend.setPrintPacket(true); // <- uncomment to print the bytes of each received message. Should be used for debug only, and should be kept disabled when deploying the S-LDM.
-	if(m_decodeFrontend.decodeEtsi(message_bin_buf, message_bin.size (), decodedData, sec_retval,certificateData, etsiDecoder::decoderFrontend::MSGTYPE_AUTO)!=ETSI_DECODER_OK) {
-		std::cerr << "Error! Cannot decode ETSI packet!" << std::endl;
+	// decodeFrontend.setPrintPacket(true); // <- uncomment to print the bytes of each received message. Should be used for debug only, and should be kept disabled when deploying the S-LDM.
+	// The type of the messages of this client (full ITS messages or Facilities layer only messages) is detected automatically
+	if(decodeFrontend.decodeEtsi(msg.payload.data(), msg.payload.size(), decodedData, sec_retval,certificateData, m_msgTypeCache)!=ETSI_DECODER_OK) {
+		diag_decode_error.report();
 		return;
 	}
 
-	if(m_logfile_name!="") {
+	// The decoded message is released at once (by resetting the decoder arena) on any return path
+	etsiDecoder::decodedMsgOwner decodedOwner(decodeFrontend,decodedData);
+
+	if(timingEnabled()) {
 		af=get_timestamp_ns();
 
-		fprintf(m_logfile_file,"[LOG - MESSAGE DECODER (Client %s)] ProcTimeMilliseconds=%.6lf\n",m_client_id.c_str(),(af-bf)/1000000.0);
+		if(m_binlog_ptr!=nullptr) {
+			m_binlog_ptr->logStage(BINLOG_MESSAGE_DECODER,m_binlog_src,bf,af);
+		}
+		if(m_latstats_ptr!=nullptr) {
+			m_latstats_ptr->record(LATENCYSTATS_DECODE,af-bf);
+		}
 	}
 
 	ldmmap::vehicleData_t vehdata;
@@ -397,28 +668,12 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 	uint64_t MBD_retval;
 
 	if (decodedData.type==etsiDecoder::ETSI_DECODED_CAM || decodedData.type==etsiDecoder::ETSI_DECODED_CAM_NOGN) {
-		if (decodeCAM(decodedData,msg,on_msg_timestamp_us,main_bf,m_client_id,vehdata)==false) {
+		// The misbehaviour detection and the database update are performed by decodeCAM(), as the new data is merged with the
+		// stored one, and the trigger manager needs the merged data
+		if (decodeCAM(decodedData,msg,on_msg_timestamp_us,main_bf,m_client_id,vehdata,message_bin,sec_retval,certificateData)==false) {
 			return;
 		}
 
-		certificateData.stationID=vehdata.stationID;
-		certificateData.msg_timestamp=vehdata.on_msg_timestamp_us;
-
-		if (m_MBDetection_enabled==true) {
-			MBD_retval=m_MBDetector_ptr->processCAM(message_bin,vehdata,sec_retval,certificateData);
-			if (MBD_retval!=0) {
-				std::cerr <<"[WARNING] Misbehaviour detected for vehicle " <<vehdata.stationID <<". Message discarded with MB_CODE " <<MBD_retval <<std::endl;
-				return;
-			}
-		}
-
-		std::cout << "[DEBUG] Updating vehicle with stationID: " << vehdata.stationID << std::endl;
-		db_retval=m_db_ptr->insertVehicle(vehdata);				
-		
-		if(db_retval!=ldmmap::LDMMap::LDMMAP_OK && db_retval!=ldmmap::LDMMap::LDMMAP_UPDATED) {
-			std::cerr << "[WARNING] Insert on the database for vehicle " <<vehdata.stationID << "failed!" << std::endl;
-		}
-
 	} else if (decodedData.type==etsiDecoder::ETSI_DECODED_DENM || decodedData.type==etsiDecoder::ETSI_DECODED_DENM_NOGN) {
 		if (decodeDENM(decodedData,msg,on_msg_timestamp_us,main_bf,m_client_id,evedata)==false) {
 			return;
@@ -429,13 +684,15 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 
 		// DENM is a special case where the MBD has to hold the events for further checks, so the client either calls MBD or inserts the event
 		if (m_MBDetection_enabled==true) {
+			uint64_t mbd_bf=statsTimestamp();
 			m_MBDetector_ptr->processDENM(message_bin,evedata,sec_retval,certificateData);
+			recordLatency(LATENCYSTATS_MBD,mbd_bf);
 		} else {
 			ldmmap::LDMMap::returnedEventData_t retEvent;
 			ldmmap::LDMMap::event_LDMMap_error_t db_everetval;
 			uint64_t nearUpdateEvent_key = 0;
 			uint64_t keyEvent = m_db_ptr->KEY_EVENT(evedata.eventLatitude,evedata.eventLongitude,evedata.eventElevation,evedata.eventCauseCode);
-			std::cout << "[DEBUG] Updating event with eventKey: " << keyEvent << std::endl;
+			diag_update_event.report("%" PRIu64,keyEvent);
 			if (!evedata.eventTermination.isAvailable()) {
 				db_everetval = m_db_ptr->lookupAndUpdateEvent(keyEvent,evedata.eventLatitude,evedata.eventLongitude,
 				evedata.eventCauseCode,evedata,retEvent, nearUpdateEvent_key);
@@ -459,7 +716,7 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 				
 			if(db_everetval!=ldmmap::LDMMap::event_LDMMAP_OK && db_retval!=ldmmap::LDMMap::event_LDMMAP_UPDATED
 				&& db_retval!=ldmmap::LDMMap::event_LDMMAP_NEAR_EVENT_UPDATED  && db_retval!=ldmmap::LDMMap::event_LDMMAP_REMOVED) {
-				std::cerr << "[WARNING] Operation on the database for event " <<keyEvent << "failed!" << std::endl;
+				diag_db_event_error.report("%" PRIu64,keyEvent);
 			}
 		}
 
@@ -475,19 +732,46 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 		}
 
 		if (m_MBDetection_enabled==true) {
+			uint64_t mbd_bf=statsTimestamp();
 			MBD_retval=m_MBDetector_ptr->processCPM(message_bin,PO_vec,sec_retval,certificateData);
+			recordLatency(LATENCYSTATS_MBD,mbd_bf);
 			if (MBD_retval!=0) {
-				std::cerr <<"[WARNING] Misbehaviour detected for vehicle " <<vehdata.stationID <<". Message discarded with MB_CODE " <<MBD_retval <<std::endl;
+				diag_misbehaviour.report("%" PRIu64 " %" PRIu64,vehdata.stationID,MBD_retval);
 				return;
 			}
 		}
 
-		for (ldmmap::vehicleData_t PO_data:PO_vec) {
-			std::cout << "[DEBUG] Updating Perceived Object " << PO_data.stationID << std::endl;
-			db_retval=m_db_ptr->insertVehicle(PO_data);
+		// Insert all the perceived objects at once, locking each database shard only once: the age check and the computation of the
+		// "instantaneous update period" metric of each object are performed by mergeCPMObject() against the stored data, during
+		// the same pass
+		cpmMergeArgs_t mergeArgs;
+		mergeArgs.ageCheck = m_opts_ptr->ageCheck_enabled;
+		mergeArgs.inst_period_ms.assign(PO_vec.size(),-1.0);
+		mergeArgs.stored_gnTimestamp.assign(PO_vec.size(),0);
+
+		std::vector<ldmmap::LDMMap::LDMMap_error_t> PO_retvals;
+		uint64_t db_bf=statsTimestamp();
+		m_db_ptr->insertVehicles(PO_vec,PO_retvals,mergeCPMObject,&mergeArgs);
+		recordLatency(LATENCYSTATS_DB_UPDATE,db_bf);
+
+		for (size_t i=0;i<PO_vec.size();i++) {
+			if(PO_retvals[i]==ldmmap::LDMMap::LDMMAP_DISCARDED) {
+				// Perceived object discarded (data is too old)
+				if(m_binlog_ptr!=nullptr) {
+					m_binlog_ptr->logDiscarded(m_binlog_src,PO_vec[i].gnTimestamp,mergeArgs.stored_gnTimestamp[i]);
+				}
+				continue;
+			}
+
+			diag_update_po.report("%" PRIu64,PO_vec[i].stationID);
+
+			if(PO_retvals[i]!=ldmmap::LDMMap::LDMMAP_OK && PO_retvals[i]!=ldmmap::LDMMap::LDMMAP_UPDATED) {
+				diag_db_po_error.report("%" PRIu64,PO_vec[i].stationID);
+			}
 
-			if(db_retval!=ldmmap::LDMMap::LDMMAP_OK && db_retval!=ldmmap::LDMMap::LDMMAP_UPDATED) {
-				std::cerr << "[WARNING] Insert on the database for Perceived Object " <<PO_data.stationID << "failed!" << std::endl;
+			if(m_binlog_ptr!=nullptr) {
+				m_binlog_ptr->logVehicle(BINLOG_FULL_CPM_OBJECT_PROCESSING,m_binlog_src,PO_vec[i].stationID,PO_vec[i].lat,PO_vec[i].lon,
+					PO_vec[i].heading,mergeArgs.inst_period_ms[i]);
 			}
 		}
 
@@ -500,21 +784,25 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 		certificateData.msg_timestamp=vehdata.on_msg_timestamp_us;
 
 		if (m_MBDetection_enabled==true) {
+			uint64_t mbd_bf=statsTimestamp();
 			MBD_retval=m_MBDetector_ptr->processVAM(message_bin,vehdata,sec_retval,certificateData);
+			recordLatency(LATENCYSTATS_MBD,mbd_bf);
 			if (MBD_retval!=0) {
-				std::cerr <<"[WARNING] Misbehaviour detected for vehicle " <<vehdata.stationID <<". Message discarded with MB_CODE " <<MBD_retval <<std::endl;
+				diag_misbehaviour.report("%" PRIu64 " %" PRIu64,vehdata.stationID,MBD_retval);
 				return;
 			}
 		}
 
-		std::cout << "[DEBUG] Updating vehicle with stationID: " << vehdata.stationID << std::endl;
+		diag_update_vru.report("%" PRIu64,vehdata.stationID);
+		uint64_t db_bf=statsTimestamp();
 		db_retval=m_db_ptr->insertVehicle(vehdata);
+		recordLatency(LATENCYSTATS_DB_UPDATE,db_bf);
 
 		if(db_retval!=ldmmap::LDMMap::LDMMAP_OK && db_retval!=ldmmap::LDMMap::LDMMAP_UPDATED) {
-			std::cerr << "[WARNING] Insert on the database for VRU " <<vehdata.stationID << "failed!" << std::endl;
+			diag_db_vru_error.report("%" PRIu64,vehdata.stationID);
 		}
 	} else {
-		std::cerr << "[WARNING] Message type not supported!" << std::endl;
+		diag_unsupported_type.report();
 		return;
 	}
 	return;
@@ -522,12 +810,53 @@ AMQPClient::on_message(proton::delivery &d, proton::message &msg) {
 
 void 
 AMQPClient::on_container_stop(proton::container &c) {
-	if(m_logfile_name!="" && m_logfile_name!="stdout") {
+	closeLogFile();
+}
+
+void
+AMQPClient::openLogFile() {
+	if(m_logfile_name!="") {
+		if(m_logfile_name=="stdout") {
+			m_logfile_file=stdout;
+		} else {
+			// Opening the output file in write + append mode just to be safe in case the user does not change the file name
+			// between different executions of the S-LDM
+			m_logfile_file=fopen(m_logfile_name.c_str(),"wa");
+		}
+
+		// The per-message logs are written by a background thread, so that logging costs only a copy of a binary record
+		// in the processing hot path
+		if(m_logfile_file!=nullptr) {
+			m_binlog_ptr=new BinLogger(m_logfile_file,m_opts_ptr->log_binary ? BinLogger::BINLOGGER_FORMAT_BINARY : BinLogger::BINLOGGER_FORMAT_TEXT);
+			m_binlog_src=m_binlog_ptr->registerSource(m_client_id);
+			m_binlog_ptr->start();
+		}
+	}
+}
+
+void
+AMQPClient::closeLogFile() {
+	// Wait for the ingest pipeline workers to process the messages already received by this client, as they may still need to log
+	// to m_logfile_file
+	while(m_ingest_inflight>0 && m_ingest_ptr!=nullptr && m_ingest_ptr->isRunning()==true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// Write all the pending log records before closing the log file
+	if(m_binlog_ptr!=nullptr) {
+		m_binlog_ptr->stop();
+		delete m_binlog_ptr;
+		m_binlog_ptr=nullptr;
+	}
+
+	if(m_logfile_name!="" && m_logfile_name!="stdout" && m_logfile_file!=nullptr) {
 		fclose(m_logfile_file);
 	}
+	m_logfile_file=nullptr;
 }
 
-bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata) {
+bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::vehicleData_t &vehdata,
+	const proton::binary &message_bin, Security::Security_error_t sec_retval, storedCertificate_t &certificateData) {
 
 	uint64_t bf = 0.0,af = 0.0;
 	uint64_t main_af = 0.0;
@@ -543,7 +872,7 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	// After getting the lat and lon values from the CAM, check if it is inside the S-LDM full coverage area,
 	// using the areaFilter module (which can access the command line options, thus also the coverage area
 	// specified by the user)
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		bf=get_timestamp_ns();
 	}
 
@@ -551,23 +880,24 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 		return false;
 	}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		af=get_timestamp_ns();
 
 		//fprintf(m_logfile_file,"[LOG - AREA FILTER (Client %s)] ProcTimeMilliseconds=%.6lf\n",m_client_id.c_str(),(af-bf)/1000000.0);
 	}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		bf=get_timestamp_ns();
 	}
 
 	// Update the database
 	ldmmap::LDMMap::LDMMap_error_t db_retval;
+	camMergeArgs_t mergeArgs = {false,false,-1.0};
 	
 	uint64_t gn_timestamp;
 	if(decodedData.type == etsiDecoder::ETSI_DECODED_CAM) {
 		gn_timestamp = decodedData.gnTimestamp;
-		vehdata.exteriorLights = manage_LowfreqContainer (decoded_cam,stationID);
+		vehdata.exteriorLights = manage_LowfreqContainer (decoded_cam,mergeArgs.keepStoredLights);
 
 		// Since on 5G-CARMEN only some specific vehicles use the complete GN+BTP+CAM messages
 		if(m_opts_ptr->interop_hijack_enable){
@@ -588,12 +918,10 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 
 	// There is no need for an else if(), as we can enter here only if the decoded message type is either ETSI_DECODED_CAM or ETSI_DECODED_CAM_NOGN
 	} else {
-		if(msg.properties().size()>0) {
-			proton::scalar gn_timestamp_prop = msg.properties().get(options_string_pop(m_opts_ptr->gn_timestamp_property));
-
+		if(msg.properties_available==true) {
 						// If the gn_timestamp property is available, check if its type is correct
-						if(gn_timestamp_prop.type() == proton::LONG) {
-								gn_timestamp = static_cast<uint64_t>(proton::get<long>(gn_timestamp_prop));
+						if(msg.gn_timestamp_available==true) {
+								gn_timestamp = msg.gn_timestamp;
 
 								// If the gn_timestamp property is there and the ext_lights_hijack is enabled we know this is a bmw message so we check for
 								// the hijacked highFreqContainer to extract the exterior lights information instead of the lowfreqContainer
@@ -611,15 +939,15 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 									vehdata.exteriorLights = ldmmap::OptionalDataItem<uint8_t>(ext_lights);
 
 									} else {
-									vehdata.exteriorLights = manage_LowfreqContainer (decoded_cam,stationID);
+									vehdata.exteriorLights = manage_LowfreqContainer (decoded_cam,mergeArgs.keepStoredLights);
 									}
 						} else {
 								gn_timestamp=UINT64_MAX; // Set to an impossible value, to understand it is not specified (not set to zero beacuse is a possible correct value).
-								fprintf(stdout,"[WARNING] Current message contains no GN and a not supported gn_timestamp property, ageCheck disabled\n");
+								diag_nogn_unsupported_ts.report();
 						}
 				} else {
 						gn_timestamp=UINT64_MAX;
-						fprintf(stdout,"[WARNING] Current message contains no GN and no gn_timestamp property, ageCheck disabled\n");
+						diag_nogn_no_ts.report();
 				}
 
 				vehdata.stationType = static_cast<ldmmap::e_StationTypeLDM>(decoded_cam->cam.camParameters.basicContainer.stationType);
@@ -628,45 +956,8 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 
 
 	// Check the age of the data store inside the database (if the age check is enabled / -g option not specified)
-	// before updating it with the new receive data
-	if(m_opts_ptr->ageCheck_enabled == true && gn_timestamp != UINT64_MAX) {
-		ldmmap::LDMMap::returnedVehicleData_t retveh;
-
-		if(m_db_ptr->lookupVehicle(stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
-			// According to the standard: GNTimestamp = (TAI timestamp since 2004-01-01 00:00:00) % 4294967296
-			// Due to the modulo operation, it is not enough to consider the difference between the received GNTimestamp and the one
-			// stored in the database, as this may cause issues when receiving data and the GNTimestamp values are cyclically reset
-			// at the same time
-			// We thus check the "gap" between the received numbers. Let's consider for instance: stored=4294967291, rx=3
-			// In this case the "rx" data is the most up-to-date, but a cyclical reset occurred
-			// We can then compute gap = 3 - 4294967291 = -429467288 < -300000 (-5 minutes) - ok! We keep this data even if 3 < 4294967291
-			// Let's consider instead:
-			// stored=3, rx=4294967291
-			// In this case 'rx' is not the most up to date data (it is impossible to have '3' stored in the database and then receive
-			// '4294967291', unless clock jumps occur in the car, bacause after all that time the data corresponding to '3' would have already
-			// been garbage cleaned from the database)
-			// We can then compute gap = 4294967291 - 3 = 429467288 > 300000 (5 minutes) - no! We should dicard the data we just received
-			// Let's consider now a "normal" scenario:
-			// stored=3, rx=114
-			// gap = 114 - 3 = 111 < 300000 - ok! The data is kept (it would be discarded only if gap > 300000)
-			// Finally, let's briefly analyze a final scenario:
-			// stored=4294967292, rx=4294967291
-			// It is evident how the rx data should be discarded because older than the stored one
-			// gap = rx - stored = 4294967291 - 4294967292 = -1 > -300000 (-5 minutes) - The data is correctly discarded due to the second
-			// condition in the if() clause
-			long long int gap = static_cast<long long int>(gn_timestamp)-static_cast<long long int>(retveh.vehData.gnTimestamp);
-
-			if((gn_timestamp>retveh.vehData.gnTimestamp && gap>300000) ||
-				(gn_timestamp<retveh.vehData.gnTimestamp && gap>-300000)) {
-				if(m_logfile_name!="") {
-					//fprintf(m_logfile_file,"[LOG - DATABASE UPDATE (Client %s)] Message discarded (data is too old). Rx = %lu, Stored = %lu, Gap = %lld\n",
-					//	m_client_id.c_str(),
-					//	gn_timestamp,retveh.vehData.gnTimestamp,gap);
-					return false;
-				}
-			}
-		}
-	}
+	// before updating it with the new receive data (the check is performed by mergeCAM(), when updating the database)
+	mergeArgs.ageCheck = m_opts_ptr->ageCheck_enabled == true && gn_timestamp != UINT64_MAX;
 
 	vehdata.lon = lon;
 	vehdata.lat = lat;
@@ -693,17 +984,7 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	vehdata.stationType = static_cast<ldmmap::e_StationTypeLDM>(decoded_cam->cam.camParameters.basicContainer.stationType);
 
 	// Save also the source vehicle quadkey
-	if(msg.properties().size()>0) {
-		proton::scalar quadkey_prop = msg.properties().get("quadkeys");
-
-		if(quadkey_prop.type() == proton::STRING) {
-			vehdata.sourceQuadkey = proton::get<std::string>(quadkey_prop);
-		} else {
-			vehdata.sourceQuadkey="";
-		}
-	} else {
-		vehdata.sourceQuadkey="";
-	}
+	vehdata.sourceQuadkey = msg.quadkey;
 
 	if(decoded_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency.vehicleWidth != VehicleWidth_unavailable) {
 		vehdata.vehicleWidth = ldmmap::OptionalDataItem<long>(decoded_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency.vehicleWidth*100);
@@ -783,18 +1064,36 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	}
 	*/
 
-	// If logging is enabled, compute also an "instantaneous update period" metric (i.e., how much time has passed between two consecutive vehicle updates)
-	if(m_logfile_name!="") {
-		ldmmap::LDMMap::returnedVehicleData_t retveh;
+	certificateData.stationID=vehdata.stationID;
+	certificateData.msg_timestamp=vehdata.on_msg_timestamp_us;
 
-		if(m_db_ptr->lookupVehicle(stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
-			l_inst_period=(get_timestamp_us()-retveh.vehData.timestamp_us)/1000.0;
-		} else {
-			l_inst_period=-1.0;
+	if (m_MBDetection_enabled==true) {
+		uint64_t mbd_bf=statsTimestamp();
+		uint64_t MBD_retval=m_MBDetector_ptr->processCAM(message_bin,vehdata,sec_retval,certificateData);
+		recordLatency(LATENCYSTATS_MBD,mbd_bf);
+		if (MBD_retval!=0) {
+			diag_misbehaviour.report("%" PRIu64 " %" PRIu64,vehdata.stationID,MBD_retval);
+			return false;
 		}
-		
 	}
 
+	// Update the database: the age check, the exterior lights carry-over and the computation of the "instantaneous update period"
+	// metric (i.e., how much time has passed between two consecutive vehicle updates) are performed by mergeCAM() against the
+	// stored data, while the vehicle entry is locked
+	diag_update_vehicle.report("%" PRIu64,vehdata.stationID);
+	uint64_t db_bf=statsTimestamp();
+	db_retval=m_db_ptr->upsertVehicle(stationID,vehdata,mergeCAM,&mergeArgs);
+	recordLatency(LATENCYSTATS_DB_UPDATE,db_bf);
+
+	if(db_retval==ldmmap::LDMMap::LDMMAP_DISCARDED) {
+		// Message discarded (data is too old)
+		return false;
+	} else if(db_retval!=ldmmap::LDMMap::LDMMAP_OK && db_retval!=ldmmap::LDMMap::LDMMAP_UPDATED) {
+		diag_db_vehicle_error.report("%" PRIu64,vehdata.stationID);
+	}
+
+	l_inst_period=mergeArgs.inst_period_ms;
+
 	// Old insert without any check
 	//std::cout << "[DEBUG] Updating vehicle with stationID: " << vehdata.stationID << std::endl;
 	//
@@ -804,17 +1103,14 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	//	std::cerr << "Warning! Insert on the database for vehicle " << (int) stationID << "failed!" << std::endl;
 	//}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		af=get_timestamp_ns();
 
-		fprintf(m_logfile_file,"[LOG - DATABASE UPDATE (Client %s)] LowFrequencyContainerAvail=%d InsertReturnValue=%d ProcTimeMilliseconds=%.6lf\n",
-			m_client_id.c_str(),
-			decoded_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency.vehicleWidth != VehicleWidth_unavailable,
-			db_retval,
-			(af-bf)/1000000.0);
+		m_binlog_ptr->logStage(BINLOG_CAM_DATABASE_UPDATE,m_binlog_src,bf,af,db_retval,
+			decoded_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency.vehicleWidth != VehicleWidth_unavailable);
 	}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		bf=get_timestamp_ns();
 	}
 
@@ -839,31 +1135,22 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 		}
 	}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		af=get_timestamp_ns();
 
-		fprintf(m_logfile_file,"[LOG - TRIGGER CHECK (Client %s)] TriggerEnabled=%d ExteriorLightsAvail=%d CrossBrdTriggerMode=%d IsInsideInternalArea=%d ProcTimeMilliseconds=%.6lf\n",
-			m_client_id.c_str(),
-			m_indicatorTrgMan_enabled,
-			vehdata.exteriorLights.isAvailable(),
-			m_opts_ptr->cross_border_trigger,
-			m_areaFilter.isInsideInternal(lat,lon),
-			(af-bf)/1000000.0);
+		m_binlog_ptr->logStage(BINLOG_CAM_TRIGGER_CHECK,m_binlog_src,bf,af,0,
+			(m_indicatorTrgMan_enabled ? 0x01 : 0) |
+			(vehdata.exteriorLights.isAvailable() ? 0x02 : 0) |
+			(m_opts_ptr->cross_border_trigger ? 0x04 : 0) |
+			(m_areaFilter.isInsideInternal(lat,lon) ? 0x08 : 0));
 	}
 
-	ASN_STRUCT_FREE(asn_DEF_CAM,decoded_cam);
-
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		main_af=get_timestamp_ns();
 
-		logfprintf(m_logfile_file,std::string("FULL CAM PROCESSING (Client") + m_client_id + std::string(")"),"StationID=%u StationTypeID=%d Coordinates=%.7lf:%.7lf Heading=%.1lf InstUpdatePeriod=%.3lf"
-			" CAMTimestamp=%ld GNTimestamp=%lu CAMTimestampDiff=%ld GNTimestampDiff=%ld"
-			" ProcTimeMilliseconds=%.6lf Cardinality=%d\n",
-			stationID,static_cast<int>(vehdata.stationType),lat,lon,
-			vehdata.heading,
-			l_inst_period,
-			vehdata.camTimestamp,vehdata.gnTimestamp,get_timestamp_ms_cam()-vehdata.camTimestamp,get_timestamp_ms_gn()-vehdata.gnTimestamp,
-			(main_af-main_bf)/1000000.0,m_db_ptr->getVehicleCardinality ());
+		// The CAM and GN timestamp differences are computed when the record is formatted
+		m_binlog_ptr->logVehicle(BINLOG_FULL_CAM_PROCESSING,m_binlog_src,stationID,lat,lon,vehdata.heading,l_inst_period,
+			main_bf,main_af,static_cast<uint16_t>(vehdata.stationType),vehdata.camTimestamp,vehdata.gnTimestamp,m_db_ptr->getVehicleCardinality());
 		
 		// fprintf(m_logfile_file,"[LOG - FULL CAM PROCESSING] StationID=%u Coordinates=%.7lf:%.7lf InstUpdatePeriod=%.3lf"
 		// 	" CAMTimestamp=%ld GNTimestamp=%lu CAMTimestampDiff=%ld GNTimestampDiff=%ld"
@@ -877,8 +1164,8 @@ bool AMQPClient::decodeCAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	return true;
 }
 
-bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::eventData_t &evedata) {
-	std::cout << " \nSTART DENM" << std::endl;//per test
+bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,ldmmap::eventData_t &evedata) {
+	diag_denm_start.report();
 
 	uint64_t main_af = 0.0;
 	uint64_t bf_InsideArea = 0;
@@ -901,28 +1188,24 @@ bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::
 	uint64_t originatingStationID = decoded_denm->denm.management.actionID.originatingStationID;
 	uint64_t sequenceNumber = decoded_denm->denm.management.actionID.sequenceNumber;
 	uint32_t stationTypeID = decoded_denm->denm.management.stationType;
-	m_logfile_name="stdout";
-	m_logfile_file=stdout;
 
-	if (m_logfile_name!=""){
+	if(m_binlog_ptr!=nullptr) {
 		bf_InsideArea = get_timestamp_ns();
 	}
 
 	if(m_areaFilter.isInside(lat,lon)==false) {
 		return false;
 	} else {
-		std::cout << "Inside Area Filter" << std::endl;//per test
+		diag_denm_inside.report();
 	}
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		af_InsideArea = get_timestamp_ns();
 
-		fprintf(m_logfile_file,"[LOG - AREA FILTER (Client %s)] ProcTimeMilliseconds=%.6lf\n",m_client_id.c_str(),(af_InsideArea - bf_InsideArea)/1000000.0);
+		m_binlog_ptr->logStage(BINLOG_DENM_AREA_FILTER,m_binlog_src,bf_InsideArea,af_InsideArea);
 	}
 
-	if(m_logfile_name!="") {
-		bf_updateDatabaseDENM = get_timestamp_ns();
-	}
+	bf_updateDatabaseDENM = get_timestamp_ns();
 
 	// Update the database
 	ldmmap::LDMMap::returnedEventData_t retEvent;
@@ -969,8 +1252,13 @@ bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::
 			evedata.eventCauseCode = ldmmap::EventType_LDM_unknown;
 		}
 
+		// The SEQUENCE OF members are copied out of the decoder arena, as the event outlives the decoded message
 		if (decoded_denm->denm.situation->eventHistory != nullptr) {
-			evedata.eventHistory.setData(*decoded_denm->denm.situation->eventHistory);
+			std::shared_ptr<EventHistory_t> eventHistory = ldmmap::asnHeapCopy(&asn_DEF_EventHistory,decoded_denm->denm.situation->eventHistory);
+
+			if(eventHistory != nullptr) {
+				evedata.eventHistory.setData(eventHistory);
+			}
 		}
 	} else {
 		evedata.eventCauseCode = ldmmap::EventType_LDM_unknown;
@@ -988,7 +1276,11 @@ bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::
 		if (decoded_denm->denm.location->eventPositionHeading != nullptr ) {
 			evedata.eventPositionHeading.setData(decoded_denm->denm.location->eventPositionHeading->headingValue);
 		}
-		evedata.traces.setData(decoded_denm->denm.location->traces);
+		std::shared_ptr<Traces_t> traces = ldmmap::asnHeapCopy(&asn_DEF_Traces,&decoded_denm->denm.location->traces);
+
+		if(traces != nullptr) {
+			evedata.traces.setData(traces);
+		}
 	}
 
 	// A la carte container
@@ -1002,42 +1294,21 @@ bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::
 
 	uint64_t keyEvent = m_db_ptr->KEY_EVENT(lat,lon,ele,evedata.eventCauseCode);
 
-	if(m_logfile_name!="") {
-		main_af = get_timestamp_ns();
-
-		logfprintf(m_logfile_file,std::string("FULL DENM PROCESSING (Client") + m_eventclient_id + std::string(")"), "eventKey=%lu"
-			"OriginatingStationID=%u sequenceNumber=%d Coordinates=%.7lf:%.7lf:%.2lf eventStationType=%lf"
-			" DENM_ReferenceTime=%ld GNTimestamp=%lu DENM_DetectionTime=%ld DENM_ValidityDuration=%d ProcTimeMilliseconds=%.6lf EventCardinality=%d\n",
-			keyEvent,originatingStationID,sequenceNumber,lat,lon,ele,
-			evedata.eventStationType,evedata.referenceTime,evedata.gnTimestampDENM,evedata.detectionTime, evedata.eventValidityDuration,
-			(main_af-main_bf)/1e6,m_db_ptr->getEventCardinality ());
+	main_af = get_timestamp_ns();
 
-	}else {
-		std::cerr << "Warning! Problem to print a DENM!" << std::endl;
+	if(m_binlog_ptr!=nullptr) {
+		m_binlog_ptr->logDENM(m_binlog_src,keyEvent,static_cast<uint32_t>(originatingStationID),static_cast<uint16_t>(sequenceNumber),lat,lon,ele,
+			static_cast<uint16_t>(stationTypeID),evedata.referenceTime,decodedData.gnTimestamp,evedata.detectionTime,
+			static_cast<uint32_t>(evedata.eventValidityDuration),main_bf,main_af,static_cast<uint32_t>(m_db_ptr->getEventCardinality()));
 	}
 	//std::cout <<"END OF DENM\n" << std::endl; //For test
 
-	// Write the DENM timestamps to a CSV file
-	std::ofstream file("DENMtimestamps_25v.csv", std::ios::app);
-	if (!file) {
-		std::cerr << "Errore nell'apertura del file!" << std::endl;
-		return false;
+	// Write the DENM timestamps to the metrics sink (the CSV file is written by its background thread)
+	if(m_metrics_ptr!=nullptr) {
+		m_metrics_ptr->emit(m_denm_metrics_stream,{(main_af-main_bf)/1e3,(af_updateDatabaseDENM-bf_updateDatabaseDENM)/1e3,
+			lookupAndUpdateEvent_time/1e3,insertEvent_time/1e3,(main_af-evedata.gnTimestampDENM)/1e3});
 	}
 
-	// If the file is empty, write the header
-	static bool first_time = true;
-	if (first_time) {
-		file << "TotalMessageProcessingTimeDENM [us],DatabaseUpdateDENM [us],"
-		"LookupAndUpdateEvent_Time [us],InsertEvent_Time [us],DecodedMessageProcessingTime [us]\n";
-		first_time = false;
-	}
-
-	// Write the timestamps to the file
-	file << (main_af-main_bf)/1e3 << "," << (af_updateDatabaseDENM-bf_updateDatabaseDENM)/1e3 << ","
-	<< lookupAndUpdateEvent_time/1e3 << "," << insertEvent_time/1e3 << "," << (main_af-evedata.gnTimestampDENM)/1e3 << "\n";
-
-	file.close(); // Close the file
-
 	/*std::ofstream file1("DENM.csv", std::ios::app);
 	if (!file1) {
 		std::cerr << "Errore nell'apertura del file!" << std::endl;
@@ -1070,7 +1341,40 @@ bool AMQPClient::decodeDENM(etsiDecoder::etsiDecodedData_t decodedData, proton::
 	return true;
 }
 
-bool AMQPClient::decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,std::vector<ldmmap::vehicleData_t> &PO_vec) {
+void
+AMQPClient::expireCPMObjects(uint64_t now_us) {
+	for(auto senderit = m_recvCPMmap.begin(); senderit != m_recvCPMmap.end();) {
+		for(auto objit = senderit->second.begin(); objit != senderit->second.end();) {
+			// The CPMs may be processed out of order by the ingest pipeline workers: "lastseen_us" may be more recent than "now_us"
+			if(objit->second.lastseen_us+AMQP_CPM_OBJECT_EXPIRY_US<now_us) {
+				// IDs not belonging to the derived IDs range are ignored by the database
+				m_db_ptr->releaseDerivedID(objit->second.ldmID);
+				objit = senderit->second.erase(objit);
+			} else {
+				++objit;
+			}
+		}
+
+		if(senderit->second.empty()) {
+			senderit = m_recvCPMmap.erase(senderit);
+		} else {
+			++senderit;
+		}
+	}
+
+	// Forget the projections of the senders which are no longer sending any object
+	for(auto projit = m_CPMprojections.begin(); projit != m_CPMprojections.end();) {
+		if(m_recvCPMmap.find(projit->first) == m_recvCPMmap.end()) {
+			projit = m_CPMprojections.erase(projit);
+		} else {
+			++projit;
+		}
+	}
+
+	m_recvCPMmap_lastcleanup_us = now_us;
+}
+
+bool AMQPClient::decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id,std::vector<ldmmap::vehicleData_t> &PO_vec) {
 
 	uint64_t bf = 0.0,af = 0.0;
 	uint64_t main_af = 0.0;
@@ -1083,12 +1387,19 @@ bool AMQPClient::decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 
 	fromStationID = asn1cpp::getField(decoded_cpm->header.stationID, uint64_t);
 
-	double l_inst_period=0.0;
-
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 	    bf=get_timestamp_ns();
 	}
 
+	uint64_t gn_timestamp;
+	if(decodedData.type == etsiDecoder::ETSI_DECODED_CPM) {
+	    gn_timestamp = decodedData.gnTimestamp;
+	    // There is no need for an else if(), as we can enter here only if the decoded message type is either ETSI_DECODED_CPM or ETSI_DECODED_CPM_NOGN
+	} else {
+	    gn_timestamp=UINT64_MAX;
+	    diag_no_gn_timestamp.report();
+	}
+
 	int wrappedContainer_size = asn1cpp::sequenceof::getSize(decoded_cpm->payload.cpmContainers);
 	for (int i=0; i<wrappedContainer_size; i++)
 	{
@@ -1098,9 +1409,23 @@ bool AMQPClient::decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	    {
 	        auto POcontainer = asn1cpp::getSeq(wrappedContainer->containerData.choice.PerceivedObjectContainer,PerceivedObjectContainer);
 			int PObjects_size = asn1cpp::sequenceof::getSize(POcontainer->perceivedObjects);
+
+			// Compute the positions of all the objects of the container at once, starting from the reference position of the sender
+			std::vector<double> POx(PObjects_size), POy(PObjects_size);
+			std::vector<double> POlat(PObjects_size), POlon(PObjects_size);
+
+			for(int j=0; j<PObjects_size;j++) {
+				// Read the positions directly, without copying each object
+				PerceivedObject_t *PO_ptr = POcontainer->perceivedObjects.list.array[j];
+				POx[j] = static_cast<double>(PO_ptr->position.xCoordinate.value)/100;
+				POy[j] = static_cast<double>(PO_ptr->position.yCoordinate.value)/100;
+			}
+
+			// Index of the first object of this container inside PO_vec
+			size_t firstPO = PO_vec.size();
+
 	        for(int j=0; j<PObjects_size;j++)
 	        {
-	            ldmmap::LDMMap::returnedVehicleData_t PO_ret_data;
 				auto PO_seq = asn1cpp::makeSeq(PerceivedObject);
 				PO_seq = asn1cpp::sequenceof::getSeq(POcontainer->perceivedObjects,PerceivedObject,j);
 
@@ -1142,136 +1467,85 @@ bool AMQPClient::decodeCPM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 					PO_data.yawRate=ldmmap::e_DataUnavailableValue::yawRate;
 				}
 
-				double lonPO, latPO, from_x,from_y,xDistance, yDistance;
-				double gammar=0;
-				double kr=0;
-				xDistance = asn1cpp::getField(PO_seq->position.xCoordinate.value,double)/100;
-				yDistance = asn1cpp::getField(PO_seq->position.yCoordinate.value,double)/100;
-				transverse_mercator_t tmerc = UTMUPS_init_UTM_TransverseMercator();
-				TransverseMercator_Forward(&tmerc, fromLon, fromLat, fromLon, &from_x, &from_y, &gammar, &kr);
-				from_x += xDistance;
-				from_y += yDistance;
-				TransverseMercator_Reverse(&tmerc, fromLon, from_x, from_y, &latPO, &lonPO, &gammar, &kr);
-				PO_data.lat = latPO;
-				PO_data.lon = lonPO;
 				PO_data.camTimestamp = static_cast<long>(asn1cpp::getField(decoded_cpm->payload.managementContainer.referenceTime,long)) - static_cast<long>(asn1cpp::getField(PO_seq->measurementDeltaTime,long));
 				PO_data.perceivedBy = asn1cpp::getField(decoded_cpm->header.stationID,long);
 				PO_data.stationType = ldmmap::StationType_LDM_detectedPassengerCar;
+				// The object is identified by its own ID for the time being: the ID used to store it in the database is assigned
+				// below, together with the ones of the other objects of the container
+				PO_data.stationID = asn1cpp::getField(PO_seq->objectId,long);
+				PO_data.gnTimestamp = gn_timestamp;
+				PO_data.timestamp_us = get_timestamp_us();
+				PO_data.vruEnvironment=VruEnvironment_unavailable;
+				PO_data.vruMovementControl=VruMovementControl_unavailable;
+				PO_data.vruSizeClass=VruSizeClass_unavailable;
+				PO_vec.emplace_back(PO_data);
+	        }
 
-				if(m_recvCPMmap[fromStationID].find(asn1cpp::getField(PO_seq->objectId,long)) == m_recvCPMmap[fromStationID].end()){
-					// First time we have received this object from this vehicle
-					//If PO id is already in local copy of LDM
-					if(m_db_ptr->lookupVehicle(asn1cpp::getField(PO_seq->objectId,long),PO_ret_data) == ldmmap::LDMMap::LDMMAP_OK)
-					{
-						// We need a new ID for object
-						std::set<uint64_t> IDs;
-						m_db_ptr->getAllIDsVehicles (IDs);
-						int newID = 1;
-						for (int num : IDs) {
-							if (num == newID) {
-								++newID;
-							} else if (num > newID) {
-								break;
+			localProjection senderProj(m_opts_ptr->cpm_enu_projection ? localProjection::LOCALPROJECTION_ENU : localProjection::LOCALPROJECTION_TMERC);
+			{
+				// CPMs may be processed in parallel by the ingest pipeline workers: the projection of the sender and the IDs of all
+				// the objects of the container are handled under a single lock
+				std::lock_guard<std::mutex> cpmmap_lk(m_recvCPMmap_mtx);
+
+				if(on_msg_timestamp_us>=m_recvCPMmap_lastcleanup_us+AMQP_CPM_MAP_CLEANUP_INTERVAL_US) {
+					expireCPMObjects(on_msg_timestamp_us);
+				}
+
+				localProjection &cachedProj = m_CPMprojections.emplace(fromStationID,senderProj).first->second;
+
+				// The origin is projected again only if the sender moved since its previous CPM
+				cachedProj.setOrigin(fromLat,fromLon);
+				senderProj = cachedProj;
+
+				std::map<uint64_t,CPMobjectEntry_t> &senderObjects = m_recvCPMmap[fromStationID];
+
+				for(size_t j=firstPO;j<PO_vec.size();j++) {
+					uint64_t objectID = PO_vec[j].stationID;
+					auto objit = senderObjects.find(objectID);
+
+					if(objit == senderObjects.end()){
+						// First time we have received this object from this vehicle
+						CPMobjectEntry_t objEntry;
+						ldmmap::LDMMap::returnedVehicleData_t PO_ret_data;
+
+						//If PO id is already in local copy of LDM
+						if(m_db_ptr->lookupVehicle(objectID,PO_ret_data) == ldmmap::LDMMap::LDMMAP_OK)
+						{
+							// We need a new ID for object: get it from the range reserved by the database to derived objects
+							objEntry.ldmID = m_db_ptr->allocateDerivedID();
+
+							if(objEntry.ldmID == 0) {
+								// All the derived IDs are in use: the stored object is going to be overwritten
+								diag_no_derived_id.report("%" PRIu64 " %" PRIu64,objectID,fromStationID);
+								objEntry.ldmID = objectID;
 							}
 						}
+						else
+						{
+							objEntry.ldmID = objectID;
+						}
+
 						//Update recvCPMmap
-						m_recvCPMmap[fromStationID][asn1cpp::getField(PO_seq->objectId,long)] = newID;
-						PO_data.stationID = newID;
-					}
-					else
-					{
-						//Update recvCPMmap
-						m_recvCPMmap[fromStationID][asn1cpp::getField(PO_seq->objectId,long)] = asn1cpp::getField(PO_seq->objectId,long);
-						PO_data.stationID = asn1cpp::getField(PO_seq->objectId,long);
+						objit = senderObjects.emplace(objectID,objEntry).first;
 					}
+
+					objit->second.lastseen_us = on_msg_timestamp_us;
+					PO_vec[j].stationID = objit->second.ldmID;
 				}
-				else
-				{
-					PO_data.stationID = m_recvCPMmap[fromStationID][asn1cpp::getField(PO_seq->objectId,long)];
-				}
+			}
 
-	            ldmmap::LDMMap::LDMMap_error_t db_retval;
-
-	            uint64_t gn_timestamp;
-	            if(decodedData.type == etsiDecoder::ETSI_DECODED_CPM) {
-	                gn_timestamp = decodedData.gnTimestamp;
-	                // There is no need for an else if(), as we can enter here only if the decoded message type is either ETSI_DECODED_CAM or ETSI_DECODED_CAM_NOGN
-	            } else {
-	                gn_timestamp=UINT64_MAX;
-	                fprintf(stdout,"[WARNING] Current message contains no GN timestamp, ageCheck disabled.\n");
-	            }
-
-	            // Check the age of the data store inside the database (if the age check is enabled / -g option not specified)
-	            // before updating it with the new receive data
-	            if(m_opts_ptr->ageCheck_enabled == true && gn_timestamp != UINT64_MAX) {
-	                ldmmap::LDMMap::returnedVehicleData_t retveh;
-
-	                if(m_db_ptr->lookupVehicle(PO_data.stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
-	                    /* According to the standard: GNTimestamp = (TAI timestamp since 2004-01-01 00:00:00) % 4294967296
-	                    // Due to the modulo operation, it is not enough to consider the difference between the received GNTimestamp and the one
-	                    // stored in the database, as this may cause issues when receiving data and the GNTimestamp values are cyclically reset
-	                    // at the same time
-	                    // We thus check the "gap" between the received numbers. Let's consider for instance: stored=4294967291, rx=3
-	                    // In this case the "rx" data is the most up-to-date, but a cyclical reset occurred
-	                    // We can then compute gap = 3 - 4294967291 = -429467288 < -300000 (-5 minutes) - ok! We keep this data even if 3 < 4294967291
-	                    // Let's consider instead:
-	                    // stored=3, rx=4294967291
-	                    // In this case 'rx' is not the most up to date data (it is impossible to have '3' stored in the database and then receive
-	                    // '4294967291', unless clock jumps occur in the car, bacause after all that time the data corresponding to '3' would have already
-	                    // been garbage cleaned from the database)
-	                    // We can then compute gap = 4294967291 - 3 = 429467288 > 300000 (5 minutes) - no! We should dicard the data we just received
-	                    // Let's consider now a "normal" scenario:
-	                    // stored=3, rx=114
-	                    // gap = 114 - 3 = 111 < 300000 - ok! The data is kept (it would be discarded only if gap > 300000)
-	                    // Finally, let's briefly analyze a final scenario:
-	                    // stored=4294967292, rx=4294967291
-	                    // It is evident how the rx data should be discarded because older than the stored one
-	                    // gap = rx - stored = 4294967291 - 4294967292 = -1 > -300000 (-5 minutes) - The data is correctly discarded due to the second
-	                    // condition in the if() clause
-	                     */
-	                    long long int gap = static_cast<long long int>(gn_timestamp)-static_cast<long long int>(retveh.vehData.gnTimestamp);
-
-	                    if((gn_timestamp>retveh.vehData.gnTimestamp && gap>300000) ||
-	                       (gn_timestamp<retveh.vehData.gnTimestamp && gap>-300000)) {
-	                        if(m_logfile_name!="") {
-	                            fprintf(m_logfile_file,"[LOG - DATABASE UPDATE (Client %s)] Message discarded (data is too old). Rx = %lu, Stored = %lu, Gap = %lld\n",
-	                                    m_client_id.c_str(),
-	                                    gn_timestamp,retveh.vehData.gnTimestamp,gap);
-	                            return false;
-	                        }
-	                    }
-	                }
-	            }
-
-	            PO_data.timestamp_us = get_timestamp_us();
-
-	            if(m_logfile_name!="") {
-	                ldmmap::LDMMap::returnedVehicleData_t retveh;
-
-	                if(m_db_ptr->lookupVehicle(PO_data.stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
-	                    l_inst_period=(get_timestamp_us()-retveh.vehData.timestamp_us)/1000.0;
-	                } else {
-	                    l_inst_period=-1.0;
-	                }
-
-	                if(m_logfile_name!="") {
-	                    logfprintf(m_logfile_file,std::string("FULL CPM Perceived Object PROCESSING (Client ") + m_client_id + std::string(")"),"StationID=%u Coordinates=%.7lf:%.7lf Heading=%.1lf InstUpdatePeriod=%.3lf\n",
-	                               PO_data.stationID,PO_data.lat,PO_data.lon,
-	                               PO_data.heading,
-	                               l_inst_period);
-	                }
-	            }
-				PO_data.vruEnvironment=VruEnvironment_unavailable;
-				PO_data.vruMovementControl=VruMovementControl_unavailable;
-				PO_data.vruSizeClass=VruSizeClass_unavailable;
-				PO_vec.emplace_back(PO_data);
-	        }
+			senderProj.toLatLon(POx.data(),POy.data(),PObjects_size,POlat.data(),POlon.data());
+
+			for(int j=0; j<PObjects_size;j++) {
+				PO_vec[firstPO+j].lat = POlat[j];
+				PO_vec[firstPO+j].lon = POlon[j];
+			}
 	    }
 	}
 	return true;
 }
 
-bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::message &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id, ldmmap::vehicleData_t &vehdata) {
+bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, const ingestMessage_t &msg, uint64_t on_msg_timestamp_us, uint64_t main_bf, std::string m_client_id, ldmmap::vehicleData_t &vehdata) {
 	
 	uint64_t bf = 0.0,af = 0.0;
 	uint64_t main_af = 0.0;
@@ -1286,7 +1560,7 @@ bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	
 	double l_inst_period=0.0;
 
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		bf=get_timestamp_ns();
 	}
 
@@ -1303,7 +1577,7 @@ bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 		// There is no need for an else if(), as we can enter here only if the decoded message type is either ETSI_DECODED_VAM or ETSI_DECODED_VAM_NOGN
 	} else {
 		gn_timestamp=UINT64_MAX;
-		fprintf(stdout,"[WARNING] Current message contains no GN timestamp, ageCheck disabled.\n");
+		diag_no_gn_timestamp.report();
 	}
 	
 	// Check the age of the data store inside the database (if the age check is enabled / -g option not specified)
@@ -1316,12 +1590,10 @@ bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 
 			if((gn_timestamp>retveh.vehData.gnTimestamp && gap>300000) ||
 				(gn_timestamp<retveh.vehData.gnTimestamp && gap>-300000)) {
-				if(m_logfile_name!="") {
-					fprintf(m_logfile_file,"[LOG - DATABASE UPDATE (Client %s)] Message discarded (data is too old). Rx = %lu, Stored = %lu, Gap = %lld\n",
-						m_client_id.c_str(),
-						gn_timestamp,retveh.vehData.gnTimestamp,gap);
-					return false;
+				if(m_binlog_ptr!=nullptr) {
+					m_binlog_ptr->logDiscarded(m_binlog_src,gn_timestamp,retveh.vehData.gnTimestamp);
 				}
+				return false;
 			}
 		}
 	}
@@ -1369,7 +1641,7 @@ bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 	}
 	
 	// If logging is enabled, compute also an "instantaneous update period" metric (i.e., how much time has passed between two consecutive vehicle updates)
-	if(m_logfile_name!="") {
+	if(m_binlog_ptr!=nullptr) {
 		ldmmap::LDMMap::returnedVehicleData_t retveh;
 
 		if(m_db_ptr->lookupVehicle(stationID,retveh)==ldmmap::LDMMap::LDMMAP_OK) {
@@ -1378,15 +1650,11 @@ bool AMQPClient::decodeVAM(etsiDecoder::etsiDecodedData_t decodedData, proton::m
 			l_inst_period=-1.0;
 		}
 
-		if(m_logfile_name!="") {
-			logfprintf(m_logfile_file,std::string("FULL VAM PROCESSING (Client ") + m_client_id + std::string(")"),"StationID=%u Coordinates=%.7lf:%.7lf Heading=%.1lf InstUpdatePeriod=%.3lf\n",
-				stationID,lat,lon,
-				vehdata.heading,
-				l_inst_period);
+		if(m_binlog_ptr!=nullptr) {
+			m_binlog_ptr->logVehicle(BINLOG_FULL_VAM_PROCESSING,m_binlog_src,stationID,lat,lon,
+				vehdata.heading,l_inst_period);
 		}
 	}
-	
-	ASN_STRUCT_FREE(asn_DEF_VAM,decoded_vam);
 
 	return true;
 }
\ No newline at end of file
@@ -123,15 +123,9 @@ void *JSONthread_callback(void *arg) {
 }
 
 json11::Json::object JSONserver::make_SLDM_json(double lat, double lon, double range) {
-	// Variable to store the relative distance of vehicles w.r.t. the reference vehicle
-	double refRelDist = -1.0;
-
 	// Create a new JSON structure
 	json11::Json::object AIM_json = {};
 
-	// Returned vehicle data vector
-	std::vector<ldmmap::LDMMap::returnedVehicleData_t> returnedvehs;
-
 	// "now" timestamp (i.e., the timestamp at which this JSON request is being generated: "generation_tstamp")
 	uint64_t now_us = get_timestamp_us();
 
@@ -145,33 +139,48 @@ json11::Json::object JSONserver::make_SLDM_json(double lat, double lon, double r
 		fprintf(stdout,"[INFO] No range specified in JSON-over-TCP request. Using default value of %.2lf m.\n",range);
 	}
 
-	if(m_db_ptr->rangeSelectVehicle(range,lat,lon,returnedvehs)!=ldmmap::LDMMap::LDMMAP_OK) {
+	json11::Json::array vehicles = {};
+	std::vector<ldmmap::LDMMap::projectedVehicleData_t> selectedVehicles;
+	std::vector<std::shared_ptr<ldmmap::PHpoints>> selectedPHpoints;
+
+	// Only the fields which are actually sent in the JSON message are read from the database (without copying the full vehicle data)
+	if(m_db_ptr->rangeSelectVehicleFields(range,lat,lon,
+		ldmmap::LDMMap::LDMMAP_FIELD_STATIONID | ldmmap::LDMMap::LDMMAP_FIELD_LAT | ldmmap::LDMMap::LDMMAP_FIELD_LON |
+		ldmmap::LDMMap::LDMMAP_FIELD_EXTERIORLIGHTS | ldmmap::LDMMap::LDMMAP_FIELD_CAMTIMESTAMP | ldmmap::LDMMap::LDMMAP_FIELD_GNTIMESTAMP |
+		ldmmap::LDMMap::LDMMAP_FIELD_VEHICLELENGTH | ldmmap::LDMMap::LDMMAP_FIELD_VEHICLEWIDTH | ldmmap::LDMMap::LDMMAP_FIELD_SPEED |
+		ldmmap::LDMMap::LDMMAP_FIELD_PHDATA | ldmmap::LDMMap::LDMMAP_FIELD_STATIONTYPE | ldmmap::LDMMap::LDMMAP_FIELD_TIMESTAMP |
+		ldmmap::LDMMap::LDMMAP_FIELD_HEADING,
+		selectedVehicles,&selectedPHpoints)!=ldmmap::LDMMap::LDMMAP_OK) {
 		AIM_json["return_code"] = json11::Json("error");
 		return AIM_json;
 	} else {
 		AIM_json["error"] = json11::Json("ok");
 	}
-	
-	json11::Json::array vehicles = {};
 
-	for(ldmmap::LDMMap::returnedVehicleData_t vehdata : returnedvehs) {
+	// The JSON message is built only after all the database locks have been released, so that the database updates never wait
+	// for the serialization
+	vehicles.reserve(selectedVehicles.size());
+
+	for(size_t i=0;i<selectedVehicles.size();i++) {
+		ldmmap::LDMMap::projectedVehicleData_t &vehdata = selectedVehicles[i];
+
 		// Compute the relative distance w.r.t. the reference lat and lon
-		refRelDist=haversineDist(lat,lon,vehdata.vehData.lat,vehdata.vehData.lon);
-
-		vehicles.push_back(make_vehicle(vehdata.vehData.stationID,
-			vehdata.vehData.lat,
-			vehdata.vehData.lon,
-			vehdata.vehData.exteriorLights.isAvailable() ? exteriorLights_bit_to_string(vehdata.vehData.exteriorLights.getData()) : "unavailable",
-			vehdata.vehData.camTimestamp,
-			vehdata.vehData.gnTimestamp,
-			vehdata.vehData.vehicleLength,
-			vehdata.vehData.vehicleWidth,
-			vehdata.vehData.speed_ms,
-			vehdata.phData,
+		double refRelDist=haversineDist(lat,lon,vehdata.lat,vehdata.lon);
+
+		vehicles.push_back(make_vehicle(vehdata.stationID,
+			vehdata.lat,
+			vehdata.lon,
+			vehdata.exteriorLights.isAvailable() ? exteriorLights_bit_to_string(vehdata.exteriorLights.getData()) : "unavailable",
+			vehdata.camTimestamp,
+			vehdata.gnTimestamp,
+			vehdata.vehicleLength,
+			vehdata.vehicleWidth,
+			vehdata.speed_ms,
+			selectedPHpoints[i].get(),
 			refRelDist,
-			vehdata.vehData.stationType,
-			now_us-vehdata.vehData.timestamp_us,
-			vehdata.vehData.heading));
+			vehdata.stationType,
+			now_us-vehdata.timestamp_us,
+			vehdata.heading));
 	}
 
 	AIM_json["vehicles"] = vehicles;
@@ -2,68 +2,204 @@
 #include "utils.h"
 #include <cmath>
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <string>
 #include <functional>
 #include "dendatadef.h"
 #include "ActionID.h"
 #include "etsiDecoderFrontend.h"
 #include "timers.h"
+#include "distanceFilter.h"
 #include <atomic>
 #include <thread>
 #include <vehicle-visualizer.h>
+#include <algorithm>
 
 
 
-#define DEFINE_KEYS(k_up,k_low,stationID) \
-		uint32_t k_low = stationID & 0x0000FFFF; \
-		uint32_t k_up = (stationID & 0xFFFF0000) >> 16;
+#define DEG_2_RAD(val) ((val)*M_PI/180.0)
 
-#define COMPOSE_KEYS(k_up,k_low) (((uint64_t) k_up) << 16) + k_low;
+// When the spatial index of a shard returns more than 1/LDMMAP_SWEEP_FRACTION of the vehicles stored in the shard as candidates,
+// a range select is performed as a linear sweep over the hot arrays of the shard, instead of looking up every candidate
+#define LDMMAP_SWEEP_FRACTION 4
 
-#define DEG_2_RAD(val) ((val)*M_PI/180.0)
+// The expiry index of a shard is rebuilt when it contains more than LDMMAP_EXPIRY_REBUILD_FACTOR entries per vehicle
+// (plus LDMMAP_EXPIRY_REBUILD_MIN_ENTRIES entries, to avoid rebuilding too often the index of almost empty shards)
+#define LDMMAP_EXPIRY_REBUILD_FACTOR 32
+#define LDMMAP_EXPIRY_REBUILD_MIN_ENTRIES 1024
 
 
 
 namespace ldmmap {
 
+	static inline double haversineDist(double lat_a, double lon_a, double lat_b, double lon_b) {
+		// 12742000 is the mean Earth radius (6371 km) * 2 * 1000 (to convert from km to m)
+		return 12742000.0*asin(sqrt(sin(DEG_2_RAD(lat_b-lat_a)/2)*sin(DEG_2_RAD(lat_b-lat_a)/2)+cos(DEG_2_RAD(lat_a))*cos(DEG_2_RAD(lat_b))*sin(DEG_2_RAD(lon_b-lon_a)/2)*sin(DEG_2_RAD(lon_b-lon_a)/2)));
+	}
+
+	// 64-bit mixing function (finalizer of splitmix64), used to spread the stationIDs over the shards
+	// Consecutive stationIDs, or stationIDs differing only in their upper bits, would otherwise end up in the same shard
+	static inline uint64_t mixStationID(uint64_t stationID) {
+		stationID = (stationID ^ (stationID >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		stationID = (stationID ^ (stationID >> 27)) * 0x94d049bb133111ebULL;
+		return stationID ^ (stationID >> 31);
+	}
+
 	// Key generation for the event (DENM)
-	int LDMMap::KEY_EVENT(double latitude, double longitude, double elevation, e_EventTypeLDM TypeEvent){
+	// The quantized coordinates and the cause code are combined with the same mixing function used for the stationIDs, without
+	// building any intermediate string
+	uint64_t
+	LDMMap::KEY_EVENT(double latitude, double longitude, double elevation, e_EventTypeLDM TypeEvent) {
+		int64_t quantized_latitude = static_cast<int64_t>(std::trunc(latitude*1e6));
+		int64_t quantized_longitude = static_cast<int64_t>(std::trunc(longitude*1e6));
+		int64_t quantized_elevation = static_cast<int64_t>(std::trunc(elevation*1e2));
+
+		// Latitude and longitude, once quantized, always fit in 32 bits
+		uint64_t EventKey = mixStationID((static_cast<uint64_t>(static_cast<uint32_t>(quantized_latitude)) << 32) | static_cast<uint32_t>(quantized_longitude));
+		EventKey = mixStationID(EventKey ^ static_cast<uint64_t>(quantized_elevation));
+		EventKey = mixStationID(EventKey ^ static_cast<uint64_t>(TypeEvent));
+
+		// 0 is used by the callers as "no event"
+		return EventKey == 0 ? 1 : EventKey;
+	}
 
-		double truncated_latitude = std::trunc(latitude*1e6)/1e6;
-		double truncated_longitude = std::trunc(longitude*1e6)/1e6;
-		double truncated_elevation = std::trunc(elevation*1e2)/1e2;
-		std::ostringstream str_lat;
-		std::ostringstream str_lon;
-		std::ostringstream str_ele;
-		std::ostringstream str_TypeEvent;
+	LDMMap::LDMMap() {
+		initShards(LDMMAP_DEFAULT_NUM_SHARDS);
 
-		// Set precision for the string streams
-		str_lat << std::fixed << std::setprecision(6) << truncated_latitude;
-		str_lon << std::fixed << std::setprecision(6) << truncated_longitude;
-		str_ele << std::fixed << std::setprecision(2) << truncated_elevation;
+		m_eventcard = 0;
+		m_eventgrid.setCellSize(LDMMAP_EVENT_GRID_CELL_SIZE_M);
 
-		str_TypeEvent << std::to_string(TypeEvent);
+		m_central_lat = 0.0;
+		m_central_lon = 0.0;
 
-		std::string strconc = str_ele.str() + str_lat.str() + str_lon.str() + str_TypeEvent.str();
-		std::size_t EventKey = std::hash<std::string>{}(strconc);
+		m_derivedid_next = 0;
 
-		return EventKey;
+		// Start with an empty snapshot, so that getSnapshot() never returns a null pointer
+		m_snapshot = std::make_shared<const snapshot_t>(snapshot_t{0,get_timestamp_us(),{},{},{},{},{}});
 	}
 
-	static inline double haversineDist(double lat_a, double lon_a, double lat_b, double lon_b) {
-		// 12742000 is the mean Earth radius (6371 km) * 2 * 1000 (to convert from km to m)
-		return 12742000.0*asin(sqrt(sin(DEG_2_RAD(lat_b-lat_a)/2)*sin(DEG_2_RAD(lat_b-lat_a)/2)+cos(DEG_2_RAD(lat_a))*cos(DEG_2_RAD(lat_b))*sin(DEG_2_RAD(lon_b-lon_a)/2)*sin(DEG_2_RAD(lon_b-lon_a)/2)));
-	}
+	LDMMap::LDMMap(unsigned int num_shards) {
+		initShards(num_shards);
 
-	LDMMap::LDMMap() {
-		m_card = 0;
 		m_eventcard = 0;
-
+		m_eventgrid.setCellSize(LDMMAP_EVENT_GRID_CELL_SIZE_M);
 
 		m_central_lat = 0.0;
 		m_central_lon = 0.0;
+
+		m_derivedid_next = 0;
+
+		// Start with an empty snapshot, so that getSnapshot() never returns a null pointer
+		m_snapshot = std::make_shared<const snapshot_t>(snapshot_t{0,get_timestamp_us(),{},{},{},{},{}});
+	}
+
+	void
+	LDMMap::initShards(unsigned int num_shards) {
+		// Round the number of shards up to the next power of two, so that a shard can be selected with a simple mask
+		m_num_shards = 1;
+
+		while(m_num_shards < num_shards && m_num_shards < LDMMAP_MAX_NUM_SHARDS) {
+			m_num_shards <<= 1;
+		}
+
+		m_shard_mask = m_num_shards - 1;
+		m_shards = std::unique_ptr<vehicleShard_t[]>(new vehicleShard_t[m_num_shards]);
+
+		m_version = 0;
+		m_changelog_shard_size = std::max<size_t>(LDMMAP_CHANGELOG_DEFAULT_SIZE/m_num_shards,LDMMAP_CHANGELOG_MIN_SHARD_SIZE);
+
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			m_shards[i].card = 0;
+			m_shards[i].expiryentries = 0;
+			m_shards[i].changeloglost = 0;
+		}
+	}
+
+	inline unsigned int
+	LDMMap::getShardIdx(uint64_t stationID) {
+		return static_cast<unsigned int>(mixStationID(stationID) & m_shard_mask);
+	}
+
+	inline LDMMap::vehicleShard_t &
+	LDMMap::getShard(uint64_t stationID) {
+		return m_shards[getShardIdx(stationID)];
+	}
+
+	uint32_t
+	LDMMap::allocSlot(vehicleShard_t &shard) {
+		uint32_t slot;
+
+		if(!shard.freeslots.empty()) {
+			slot = shard.freeslots.back();
+			shard.freeslots.pop_back();
+		} else {
+			// No free slots: grow all the arrays by one element
+			slot = shard.used.size();
+
+			shard.lat.push_back(NAN);
+			shard.lon.push_back(NAN);
+			shard.heading.push_back(LDM_HEADING_UNAVAILABLE);
+			shard.speed_ms.push_back(0.0);
+			shard.timestamp_us.push_back(0);
+			shard.stationID.push_back(0);
+			shard.stationType.push_back(StationType_LDM_unknown);
+			shard.used.push_back(0);
+			shard.version.push_back(0);
+			shard.records.emplace_back();
+		}
+
+		shard.used[slot] = 1;
+
+		return slot;
+	}
+
+	inline void
+	LDMMap::storeSlot(vehicleShard_t &shard, uint32_t slot, const vehicleData_t &vehData) {
+		shard.lat[slot] = vehData.lat;
+		shard.lon[slot] = vehData.lon;
+		shard.heading[slot] = vehData.heading;
+		shard.speed_ms[slot] = vehData.speed_ms;
+		shard.timestamp_us[slot] = vehData.timestamp_us;
+		shard.stationID[slot] = vehData.stationID;
+		shard.stationType[slot] = vehData.stationType;
+
+		shard.records[slot].vehData = vehData;
+	}
+
+	void
+	LDMMap::freeSlot(vehicleShard_t &shard, uint32_t slot) {
+		shard.lat[slot] = NAN;
+		shard.lon[slot] = NAN;
+		shard.used[slot] = 0;
+
+		// Release the memory of the cold data (e.g., of the strings inside vehicleData_t) and the reference to the PHpoints object
+		shard.records[slot] = returnedVehicleData_t();
+
+		shard.freeslots.push_back(slot);
+	}
+
+	void
+	LDMMap::logChange(vehicleShard_t &shard, uint64_t stationID, uint32_t slot, changeType_t type) {
+		// The shard lock is held in exclusive mode: the versions recorded in the change log of a shard are always increasing
+		uint64_t version = ++m_version;
+
+		shard.version[slot] = version;
+		shard.changelog.push_back({version,stationID,type});
+
+		if(shard.changelog.size() > m_changelog_shard_size) {
+			shard.changeloglost = shard.changelog.front().version;
+			shard.changelog.pop_front();
+		}
+	}
+
+	int
+	LDMMap::getVehicleCardinality() {
+		uint64_t card = 0;
+
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			card += m_shards[i].card.load(std::memory_order_relaxed);
+		}
+
+		return card;
 	}
 
 	LDMMap::~LDMMap() {
@@ -71,52 +207,179 @@ namespace ldmmap {
 		clearEvent();
 	}
 
-	LDMMap::LDMMap_error_t
-	LDMMap::insertVehicle(vehicleData_t newVehicleData) {
-		LDMMap_error_t retval;
-		DEFINE_KEYS(key_upper,key_lower,newVehicleData.stationID);
+	LDMMap::snapshotPtr_t
+	LDMMap::publishSnapshot() {
+		std::lock_guard<std::mutex> lk(m_snapshotmut);
+		std::shared_ptr<snapshot_t> snapshot = std::make_shared<snapshot_t>();
+
+		snapshot->version = std::atomic_load(&m_snapshot)->version + 1;
+		snapshot->timestamp_us = get_timestamp_us();
+
+		size_t expected_size = getVehicleCardinality();
+		snapshot->vehicles.reserve(expected_size);
+		snapshot->lat.reserve(expected_size);
+		snapshot->lon.reserve(expected_size);
+		snapshot->phData.reserve(expected_size);
+
+		// Copy one shard at a time, so that the threads updating the database are blocked only while their shard is being copied
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			const vehicleShard_t &shard = m_shards[i];
+			std::shared_lock<std::shared_mutex> lkshard(m_shards[i].shardmut);
+
+			for(uint32_t slot=0;slot<shard.used.size();slot++) {
+				if(shard.used[slot]) {
+					snapshot->vehicles.push_back(shard.records[slot].vehData);
+					snapshot->lat.push_back(shard.lat[slot]);
+					snapshot->lon.push_back(shard.lon[slot]);
+					snapshot->phData.push_back(shard.records[slot].phData);
+				}
+			}
+		}
+
+		{
+			std::shared_lock<std::shared_mutex> lkevent(m_eventmapmut);
+
+			snapshot->events.reserve(m_eventldmmap.size());
 
-		if(m_card==UINT64_MAX) {
-			return LDMMAP_MAP_FULL;
+			for(auto const& [key, val] : m_eventldmmap) {
+				snapshot->events.emplace_back(key,val.eventData);
+			}
 		}
 
-		std::shared_mutex *mapmutexptr;
-		std::unordered_map<uint32_t,returnedVehicleData_t> lowerMap;
+		snapshotPtr_t published = std::move(snapshot);
+		std::atomic_store(&m_snapshot,published);
 
-		if(m_ldmmap.count(key_upper) == 0) {
-			mapmutexptr = new std::shared_mutex();
-			lowerMap[key_lower].vehData = newVehicleData;
-			lowerMap[key_lower].phData = new PHpoints();
+		return published;
+	}
 
-			std::lock_guard<std::shared_mutex> lk(m_mainmapmut);
+	void
+	LDMMap::rangeSelectSnapshot(const snapshotPtr_t &snapshot, double range_m, double lat, double lon, std::vector<size_t> &selectedIdxs) {
+		std::vector<uint64_t> matchMask(DISTANCEFILTER_MASK_WORDS(snapshot->vehicles.size()));
 
-			m_ldmmap[key_upper] = std::pair<std::shared_mutex*,std::unordered_map<uint32_t,returnedVehicleData_t>>(mapmutexptr,lowerMap);
-			m_card++;
+		if(distanceFilter(snapshot->lat.data(),snapshot->lon.data(),snapshot->vehicles.size(),lat,lon,range_m,matchMask.data())==0) {
+			return;
+		}
 
-			retval = LDMMAP_OK;
-		} else {
-			if(m_ldmmap[key_upper].second.count(key_lower) == 0) {
-				m_card++;
-				retval = LDMMAP_OK;
-			} else {
-				retval = LDMMAP_UPDATED;
+		for(size_t w=0;w<matchMask.size();w++) {
+			for(uint64_t word=matchMask[w];word!=0;word&=word-1) {
+				selectedIdxs.push_back(w*64+__builtin_ctzll(word));
 			}
+		}
+	}
 
-			std::lock_guard<std::shared_mutex> lk(*m_ldmmap[key_upper].first);
-			m_ldmmap[key_upper].second[key_lower].vehData = newVehicleData;
+	LDMMap::LDMMap_error_t
+	LDMMap::storeVehicle(vehicleShard_t &shard, std::unordered_map<uint64_t,uint32_t>::iterator slotit, const vehicleData_t &newVehicleData) {
+		LDMMap_error_t retval;
+		uint32_t slot;
 
-			// INSERT operation -> create a new PHpoints object
-			if(retval == LDMMAP_OK) {
-				m_ldmmap[key_upper].second[key_lower].phData = new PHpoints();
+		if(slotit == shard.slotmap.end()) {
+			if(shard.used.size()-shard.freeslots.size()>=UINT32_MAX) {
+				return LDMMAP_MAP_FULL;
 			}
+
+			// INSERT operation -> create a new PHpoints object
+			slot = allocSlot(shard);
+			shard.slotmap[newVehicleData.stationID] = slot;
+			shard.records[slot].phData = std::make_shared<PHpoints>();
+			shard.card++;
+
+			retval = LDMMAP_OK;
+		} else {
+			slot = slotit->second;
+
+			retval = LDMMAP_UPDATED;
 		}
 
+		// Add the vehicle to the expiry index, if it is new or if its timestamp has moved to a different bucket
+		if(retval == LDMMAP_OK || shard.timestamp_us[slot]/LDMMAP_EXPIRY_BUCKET_US != newVehicleData.timestamp_us/LDMMAP_EXPIRY_BUCKET_US) {
+			addExpiryEntry(shard,slot,newVehicleData.timestamp_us);
+		}
+
+		storeSlot(shard,slot,newVehicleData);
+		logChange(shard,newVehicleData.stationID,slot,retval == LDMMAP_OK ? LDMMAP_CHANGE_INSERT : LDMMAP_CHANGE_UPDATE);
+
 		// std::cout << "Updating vehicle: " << newVehicleData.stationID << std::endl;
-		m_ldmmap[key_upper].second[key_lower].phData->insert(newVehicleData);
+		shard.records[slot].phData->insert(newVehicleData);
+
+		// Keep the spatial index of the shard in sync with the new vehicle position (the index is protected by the shard lock,
+		// thus updates of vehicles stored in different shards never wait on each other)
+		shard.grid.update(newVehicleData.stationID,newVehicleData.lat,newVehicleData.lon);
+
+		return retval;
+	}
+
+	LDMMap::LDMMap_error_t
+	LDMMap::insertVehicle(vehicleData_t newVehicleData) {
+		vehicleShard_t &shard = getShard(newVehicleData.stationID);
+
+		// Only the shard containing this vehicle is locked: insertions of vehicles belonging to different shards can proceed in parallel
+		std::lock_guard<std::shared_mutex> lk(shard.shardmut);
+
+		return storeVehicle(shard,shard.slotmap.find(newVehicleData.stationID),newVehicleData);
+	}
+
+	LDMMap::LDMMap_error_t
+	LDMMap::insertVehicles(std::vector<vehicleData_t> &newVehicles, std::vector<LDMMap_error_t> &results,
+		bool (*merge_fcn)(const vehicleData_t *,vehicleData_t &,size_t,void *), void *additional_args) {
+		LDMMap_error_t retval = LDMMAP_OK;
+
+		results.assign(newVehicles.size(),LDMMAP_UNKNOWN_ERROR);
+
+		// Group the vehicles by shard; sorting the (shard, index) pairs keeps the original order within each shard
+		std::vector<std::pair<unsigned int,size_t>> shardItems;
+		shardItems.reserve(newVehicles.size());
+
+		for(size_t i=0;i<newVehicles.size();i++) {
+			shardItems.emplace_back(getShardIdx(newVehicles[i].stationID),i);
+		}
+
+		std::sort(shardItems.begin(),shardItems.end());
+
+		for(size_t i=0;i<shardItems.size();) {
+			vehicleShard_t &shard = m_shards[shardItems[i].first];
+
+			std::lock_guard<std::shared_mutex> lk(shard.shardmut);
+
+			for(unsigned int shardIdx=shardItems[i].first;i<shardItems.size() && shardItems[i].first==shardIdx;i++) {
+				size_t idx = shardItems[i].second;
+				auto slotit = shard.slotmap.find(newVehicles[idx].stationID);
+
+				if(merge_fcn!=nullptr && merge_fcn(slotit == shard.slotmap.end() ? nullptr : &shard.records[slotit->second].vehData,newVehicles[idx],idx,additional_args)==false) {
+					results[idx] = LDMMAP_DISCARDED;
+					continue;
+				}
+
+				results[idx] = storeVehicle(shard,slotit,newVehicles[idx]);
+
+				if(retval == LDMMAP_OK && results[idx] != LDMMAP_OK && results[idx] != LDMMAP_UPDATED) {
+					retval = results[idx];
+				}
+			}
+		}
 
 		return retval;
 	}
 
+	LDMMap::LDMMap_error_t
+	LDMMap::upsertVehicle(uint64_t stationID, vehicleData_t &newVehicleData,
+		bool (*merge_fcn)(const vehicleData_t *,vehicleData_t &,void *), void *additional_args) {
+		vehicleShard_t &shard = getShard(stationID);
+
+		std::lock_guard<std::shared_mutex> lk(shard.shardmut);
+
+		auto slotit = shard.slotmap.find(stationID);
+
+		newVehicleData.stationID = stationID;
+
+		// The callback sees the stored data and the new data under the same lock acquisition used to store the new data: no other
+		// update of this vehicle can happen in between
+		if(merge_fcn!=nullptr && merge_fcn(slotit == shard.slotmap.end() ? nullptr : &shard.records[slotit->second].vehData,newVehicleData,additional_args)==false) {
+			return LDMMAP_DISCARDED;
+		}
+
+		return storeVehicle(shard,slotit,newVehicleData);
+	}
+
 	LDMMap::event_LDMMap_error_t
 	LDMMap::insertEvent(eventData_t newEventData, uint64_t eventkey_map) {
 		event_LDMMap_error_t reteveval;
@@ -124,12 +387,13 @@ namespace ldmmap {
 			return event_LDMMAP_FULL;
 		}
 		//printf("EVENTKEY IN INSERT EVENT: %lu\n",eventkey_map); // For debug purposes
-		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
 
 		if (m_eventldmmap.count(eventkey_map)==0) {
 			newEventData.insertEventTimestamp_us = get_timestamp_us();
 
 			m_eventldmmap[eventkey_map].eventData = newEventData;
+			m_eventgrid.update(eventkey_map,newEventData.eventLatitude,newEventData.eventLongitude);
 			m_eventcard++;
 			reteveval = event_LDMMAP_OK;
 		}else {
@@ -141,36 +405,36 @@ namespace ldmmap {
 
 	LDMMap::LDMMap_error_t
 	LDMMap::removeVehicle(uint64_t stationID) {
-		DEFINE_KEYS(key_upper,key_lower,stationID);
+		vehicleShard_t &shard = getShard(stationID);
 
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+		std::lock_guard<std::shared_mutex> lk(shard.shardmut);
 
-		if(m_ldmmap.count(key_upper) == 0) {
-			return LDMMAP_ITEM_NOT_FOUND;
-		} else {
-			if(m_ldmmap[key_upper].second.count(key_lower) == 0) {
-				return LDMMAP_ITEM_NOT_FOUND;
-			} else {
-				std::lock_guard<std::shared_mutex> lk(*m_ldmmap[key_upper].first);
-				m_ldmmap[key_upper].second.erase(stationID);
-				m_card--;
+		auto slotit = shard.slotmap.find(stationID);
 
-			}
+		if(slotit == shard.slotmap.end()) {
+			return LDMMAP_ITEM_NOT_FOUND;
 		}
 
+		freeSlot(shard,slotit->second);
+		logChange(shard,stationID,slotit->second,LDMMAP_CHANGE_DELETE);
+		shard.slotmap.erase(slotit);
+		shard.card--;
+		shard.grid.remove(stationID);
+
 		return LDMMAP_OK;
 	}
 
 	LDMMap::event_LDMMap_error_t
 	LDMMap::removeEvent(uint64_t eventkey_map){
 
-		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
 
 		if(m_eventldmmap.count(eventkey_map) == 0){
 			return event_LDMMAP_ITEM_NOT_FOUND;
 		} else {
 
 			m_eventldmmap.erase(eventkey_map);
+			m_eventgrid.remove(eventkey_map);
 			m_eventcard--;
 			return event_LDMMAP_REMOVED;
 		}
@@ -178,21 +442,18 @@ namespace ldmmap {
 
 	LDMMap::LDMMap_error_t
 	LDMMap::lookupVehicle(uint64_t stationID,returnedVehicleData_t &retVehicleData) {
-		DEFINE_KEYS(key_upper,key_lower,stationID);
+		vehicleShard_t &shard = getShard(stationID);
 
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+		std::shared_lock<std::shared_mutex> lk(shard.shardmut);
 
-		if(m_ldmmap.count(key_upper) == 0) {
+		auto slotit = shard.slotmap.find(stationID);
+
+		if(slotit == shard.slotmap.end()) {
 			return LDMMAP_ITEM_NOT_FOUND;
-		} else {
-			if(m_ldmmap[key_upper].second.count(key_lower) == 0) {
-				return LDMMAP_ITEM_NOT_FOUND;
-			} else {
-				std::shared_lock<std::shared_mutex> lk(*m_ldmmap[key_upper].first);
-				retVehicleData = m_ldmmap[key_upper].second[key_lower];
-			}
 		}
 
+		retVehicleData = shard.records[slotit->second];
+
 		return LDMMAP_OK;
 	}
 
@@ -200,41 +461,109 @@ namespace ldmmap {
 	LDMMap::event_LDMMap_error_t
 	LDMMap:: lookupAndUpdateEvent(uint64_t eventkey_map, double LatNewEve, double LonNewEve, uint64_t NewCauseCode,
 		eventData_t &UpEveData,returnedEventData_t &UpEventData , uint64_t &closestEvent_key) {
-		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
-		std::cout << "new eventkey_map: " << eventkey_map << std::endl;
-		if (m_eventldmmap.count(eventkey_map)!=0) {
-			m_eventldmmap[eventkey_map] = UpEventData;
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
+
+		auto eventit = m_eventldmmap.find(eventkey_map);
+
+		if (eventit!=m_eventldmmap.end()) {
+			// Store the new event data, keeping the stored position consistent with the one in the spatial index (an event with
+			// the same key has, by construction, the same quantized position)
+			eventit->second.eventData = UpEveData;
+			UpEventData = eventit->second;
 			return event_LDMMAP_UPDATED;
 		}
 
-		double minDistanceEvents = 10;
+		double minDistanceEvents = LDMMAP_NEAR_EVENT_RANGE_M;
+		bool nearEventFound = false;
+		std::vector<uint64_t> candidateKeys;
+		std::vector<uint64_t> sameCauseKeys;
+		std::vector<double> sameCauseLats;
+		std::vector<double> sameCauseLons;
+
+		// Get from the spatial index only the events located in the cells around the new event, and filter the ones with the
+		// same causeCode in a single batch
+		m_eventgrid.query(LatNewEve,LonNewEve,minDistanceEvents,candidateKeys);
 
-		// Looking for the closest event with the same causeCode
-		for (const auto &[key, val]:m_eventldmmap) {
-			if (val.eventData.eventCauseCode == NewCauseCode) {
-				double distance = haversineDist(LatNewEve,	LonNewEve,
-					val.eventData.eventLatitude, val.eventData.eventLongitude);
+		for (uint64_t key:candidateKeys) {
+			const eventData_t &eventData = m_eventldmmap[key].eventData;
 
-				if (distance <= 10.0 && distance <= minDistanceEvents) {
-					minDistanceEvents = distance;
-					closestEvent_key = key;
-					//For debug purposes
-					//std::cout <<"Closest EventKey: " << closestEvent_key << std::endl;
-					//std::cout <<"minDistanceEvents: " << minDistanceEvents << std::endl;
+			if (eventData.eventCauseCode == NewCauseCode) {
+				sameCauseKeys.push_back(key);
+				sameCauseLats.push_back(eventData.eventLatitude);
+				sameCauseLons.push_back(eventData.eventLongitude);
+			}
+		}
+
+		std::vector<uint64_t> nearMask(DISTANCEFILTER_MASK_WORDS(sameCauseKeys.size()));
+
+		if(distanceFilter(sameCauseLats.data(),sameCauseLons.data(),sameCauseKeys.size(),LatNewEve,LonNewEve,minDistanceEvents,nearMask.data())>0) {
+			// Looking for the closest event with the same causeCode, among the ones within 10 m
+			for (size_t i=0;i<sameCauseKeys.size();i++) {
+				if (nearMask[i/64] & (UINT64_C(1) << (i%64))) {
+					double distance = haversineDist(LatNewEve,	LonNewEve,
+						sameCauseLats[i], sameCauseLons[i]);
+
+					if (distance <= minDistanceEvents) {
+						minDistanceEvents = distance;
+						closestEvent_key = sameCauseKeys[i];
+						nearEventFound = true;
+						//For debug purposes
+						//std::cout <<"Closest EventKey: " << closestEvent_key << std::endl;
+						//std::cout <<"minDistanceEvents: " << minDistanceEvents << std::endl;
+					}
 				}
 			}
 		}
 
 		// If a close event is found, update its data
-		if (closestEvent_key!=0) {
-			m_eventldmmap[closestEvent_key].eventData.insertEventTimestamp_us = UpEveData.insertEventTimestamp_us;
-			m_eventldmmap[closestEvent_key].eventData.eventValidityDuration = UpEveData.eventValidityDuration;
+		if (nearEventFound) {
+			eventData_t &nearEventData = m_eventldmmap[closestEvent_key].eventData;
+
+			nearEventData.insertEventTimestamp_us = UpEveData.insertEventTimestamp_us;
+			nearEventData.eventValidityDuration = UpEveData.eventValidityDuration;
 			return event_LDMMAP_NEAR_EVENT_UPDATED;
 		} else {
 			return event_LDMMAP_ITEM_NOT_FOUND;
 		}
 	}
 
+	LDMMap::event_LDMMap_error_t
+	LDMMap::eventrangeselect(double eventrange_m, double evelat, double evelon, std::vector<returnedEventData_t> &selectedEvents) {
+		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
+
+		std::vector<uint64_t> candidateKeys;
+		std::vector<double> candidateLats;
+		std::vector<double> candidateLons;
+
+		// Get from the spatial index only the events located in the cells overlapping the requested area
+		m_eventgrid.query(evelat,evelon,eventrange_m,candidateKeys);
+
+		candidateLats.reserve(candidateKeys.size());
+		candidateLons.reserve(candidateKeys.size());
+
+		for (uint64_t key:candidateKeys) {
+			const eventData_t &eventData = m_eventldmmap[key].eventData;
+
+			candidateLats.push_back(eventData.eventLatitude);
+			candidateLons.push_back(eventData.eventLongitude);
+		}
+
+		// Perform the exact distance check on all the candidates in a single batch
+		std::vector<uint64_t> matchMask(DISTANCEFILTER_MASK_WORDS(candidateKeys.size()));
+
+		if (distanceFilter(candidateLats.data(),candidateLons.data(),candidateKeys.size(),evelat,evelon,eventrange_m,matchMask.data())==0) {
+			return event_LDMMAP_ITEM_NOT_FOUND;
+		}
+
+		for (size_t i=0;i<candidateKeys.size();i++) {
+			if (matchMask[i/64] & (UINT64_C(1) << (i%64))) {
+				selectedEvents.push_back(m_eventldmmap[candidateKeys[i]]);
+			}
+		}
+
+		return event_LDMMAP_OK;
+	}
+
 	/*
 	LDMMap::event_LDMMap_error_t
 	LDMMap::lookupEvent(uint64_t eventkey_map, returnedEventData_t &retEveData, uint64_t &found_event_key) {
@@ -322,23 +651,186 @@ namespace ldmmap {
 	}
 	*/
 
+	template <typename visitFcn>
+	void
+	LDMMap::rangeVisitVehicle(double range_m, double lat, double lon, visitFcn &&visit) {
+		std::vector<uint64_t> candidateIDs;
+		std::vector<uint32_t> candidateSlots;
+		std::vector<double> candidateLats;
+		std::vector<double> candidateLons;
+		std::vector<uint64_t> matchMask;
+
+		// Each shard is locked only once, and its spatial index is read with the same lock
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			vehicleShard_t &shard = m_shards[i];
+
+			std::shared_lock<std::shared_mutex> lk(shard.shardmut);
+
+			// Get from the spatial index only the vehicles located in the cells overlapping the requested area
+			// The exact distance check is then performed on these candidates only
+			candidateIDs.clear();
+			shard.grid.query(lat,lon,range_m,candidateIDs);
+
+			if(candidateIDs.empty()) {
+				continue;
+			}
+
+			// If most of the shard is returned as candidate, a linear sweep over the hot arrays is faster than looking up each candidate
+			if(candidateIDs.size()*LDMMAP_SWEEP_FRACTION >= shard.card.load()) {
+				rangeSweepShard(shard,range_m,lat,lon,matchMask,visit);
+
+				continue;
+			}
+
+			candidateSlots.clear();
+			candidateLats.clear();
+			candidateLons.clear();
+
+			for(uint64_t stationID : candidateIDs) {
+				auto slotit = shard.slotmap.find(stationID);
+
+				if(slotit != shard.slotmap.end()) {
+					candidateSlots.push_back(slotit->second);
+					candidateLats.push_back(shard.lat[slotit->second]);
+					candidateLons.push_back(shard.lon[slotit->second]);
+				}
+			}
+
+			// Perform the exact distance check on all the candidates of this shard in a single batch
+			matchMask.resize(DISTANCEFILTER_MASK_WORDS(candidateSlots.size()));
+
+			if(distanceFilter(candidateLats.data(),candidateLons.data(),candidateSlots.size(),lat,lon,range_m,matchMask.data())>0) {
+				for(size_t j=0;j<candidateSlots.size();j++) {
+					if(matchMask[j/64] & (UINT64_C(1) << (j%64))) {
+						visit(static_cast<const vehicleShard_t &>(shard),candidateSlots[j]);
+					}
+				}
+			}
+		}
+	}
+
+	template <typename visitFcn>
+	void
+	LDMMap::rangeSweepShard(const vehicleShard_t &shard, double range_m, double lat, double lon, std::vector<uint64_t> &matchMask, visitFcn &&visit) {
+		size_t num_slots = shard.used.size();
+
+		// First pass: only the latitude and longitude arrays are read, by the batched distance filter
+		// Free slots have their latitude and longitude set to NaN: the distance check always fails for them
+		matchMask.resize(DISTANCEFILTER_MASK_WORDS(num_slots));
+
+		if(distanceFilter(shard.lat.data(),shard.lon.data(),num_slots,lat,lon,range_m,matchMask.data())==0) {
+			return;
+		}
+
+		// Second pass: read the data of the selected vehicles only
+		for(size_t w=0;w<matchMask.size();w++) {
+			for(uint64_t word=matchMask[w];word!=0;word&=word-1) {
+				visit(shard,static_cast<uint32_t>(w*64+__builtin_ctzll(word)));
+			}
+		}
+	}
+
+	bool
+	LDMMap::setSpatialIndexCellSize(double cell_size_m) {
+		if(cell_size_m < SPATIALGRID_MIN_CELL_SIZE_M) {
+			return false;
+		}
+
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			std::lock_guard<std::shared_mutex> lk(m_shards[i].shardmut);
+
+			m_shards[i].grid.setCellSize(cell_size_m);
+		}
+
+		return true;
+	}
+
+	inline void
+	LDMMap::projectSlot(const vehicleShard_t &shard, uint32_t slot, uint32_t fields, projectedVehicleData_t &proj) {
+		// The fields stored in the hot arrays are read from there, the other ones from the full record
+		const vehicleData_t &vehData = shard.records[slot].vehData;
+
+		if(fields & LDMMAP_FIELD_STATIONID) proj.stationID = shard.stationID[slot];
+		if(fields & LDMMAP_FIELD_LAT) proj.lat = shard.lat[slot];
+		if(fields & LDMMAP_FIELD_LON) proj.lon = shard.lon[slot];
+		if(fields & LDMMAP_FIELD_ELEVATION) proj.elevation = vehData.elevation;
+		if(fields & LDMMAP_FIELD_HEADING) proj.heading = shard.heading[slot];
+		if(fields & LDMMAP_FIELD_SPEED) proj.speed_ms = shard.speed_ms[slot];
+		if(fields & LDMMAP_FIELD_GNTIMESTAMP) proj.gnTimestamp = vehData.gnTimestamp;
+		if(fields & LDMMAP_FIELD_CAMTIMESTAMP) proj.camTimestamp = vehData.camTimestamp;
+		if(fields & LDMMAP_FIELD_TIMESTAMP) proj.timestamp_us = shard.timestamp_us[slot];
+		if(fields & LDMMAP_FIELD_ON_MSG_TIMESTAMP) proj.on_msg_timestamp_us = vehData.on_msg_timestamp_us;
+		if(fields & LDMMAP_FIELD_VEHICLEWIDTH) proj.vehicleWidth = vehData.vehicleWidth;
+		if(fields & LDMMAP_FIELD_VEHICLELENGTH) proj.vehicleLength = vehData.vehicleLength;
+		if(fields & LDMMAP_FIELD_STATIONTYPE) proj.stationType = shard.stationType[slot];
+		if(fields & LDMMAP_FIELD_EXTERIORLIGHTS) proj.exteriorLights = vehData.exteriorLights;
+		if(fields & LDMMAP_FIELD_PHDATA) proj.phData = shard.records[slot].phData.get();
+	}
+
 	LDMMap::LDMMap_error_t
 	LDMMap::rangeSelectVehicle(double range_m, double lat, double lon, std::vector<returnedVehicleData_t> &selectedVehicles) {
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+		rangeVisitVehicle(range_m,lat,lon,[&selectedVehicles](const vehicleShard_t &shard, uint32_t slot) {
+			selectedVehicles.push_back(shard.records[slot]);
+		});
+
+		return LDMMAP_OK;
+	}
 
-		for(auto const& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps
-			val.first->lock_shared();
+	LDMMap::LDMMap_error_t
+	LDMMap::rangeSelectVehicleFields(double range_m, double lat, double lon, uint32_t fields,
+		void (*oper_fcn)(const projectedVehicleData_t &,void *), void *additional_args) {
+		projectedVehicleData_t proj = {};
 
-			for(auto const& [keyl, vall] : val.second) {
-				if(haversineDist(lat,lon,vall.vehData.lat,vall.vehData.lon)<=range_m) {
-					selectedVehicles.push_back(vall);
-				}
+		rangeVisitVehicle(range_m,lat,lon,[&](const vehicleShard_t &shard, uint32_t slot) {
+			projectSlot(shard,slot,fields,proj);
+			oper_fcn(proj,additional_args);
+		});
+
+		return LDMMAP_OK;
+	}
+
+	LDMMap::LDMMap_error_t
+	LDMMap::rangeSelectVehicleFields(double range_m, uint64_t stationID, uint32_t fields,
+		void (*oper_fcn)(const projectedVehicleData_t &,void *), void *additional_args) {
+		double lat, lon;
+
+		// Get the latitude and longitude of the speficied vehicle, reading the hot arrays only
+		{
+			vehicleShard_t &shard = getShard(stationID);
+			std::shared_lock<std::shared_mutex> lk(shard.shardmut);
+
+			auto slotit = shard.slotmap.find(stationID);
+
+			if(slotit == shard.slotmap.end()) {
+				return LDMMAP_ITEM_NOT_FOUND;
 			}
 
-			val.first->unlock_shared();
+			lat = shard.lat[slotit->second];
+			lon = shard.lon[slotit->second];
 		}
 
+		// Perform a rangeSelectVehicleFields() centered on that latitude and longitude values
+		return rangeSelectVehicleFields(range_m,lat,lon,fields,oper_fcn,additional_args);
+	}
+
+	LDMMap::LDMMap_error_t
+	LDMMap::rangeSelectVehicleFields(double range_m, double lat, double lon, uint32_t fields, std::vector<projectedVehicleData_t> &selectedVehicles,
+		std::vector<std::shared_ptr<PHpoints>> *selectedPHpoints) {
+		// The raw PHpoints pointers would no longer be valid after the shard locks are released: the shared pointers are
+		// returned instead, keeping the PHpoints objects alive
+		bool copyPHpoints = (fields & LDMMAP_FIELD_PHDATA) && selectedPHpoints!=nullptr;
+		fields &= ~LDMMAP_FIELD_PHDATA;
+
+		rangeVisitVehicle(range_m,lat,lon,[&](const vehicleShard_t &shard, uint32_t slot) {
+			selectedVehicles.emplace_back();
+			selectedVehicles.back().phData = nullptr;
+			projectSlot(shard,slot,fields,selectedVehicles.back());
+
+			if(copyPHpoints) {
+				selectedPHpoints->push_back(shard.records[slot].phData);
+			}
+		});
+
 		return LDMMAP_OK;
 	}
 
@@ -356,26 +848,146 @@ namespace ldmmap {
 		return rangeSelectVehicle(range_m,retData.vehData.lat,retData.vehData.lon,selectedVehicles);
 	}
 
+	LDMMap::LDMMap_error_t
+	LDMMap::subscribe(uint64_t sinceVersion, std::vector<vehicleChange_t> &changes, uint64_t &currentVersion) {
+		// Type of the first change and version of the last change of each vehicle, in the current shard
+		std::unordered_map<uint64_t,std::pair<changeType_t,uint64_t>> changedIDs;
+
+		// Any change happening after this point will be reported again by the next call
+		currentVersion = m_version.load();
+
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			vehicleShard_t &shard = m_shards[i];
+			std::shared_lock<std::shared_mutex> lk(shard.shardmut);
+
+			if(shard.changeloglost > sinceVersion) {
+				return LDMMAP_CHANGES_LOST;
+			}
+
+			// The change log is sorted by version: skip all the entries up to sinceVersion
+			auto cit = std::upper_bound(shard.changelog.begin(),shard.changelog.end(),sinceVersion,
+				[](uint64_t version, const changeLogEntry_t &entry) {return version < entry.version;});
+
+			if(cit == shard.changelog.end()) {
+				continue;
+			}
+
+			changedIDs.clear();
+
+			for(;cit!=shard.changelog.end();++cit) {
+				auto ins = changedIDs.emplace(cit->stationID,std::make_pair(cit->type,cit->version));
+
+				if(!ins.second) {
+					ins.first->second.second = cit->version;
+				}
+			}
+
+			// Report each vehicle only once, with its current data
+			for(auto const& [stationID, change] : changedIDs) {
+				auto slotit = shard.slotmap.find(stationID);
+
+				changes.emplace_back();
+				vehicleChange_t &vehChange = changes.back();
+
+				vehChange.stationID = stationID;
+
+				if(slotit == shard.slotmap.end()) {
+					vehChange.type = LDMMAP_CHANGE_DELETE;
+					vehChange.version = change.second;
+				} else {
+					vehChange.type = change.first == LDMMAP_CHANGE_INSERT ? LDMMAP_CHANGE_INSERT : LDMMAP_CHANGE_UPDATE;
+					vehChange.version = shard.version[slotit->second];
+					vehChange.vehicle = shard.records[slotit->second];
+				}
+			}
+		}
+
+		return LDMMAP_OK;
+	}
+
 	void
-	LDMMap::deleteVehicleOlderThan(double time_milliseconds) {
-		uint64_t now = get_timestamp_us();
+	LDMMap::addExpiryEntry(vehicleShard_t &shard, uint32_t slot, uint64_t timestamp_us) {
+		if(shard.expiryentries >= LDMMAP_EXPIRY_REBUILD_FACTOR*shard.card+LDMMAP_EXPIRY_REBUILD_MIN_ENTRIES) {
+			// Too many old entries: rebuild the index with a single entry for each vehicle (the current one, for "slot",
+			// is added below)
+			shard.expirybuckets.clear();
+			shard.expiryentries = 0;
+
+			for(uint32_t s=0;s<shard.used.size();s++) {
+				if(shard.used[s] && s != slot) {
+					shard.expirybuckets[shard.timestamp_us[s]/LDMMAP_EXPIRY_BUCKET_US].push_back(s);
+					shard.expiryentries++;
+				}
+			}
+		}
+
+		shard.expirybuckets[timestamp_us/LDMMAP_EXPIRY_BUCKET_US].push_back(slot);
+		shard.expiryentries++;
+	}
+
+	void
+	LDMMap::expireShard(vehicleShard_t &shard, uint64_t now, double time_milliseconds, void (*oper_fcn)(uint64_t,void *), void *additional_args) {
+		// An entry is expired when now-timestamp_us > time_milliseconds*1000, i.e., when timestamp_us < cutoff_us
+		double cutoff_us = (double) now - time_milliseconds*1000.0;
+
+		if(cutoff_us <= 0) {
+			return;
+		}
+
+		// Only the buckets up to the one containing cutoff_us may contain expired entries
+		// All the buckets before it are entirely expired, while the last one may be only partially expired
+		uint64_t last_bucket = ((uint64_t) cutoff_us)/LDMMAP_EXPIRY_BUCKET_US;
+
+		for(auto bit=shard.expirybuckets.begin();bit!=shard.expirybuckets.end() && bit->first<=last_bucket;) {
+			std::vector<uint32_t> &slots = bit->second;
+			size_t kept = 0;
+
+			for(uint32_t slot : slots) {
+				// Discard the old entries: the slot has been freed, or the vehicle has been updated after this entry was added
+				// (in this case, another entry for the same slot is stored in a newer bucket)
+				if(!shard.used[slot] || shard.timestamp_us[slot]/LDMMAP_EXPIRY_BUCKET_US != bit->first) {
+					continue;
+				}
 
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+				if(((double)(now-shard.timestamp_us[slot]))/1000.0 > time_milliseconds) {
+					uint64_t stationID = shard.stationID[slot];
 
-		for(auto& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps
-			val.first->lock();
+					if(oper_fcn != nullptr) {
+						oper_fcn(stationID,additional_args);
+					}
 
-			for (auto mit=val.second.cbegin();mit!=val.second.cend();) {
-				if(((double)(now-mit->second.vehData.timestamp_us))/1000.0 > time_milliseconds) {
-					mit = val.second.erase(mit);
-					m_card--;
+					shard.grid.remove(stationID);
+					shard.slotmap.erase(stationID);
+					freeSlot(shard,slot);
+					logChange(shard,stationID,slot,LDMMAP_CHANGE_DELETE);
+					shard.card--;
 				} else {
-					++mit;
+					// Not yet expired (this can only happen in the last bucket)
+					slots[kept++] = slot;
 				}
 			}
 
-			val.first->unlock();
+			shard.expiryentries -= slots.size()-kept;
+
+			if(kept == 0) {
+				bit = shard.expirybuckets.erase(bit);
+			} else {
+				slots.resize(kept);
+				++bit;
+			}
+		}
+	}
+
+	void
+	LDMMap::deleteVehicleOlderThan(double time_milliseconds) {
+		uint64_t now = get_timestamp_us();
+
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			// Iterate over the single shards, locking one shard at a time
+			vehicleShard_t &shard = m_shards[i];
+			std::lock_guard<std::shared_mutex> lk(shard.shardmut);
+
+			expireShard(shard,now,time_milliseconds,nullptr,nullptr);
 		}
 	}
 
@@ -383,9 +995,10 @@ namespace ldmmap {
 	void
 	LDMMap::deleteEventOlderThan(returnedEventData_t validityDuration) {
 		uint64_t evenow = get_timestamp_us();
-		//std::lock_guard<std::shared_mutex> lk(m_eventmainmapmut);
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
 		for (auto eit = m_eventldmmap.begin(); eit != m_eventldmmap.end();) {
 			if ((double) ((evenow-eit -> second.eventData.eventValidityDuration)/1000.0) > validityDuration.eventData.eventValidityDuration*1000) {
+				m_eventgrid.remove(eit->first);
 				eit = m_eventldmmap.erase(eit);
 				m_eventcard--;
 			} else {
@@ -399,32 +1012,20 @@ namespace ldmmap {
 		uint64_t now = get_timestamp_us();
 		//std::cout << "NOW V: " << now << std::endl;
 
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
-
-		for(auto& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps
-			val.first->lock();
-
-			for (auto mit=val.second.cbegin();mit!=val.second.cend();) {
-				if(((double)(now-mit->second.vehData.timestamp_us))/1000.0 > time_milliseconds) {
-					// With respect to deleteOlderThan(), this function will also call oper_fcn() for each deleted entry
-					oper_fcn(mit->second.vehData.stationID,additional_args);
-					mit = val.second.erase(mit);
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			// Iterate over the single shards, locking one shard at a time
+			vehicleShard_t &shard = m_shards[i];
+			std::lock_guard<std::shared_mutex> lk(shard.shardmut);
 
-					m_card--;
-				} else {
-					++mit;
-				}
-			}
-
-			val.first->unlock();
+			// With respect to deleteOlderThan(), this function will also call oper_fcn() for each deleted entry
+			expireShard(shard,now,time_milliseconds,oper_fcn,additional_args);
 		}
 	}
 
 	// This function deletes all the events older than a certain validity duration
 	void LDMMap::deleteEventOlderThanAndExecute( void (*oper_fcn)(uint64_t, void *), void *additional_args) {
 		uint64_t now = get_timestamp_us();
-		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
 
 		// Iterate over the event map and remove events that are older than their validity duration
 		for (auto it = m_eventldmmap.cbegin(); it != m_eventldmmap.cend();) {
@@ -440,6 +1041,7 @@ namespace ldmmap {
 			if (((double)(now - it->second.eventData.insertEventTimestamp_us)) / 1000.0 > validityDuration) {
 				// Chiama la funzione di callback per ogni evento rimosso
 				oper_fcn(it->first, additional_args);
+				m_eventgrid.remove(it->first);
 				it = m_eventldmmap.erase(it);
 				m_eventcard--;
 				std::cout <<"\n"<<std::endl;
@@ -451,33 +1053,42 @@ namespace ldmmap {
 
 	void
 	LDMMap::clear() {
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
-
-		for(auto& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps and clear them
-			// Delete also the shared mutex objects
-
-			for(auto const& [keyl, vall] : val.second) {
-				vall.phData->clear();
-				delete vall.phData;
-			}
-
-			val.second.clear();
-			delete val.first;
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			// Iterate over the single shards and clear them
+			vehicleShard_t &shard = m_shards[i];
+			std::lock_guard<std::shared_mutex> lk(shard.shardmut);
+
+			shard.slotmap.clear();
+			shard.lat.clear();
+			shard.lon.clear();
+			shard.heading.clear();
+			shard.speed_ms.clear();
+			shard.timestamp_us.clear();
+			shard.stationID.clear();
+			shard.stationType.clear();
+			shard.used.clear();
+			shard.version.clear();
+			shard.records.clear();
+			shard.freeslots.clear();
+			shard.expirybuckets.clear();
+			shard.expiryentries = 0;
+			shard.grid.clear();
+
+			// The deletions are not recorded one by one: the subscribers will have to read the whole database again
+			shard.changelog.clear();
+			shard.changeloglost = ++m_version;
+
+			// Set the cardinality of the shard to 0 again
+			shard.card = 0;
 		}
-
-		// Clear the upper map
-		m_ldmmap.clear();
-
-		// Set the cardinality of the map to 0 again
-		m_card = 0;
 	}
 
 	void LDMMap::clearEvent() {
-		std::shared_lock<std::shared_mutex> lk(m_eventmapmut);
+		std::lock_guard<std::shared_mutex> lk(m_eventmapmut);
 
-		// Clear the event map
+		// Clear the event map and its spatial index
 		m_eventldmmap.clear();
+		m_eventgrid.clear();
 
 		// Set the cardinality of the map to 0 again
 		m_eventcard = 0;
@@ -487,17 +1098,13 @@ namespace ldmmap {
 	LDMMap::printAllVehicleContents(std::string label) {
 		std::cout << "\n[" << label << "] Vehicle IDs: ";
 
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
-
-		for(auto const& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps
-			val.first->lock_shared();
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			// Iterate over the single shards
+			std::shared_lock<std::shared_mutex> lk(m_shards[i].shardmut);
 
-			for(auto const& [keyl, vall] : val.second) {
-				std::cout << vall.vehData.stationID << ", ";
+			for(auto const& [keyl, slot] : m_shards[i].slotmap) {
+				std::cout << m_shards[i].stationID[slot] << ", ";
 			}
-
-			val.first->unlock_shared();
 		}
 
 		std::cout << std::endl;
@@ -535,18 +1142,18 @@ namespace ldmmap {
 
 	void
 	LDMMap::executeOnAllVehicleContents(void (*oper_fcn)(vehicleData_t,void *),void *additional_args) {
-		std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+		for(unsigned int i=0;i<m_num_shards;i++) {
+			// Iterate over the single shards
+			std::shared_lock<std::shared_mutex> lk(m_shards[i].shardmut);
 
-		for(auto const& [key, val] : m_ldmmap) {
-			// Iterate over the single lower maps
-			val.first->lock_shared();
+			const vehicleShard_t &shard = m_shards[i];
 
-			for(auto const& [keyl, vall] : val.second) {
+			for(uint32_t slot=0;slot<shard.used.size();slot++) {
 				// Execute the callback for every entry
-				oper_fcn(vall.vehData,additional_args);
+				if(shard.used[slot]) {
+					oper_fcn(shard.records[slot].vehData,additional_args);
+				}
 			}
-
-			val.first->unlock_shared();
 		}
 	}
 
@@ -563,19 +1170,59 @@ namespace ldmmap {
 
 	LDMMap::LDMMap_error_t
     LDMMap::getAllIDsVehicles(std::set<uint64_t> &selectedIDs) {
-        std::shared_lock<std::shared_mutex> lk(m_mainmapmut);
+        for(unsigned int i=0;i<m_num_shards;i++) {
+            // Iterate over the single shards
+            std::shared_lock<std::shared_mutex> lk(m_shards[i].shardmut);
 
-        for(auto const& [key, val] : m_ldmmap) {
-            // Iterate over the single lower maps
-            val.first->lock_shared();
-
-            for(auto const& [keyl, vall] : val.second) {
-                selectedIDs.insert(vall.vehData.stationID);
+            for(auto const& [keyl, slot] : m_shards[i].slotmap) {
+                selectedIDs.insert(keyl);
             }
-
-            val.first->unlock_shared();
         }
         return LDMMAP_OK;
     }
 
+
+	uint64_t
+	LDMMap::allocateDerivedID() {
+		uint32_t offset;
+
+		std::lock_guard<std::mutex> lk(m_derivedidmut);
+
+		if(!m_derivedid_freelist.empty()) {
+			offset = m_derivedid_freelist.front();
+			m_derivedid_freelist.pop_front();
+		} else if(m_derivedid_next < LDMMAP_DERIVED_ID_RANGE) {
+			offset = m_derivedid_next++;
+
+			if(m_derivedid_bitmap.size() < (m_derivedid_next+63)/64) {
+				m_derivedid_bitmap.push_back(0);
+			}
+		} else {
+			// All the IDs of the range are in use
+			return 0;
+		}
+
+		m_derivedid_bitmap[offset/64] |= UINT64_C(1) << (offset%64);
+
+		return LDMMAP_DERIVED_ID_BASE + offset;
+	}
+
+	void
+	LDMMap::releaseDerivedID(uint64_t id) {
+		if(!isDerivedID(id)) {
+			return;
+		}
+
+		uint32_t offset = static_cast<uint32_t>(id - LDMMAP_DERIVED_ID_BASE);
+
+		std::lock_guard<std::mutex> lk(m_derivedidmut);
+
+		if(offset >= m_derivedid_next || !(m_derivedid_bitmap[offset/64] & (UINT64_C(1) << (offset%64)))) {
+			return;
+		}
+
+		m_derivedid_bitmap[offset/64] &= ~(UINT64_C(1) << (offset%64));
+		m_derivedid_freelist.push_back(offset);
+	}
+
 }
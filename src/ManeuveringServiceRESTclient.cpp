@@ -146,7 +146,7 @@ web::json::value ManeuveringServiceRestClient::make_SLDM_json(int eventID) {
 			vehdata.vehData.vehicleLength,
 			vehdata.vehData.vehicleWidth,
 			vehdata.vehData.speed_ms,
-			vehdata.phData,
+			vehdata.phData.get(),
 			vehdata.vehData.sourceQuadkey,
 			refRelDist,
 			vehdata.vehData.stationType,
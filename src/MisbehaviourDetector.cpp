@@ -70,6 +70,7 @@ const std::map<int,std::string> misbehaviourStringsEvent={
 };
 
 uint64_t MisbehaviourDetector::processCAM(proton::binary message_bin, ldmmap::vehicleData_t vehdata, Security::Security_error_t sec_retval, storedCertificate_t certificateData) {
+	std::lock_guard<std::mutex> lk(m_state_mutex);
 
 	uint64_t MB_CODE=0, unavailables=0;
 	ldmmap::LDMMap::LDMMap_error_t db_retval;
@@ -234,6 +235,7 @@ uint64_t MisbehaviourDetector::processCAM(proton::binary message_bin, ldmmap::ve
 }
 
 uint64_t MisbehaviourDetector::processVAM(proton::binary message_bin, ldmmap::vehicleData_t vehdata, Security::Security_error_t sec_retval, storedCertificate_t certificateData) {
+	std::lock_guard<std::mutex> lk(m_state_mutex);
 
 	uint64_t MB_CODE=0, unavailables=0;
 	ldmmap::LDMMap::LDMMap_error_t db_retval;
@@ -298,6 +300,7 @@ uint64_t MisbehaviourDetector::processVAM(proton::binary message_bin, ldmmap::ve
 }
 
 uint64_t MisbehaviourDetector::processCPM(proton::binary message_bin, std::vector<ldmmap::vehicleData_t> PO_vec, Security::Security_error_t sec_retval, storedCertificate_t certificateData) {
+	std::lock_guard<std::mutex> lk(m_state_mutex);
 
 	uint64_t MB_CODE=0, unavailables=0;
 	ldmmap::LDMMap::LDMMap_error_t db_retval;
@@ -1288,6 +1291,7 @@ size_t WriteCallbackMBD(void* ptr, size_t size, size_t nmemb, void* stream) {
 
 
 void MisbehaviourDetector::processDENM(proton::binary message_bin, ldmmap::eventData_t evedata, Security::Security_error_t sec_retval, storedCertificate_t certificateData) {
+	std::lock_guard<std::mutex> lk(m_state_mutex);
 	bool pending;
 	pendingEvent_t currentEvent;
 
@@ -1367,7 +1371,7 @@ void MisbehaviourDetector::processDENM(proton::binary message_bin, ldmmap::event
 			if (lastEventPresent) {
 				if (evedata.eventHistory.isAvailable() && lastEvent.eventHistory.isAvailable()) {
 					// simply compare eventHistory, maybe since eventHistory appends each new event to it it should compare after truncating last element
-					if (evedata.eventHistory.getData().list.array!=lastEvent.eventHistory.getData().list.array) {
+					if (evedata.eventHistory.getData()->list.array!=lastEvent.eventHistory.getData()->list.array) {
 						// misbehaviour: eventHistory not matching
 						currentEvent.EMB_CODE|=MB_CODE_CONV(EMB_EVENT_HISTORY_INC);
 					}
@@ -1521,7 +1525,7 @@ void MisbehaviourDetector::processDENM(proton::binary message_bin, ldmmap::event
 			if (lastEventPresent) {
 				if (evedata.eventHistory.isAvailable() && lastEvent.eventHistory.isAvailable()) {
 					// simply compare eventHistory, maybe since eventHistory appends each new event to it it should compare after truncating last element
-					if (evedata.eventHistory.getData().list.array!=lastEvent.eventHistory.getData().list.array) {
+					if (evedata.eventHistory.getData()->list.array!=lastEvent.eventHistory.getData()->list.array) {
 						// misbehaviour: eventHistory not matching
 						currentEvent.EMB_CODE|=MB_CODE_CONV(EMB_EVENT_HISTORY_INC);
 					}
@@ -1707,6 +1711,7 @@ void MisbehaviourDetector::eventDecision(pendingEvent_t currentEvent) {
 }
 
 void MisbehaviourDetector::cleanupPendingEvents() {
+	std::lock_guard<std::mutex> lk(m_state_mutex);
 	uint64_t now = get_timestamp_ns();
     for (auto it=m_pendingEvents.cbegin();it!=m_pendingEvents.cend();) {
 		// first check if the event is too old to be relevant, then check the validation period
@@ -1714,8 +1719,10 @@ void MisbehaviourDetector::cleanupPendingEvents() {
 		if (((now/1000.0)-it->second.evedata.detectionTime)>300e6) { // 300e6 -> 5 minutes
 			it=m_pendingEvents.erase(it);
 		} else if(now>=it->second.endOfChecks) {
-			eventDecision(it->second);
+			// eventDecision() erases the event from m_pendingEvents: move past it before calling eventDecision()
+			pendingEvent_t currentEvent=it->second;
             it=m_pendingEvents.erase(it);
+			eventDecision(currentEvent);
 		} else {
             ++it;
         }
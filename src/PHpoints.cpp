@@ -1,5 +1,6 @@
 #include "PHpoints.h"
 #include <cmath>
+#include <algorithm>
 #include <iostream> // [TBR]
 
 namespace ldmmap
@@ -31,13 +32,17 @@ namespace ldmmap
 		m_PHpoints_size = 0;
 		m_next_idx = 0;
 		m_oldest_idx = 0;
+		m_stored_distance = 0;
 
 		m_removeOnlyOne = false;
 		m_iterateFull = false;
 
 		m_vectorReservedSize = 300; // 300 is the result of ceil(m_distance_limit/m_min_dist_m), i.e. ceil(300/1)
 
-		m_pDataArray.reserve(m_vectorReservedSize); // 300 is the result of ceil(m_distance_limit/m_min_dist_m), i.e. ceil(300/1)
+		// The storage is allocated only when the first point is inserted
+		m_points = nullptr;
+		m_capacity = 0;
+		m_block_capacity = 0;
 	}
 
 	PHpoints::PHpoints(double distance_limit, double min_dist_m, double max_dist_m, double max_heading_diff_degs) {
@@ -49,19 +54,68 @@ namespace ldmmap
 		m_PHpoints_size = 0;
 		m_next_idx = 0;
 		m_oldest_idx = 0;
+		m_stored_distance = 0;
 
 		m_removeOnlyOne = false;
 		m_iterateFull = false;
 
-		m_vectorReservedSize = (int) ceil(m_distance_limit/m_min_dist_m);
+		m_vectorReservedSize = std::max((int) ceil(m_distance_limit/m_min_dist_m),1);
 
-		m_pDataArray.reserve(m_vectorReservedSize);
+		// The storage is allocated only when the first point is inserted
+		m_points = nullptr;
+		m_capacity = 0;
+		m_block_capacity = 0;
 	}
 
 	PHpoints::~PHpoints() {
 		clear();
 	}
 
+	inline PHCompactData_t
+	PHpoints::encodePoint(double lat, double lon, double elev, double heading, double point_distance) {
+		PHCompactData_t point;
+
+		point.lat = static_cast<int32_t>(std::lround(lat*1e7));
+		point.lon = static_cast<int32_t>(std::lround(lon*1e7));
+		point.point_distance = static_cast<float>(point_distance);
+		point.heading = static_cast<uint16_t>(std::clamp(std::lround(heading*10.0),0L,static_cast<long>(UINT16_MAX)));
+		point.elev = static_cast<int16_t>(std::clamp(std::lround(elev*2.0),static_cast<long>(INT16_MIN),static_cast<long>(INT16_MAX)));
+
+		return point;
+	}
+
+	inline PHpoints::PHData_t
+	PHpoints::decodePoint(const PHCompactData_t &point) {
+		PHData_t data;
+
+		data.lat = point.lat/1e7;
+		data.lon = point.lon/1e7;
+		data.elev = point.elev/2.0;
+		data.heading = point.heading/10.0;
+		data.point_distance = point.point_distance;
+
+		return data;
+	}
+
+	void
+	PHpoints::grow(uint32_t min_points) {
+		uint32_t new_block_capacity;
+		PHCompactData_t *new_points = PHpointsPool::getInstance().allocate(min_points,new_block_capacity);
+
+		// Copy the stored points, from the oldest to the newest one
+		for(int i=0;i<m_PHpoints_size;i++) {
+			new_points[i] = m_points[(m_oldest_idx+i)%m_capacity];
+		}
+
+		PHpointsPool::getInstance().release(m_points,m_block_capacity);
+
+		m_points = new_points;
+		m_block_capacity = new_block_capacity;
+		m_capacity = std::min(new_block_capacity,static_cast<uint32_t>(m_vectorReservedSize));
+		m_oldest_idx = 0;
+		m_next_idx = m_PHpoints_size%m_capacity;
+	}
+
 	bool 
 	PHpoints::switchRemoveOnlyOne(void) {
 		if(m_removeOnlyOne == true) {
@@ -77,14 +131,17 @@ namespace ldmmap
 	PHpoints::insert(vehicleData_t newVehicleData) {
 		double point_dist=0;
 
+		std::lock_guard<std::mutex> lk(m_pointsmut);
+
 		if(m_PHpoints_size>=1) {
 			// Get the index in the array of the previously saved point
-			int prev_idx = m_next_idx == 0 ? m_PHpoints_size-1 : m_next_idx-1;
+			int prev_idx = m_next_idx == 0 ? m_capacity-1 : m_next_idx-1;
+			PHData_t prev_point = decodePoint(m_points[prev_idx]);
 
-			point_dist=haversineDist(m_pDataArray[prev_idx].lat,m_pDataArray[prev_idx].lon,newVehicleData.lat,newVehicleData.lon);
+			point_dist=haversineDist(prev_point.lat,prev_point.lon,newVehicleData.lat,newVehicleData.lon);
 
 			if(point_dist<m_max_dist_m) {
-				if(point_dist<m_min_dist_m || fabs(angDiff(m_pDataArray[prev_idx].heading,newVehicleData.heading))<m_max_heading_diff_degs) {
+				if(point_dist<m_min_dist_m || fabs(angDiff(prev_point.heading,newVehicleData.heading))<m_max_heading_diff_degs) {
 					// Skip this point
 					return PHP_SKIPPED;
 				}
@@ -92,63 +149,77 @@ namespace ldmmap
 
 			if (m_removeOnlyOne == true) {
 				if(m_stored_distance>=m_distance_limit) {
-					m_stored_distance-=m_pDataArray[m_oldest_idx].point_distance;
+					m_stored_distance-=m_points[m_oldest_idx].point_distance;
 					m_PHpoints_size--;
-					m_oldest_idx=(m_oldest_idx+1)%m_vectorReservedSize;
+					m_oldest_idx=(m_oldest_idx+1)%m_capacity;
 				}
 			} else {
 				while(m_stored_distance>=m_distance_limit && m_PHpoints_size>1) {
-					m_stored_distance-=m_pDataArray[m_oldest_idx].point_distance;
+					m_stored_distance-=m_points[m_oldest_idx].point_distance;
 					m_PHpoints_size--;
-					m_oldest_idx=(m_oldest_idx+1)%m_vectorReservedSize;
+					m_oldest_idx=(m_oldest_idx+1)%m_capacity;
 				}
 			}
 
-			m_stored_distance+=point_dist;
+			// The same (single precision) value which is stored for the point is added to the stored distance
+			m_stored_distance+=static_cast<float>(point_dist);
 		}
 
-		if(m_PHpoints_size<m_vectorReservedSize) {
-			m_PHpoints_size++;
+		if(m_PHpoints_size==static_cast<int>(m_capacity)) {
+			if(m_capacity<static_cast<uint32_t>(m_vectorReservedSize)) {
+				// Grow the storage, doubling its capacity (up to the maximum number of points)
+				grow(m_capacity==0 ? PHPOINTS_INITIAL_CAPACITY : std::min(2*m_capacity,static_cast<uint32_t>(m_vectorReservedSize)));
+			} else {
+				// The maximum number of points has been reached: overwrite the oldest point
+				m_stored_distance-=m_points[m_oldest_idx].point_distance;
+				m_PHpoints_size--;
+				m_oldest_idx=(m_oldest_idx+1)%m_capacity;
+			}
 		}
 
-		m_pDataArray[m_next_idx].lat=newVehicleData.lat;
-		m_pDataArray[m_next_idx].lon=newVehicleData.lon;
-		m_pDataArray[m_next_idx].elev=newVehicleData.elevation;
-		m_pDataArray[m_next_idx].heading=newVehicleData.heading;
-		m_pDataArray[m_next_idx].point_distance=point_dist;
-		m_next_idx=(m_next_idx+1)%m_vectorReservedSize;
+		m_PHpoints_size++;
+
+		m_points[m_next_idx]=encodePoint(newVehicleData.lat,newVehicleData.lon,newVehicleData.elevation,newVehicleData.heading,point_dist);
+		m_next_idx=(m_next_idx+1)%m_capacity;
 
 		return PHP_INSERTED;
 	}
 
 	PHpoints::PHpoints_retval_t 
 	PHpoints::iterate(PHDataIter_t &PHDataIter, PHData_t *nextPHData) {
+		std::lock_guard<std::mutex> lk(m_pointsmut);
+
 		// We need to initizialize some variables when iterate() is called for the first time
-		if(PHDataIter.ptrDataArray==NULL) {
+		if(PHDataIter.ptrPHpoints==NULL) {
+			if(m_capacity==0) {
+				return PHP_TERMINATE_ITERATION;
+			}
 
 			if(m_iterateFull == true) {
 				PHDataIter.cyclic_idx=m_next_idx;
 				PHDataIter.idx=0;
 			} else {
-				PHDataIter.cyclic_idx=m_next_idx == 0 ? m_vectorReservedSize-1 : m_next_idx-1;
+				PHDataIter.cyclic_idx=m_next_idx == 0 ? m_capacity-1 : m_next_idx-1;
 				PHDataIter.idx=1;
 			}
-			PHDataIter.ptrDataArray=&m_pDataArray;
+			PHDataIter.ptrPHpoints=this;
 			PHDataIter.pDataArraySize=m_PHpoints_size;
+			PHDataIter.capacity=m_capacity;
+		}
+
+		// If the storage has been re-arranged after the iteration started, the stored indices are no longer valid
+		if(PHDataIter.ptrPHpoints!=this || PHDataIter.capacity!=static_cast<int>(m_capacity)) {
+			return PHP_TERMINATE_ITERATION;
 		}
 
 		if(PHDataIter.idx<PHDataIter.pDataArraySize) {
-			if(PHDataIter.ptrDataArray==NULL) {
-				return PHP_ERROR;
-			}
-			
-			PHDataIter.cyclic_idx=PHDataIter.cyclic_idx == 0 ? m_vectorReservedSize-1 : PHDataIter.cyclic_idx-1;
+			PHDataIter.cyclic_idx=PHDataIter.cyclic_idx == 0 ? m_capacity-1 : PHDataIter.cyclic_idx-1;
 			PHDataIter.idx++;
-			PHDataIter.data=(*PHDataIter.ptrDataArray)[PHDataIter.cyclic_idx];
+			PHDataIter.data=decodePoint(m_points[PHDataIter.cyclic_idx]);
 
 			if(nextPHData!=NULL) {
 				if(PHDataIter.idx<PHDataIter.pDataArraySize-1) {
-					*nextPHData=(*PHDataIter.ptrDataArray)[PHDataIter.cyclic_idx == 0 ? m_vectorReservedSize-1 : PHDataIter.cyclic_idx-1];
+					*nextPHData=decodePoint(m_points[PHDataIter.cyclic_idx == 0 ? m_capacity-1 : PHDataIter.cyclic_idx-1]);
 				} else {
 					nextPHData->lat=INVALID_PHDATA;
 					nextPHData->lon=INVALID_PHDATA; 
@@ -166,10 +237,18 @@ namespace ldmmap
 
 	void
 	PHpoints::clear() {
-		m_pDataArray.clear();
+		std::lock_guard<std::mutex> lk(m_pointsmut);
+
+		// Give the storage back to the pool
+		PHpointsPool::getInstance().release(m_points,m_block_capacity);
+
+		m_points = nullptr;
+		m_capacity = 0;
+		m_block_capacity = 0;
 
 		m_PHpoints_size = 0;
 		m_next_idx = 0;
 		m_oldest_idx = 0;
+		m_stored_distance = 0;
 	}
-}
\ No newline at end of file
+}
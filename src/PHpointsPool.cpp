@@ -0,0 +1,92 @@
+#include "PHpointsPool.h"
+
+namespace ldmmap {
+	PHpointsPool::PHpointsPool() {
+		m_allocated_blocks = 0;
+		m_allocated_points = 0;
+	}
+
+	PHpointsPool &
+	PHpointsPool::getInstance() {
+		static PHpointsPool pool;
+
+		return pool;
+	}
+
+	inline int
+	PHpointsPool::getSizeClass(uint32_t points) {
+		uint32_t class_points = PHPOINTSPOOL_MIN_BLOCK_POINTS;
+
+		for(int sc=0;sc<PHPOINTSPOOL_NUM_SIZE_CLASSES;sc++) {
+			if(points<=class_points) {
+				return sc;
+			}
+
+			class_points <<= 1;
+		}
+
+		// Too big to be managed by the pool
+		return -1;
+	}
+
+	PHCompactData_t *
+	PHpointsPool::allocate(uint32_t min_points, uint32_t &capacity) {
+		PHCompactData_t *block;
+		int sc = getSizeClass(min_points);
+
+		if(sc<0) {
+			capacity = min_points;
+			block = new PHCompactData_t[capacity];
+		} else {
+			sizeClass_t &sclass = m_classes[sc];
+
+			capacity = PHPOINTSPOOL_MIN_BLOCK_POINTS << sc;
+
+			std::lock_guard<std::mutex> lk(sclass.mut);
+
+			if(sclass.freelist.empty()) {
+				// Carve a new slab into blocks of this size class (a slab contains at least one block)
+				uint32_t slab_blocks = PHPOINTSPOOL_SLAB_SIZE_BYTES/(capacity*sizeof(PHCompactData_t));
+
+				if(slab_blocks==0) {
+					slab_blocks = 1;
+				}
+
+				sclass.slabs.emplace_back(new PHCompactData_t[slab_blocks*capacity]);
+
+				PHCompactData_t *slab = sclass.slabs.back().get();
+
+				for(uint32_t i=0;i<slab_blocks;i++) {
+					sclass.freelist.push_back(slab+i*capacity);
+				}
+			}
+
+			block = sclass.freelist.back();
+			sclass.freelist.pop_back();
+		}
+
+		m_allocated_blocks++;
+		m_allocated_points += capacity;
+
+		return block;
+	}
+
+	void
+	PHpointsPool::release(PHCompactData_t *block, uint32_t capacity) {
+		if(block==nullptr) {
+			return;
+		}
+
+		int sc = getSizeClass(capacity);
+
+		if(sc<0) {
+			delete[] block;
+		} else {
+			std::lock_guard<std::mutex> lk(m_classes[sc].mut);
+			m_classes[sc].freelist.push_back(block);
+		}
+
+		m_allocated_blocks--;
+		m_allocated_points -= capacity;
+	}
+}
@@ -0,0 +1,378 @@
+#include "binLogger.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+// Epoch time at 2004-01-01 (in ms), used to compute the CAM and GeoNetworking timestamps (as in utils.cpp)
+#define TIME_SHIFT_MILLI 1072915200000
+
+namespace {
+	// Slots of the ring buffer arrays of the loggers which are currently assigned to a thread
+	std::atomic<bool> thread_slot_used[BINLOGGER_MAX_THREADS];
+
+	// Index of the calling thread inside the ring buffer arrays of the loggers, assigned the first time the thread logs a record,
+	// and released when the thread terminates, so that it can be reused by a new thread (e.g., after a client reconnects)
+	// A thread which finds all the slots in use gets BINLOGGER_MAX_THREADS, and its records are dropped
+	// The ring buffer of a released slot is reused as it is by the next thread: the release and the acquisition of the slot
+	// make all the records of the previous owner visible to the new one
+	class threadSlot {
+		public:
+			threadSlot() {
+				for(idx=0;idx<BINLOGGER_MAX_THREADS;idx++) {
+					bool expected=false;
+
+					if(thread_slot_used[idx].load(std::memory_order_relaxed)==false &&
+						thread_slot_used[idx].compare_exchange_strong(expected,true,std::memory_order_acquire)==true) {
+						break;
+					}
+				}
+			}
+
+			~threadSlot() {
+				if(idx<BINLOGGER_MAX_THREADS) {
+					thread_slot_used[idx].store(false,std::memory_order_release);
+				}
+			}
+
+			unsigned int idx;
+	};
+
+	thread_local threadSlot thread_slot;
+}
+
+BinLogger::BinLogger(FILE *outfile, binLoggerFormat_t format) {
+	m_outfile=outfile;
+	m_format=format;
+	m_tai_offset_ns=getTAIOffset();
+
+	m_rings=std::unique_ptr<std::atomic<ring_t *>[]>(new std::atomic<ring_t *>[BINLOGGER_MAX_THREADS]);
+	for(unsigned int i=0;i<BINLOGGER_MAX_THREADS;i++) {
+		m_rings[i]=nullptr;
+	}
+	m_overflow_dropped=0;
+
+	m_sources_written=0;
+	m_running=false;
+}
+
+BinLogger::~BinLogger() {
+	stop();
+
+	for(unsigned int i=0;i<BINLOGGER_MAX_THREADS;i++) {
+		delete m_rings[i].load();
+	}
+}
+
+void
+BinLogger::start() {
+	if(m_running==true || m_outfile==nullptr) {
+		return;
+	}
+
+	if(m_format==BINLOGGER_FORMAT_BINARY) {
+		binLogFileHeader_t header;
+
+		memcpy(header.magic,BINLOGGER_FILE_MAGIC,sizeof(header.magic));
+		header.version=BINLOGGER_FILE_VERSION;
+		header.record_size=sizeof(binLogRecord_t);
+		header.tai_offset_ns=m_tai_offset_ns;
+
+		fwrite(&header,sizeof(header),1,m_outfile);
+	}
+
+	m_running=true;
+	m_flusher=std::thread(&BinLogger::flusherLoop,this);
+}
+
+void
+BinLogger::stop() {
+	{
+		std::lock_guard<std::mutex> lk(m_flushermut);
+
+		if(m_running==false) {
+			return;
+		}
+
+		m_running=false;
+	}
+
+	m_flushercv.notify_one();
+
+	if(m_flusher.joinable()) {
+		m_flusher.join();
+	}
+}
+
+uint8_t
+BinLogger::registerSource(const std::string &name) {
+	std::lock_guard<std::mutex> lk(m_sourcesmut);
+
+	// Sources with the same name share the same index
+	for(size_t i=0;i<m_sources.size();i++) {
+		if(m_sources[i]==name) {
+			return static_cast<uint8_t>(i);
+		}
+	}
+
+	if(m_sources.size()>=BINLOGGER_MAX_SOURCES) {
+		return BINLOGGER_MAX_SOURCES-1;
+	}
+
+	m_sources.push_back(name);
+
+	return static_cast<uint8_t>(m_sources.size()-1);
+}
+
+BinLogger::ring_t *
+BinLogger::getThreadRing() {
+	unsigned int thread_idx=thread_slot.idx;
+
+	if(thread_idx>=BINLOGGER_MAX_THREADS) {
+		return nullptr;
+	}
+
+	ring_t *ring=m_rings[thread_idx].load(std::memory_order_acquire);
+
+	// Only the thread owning the slot can allocate its ring
+	if(ring==nullptr) {
+		ring=new ring_t;
+		ring->head=0;
+		ring->tail=0;
+		ring->dropped=0;
+		ring->records=std::unique_ptr<binLogRecord_t[]>(new binLogRecord_t[BINLOGGER_RING_SIZE]);
+
+		m_rings[thread_idx].store(ring,std::memory_order_release);
+	}
+
+	return ring;
+}
+
+bool
+BinLogger::log(binLogRecord_t &rec, uint64_t timestamp_ns) {
+	ring_t *ring=getThreadRing();
+
+	if(ring==nullptr) {
+		m_overflow_dropped++;
+		return false;
+	}
+
+	uint64_t head=ring->head.load(std::memory_order_relaxed);
+
+	if(head-ring->tail.load(std::memory_order_acquire)>=BINLOGGER_RING_SIZE) {
+		ring->dropped.fetch_add(1,std::memory_order_relaxed);
+		return false;
+	}
+
+	rec.timestamp_ns=timestamp_ns!=0 ? timestamp_ns : get_timestamp_ns();
+	rec.reserved16=0;
+	rec.reserved32=0;
+
+	ring->records[head & (BINLOGGER_RING_SIZE-1)]=rec;
+	ring->head.store(head+1,std::memory_order_release);
+
+	return true;
+}
+
+uint64_t
+BinLogger::getDroppedCount() {
+	uint64_t dropped=m_overflow_dropped;
+
+	for(unsigned int i=0;i<BINLOGGER_MAX_THREADS;i++) {
+		ring_t *ring=m_rings[i].load(std::memory_order_acquire);
+
+		if(ring!=nullptr) {
+			dropped+=ring->dropped.load(std::memory_order_relaxed);
+		}
+	}
+
+	return dropped;
+}
+
+void
+BinLogger::flusherLoop() {
+	std::vector<binLogRecord_t> batch;
+
+	while(true) {
+		bool running;
+
+		{
+			std::unique_lock<std::mutex> lk(m_flushermut);
+			m_flushercv.wait_for(lk,std::chrono::milliseconds(BINLOGGER_FLUSH_INTERVAL_MS),[this]{return m_running==false;});
+			running=m_running;
+		}
+
+		flush(batch);
+
+		if(running==false) {
+			break;
+		}
+	}
+}
+
+void
+BinLogger::flush(std::vector<binLogRecord_t> &batch) {
+	batch.clear();
+
+	// Collect the records of all the threads
+	for(unsigned int i=0;i<BINLOGGER_MAX_THREADS;i++) {
+		ring_t *ring=m_rings[i].load(std::memory_order_acquire);
+
+		if(ring==nullptr) {
+			continue;
+		}
+
+		uint64_t tail=ring->tail.load(std::memory_order_relaxed);
+		uint64_t head=ring->head.load(std::memory_order_acquire);
+
+		for(;tail!=head;tail++) {
+			batch.push_back(ring->records[tail & (BINLOGGER_RING_SIZE-1)]);
+		}
+
+		ring->tail.store(tail,std::memory_order_release);
+	}
+
+	// The records of each thread are already ordered: merge them by timestamp
+	std::stable_sort(batch.begin(),batch.end(),[](const binLogRecord_t &a, const binLogRecord_t &b) {
+		return a.timestamp_ns<b.timestamp_ns;
+	});
+
+	std::vector<std::string> sources;
+	{
+		std::lock_guard<std::mutex> lk(m_sourcesmut);
+		sources=m_sources;
+	}
+
+	if(m_format==BINLOGGER_FORMAT_BINARY) {
+		// Write the names of the new sources before their records
+		for(;m_sources_written<sources.size();m_sources_written++) {
+			binLogRecord_t namerec;
+
+			memset(&namerec,0,sizeof(namerec));
+			namerec.timestamp_ns=get_timestamp_ns();
+			namerec.type=BINLOG_SOURCE_NAME;
+			namerec.source=static_cast<uint8_t>(m_sources_written);
+			strncpy(namerec.name,sources[m_sources_written].c_str(),sizeof(namerec.name)-1);
+
+			fwrite(&namerec,sizeof(namerec),1,m_outfile);
+		}
+
+		if(!batch.empty()) {
+			fwrite(batch.data(),sizeof(binLogRecord_t),batch.size(),m_outfile);
+		}
+	} else {
+		for(const binLogRecord_t &rec : batch) {
+			formatRecord(m_outfile,rec,rec.source<sources.size() ? sources[rec.source].c_str() : "unknown",m_tai_offset_ns);
+		}
+	}
+
+	if(!batch.empty()) {
+		fflush(m_outfile);
+	}
+}
+
+int64_t
+BinLogger::getTAIOffset() {
+	struct timespec tai, realtime;
+
+	if(clock_gettime(CLOCK_TAI,&tai)==-1 || clock_gettime(CLOCK_REALTIME,&realtime)==-1) {
+		return 0;
+	}
+
+	int64_t offset_ns=(static_cast<int64_t>(tai.tv_sec)-static_cast<int64_t>(realtime.tv_sec))*1000000000+(tai.tv_nsec-realtime.tv_nsec);
+
+	// Round to the nearest second (the two clocks only differ by an integer number of leap seconds)
+	return ((offset_ns+500000000)/1000000000)*1000000000;
+}
+
+void
+BinLogger::formatRecord(FILE *outfile, const binLogRecord_t &rec, const char *source_name, int64_t tai_offset_ns) {
+	// Date and time at which the record has been logged, as printed by logfprintf()
+	std::time_t rec_time = static_cast<std::time_t>(rec.timestamp_ns/1000000000);
+	char date[26];
+
+	switch(rec.type) {
+		case BINLOG_SOURCE_NAME:
+			break;
+		case BINLOG_CONNECTION_OPEN:
+			fprintf(outfile,"[LOG - AMQPClient %s] Connection successfully established.\n",source_name);
+			break;
+		case BINLOG_CONNECTION_CLOSE:
+			fprintf(outfile,"[LOG - AMQPClient %s] Connection closed.\n",source_name);
+			break;
+		case BINLOG_MESSAGE_DECODER:
+			fprintf(outfile,"[LOG - MESSAGE DECODER (Client %s)] ProcTimeMilliseconds=%.6lf\n",source_name,rec.stage.duration_ns/1000000.0);
+			break;
+		case BINLOG_CAM_DATABASE_UPDATE:
+			fprintf(outfile,"[LOG - DATABASE UPDATE (Client %s)] LowFrequencyContainerAvail=%d InsertReturnValue=%d ProcTimeMilliseconds=%.6lf\n",
+				source_name,
+				(rec.stage.flags & 0x01)!=0,
+				rec.stage.retval,
+				rec.stage.duration_ns/1000000.0);
+			break;
+		case BINLOG_CAM_TRIGGER_CHECK:
+			fprintf(outfile,"[LOG - TRIGGER CHECK (Client %s)] TriggerEnabled=%d ExteriorLightsAvail=%d CrossBrdTriggerMode=%d IsInsideInternalArea=%d ProcTimeMilliseconds=%.6lf\n",
+				source_name,
+				(rec.stage.flags & 0x01)!=0,
+				(rec.stage.flags & 0x02)!=0,
+				(rec.stage.flags & 0x04)!=0,
+				(rec.stage.flags & 0x08)!=0,
+				rec.stage.duration_ns/1000000.0);
+			break;
+		case BINLOG_DATA_TOO_OLD:
+			fprintf(outfile,"[LOG - DATABASE UPDATE (Client %s)] Message discarded (data is too old). Rx = %lu, Stored = %lu, Gap = %lld\n",
+				source_name,
+				rec.discarded.rx_gn_timestamp,rec.discarded.stored_gn_timestamp,
+				static_cast<long long int>(rec.discarded.rx_gn_timestamp)-static_cast<long long int>(rec.discarded.stored_gn_timestamp));
+			break;
+		case BINLOG_FULL_CAM_PROCESSING: {
+			// The ages of the CAM and GN timestamps are computed with respect to the time at which the record has been logged
+			uint64_t rec_ms=rec.timestamp_ns/1000000;
+			long cam_now=static_cast<long>((rec_ms-TIME_SHIFT_MILLI)%65536);
+			long gn_now=static_cast<long>(((rec.timestamp_ns+tai_offset_ns)/1000000-TIME_SHIFT_MILLI)%4294967296);
+
+			fprintf(outfile,"[LOG - FULL CAM PROCESSING (Client%s)] (%.24s) StationID=%lu StationTypeID=%d Coordinates=%.7lf:%.7lf Heading=%.1lf InstUpdatePeriod=%.3lf"
+				" CAMTimestamp=%ld GNTimestamp=%lu CAMTimestampDiff=%ld GNTimestampDiff=%ld"
+				" ProcTimeMilliseconds=%.6lf Cardinality=%d\n",
+				source_name,ctime_r(&rec_time,date),
+				rec.vehicle.stationID,static_cast<int>(rec.vehicle.stationType),rec.vehicle.lat/10000000.0,rec.vehicle.lon/10000000.0,
+				rec.vehicle.heading,
+				rec.vehicle.inst_period_ms,
+				static_cast<long>(rec.vehicle.camTimestamp),static_cast<uint64_t>(rec.vehicle.gnTimestamp),
+				cam_now-static_cast<long>(rec.vehicle.camTimestamp),gn_now-static_cast<long>(rec.vehicle.gnTimestamp),
+				rec.vehicle.duration_ns/1000000.0,static_cast<int>(rec.vehicle.cardinality));
+			break;
+		}
+		case BINLOG_FULL_CPM_OBJECT_PROCESSING:
+		case BINLOG_FULL_VAM_PROCESSING:
+			fprintf(outfile,"[LOG - FULL %s PROCESSING (Client %s)] (%.24s) StationID=%lu Coordinates=%.7lf:%.7lf Heading=%.1lf InstUpdatePeriod=%.3lf\n",
+				rec.type==BINLOG_FULL_VAM_PROCESSING ? "VAM" : "CPM Perceived Object",
+				source_name,ctime_r(&rec_time,date),
+				rec.vehicle.stationID,rec.vehicle.lat/10000000.0,rec.vehicle.lon/10000000.0,
+				rec.vehicle.heading,
+				rec.vehicle.inst_period_ms);
+			break;
+		case BINLOG_DENM_AREA_FILTER:
+			fprintf(outfile,"[LOG - AREA FILTER (Client %s)] ProcTimeMilliseconds=%.6lf\n",source_name,rec.stage.duration_ns/1000000.0);
+			break;
+		case BINLOG_FULL_DENM_PROCESSING: {
+			uint64_t referenceTime_us=rec.timestamp_ns/1000;
+
+			fprintf(outfile,"[LOG - FULL DENM PROCESSING (Client%s)] (%.24s) eventKey=%lu"
+				"OriginatingStationID=%u sequenceNumber=%d Coordinates=%.7lf:%.7lf:%.2lf eventStationType=%lf"
+				" DENM_ReferenceTime=%ld GNTimestamp=%lu DENM_DetectionTime=%ld DENM_ValidityDuration=%d ProcTimeMilliseconds=%.6lf EventCardinality=%d\n",
+				source_name,ctime_r(&rec_time,date),
+				rec.event.eventKey,rec.event.originatingStationID,static_cast<int>(rec.event.sequenceNumber),
+				rec.event.lat/10000000.0,rec.event.lon/10000000.0,rec.event.elevation/100.0,
+				static_cast<double>(rec.event.stationType),static_cast<long>(referenceTime_us),static_cast<uint64_t>(rec.event.gnTimestamp)*1000,
+				static_cast<long>(referenceTime_us-rec.event.detection_age_us),static_cast<int>(rec.event.validityDuration),
+				rec.event.duration_ns/1000000.0,static_cast<int>(rec.event.cardinality));
+			break;
+		}
+		default:
+			fprintf(outfile,"[LOG - UNKNOWN RECORD (Client %s)] Type=%d\n",source_name,static_cast<int>(rec.type));
+			break;
+	}
+}
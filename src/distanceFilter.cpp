@@ -0,0 +1,286 @@
+#include "distanceFilter.h"
+#include "asn_utils.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DISTANCEFILTER_X86
+#endif
+
+// Mean Earth radius, in meters (the same value used by haversineDist())
+#define EARTH_RADIUS_M 6371000.0
+
+// Relative safety margin applied to the pre-filter thresholds, to make sure that floating point rounding errors never lead
+// to a different result with respect to the exact haversine distance (positions falling inside the margin are checked exactly)
+#define DISTANCEFILTER_REL_MARGIN 1e-9
+
+namespace ldmmap {
+	// Parameters of a single query, pre-computed once per call
+	typedef struct distanceFilterQuery {
+		double lat;
+		double lon;
+		// Conversion factor from a difference in degrees to half of the same difference in radians
+		double halfdeg2rad;
+		// Cosine of the latitude of the center of the query circle
+		double coslat;
+		// Threshold on the haversine of the central angle: below h_in a position is surely inside the circle, above h_out it is surely outside
+		double h_in;
+		double h_out;
+		double range_m;
+	} distanceFilterQuery_t;
+
+	// Let a=dlat/2 and b=dlon/2 (in radians). The haversine of the central angle between the two positions is:
+	// h = sin^2(a) + cos(lat)*cos(lat_i)*sin^2(b)
+	// and the distance is within range_m if and only if h <= sin^2(range_m/(2*R)).
+	// h is bounded without computing any trigonometric function as:
+	// - sin^2(x) <= x^2 and sin^2(x) >= max(0,x^2-x^4/3)
+	// - |cos(lat_i)-cos(lat)| <= |dlat|, and thus cos(lat)-|dlat| <= cos(lat_i) <= min(1,cos(lat)+|dlat|)
+	// The lower bound requires cos(lat_i) >= 0, i.e., a valid latitude: positions with |lat_i| > 90 deg are always checked exactly.
+	static inline void
+	boundsScalar(const distanceFilterQuery_t &q, double lat_i, double lon_i, double &h_lo, double &h_hi) {
+		double a = (lat_i-q.lat)*q.halfdeg2rad;
+		double b = (lon_i-q.lon)*q.halfdeg2rad;
+		double a2 = a*a;
+		double b2 = b*b;
+		double absdlat = 2.0*std::fabs(a);
+		double cos_hi = std::fmin(q.coslat+absdlat,1.0);
+		double cos_lo = std::fmax(q.coslat-absdlat,0.0);
+
+		h_hi = a2+q.coslat*cos_hi*b2;
+		h_lo = std::fmax(a2-a2*a2/3.0,0.0)+q.coslat*cos_lo*std::fmax(b2-b2*b2/3.0,0.0);
+
+		// NaN positions must not be classified by the pre-filter (std::fmin/std::fmax do not propagate NaNs)
+		if(std::isnan(a2) || std::isnan(b2) || std::fabs(lat_i)>90.0) {
+			h_lo = h_hi = NAN;
+		}
+	}
+
+	static inline bool
+	exactCheck(const distanceFilterQuery_t &q, double lat_i, double lon_i) {
+		return haversineDist(q.lat,q.lon,lat_i,lon_i)<=q.range_m;
+	}
+
+	static inline bool
+	checkScalar(const distanceFilterQuery_t &q, double lat_i, double lon_i) {
+		double h_lo, h_hi;
+
+		boundsScalar(q,lat_i,lon_i,h_lo,h_hi);
+
+		if(h_hi<=q.h_in) {
+			return true;
+		} else if(h_lo>q.h_out) {
+			return false;
+		}
+
+		// Boundary position (or NaN): compute the exact distance
+		return exactCheck(q,lat_i,lon_i);
+	}
+
+	static size_t
+	distanceFilterScalar(const distanceFilterQuery_t &q, const double *lats, const double *lons, size_t start, size_t n, uint64_t *mask) {
+		size_t matches = 0;
+
+		for(size_t i=start;i<n;i++) {
+			if(checkScalar(q,lats[i],lons[i])) {
+				mask[i/64] |= UINT64_C(1) << (i%64);
+				matches++;
+			}
+		}
+
+		return matches;
+	}
+
+	#ifdef DISTANCEFILTER_X86
+	// Note: _mm_max_pd()/_mm_min_pd() return their second operand when any of the two is NaN; the expressions depending on the
+	// position are always passed as second operand, so that NaN positions are never classified by the pre-filter
+	static size_t
+	distanceFilterSSE2(const distanceFilterQuery_t &q, const double *lats, const double *lons, size_t n, uint64_t *mask) {
+		const __m128d v_lat = _mm_set1_pd(q.lat);
+		const __m128d v_lon = _mm_set1_pd(q.lon);
+		const __m128d v_k = _mm_set1_pd(q.halfdeg2rad);
+		const __m128d v_coslat = _mm_set1_pd(q.coslat);
+		const __m128d v_h_in = _mm_set1_pd(q.h_in);
+		const __m128d v_h_out = _mm_set1_pd(q.h_out);
+		const __m128d v_zero = _mm_setzero_pd();
+		const __m128d v_one = _mm_set1_pd(1.0);
+		const __m128d v_two = _mm_set1_pd(2.0);
+		const __m128d v_third = _mm_set1_pd(1.0/3.0);
+		const __m128d v_maxlat = _mm_set1_pd(90.0);
+		const __m128d v_absmask = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+		size_t matches = 0;
+		size_t i;
+
+		for(i=0;i+2<=n;i+=2) {
+			__m128d lat_i = _mm_loadu_pd(lats+i);
+			__m128d a = _mm_mul_pd(_mm_sub_pd(lat_i,v_lat),v_k);
+			__m128d b = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(lons+i),v_lon),v_k);
+			__m128d a2 = _mm_mul_pd(a,a);
+			__m128d b2 = _mm_mul_pd(b,b);
+			__m128d absdlat = _mm_mul_pd(v_two,_mm_and_pd(a,v_absmask));
+			__m128d cos_hi = _mm_min_pd(v_one,_mm_add_pd(v_coslat,absdlat));
+			__m128d cos_lo = _mm_max_pd(v_zero,_mm_sub_pd(v_coslat,absdlat));
+			__m128d h_hi = _mm_add_pd(a2,_mm_mul_pd(_mm_mul_pd(v_coslat,cos_hi),b2));
+			__m128d lo_a = _mm_max_pd(v_zero,_mm_sub_pd(a2,_mm_mul_pd(_mm_mul_pd(a2,a2),v_third)));
+			__m128d lo_b = _mm_max_pd(v_zero,_mm_sub_pd(b2,_mm_mul_pd(_mm_mul_pd(b2,b2),v_third)));
+			__m128d h_lo = _mm_add_pd(lo_a,_mm_mul_pd(_mm_mul_pd(v_coslat,cos_lo),lo_b));
+
+			int inside = _mm_movemask_pd(_mm_cmple_pd(h_hi,v_h_in));
+			int outside = _mm_movemask_pd(_mm_and_pd(_mm_cmpgt_pd(h_lo,v_h_out),_mm_cmple_pd(_mm_and_pd(lat_i,v_absmask),v_maxlat)));
+
+			for(int j=0;j<2;j++) {
+				bool match;
+
+				if(inside & (1<<j)) {
+					match = true;
+				} else if(outside & (1<<j)) {
+					match = false;
+				} else {
+					match = exactCheck(q,lats[i+j],lons[i+j]);
+				}
+
+				if(match) {
+					mask[(i+j)/64] |= UINT64_C(1) << ((i+j)%64);
+					matches++;
+				}
+			}
+		}
+
+		return matches + distanceFilterScalar(q,lats,lons,i,n,mask);
+	}
+
+	__attribute__((target("avx2")))
+	static size_t
+	distanceFilterAVX2(const distanceFilterQuery_t &q, const double *lats, const double *lons, size_t n, uint64_t *mask) {
+		const __m256d v_lat = _mm256_set1_pd(q.lat);
+		const __m256d v_lon = _mm256_set1_pd(q.lon);
+		const __m256d v_k = _mm256_set1_pd(q.halfdeg2rad);
+		const __m256d v_coslat = _mm256_set1_pd(q.coslat);
+		const __m256d v_h_in = _mm256_set1_pd(q.h_in);
+		const __m256d v_h_out = _mm256_set1_pd(q.h_out);
+		const __m256d v_zero = _mm256_setzero_pd();
+		const __m256d v_one = _mm256_set1_pd(1.0);
+		const __m256d v_two = _mm256_set1_pd(2.0);
+		const __m256d v_third = _mm256_set1_pd(1.0/3.0);
+		const __m256d v_maxlat = _mm256_set1_pd(90.0);
+		const __m256d v_absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+		size_t matches = 0;
+		size_t i;
+
+		for(i=0;i+4<=n;i+=4) {
+			__m256d lat_i = _mm256_loadu_pd(lats+i);
+			__m256d a = _mm256_mul_pd(_mm256_sub_pd(lat_i,v_lat),v_k);
+			__m256d b = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(lons+i),v_lon),v_k);
+			__m256d a2 = _mm256_mul_pd(a,a);
+			__m256d b2 = _mm256_mul_pd(b,b);
+			__m256d absdlat = _mm256_mul_pd(v_two,_mm256_and_pd(a,v_absmask));
+			__m256d cos_hi = _mm256_min_pd(v_one,_mm256_add_pd(v_coslat,absdlat));
+			__m256d cos_lo = _mm256_max_pd(v_zero,_mm256_sub_pd(v_coslat,absdlat));
+			__m256d h_hi = _mm256_add_pd(a2,_mm256_mul_pd(_mm256_mul_pd(v_coslat,cos_hi),b2));
+			__m256d lo_a = _mm256_max_pd(v_zero,_mm256_sub_pd(a2,_mm256_mul_pd(_mm256_mul_pd(a2,a2),v_third)));
+			__m256d lo_b = _mm256_max_pd(v_zero,_mm256_sub_pd(b2,_mm256_mul_pd(_mm256_mul_pd(b2,b2),v_third)));
+			__m256d h_lo = _mm256_add_pd(lo_a,_mm256_mul_pd(_mm256_mul_pd(v_coslat,cos_lo),lo_b));
+
+			int inside = _mm256_movemask_pd(_mm256_cmp_pd(h_hi,v_h_in,_CMP_LE_OQ));
+			int outside = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(h_lo,v_h_out,_CMP_GT_OQ),_mm256_cmp_pd(_mm256_and_pd(lat_i,v_absmask),v_maxlat,_CMP_LE_OQ)));
+
+			// Fast path: all the four positions have been classified by the pre-filter
+			if((inside|outside)==0xF) {
+				if(inside) {
+					mask[i/64] |= static_cast<uint64_t>(inside) << (i%64);
+					matches += __builtin_popcount(inside);
+				}
+				continue;
+			}
+
+			for(int j=0;j<4;j++) {
+				bool match;
+
+				if(inside & (1<<j)) {
+					match = true;
+				} else if(outside & (1<<j)) {
+					match = false;
+				} else {
+					match = exactCheck(q,lats[i+j],lons[i+j]);
+				}
+
+				if(match) {
+					mask[(i+j)/64] |= UINT64_C(1) << ((i+j)%64);
+					matches++;
+				}
+			}
+		}
+
+		return matches + distanceFilterScalar(q,lats,lons,i,n,mask);
+	}
+	#endif
+
+	typedef size_t (*distanceFilterImpl_t)(const distanceFilterQuery_t &,const double *,const double *,size_t,uint64_t *);
+
+	static size_t
+	distanceFilterScalarImpl(const distanceFilterQuery_t &q, const double *lats, const double *lons, size_t n, uint64_t *mask) {
+		return distanceFilterScalar(q,lats,lons,0,n,mask);
+	}
+
+	// Select the best implementation supported by the CPU (only once)
+	static distanceFilterImpl_t
+	selectImplementation(const char **name) {
+		#ifdef DISTANCEFILTER_X86
+		__builtin_cpu_init();
+
+		if(__builtin_cpu_supports("avx2")) {
+			*name = "avx2";
+			return distanceFilterAVX2;
+		}
+
+		if(__builtin_cpu_supports("sse2")) {
+			*name = "sse2";
+			return distanceFilterSSE2;
+		}
+		#endif
+
+		*name = "scalar";
+		return distanceFilterScalarImpl;
+	}
+
+	static const char *impl_name = nullptr;
+	static distanceFilterImpl_t getImplementation() {
+		static const distanceFilterImpl_t impl = selectImplementation(&impl_name);
+
+		return impl;
+	}
+
+	size_t
+	distanceFilter(const double *lats, const double *lons, size_t n, double lat, double lon, double range_m, uint64_t *mask) {
+		distanceFilterQuery_t q;
+
+		memset(mask,0,DISTANCEFILTER_MASK_WORDS(n)*sizeof(uint64_t));
+
+		q.lat = lat;
+		q.lon = lon;
+		q.range_m = range_m;
+		q.halfdeg2rad = M_PI/360.0;
+		q.coslat = std::cos(DEG_2_RAD_ASN_UTILS(lat));
+
+		// The bounds are valid only for a valid query latitude and for ranges shorter than half of the Earth circumference
+		// (sin^2(x/2) is monotonic only in [0,pi]): in all the other cases, always compute the exact distance
+		if(!(std::fabs(lat)<=90.0) || !(range_m>=0.0 && range_m<M_PI*EARTH_RADIUS_M)) {
+			q.h_in = -1.0;
+			q.h_out = INFINITY;
+		} else {
+			double s = std::sin(range_m/(2.0*EARTH_RADIUS_M));
+
+			q.h_in = s*s*(1.0-DISTANCEFILTER_REL_MARGIN);
+			q.h_out = s*s*(1.0+DISTANCEFILTER_REL_MARGIN);
+		}
+
+		return getImplementation()(q,lats,lons,n,mask);
+	}
+
+	const char *
+	distanceFilterImplementation() {
+		getImplementation();
+
+		return impl_name;
+	}
+}
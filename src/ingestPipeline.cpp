@@ -0,0 +1,231 @@
+#include "ingestPipeline.h"
+#include "etsiDecoderFrontend.h"
+#include "geonet.h"
+#include "btp.h"
+
+#include <chrono>
+
+// Length of the ItsPduHeader (protocolVersion, messageID, stationID) of the Facilities layer messages
+#define ITS_PDU_HEADER_LEN 6
+// Minimum length of a full ITS message (GN+BTP+Facilities), used, as in the decoder frontend, to detect Facilities-only messages
+#define ITS_MIN_GN_MESSAGE_LEN 44
+// Maximum number of bytes which are scanned, inside a secured packet, to locate the unsecured GeoNetworking payload
+#define SECURED_HEADER_MAX_SCAN 16
+
+IngestPipeline::IngestPipeline(unsigned int num_workers, size_t queue_size, void (*process_fcn)(ingestMessage_t &,unsigned int,void *), void *additional_args) {
+	m_num_workers = num_workers>0 ? num_workers : 1;
+	m_workers = std::unique_ptr<worker_t[]>(new worker_t[m_num_workers]);
+
+	for(unsigned int i=0;i<m_num_workers;i++) {
+		m_workers[i].queue = std::unique_ptr<MPMCQueue<ingestMessage_t>>(new MPMCQueue<ingestMessage_t>(queue_size));
+		m_workers[i].sleeping = false;
+	}
+
+	m_process_fcn = process_fcn;
+	m_additional_args = additional_args;
+
+	m_running = false;
+	m_pushers = 0;
+	m_backpressure_cnt = 0;
+}
+
+IngestPipeline::~IngestPipeline() {
+	stop();
+}
+
+void
+IngestPipeline::start() {
+	if(m_running.exchange(true)==true) {
+		return;
+	}
+
+	for(unsigned int i=0;i<m_num_workers;i++) {
+		m_workers[i].thread = std::thread(&IngestPipeline::workerLoop,this,i);
+	}
+}
+
+void
+IngestPipeline::stop() {
+	if(m_running.exchange(false)==false) {
+		return;
+	}
+
+	// Wait for the push() calls which have seen the pipeline still running: after this point, no message can be enqueued
+	// anymore, and the final drain below is guaranteed to process all the messages accepted by push()
+	while(m_pushers.load()>0) {
+		std::this_thread::yield();
+	}
+
+	for(unsigned int i=0;i<m_num_workers;i++) {
+		{
+			std::lock_guard<std::mutex> lk(m_workers[i].mut);
+		}
+		m_workers[i].cv.notify_one();
+	}
+
+	for(unsigned int i=0;i<m_num_workers;i++) {
+		if(m_workers[i].thread.joinable()) {
+			m_workers[i].thread.join();
+		}
+	}
+
+	// Process any message which was pushed while the workers were terminating
+	ingestMessage_t msg;
+
+	for(unsigned int i=0;i<m_num_workers;i++) {
+		while(m_workers[i].queue->pop(msg)==true) {
+			m_process_fcn(msg,i,m_additional_args);
+		}
+	}
+}
+
+bool
+IngestPipeline::push(ingestMessage_t &msg) {
+	uint64_t key = getAffinityKey(msg.payload.data(),msg.payload.size());
+	// Spread the stationIDs (which are often consecutive) over the workers
+	worker_t &worker = m_workers[((key*UINT64_C(0x9E3779B97F4A7C15)) >> 32) % m_num_workers];
+	bool full = false;
+
+	// The counter of the push() calls in progress is incremented before checking m_running, while stop() clears m_running before
+	// reading the counter (both with sequentially consistent operations): either this thread sees the pipeline stopped, or stop()
+	// waits for this push() to complete before draining the queues
+	m_pushers++;
+	if(m_running.load()==false) {
+		m_pushers--;
+		return false;
+	}
+
+	while(worker.queue->push(msg)==false) {
+		if(m_running.load()==false) {
+			m_pushers--;
+			return false;
+		}
+
+		if(full==false) {
+			full = true;
+			m_backpressure_cnt++;
+		}
+
+		std::this_thread::yield();
+	}
+
+	// Wake up the worker only if it is waiting for new messages
+	// The fence (paired with the one in workerLoop()) guarantees that either the worker sees the new message, or this
+	// thread sees the worker sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(worker.sleeping.load(std::memory_order_relaxed)==true) {
+		{
+			std::lock_guard<std::mutex> lk(worker.mut);
+		}
+		worker.cv.notify_one();
+	}
+
+	m_pushers--;
+
+	return true;
+}
+
+void
+IngestPipeline::workerLoop(unsigned int worker_idx) {
+	worker_t &worker = m_workers[worker_idx];
+	ingestMessage_t msg;
+
+	while(true) {
+		if(worker.queue->pop(msg)==true) {
+			m_process_fcn(msg,worker_idx,m_additional_args);
+			continue;
+		}
+
+		// The queue is empty: terminate if the pipeline has been stopped (all the queued messages have already been processed)
+		if(m_running==false) {
+			break;
+		}
+
+		std::unique_lock<std::mutex> lk(worker.mut);
+		worker.sleeping.store(true,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// Check again the queue after setting "sleeping", to avoid missing a message pushed in the meantime
+		if(worker.queue->size()==0 && m_running==true) {
+			worker.cv.wait_for(lk,std::chrono::milliseconds(INGESTPIPELINE_IDLE_WAIT_MS));
+		}
+
+		worker.sleeping.store(false,std::memory_order_relaxed);
+	}
+}
+
+uint64_t
+IngestPipeline::getAffinityKey(const uint8_t *buf, size_t len) {
+	size_t offset = 0;
+
+	if(buf==nullptr || len<ITS_PDU_HEADER_LEN) {
+		return 0;
+	}
+
+	// Facilities-only message: the ItsPduHeader is at the beginning of the packet
+	// The same check of the decoder frontend (in MSGTYPE_AUTO mode) is used
+	if(len<ITS_MIN_GN_MESSAGE_LEN || is_enum_valid_etsi_message_t(static_cast<etsi_message_t>(buf[1]))) {
+		return (static_cast<uint64_t>(buf[2]) << 24) | (static_cast<uint64_t>(buf[3]) << 16) | (static_cast<uint64_t>(buf[4]) << 8) | buf[5];
+	}
+
+	// Basic Header: the Next Header field (4 LSBs of the first byte) tells if a Common Header (1) or a secured packet (2) follows
+	uint8_t nh = buf[0] & 0x0F;
+	offset = GN_BASIC_HEADER_LEN;
+
+	if(nh==2) {
+		// Secured packet: skip the signed data header, looking for the unsecured data containing the Common Header
+		// Only the typical layout is considered (protocolVersion 3, signedData, then protocolVersion 3, unsecuredData,
+		// followed by the OER length of the payload); any other packet is assigned key 0
+		if(len<offset+2 || buf[offset]!=0x03 || buf[offset+1]!=0x81) {
+			return 0;
+		}
+
+		size_t i;
+		for(i=offset+2;i<offset+SECURED_HEADER_MAX_SCAN && i+2<len;i++) {
+			if(buf[i]==0x03 && buf[i+1]==0x80) {
+				break;
+			}
+		}
+
+		if(i>=offset+SECURED_HEADER_MAX_SCAN || i+2>=len) {
+			return 0;
+		}
+
+		// OER length determinant: short form (1 byte) or long form (0x80 | number of length bytes, followed by the length)
+		offset = i+2;
+		if(buf[offset] & 0x80) {
+			offset += 1+(buf[offset] & 0x7F);
+		} else {
+			offset += 1;
+		}
+	} else if(nh!=1) {
+		return 0;
+	}
+
+	if(len<offset+GN_COMMON_HEADER_LEN) {
+		return 0;
+	}
+
+	// Common Header: the Header Type is stored in the 4 MSBs of the second byte
+	switch(buf[offset+1] >> 4) {
+		case 1: // Beacon (no payload)
+			return 0;
+		case 3: // GeoAnycast
+		case 4: // GeoBroadcast
+			offset += GN_COMMON_HEADER_LEN+GN_GBC_HEADER_LEN;
+			break;
+		case 5: // Topologically-scoped broadcast (single-hop or multi-hop, both with a 28-byte extended header)
+			offset += GN_COMMON_HEADER_LEN+GN_SHB_HEADER_LEN;
+			break;
+		default:
+			return 0;
+	}
+
+	offset += BTP_HEADER_LEN;
+
+	if(len<offset+ITS_PDU_HEADER_LEN) {
+		return 0;
+	}
+
+	return (static_cast<uint64_t>(buf[offset+2]) << 24) | (static_cast<uint64_t>(buf[offset+3]) << 16) | (static_cast<uint64_t>(buf[offset+4]) << 8) | buf[offset+5];
+}
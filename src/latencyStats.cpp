@@ -0,0 +1,136 @@
+#include "latencyStats.h"
+
+#define SUB_BUCKETS (1<<LATENCYSTATS_SUB_BUCKET_BITS)
+
+LatencyStats::LatencyStats() {
+	for(unsigned int s=0;s<LATENCYSTATS_NUM_STAGES;s++) {
+		m_buckets[s]=std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[LATENCYSTATS_NUM_BUCKETS]);
+
+		for(unsigned int i=0;i<LATENCYSTATS_NUM_BUCKETS;i++) {
+			m_buckets[s][i]=0;
+		}
+
+		m_count[s]=0;
+		m_sum[s]=0;
+		m_max[s]=0;
+	}
+}
+
+unsigned int
+LatencyStats::getBucketIndex(uint64_t value) {
+	// The values below SUB_BUCKETS have a bucket each
+	if(value<SUB_BUCKETS) {
+		return static_cast<unsigned int>(value);
+	}
+
+	unsigned int msb=63-__builtin_clzll(value);
+	unsigned int sub=static_cast<unsigned int>(value>>(msb-LATENCYSTATS_SUB_BUCKET_BITS)) & (SUB_BUCKETS-1);
+
+	return ((msb-LATENCYSTATS_SUB_BUCKET_BITS+1)<<LATENCYSTATS_SUB_BUCKET_BITS)+sub;
+}
+
+uint64_t
+LatencyStats::getBucketValue(unsigned int idx) {
+	if(idx<SUB_BUCKETS) {
+		return idx;
+	}
+
+	unsigned int msb=(idx>>LATENCYSTATS_SUB_BUCKET_BITS)+LATENCYSTATS_SUB_BUCKET_BITS-1;
+	uint64_t sub=idx & (SUB_BUCKETS-1);
+	unsigned int shift=msb-LATENCYSTATS_SUB_BUCKET_BITS;
+	uint64_t lower=((UINT64_C(1)<<LATENCYSTATS_SUB_BUCKET_BITS)+sub)<<shift;
+
+	return lower+((UINT64_C(1)<<shift)>>1);
+}
+
+void
+LatencyStats::record(latencyStatsStage_t stage, uint64_t latency_ns) {
+	m_buckets[stage][getBucketIndex(latency_ns)].fetch_add(1,std::memory_order_relaxed);
+	m_count[stage].fetch_add(1,std::memory_order_relaxed);
+	m_sum[stage].fetch_add(latency_ns,std::memory_order_relaxed);
+
+	uint64_t max=m_max[stage].load(std::memory_order_relaxed);
+	while(latency_ns>max && m_max[stage].compare_exchange_weak(max,latency_ns,std::memory_order_relaxed)==false);
+}
+
+uint64_t
+LatencyStats::getCount(latencyStatsStage_t stage) {
+	return m_count[stage];
+}
+
+double
+LatencyStats::getMean(latencyStatsStage_t stage) {
+	uint64_t count=m_count[stage];
+
+	return count>0 ? static_cast<double>(m_sum[stage])/count : 0.0;
+}
+
+uint64_t
+LatencyStats::getPercentile(latencyStatsStage_t stage, double percentile) {
+	uint64_t total=0;
+
+	// The count is computed again from the buckets, as more latencies may be recorded in the meantime
+	for(unsigned int i=0;i<LATENCYSTATS_NUM_BUCKETS;i++) {
+		total+=m_buckets[stage][i].load(std::memory_order_relaxed);
+	}
+
+	if(total==0) {
+		return 0;
+	}
+
+	uint64_t rank=static_cast<uint64_t>(percentile/100.0*total+0.5);
+	uint64_t cumulative=0;
+
+	if(rank<1) {
+		rank=1;
+	}
+
+	for(unsigned int i=0;i<LATENCYSTATS_NUM_BUCKETS;i++) {
+		cumulative+=m_buckets[stage][i].load(std::memory_order_relaxed);
+
+		if(cumulative>=rank) {
+			// The value of the bucket is never reported above the actual maximum
+			uint64_t value=getBucketValue(i);
+			uint64_t max=m_max[stage];
+
+			return value<max ? value : max;
+		}
+	}
+
+	return m_max[stage];
+}
+
+const char *
+LatencyStats::getStageName(latencyStatsStage_t stage) {
+	switch(stage) {
+		case LATENCYSTATS_DECODE:
+			return "Decode";
+		case LATENCYSTATS_MBD:
+			return "Misbehaviour detection";
+		case LATENCYSTATS_DB_UPDATE:
+			return "Database update";
+		case LATENCYSTATS_TOTAL:
+			return "Total";
+		default:
+			return "Unknown";
+	}
+}
+
+void
+LatencyStats::print(FILE *outfile) {
+	fprintf(outfile,"%-24s %10s %10s %10s %10s %10s %10s %10s\n","Stage [us]","Count","Mean","50th","90th","99th","99.9th","Max");
+
+	for(unsigned int s=0;s<LATENCYSTATS_NUM_STAGES;s++) {
+		latencyStatsStage_t stage=static_cast<latencyStatsStage_t>(s);
+
+		if(getCount(stage)==0) {
+			continue;
+		}
+
+		fprintf(outfile,"%-24s %10" PRIu64 " %10.3lf %10.3lf %10.3lf %10.3lf %10.3lf %10.3lf\n",
+			getStageName(stage),getCount(stage),getMean(stage)/1000.0,
+			getPercentile(stage,50.0)/1000.0,getPercentile(stage,90.0)/1000.0,
+			getPercentile(stage,99.0)/1000.0,getPercentile(stage,99.9)/1000.0,
+			getMax(stage)/1000.0);
+	}
+}
@@ -0,0 +1,82 @@
+#include "localProjection.h"
+#include <cmath>
+
+#define DEG_TO_RAD (M_PI/180.0)
+#define RAD_TO_DEG (180.0/M_PI)
+
+localProjection::localProjection(localProjection_mode_t mode) {
+	m_mode=mode;
+	m_origin_set=false;
+
+	m_lat0=0.0;
+	m_lon0=0.0;
+	m_x0=0.0;
+	m_y0=0.0;
+	m_northdeg_per_m=0.0;
+	m_eastdeg_per_m=0.0;
+	m_latcorr_coeff=0.0;
+	m_loncorr_coeff=0.0;
+}
+
+transverse_mercator_t &
+localProjection::getUTMTransverseMercator() {
+	static transverse_mercator_t tmerc = UTMUPS_init_UTM_TransverseMercator();
+
+	return tmerc;
+}
+
+void
+localProjection::setOrigin(double lat, double lon) {
+	if(m_origin_set==true && lat==m_lat0 && lon==m_lon0) {
+		return;
+	}
+
+	m_lat0=lat;
+	m_lon0=lon;
+	m_origin_set=true;
+
+	if(m_mode==LOCALPROJECTION_TMERC) {
+		double gamma, k;
+
+		TransverseMercator_Forward(&getUTMTransverseMercator(),m_lon0,m_lat0,m_lon0,&m_x0,&m_y0,&gamma,&k);
+	} else {
+		// Meridional (M) and prime vertical (N) radii of curvature of the WGS84 ellipsoid at the origin
+		double f=UTMUPS_WGS84_f();
+		double e2=f*(2-f);
+		double sinlat=sin(m_lat0*DEG_TO_RAD);
+		double coslat=cos(m_lat0*DEG_TO_RAD);
+		double w=sqrt(1-e2*sinlat*sinlat);
+		double N=WGS84_A/w;
+		double M=WGS84_A*(1-e2)/(w*w*w);
+
+		m_northdeg_per_m=RAD_TO_DEG/M;
+		m_eastdeg_per_m=RAD_TO_DEG/(N*coslat);
+		// A straight line towards East moves away from the parallel of the origin, towards the Equator
+		m_latcorr_coeff=-RAD_TO_DEG*sinlat/(coslat*2*M*N);
+		// The radius of the parallels (and thus the conversion factor towards East) changes with the latitude
+		m_loncorr_coeff=sinlat/(coslat*M);
+	}
+}
+
+void
+localProjection::toLatLon(double x, double y, double &lat, double &lon) {
+	toLatLon(&x,&y,1,&lat,&lon);
+}
+
+void
+localProjection::toLatLon(const double *x, const double *y, size_t n, double *lat, double *lon) {
+	if(m_mode==LOCALPROJECTION_TMERC) {
+		transverse_mercator_t &tmerc=getUTMTransverseMercator();
+		double gamma, k;
+
+		for(size_t i=0;i<n;i++) {
+			TransverseMercator_Reverse(&tmerc,m_lon0,m_x0+x[i],m_y0+y[i],&lat[i],&lon[i],&gamma,&k);
+		}
+	} else {
+		// The loop has no dependencies between iterations and no function calls, so that it can be vectorized by the compiler
+		for(size_t i=0;i<n;i++) {
+			lat[i]=m_lat0+y[i]*m_northdeg_per_m+x[i]*x[i]*m_latcorr_coeff;
+			lon[i]=m_lon0+x[i]*m_eastdeg_per_m*(1+y[i]*m_loncorr_coeff);
+		}
+	}
+}
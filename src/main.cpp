@@ -11,6 +11,13 @@
 #include "QuadKeyTS.h"
 #include "AMQPclient.h"
 #include "JSONserver.h"
+#include "ingestPipeline.h"
+#include "metricsSink.h"
+#include "udpIngest.h"
+#include "replayIngest.h"
+#include "latencyStats.h"
+#include "trafficGenerator.h"
+#include "diagCounter.h"
 #include "utils.h"
 #include "timers.h"
 
@@ -38,7 +45,30 @@ std::condition_variable synccv;
 std::unordered_map<int,AMQPClient*> amqpclimap;
 std::mutex amqpclimutex;
 
-void AMQPclient_t(ldmmap::LDMMap *db_ptr,options_t *opts_ptr,std::string logfile_name,std::string clientID,unsigned int clientIndex,indicatorTriggerManager *itm_ptr,std::string quadKey_filter,AMQPClient *main_amqp_ptr,MisbehaviourDetector *mbd_ptr,CertificateStore *certStore_ptr) {
+// Configuration of the synthetic traffic generator: the stations move inside the internal area of the S-LDM
+static trafficGenConfig_t
+trafficGenConfigFromOptions(const options_t &opts) {
+	trafficGenConfig_t config;
+
+	config.num_stations=static_cast<unsigned int>(opts.generator_stations);
+	config.rate=opts.generator_rate;
+	config.duration_s=opts.generator_duration;
+	config.min_lat=opts.min_lat;
+	config.min_lon=opts.min_lon;
+	config.max_lat=opts.max_lat;
+	config.max_lon=opts.max_lon;
+	config.trajectory=opts.generator_linear_trajectory==true ? TRAFFICGEN_TRAJECTORY_LINEAR : TRAFFICGEN_TRAJECTORY_CIRCULAR;
+	for(int i=0;i<TRAFFICGEN_NUM_MSGTYPES;i++) {
+		config.weights[i]=static_cast<unsigned int>(opts.generator_mix[i]);
+	}
+	config.perceived_objects=static_cast<unsigned int>(opts.generator_perceived_objects);
+	config.facility_only=opts.generator_facility_only;
+	config.seed=static_cast<uint32_t>(opts.generator_seed);
+
+	return config;
+}
+
+void AMQPclient_t(ldmmap::LDMMap *db_ptr,options_t *opts_ptr,std::string logfile_name,std::string clientID,unsigned int clientIndex,indicatorTriggerManager *itm_ptr,std::string quadKey_filter,AMQPClient *main_amqp_ptr,MisbehaviourDetector *mbd_ptr,CertificateStore *certStore_ptr,IngestPipeline *ingest_ptr,MetricsSink *metrics_ptr,IngestRecorder *recorder_ptr) {
 	if(clientIndex >= MAX_ADDITIONAL_AMQP_CLIENTS-1) {
 		fprintf(stderr,"[FATAL ERROR] Error: there is a bug in the code, which attemps to spawn too many AMQP clients.\nPlease report this bug to the developers.\n");
 		fprintf(stderr,"Bug details: client id: %s - client index: %u - max supported clients: %u\n",clientID.c_str(),clientIndex,MAX_ADDITIONAL_AMQP_CLIENTS-1);
@@ -52,6 +82,11 @@ void AMQPclient_t(ldmmap::LDMMap *db_ptr,options_t *opts_ptr,std::string logfile
 
 	AMQPClient recvClient(std::string(options_string_pop(opts_ptr->amqp_broker_x[clientIndex].broker_url)), std::string(options_string_pop(opts_ptr->amqp_broker_x[clientIndex].broker_topic)), opts_ptr->min_lat,opts_ptr->max_lat, opts_ptr->min_lon, opts_ptr->max_lon, opts_ptr, db_ptr, logfile_name);
 
+	// Let the ingest pipeline workers (if enabled) process the received messages
+	recvClient.setIngestPipeline(ingest_ptr);
+	recvClient.setMetricsSink(metrics_ptr);
+	recvClient.setIngestRecorder(recorder_ptr);
+
 	// If this flag is set to true, the client will be restarted after an error, instead of being terminated
 	bool cli_restart = false;
 
@@ -191,6 +226,38 @@ void *DBcleaner_callback(void *arg) {
 	pthread_exit(nullptr);
 }
 
+void *SnapshotPublisher_callback(void *arg) {
+	// Get the pointer to the options/parameters (the same ones of the vehicle visualizer, which reads the published snapshots)
+	vizOptions_t *vizopts_ptr = static_cast<vizOptions_t *>(arg);
+	ldmmap::LDMMap *db_ptr = vizopts_ptr->db_ptr;
+
+	// Publish the snapshots twice per visualizer update, so that the visualizer never reads a snapshot older than half its update interval
+	Timer tmr(vizopts_ptr->opts_ptr->vehviz_update_interval_sec*1e3/2.0);
+
+        if(tmr.start()==false) {
+                std::cerr << "[ERROR] Fatal error! Cannot create timer for the DB snapshot publisher thread!" << std::endl;
+                terminatorFlag = true;
+                pthread_exit(nullptr);
+        }
+
+	POLL_DEFINE_JUNK_VARIABLE();
+
+	while(terminatorFlag == false && tmr.waitForExpiration()==true) {
+			// ---- These operations will be performed periodically ----
+
+			// The snapshot is taken here, and not by the readers, so that the readers only need to atomically load the
+			// last published one with getSnapshot()
+			db_ptr->publishSnapshot();
+			// --------
+	}
+
+	if(terminatorFlag == true) {
+		std::cerr << "[WARN] DB snapshot publisher terminated due to error." << std::endl;
+	}
+
+	pthread_exit(nullptr);
+}
+
 void updateVisualizer(ldmmap::vehicleData_t vehdata,void *vizObjVoidPtr) {
 	vehicleVisualizer *vizObjPtr = static_cast<vehicleVisualizer *>(vizObjVoidPtr);
 
@@ -245,8 +312,17 @@ void *VehVizUpdater_callback(void *arg) {
 
                         // ---- These operations will be performed periodically ----
 
-                        db_ptr->executeOnAllVehicleContents(&updateVisualizer, static_cast<void *>(&vehicleVisObj));
-						db_ptr->executeOnAllEventContents(&updateEventVisualizer, static_cast<void *>(&vehicleVisObj));
+                        // Read the database content from the last snapshot published by SnapshotPublisher_callback(), so that the
+                        // (possibly slow) updates sent to the visualizer never block the threads updating the database
+                        ldmmap::LDMMap::snapshotPtr_t snapshot = db_ptr->getSnapshot();
+
+                        for(const ldmmap::vehicleData_t &vehData : snapshot->vehicles) {
+                        	updateVisualizer(vehData, static_cast<void *>(&vehicleVisObj));
+                        }
+
+                        for(const auto &[key, eveData] : snapshot->events) {
+                        	updateEventVisualizer(eveData, key, static_cast<void *>(&vehicleVisObj));
+                        }
 
 			// --------
 	}
@@ -266,6 +342,8 @@ int main(int argc, char **argv) {
 	pthread_t dbcleaner_tid;
 	// Vehicle visualizer update thread ID
 	pthread_t vehviz_tid;
+	// DB snapshot publisher thread ID
+	pthread_t snapshot_tid;
 	// Thread attributes (unused, for the time being)
 	// pthread_attr_t tattr;
 
@@ -292,6 +370,38 @@ int main(int argc, char **argv) {
 		std::cout << "Cross-border trigger mode enabled." << std::endl;
 	}
 
+	// Generator dump mode: the synthetic messages are only written to a recording file (to be replayed later with --replay-file)
+	if(options_string_len(sldm_opts.generator_dump_file)>0) {
+		std::string dump_file=std::string(options_string_pop(sldm_opts.generator_dump_file));
+		IngestRecorder recorder;
+		bool dump_ok=false;
+
+		if(sldm_opts.generator_stations<=0) {
+			fprintf(stderr,"Critical error: the number of stations of the traffic generator must be specified (--generator-stations) to write %s.\n",dump_file.c_str());
+		} else if(recorder.open(dump_file)==false) {
+			fprintf(stderr,"Critical error: cannot create the generator dump file %s.\n",dump_file.c_str());
+		} else {
+			TrafficGenerator generator(trafficGenConfigFromOptions(sldm_opts),nullptr,nullptr);
+
+			dump_ok=generator.dump(recorder);
+			recorder.close();
+
+			if(dump_ok==true) {
+				fprintf(stdout,"[INFO] %" PRIu64 " synthetic messages written to %s (%" PRIu64 " could not be encoded)\n",
+					recorder.getRecordedCount(),dump_file.c_str(),generator.getEncodeErrorCount());
+				for(int i=0;i<TRAFFICGEN_NUM_MSGTYPES;i++) {
+					fprintf(stdout,"[INFO]   %s: %" PRIu64 "\n",TrafficGenerator::getMsgTypeName(static_cast<trafficGenMsgType_t>(i)),
+						generator.getGeneratedCount(static_cast<trafficGenMsgType_t>(i)));
+				}
+			} else {
+				fprintf(stderr,"Critical error: both the duration (--generator-duration) and the rate (--generator-rate) of the traffic generator must be greater than 0 to write %s.\n",dump_file.c_str());
+			}
+		}
+
+		options_free(&sldm_opts);
+		exit(dump_ok==true ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
 	/* ----------------- TEST AREA (insert here your test code, which will be removed from the final version of main()) ----------------- */
 	/* ------------------------------------------------------------------------------------------------------------------------------------ */
 	/* ------------------------------------------------------------------------------------------------------------------------------------ */
@@ -371,6 +481,7 @@ int main(int argc, char **argv) {
 	if(decodeFrontend.decodeEtsi((uint8_t *)&denm2_bytes[0], 190, decodedData, sec_retval,certificateData)!=ETSI_DECODER_OK) {
 		std::cerr << "Error! Cannot decode ETSI packet!" << std::endl;
 	}
+	etsiDecoder::decodedMsgOwner decodedOwner(decodeFrontend,decodedData);
 
 	if(decodedData.type == etsiDecoder::ETSI_DECODED_CAM) {
 		CAM_t *decoded_cam;
@@ -462,8 +573,11 @@ int main(int argc, char **argv) {
 
 	}
 
-	// Create a new DB object
-	ldmmap::LDMMap *db_ptr = new ldmmap::LDMMap();
+	// Create a new DB object, with the number of shards specified by the user (--db-shards)
+	ldmmap::LDMMap *db_ptr = new ldmmap::LDMMap(sldm_opts.db_shards);
+
+	// Set the size of the cells of the spatial index used by the database for range queries
+	db_ptr->setSpatialIndexCellSize(sldm_opts.spatial_index_cell_size);
 
 	// Create a CertificateStore object (the same object will be then accessed by all the AMQP clients, when using more than one client)
 	CertificateStore *certStore_ptr = new CertificateStore();
@@ -493,6 +607,8 @@ int main(int argc, char **argv) {
 	// pthread_attr_setdetachstate(&tattr,PTHREAD_CREATE_DETACHED);
 	vizOptions_t vizParams = {db_ptr,&sldm_opts};
 	pthread_create(&vehviz_tid,NULL,VehVizUpdater_callback,(void *) &vizParams);
+	// The snapshots read by the vehicle visualizer are published by a third thread, periodically copying the database
+	pthread_create(&snapshot_tid,NULL,SnapshotPublisher_callback,(void *) &vizParams);
 	// pthread_attr_destroy(&tattr);
 
 	// Create an indicatorTriggerManager object (the same object will be then accessed by all the AMQP clients, when using more than one client)
@@ -543,8 +659,42 @@ int main(int argc, char **argv) {
 
 	// -*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*-*
 
+	// Create the ingest pipeline, shared by all the AMQP clients (if --ingest-workers is set to 0, each client processes its
+	// messages directly in its own thread)
+	IngestPipeline *ingest_ptr=nullptr;
+
+	if(sldm_opts.ingest_workers>0) {
+		ingest_ptr=new IngestPipeline(sldm_opts.ingest_workers,sldm_opts.ingest_queue_size,AMQPClient::ingestProcessMessage,nullptr);
+		ingest_ptr->start();
+
+		std::cout << "[INFO] Received messages will be processed by " << sldm_opts.ingest_workers << " ingest worker threads." << std::endl;
+	}
+
+	// Create the metrics sink, shared by all the AMQP clients, which writes the timing measurements to CSV files in background
+	std::string metrics_dir="";
+	if(options_string_len(sldm_opts.metrics_dir)>0) {
+		metrics_dir=std::string(options_string_pop(sldm_opts.metrics_dir));
+	}
+
+	MetricsSink *metrics_ptr=new MetricsSink(metrics_dir,static_cast<uint64_t>(sldm_opts.metrics_max_file_size)*1024*1024);
+	metrics_ptr->start();
+
+	// Record all the received messages, if requested by the user, to replay them later
+	IngestRecorder *recorder_ptr=nullptr;
+	if(options_string_len(sldm_opts.record_file)>0) {
+		recorder_ptr=new IngestRecorder();
+
+		if(recorder_ptr->open(std::string(options_string_pop(sldm_opts.record_file)))==false) {
+			fprintf(stderr,"Critical error: cannot create the record file %s.\n",options_string_pop(sldm_opts.record_file));
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	// Create the main AMQP client object
 	AMQPClient mainRecvClient(std::string(options_string_pop(sldm_opts.amqp_broker_one.broker_url)), std::string(options_string_pop(sldm_opts.amqp_broker_one.broker_topic)), sldm_opts.min_lat, sldm_opts.max_lat, sldm_opts.min_lon, sldm_opts.max_lon, &sldm_opts, db_ptr, logfile_name);
+	mainRecvClient.setIngestPipeline(ingest_ptr);
+	mainRecvClient.setMetricsSink(metrics_ptr);
+	mainRecvClient.setIngestRecorder(recorder_ptr);
 
 	// Create the JSONserver object for the on-demand JSON-over-TCP interface
 	JSONserver jsonsrv(db_ptr);
@@ -566,68 +716,187 @@ int main(int argc, char **argv) {
 
 		for(unsigned int i=0;i<sldm_opts.num_amqp_x_enabled;i++) {
 			amqp_x_threads.emplace_back(AMQPclient_t,db_ptr,&sldm_opts,(logfile_name == "stdout" ? "stdout" : logfile_name + std::to_string(i+2)),
-				std::to_string(i+2),i,&itm,filter_str,&mainRecvClient,mbd_ptr,certStore_ptr);
+				std::to_string(i+2),i,&itm,filter_str,&mainRecvClient,mbd_ptr,certStore_ptr,ingest_ptr,metrics_ptr,recorder_ptr);
 		}
 	}
 
-	if(sldm_opts.amqp_broker_one.amqp_reconnect_after_local_timeout_expired==true) {
-		std::cout << "[AMQPClient 1] This client will be restarted if a local idle timeout error occurs." << std::endl;
-	}
+	if(options_string_len(sldm_opts.replay_file)>0) {
+		// Offline benchmark mode: the messages of the capture file are processed by the main AMQP client, without connecting to
+		// any broker, and the S-LDM terminates at the end of the replay
+		std::string replay_file=std::string(options_string_pop(sldm_opts.replay_file));
+		LatencyStats latstats;
 
-	// If this flag is set to true, the client will be restarted after an error, instead of being terminated
-	bool cli_restart = false;
+		if(sldm_opts.indicatorTrgMan_enabled==true) {
+			mainRecvClient.setIndicatorTriggerManager(&itm);
+		}
+		mainRecvClient.setMisbehaviourDetector(mbd_ptr);
+		mainRecvClient.setClientID("1");
+		mainRecvClient.setLatencyStats(&latstats);
+		mainRecvClient.openLogFile();
 
-	do {
-		cli_restart = false;
+		ReplayIngest replay(replay_file,sldm_opts.replay_speed,AMQPClient::sourceIngestMessage,&mainRecvClient);
 
-		// Start the AMQP client event loop (main client)
-		try {
-			// The indicator trigger manager is disabled by default in AMQPClient, unless it is explicitely enabled with a call to setIndicatorTriggerManager(true)
-			if(sldm_opts.indicatorTrgMan_enabled==true) {
-				mainRecvClient.setIndicatorTriggerManager(&itm);
-			}
+		std::cout << "[INFO] Replaying the messages stored in " << replay_file << "..." << std::endl;
 
-			// Activate Misbehaviour Detector is enabled
-			mainRecvClient.setMisbehaviourDetector(mbd_ptr);
+		uint64_t replay_bf=get_timestamp_us();
+		bool replay_ok=replay.run();
+		// closeLogFile() also waits for the ingest pipeline workers to process all the replayed messages
+		mainRecvClient.closeLogFile();
+		uint64_t replay_af=get_timestamp_us();
 
-			// Set username, if specified
-			if(options_string_len(sldm_opts.amqp_broker_one.amqp_username)>0) {
-				mainRecvClient.setUsername(std::string(options_string_pop(sldm_opts.amqp_broker_one.amqp_username)));
-			}
+		if(replay_ok==true) {
+			double duration_s=(replay_af-replay_bf)/1e6;
 
-			// Set password, if specified
-			if(options_string_len(sldm_opts.amqp_broker_one.amqp_password)>0) {
-				mainRecvClient.setPassword(std::string(options_string_pop(sldm_opts.amqp_broker_one.amqp_password)));
-			}
+			fprintf(stdout,"[INFO] Replay completed: %" PRIu64 " messages (%" PRIu64 " skipped packets) in %.3lf s - %.1lf messages/s\n",
+				replay.getReplayedCount(),replay.getSkippedCount(),duration_s,
+				duration_s>0 ? replay.getReplayedCount()/duration_s : 0.0);
+			latstats.print(stdout);
+		} else {
+			fprintf(stderr,"Critical error: cannot replay the messages stored in %s.\n",replay_file.c_str());
+		}
 
-			// Set connection options (they all default to "false" - see also options.c/broker_options_inizialize())
-			mainRecvClient.setConnectionOptions(sldm_opts.amqp_broker_one.amqp_allow_sasl,sldm_opts.amqp_broker_one.amqp_allow_insecure,sldm_opts.amqp_broker_one.amqp_reconnect);
-			mainRecvClient.setIdleTimeout(sldm_opts.amqp_broker_one.amqp_idle_timeout);
+		mainRecvClient.setLatencyStats(nullptr);
+		terminatorFlag = true;
+	} else if(sldm_opts.generator_stations>0) {
+		// Load test mode: the messages of the synthetic stations are processed by the main AMQP client, without connecting to any
+		// broker, and the S-LDM terminates at the end of the generation
+		LatencyStats latstats;
+		std::atomic<bool> generator_done(false);
+
+		if(sldm_opts.indicatorTrgMan_enabled==true) {
+			mainRecvClient.setIndicatorTriggerManager(&itm);
+		}
+		mainRecvClient.setMisbehaviourDetector(mbd_ptr);
+		mainRecvClient.setClientID("1");
+		mainRecvClient.setLatencyStats(&latstats);
+		mainRecvClient.openLogFile();
 
-			mainRecvClient.setClientID("1");
+		TrafficGenerator generator(trafficGenConfigFromOptions(sldm_opts),AMQPClient::sourceIngestMessage,&mainRecvClient);
 
-			// Set the QuadKey filter
-			if(sldm_opts.quadkFilter_enabled==true) {
-				mainRecvClient.setFilter(filter_str);
-			}
+		std::cout << "[INFO] Generating the messages of " << sldm_opts.generator_stations << " synthetic stations..." << std::endl;
 
-			proton::container(mainRecvClient).run();
-		} catch (const std::exception& e) {
-			if(sldm_opts.amqp_broker_one.amqp_reconnect_after_local_timeout_expired==true && std::string(e.what()) == "amqp:resource-limit-exceeded: local-idle-timeout expired") {
-				std::cerr << "[AMQPClient 1] Exception occurred: " << e.what() << std::endl;
-				std::cout << "[AMQPClient 1] Attempting to restart the client after a local idle timeout expired error..." << std::endl;
-				mainRecvClient.force_container_stop();
+		uint64_t generator_bf=get_timestamp_us();
+		std::thread generator_thread([&generator,&generator_done] {
+			generator.run();
+			generator_done = true;
+		});
+
+		// The generation is also stopped if any other thread requests the termination of the S-LDM
+		while(generator_done == false && terminatorFlag == false) {
+			usleep(100000);
+		}
+
+		generator.stop();
+		generator_thread.join();
+		// closeLogFile() also waits for the ingest pipeline workers to process all the generated messages
+		mainRecvClient.closeLogFile();
+		uint64_t generator_af=get_timestamp_us();
+
+		double duration_s=(generator_af-generator_bf)/1e6;
+
+		fprintf(stdout,"[INFO] Traffic generation completed: %" PRIu64 " messages (%" PRIu64 " encoding errors) in %.3lf s - %.1lf messages/s\n",
+			generator.getGeneratedCount(),generator.getEncodeErrorCount(),duration_s,
+			duration_s>0 ? generator.getGeneratedCount()/duration_s : 0.0);
+		for(int i=0;i<TRAFFICGEN_NUM_MSGTYPES;i++) {
+			fprintf(stdout,"[INFO]   %s: %" PRIu64 "\n",TrafficGenerator::getMsgTypeName(static_cast<trafficGenMsgType_t>(i)),
+				generator.getGeneratedCount(static_cast<trafficGenMsgType_t>(i)));
+		}
+		latstats.print(stdout);
+
+		mainRecvClient.setLatencyStats(nullptr);
+		terminatorFlag = true;
+	} else if(sldm_opts.udp_ingest_port>0) {
+		// The messages are received over UDP instead of from the main AMQP broker: the main AMQP client is only used to process them,
+		// without running its event loop
+		std::string udp_ingest_address="";
+		if(options_string_len(sldm_opts.udp_ingest_address)>0) {
+			udp_ingest_address=std::string(options_string_pop(sldm_opts.udp_ingest_address));
+		}
+
+		if(sldm_opts.indicatorTrgMan_enabled==true) {
+			mainRecvClient.setIndicatorTriggerManager(&itm);
+		}
+		mainRecvClient.setMisbehaviourDetector(mbd_ptr);
+		mainRecvClient.setClientID("1");
+		mainRecvClient.openLogFile();
+
+		UDPIngest udpIngest(udp_ingest_address,static_cast<uint16_t>(sldm_opts.udp_ingest_port),AMQPClient::sourceIngestMessage,&mainRecvClient);
+
+		if(udpIngest.start()==false) {
+			fprintf(stderr,"Critical error: cannot start the UDP ingest source on port %ld.\n",sldm_opts.udp_ingest_port);
+			terminatorFlag = true;
+		} else {
+			std::cout << "[INFO] ITS messages will be received over UDP on port " << sldm_opts.udp_ingest_port << "." << std::endl;
+
+			while(terminatorFlag == false) {
 				sleep(1);
-				cli_restart = true;
-			} else {
-				std::cerr << e.what() << std::endl;
-				terminatorFlag = true;
 			}
+
+			udpIngest.stop();
 		}
-	} while(cli_restart==true);
+
+		mainRecvClient.closeLogFile();
+	} else {
+		if(sldm_opts.amqp_broker_one.amqp_reconnect_after_local_timeout_expired==true) {
+			std::cout << "[AMQPClient 1] This client will be restarted if a local idle timeout error occurs." << std::endl;
+		}
+
+		// If this flag is set to true, the client will be restarted after an error, instead of being terminated
+		bool cli_restart = false;
+
+		do {
+			cli_restart = false;
+
+			// Start the AMQP client event loop (main client)
+			try {
+				// The indicator trigger manager is disabled by default in AMQPClient, unless it is explicitely enabled with a call to setIndicatorTriggerManager(true)
+				if(sldm_opts.indicatorTrgMan_enabled==true) {
+					mainRecvClient.setIndicatorTriggerManager(&itm);
+				}
+
+				// Activate Misbehaviour Detector is enabled
+				mainRecvClient.setMisbehaviourDetector(mbd_ptr);
+
+				// Set username, if specified
+				if(options_string_len(sldm_opts.amqp_broker_one.amqp_username)>0) {
+					mainRecvClient.setUsername(std::string(options_string_pop(sldm_opts.amqp_broker_one.amqp_username)));
+				}
+
+				// Set password, if specified
+				if(options_string_len(sldm_opts.amqp_broker_one.amqp_password)>0) {
+					mainRecvClient.setPassword(std::string(options_string_pop(sldm_opts.amqp_broker_one.amqp_password)));
+				}
+
+				// Set connection options (they all default to "false" - see also options.c/broker_options_inizialize())
+				mainRecvClient.setConnectionOptions(sldm_opts.amqp_broker_one.amqp_allow_sasl,sldm_opts.amqp_broker_one.amqp_allow_insecure,sldm_opts.amqp_broker_one.amqp_reconnect);
+				mainRecvClient.setIdleTimeout(sldm_opts.amqp_broker_one.amqp_idle_timeout);
+
+				mainRecvClient.setClientID("1");
+
+				// Set the QuadKey filter
+				if(sldm_opts.quadkFilter_enabled==true) {
+					mainRecvClient.setFilter(filter_str);
+				}
+
+				proton::container(mainRecvClient).run();
+			} catch (const std::exception& e) {
+				if(sldm_opts.amqp_broker_one.amqp_reconnect_after_local_timeout_expired==true && std::string(e.what()) == "amqp:resource-limit-exceeded: local-idle-timeout expired") {
+					std::cerr << "[AMQPClient 1] Exception occurred: " << e.what() << std::endl;
+					std::cout << "[AMQPClient 1] Attempting to restart the client after a local idle timeout expired error..." << std::endl;
+					mainRecvClient.force_container_stop();
+					sleep(1);
+					cli_restart = true;
+				} else {
+					std::cerr << e.what() << std::endl;
+					terminatorFlag = true;
+				}
+			}
+		} while(cli_restart==true);
+	}
 
 	pthread_join(dbcleaner_tid,nullptr);
 	pthread_join(vehviz_tid,nullptr);
+	pthread_join(snapshot_tid,nullptr);
 
 	if(sldm_opts.num_amqp_x_enabled>0) {
 		fprintf(stdout,"[INFO] Terminating the other AMQP clients...\n");
@@ -645,8 +914,25 @@ int main(int argc, char **argv) {
 		amqp_x_threads[i].join();
 	}
 
+	// Process the messages which are still queued and terminate the ingest workers, only after all the producers (the AMQP clients
+	// and the UDP, replay and generator sources, which have all been stopped above) cannot push any other message
+	if(ingest_ptr!=nullptr) {
+		ingest_ptr->stop();
+	}
+
+	delete ingest_ptr;
+
+	delete recorder_ptr;
+
+	// Write the metrics which are still queued (all the clients have been terminated)
+	metrics_ptr->stop();
+	delete metrics_ptr;
+
 	db_ptr->clear();
 
+	// Print how many times each per-message diagnostic event (e.g., a decoding error) occurred, as they are printed at a limited rate
+	DiagCounter::printSummary(stdout);
+
 	// Freeing the options
 	options_free(&sldm_opts);
 
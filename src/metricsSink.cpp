@@ -0,0 +1,248 @@
+#include "metricsSink.h"
+
+#include <chrono>
+#include <cstring>
+
+MetricsSink::MetricsSink(const std::string &directory, uint64_t max_file_size, unsigned int max_rotated_files, size_t queue_size) :
+	m_queue(queue_size) {
+	m_directory=directory=="" ? "." : directory;
+	m_max_file_size=max_file_size;
+	m_max_rotated_files=max_rotated_files;
+
+	m_dropped=0;
+
+	m_streams=std::unique_ptr<stream_t[]>(new stream_t[METRICSSINK_MAX_STREAMS]);
+	m_num_streams=0;
+
+	m_running=false;
+}
+
+MetricsSink::~MetricsSink() {
+	stop();
+}
+
+void
+MetricsSink::start() {
+	if(m_running.exchange(true)==true) {
+		return;
+	}
+
+	m_writer=std::thread(&MetricsSink::writerLoop,this);
+}
+
+void
+MetricsSink::stop() {
+	{
+		std::lock_guard<std::mutex> lk(m_writermut);
+
+		if(m_running==false) {
+			return;
+		}
+
+		m_running=false;
+	}
+
+	m_writercv.notify_one();
+
+	if(m_writer.joinable()) {
+		m_writer.join();
+	}
+
+	for(unsigned int i=0;i<m_num_streams;i++) {
+		if(m_streams[i].file!=nullptr) {
+			fclose(m_streams[i].file);
+			m_streams[i].file=nullptr;
+		}
+	}
+}
+
+int
+MetricsSink::registerStream(const std::string &name, const std::vector<std::string> &columns) {
+	std::lock_guard<std::mutex> lk(m_streamsmut);
+	unsigned int num_streams=m_num_streams.load(std::memory_order_relaxed);
+
+	for(unsigned int i=0;i<num_streams;i++) {
+		if(m_streams[i].name==name) {
+			return static_cast<int>(i);
+		}
+	}
+
+	if(num_streams>=METRICSSINK_MAX_STREAMS || columns.size()>METRICSSINK_MAX_COLUMNS) {
+		return -1;
+	}
+
+	stream_t &stream=m_streams[num_streams];
+	stream.name=name;
+	stream.columns=columns;
+	stream.file=nullptr;
+	stream.file_size=0;
+	stream.open_retry_ns=0;
+
+	// Publish the stream only after it has been fully initialized
+	m_num_streams.store(num_streams+1,std::memory_order_release);
+
+	return static_cast<int>(num_streams);
+}
+
+bool
+MetricsSink::emit(int stream, const double *values, size_t num_values) {
+	if(stream<0 || static_cast<unsigned int>(stream)>=m_num_streams.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	metricsRow_t row;
+	row.stream=static_cast<uint32_t>(stream);
+	row.num_values=static_cast<uint32_t>(num_values<METRICSSINK_MAX_COLUMNS ? num_values : METRICSSINK_MAX_COLUMNS);
+	memcpy(row.values,values,row.num_values*sizeof(double));
+
+	if(m_queue.push(row)==false) {
+		m_dropped.fetch_add(1,std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+void
+MetricsSink::writerLoop() {
+	metricsRow_t row;
+	bool pending=false;
+
+	while(true) {
+		if(m_queue.pop(row)==true) {
+			writeRow(row);
+			pending=true;
+			continue;
+		}
+
+		// The queue is empty: make the rows written so far visible in the files
+		if(pending==true) {
+			for(unsigned int i=0;i<m_num_streams;i++) {
+				if(m_streams[i].file!=nullptr) {
+					fflush(m_streams[i].file);
+				}
+			}
+			pending=false;
+		}
+
+		std::unique_lock<std::mutex> lk(m_writermut);
+
+		if(m_running==false) {
+			break;
+		}
+
+		m_writercv.wait_for(lk,std::chrono::milliseconds(METRICSSINK_FLUSH_INTERVAL_MS));
+	}
+
+	// Write the rows which have been emitted while the writer was terminating
+	while(m_queue.pop(row)==true) {
+		writeRow(row);
+	}
+}
+
+void
+MetricsSink::writeRow(const metricsRow_t &row) {
+	stream_t &stream=m_streams[row.stream];
+
+	if(stream.file==nullptr && openStreamFile(stream)==false) {
+		return;
+	}
+
+	size_t num_columns=stream.columns.size();
+	int written=0;
+
+	for(size_t i=0;i<num_columns;i++) {
+		if(i<row.num_values) {
+			written+=fprintf(stream.file,i==0 ? "%g" : ",%g",row.values[i]);
+		} else if(i>0) {
+			written+=fprintf(stream.file,",");
+		}
+	}
+	written+=fprintf(stream.file,"\n");
+
+	if(written>0) {
+		stream.file_size+=written;
+	}
+
+	if(m_max_file_size>0 && stream.file_size>=m_max_file_size) {
+		rotateStreamFile(stream);
+	}
+}
+
+std::string
+MetricsSink::getStreamFileName(const stream_t &stream, unsigned int rotation_idx) {
+	if(rotation_idx==0) {
+		return m_directory + "/" + stream.name + ".csv";
+	}
+
+	return m_directory + "/" + stream.name + "." + std::to_string(rotation_idx) + ".csv";
+}
+
+bool
+MetricsSink::openStreamFile(stream_t &stream) {
+	uint64_t now_ns=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// Do not try to open again, for each row, a file which could not be opened
+	if(stream.open_retry_ns>0 && now_ns<stream.open_retry_ns) {
+		return false;
+	}
+
+	std::string filename=getStreamFileName(stream,0);
+
+	// The data is appended to any existing file, as the rows are not tied to a specific execution of the S-LDM
+	stream.file=fopen(filename.c_str(),"a");
+
+	if(stream.file==nullptr) {
+		if(stream.open_retry_ns==0) {
+			fprintf(stderr,"[WARNING] Cannot open the metrics file %s: the rows of this stream will be discarded (opening it again every %d seconds).\n",
+				filename.c_str(),METRICSSINK_OPEN_RETRY_INTERVAL_S);
+		}
+
+		stream.open_retry_ns=now_ns+static_cast<uint64_t>(METRICSSINK_OPEN_RETRY_INTERVAL_S)*1000000000ULL;
+		return false;
+	}
+
+	if(stream.open_retry_ns>0) {
+		fprintf(stderr,"[INFO] The metrics file %s has been opened: the rows of this stream are being written again.\n",filename.c_str());
+		stream.open_retry_ns=0;
+	}
+
+	stream.filebuf=std::unique_ptr<char[]>(new char[METRICSSINK_FILE_BUFFER_SIZE]);
+	setvbuf(stream.file,stream.filebuf.get(),_IOFBF,METRICSSINK_FILE_BUFFER_SIZE);
+
+	fseek(stream.file,0,SEEK_END);
+	long size=ftell(stream.file);
+	stream.file_size=size>0 ? static_cast<uint64_t>(size) : 0;
+
+	// If the file is empty, write the header
+	if(stream.file_size==0) {
+		for(size_t i=0;i<stream.columns.size();i++) {
+			int written=fprintf(stream.file,i==0 ? "%s" : ",%s",stream.columns[i].c_str());
+
+			if(written>0) {
+				stream.file_size+=written;
+			}
+		}
+		stream.file_size+=fprintf(stream.file,"\n");
+	}
+
+	return true;
+}
+
+void
+MetricsSink::rotateStreamFile(stream_t &stream) {
+	fclose(stream.file);
+	stream.file=nullptr;
+
+	if(m_max_rotated_files==0) {
+		remove(getStreamFileName(stream,0).c_str());
+	} else {
+		// The oldest file, if any, is overwritten by rename()
+		for(unsigned int i=m_max_rotated_files-1;i>=1;i--) {
+			rename(getStreamFileName(stream,i).c_str(),getStreamFileName(stream,i+1).c_str());
+		}
+		rename(getStreamFileName(stream,0).c_str(),getStreamFileName(stream,1).c_str());
+	}
+
+	// The new file is opened (with its header) only when the next row is written
+}
@@ -0,0 +1,285 @@
+#include "replayIngest.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "pcap.h"
+
+// EtherType of GeoNetworking and of the VLAN tags
+#define ETHERTYPE_GEONETWORKING 0x8947
+#define ETHERTYPE_VLAN 0x8100
+// Length of the Ethernet header, of a VLAN tag and of the Linux "cooked" capture header
+#define ETHERNET_HEADER_LEN 14
+#define VLAN_TAG_LEN 4
+#define LINUX_SLL_HEADER_LEN 16
+
+// Magic numbers of the pcap (microsecond and nanosecond resolution, both byte orders) and pcapng files
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_US_SWAPPED 0xd4c3b2a1
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_MAGIC_NS_SWAPPED 0x4d3cb2a1
+#define PCAPNG_MAGIC 0x0a0d0d0a
+
+IngestRecorder::IngestRecorder() {
+	m_file=nullptr;
+	m_recorded_cnt=0;
+}
+
+IngestRecorder::~IngestRecorder() {
+	close();
+}
+
+bool
+IngestRecorder::open(const std::string &filename) {
+	std::lock_guard<std::mutex> lk(m_filemut);
+
+	if(m_file!=nullptr) {
+		fclose(m_file);
+	}
+
+	m_file=fopen(filename.c_str(),"wb");
+
+	if(m_file==nullptr) {
+		return false;
+	}
+
+	fwrite(INGESTRECORDER_FILE_MAGIC,1,strlen(INGESTRECORDER_FILE_MAGIC),m_file);
+
+	return true;
+}
+
+void
+IngestRecorder::close() {
+	std::lock_guard<std::mutex> lk(m_filemut);
+
+	if(m_file!=nullptr) {
+		fclose(m_file);
+		m_file=nullptr;
+	}
+}
+
+void
+IngestRecorder::record(const ingestMessage_t &msg) {
+	ingestRecordHeader_t header;
+
+	header.rx_timestamp_us=msg.on_msg_timestamp_us;
+	header.gn_timestamp=msg.gn_timestamp;
+	header.payload_len=static_cast<uint32_t>(msg.payload.size());
+	header.quadkey_len=static_cast<uint16_t>(msg.quadkey.size()<UINT16_MAX ? msg.quadkey.size() : UINT16_MAX);
+	header.flags=(msg.properties_available ? INGESTRECORDER_FLAG_PROPERTIES_AVAILABLE : 0) |
+		(msg.gn_timestamp_available ? INGESTRECORDER_FLAG_GN_TIMESTAMP_AVAILABLE : 0);
+	header.reserved=0;
+
+	std::lock_guard<std::mutex> lk(m_filemut);
+
+	if(m_file==nullptr) {
+		return;
+	}
+
+	fwrite(&header,sizeof(header),1,m_file);
+	fwrite(msg.quadkey.data(),1,header.quadkey_len,m_file);
+	fwrite(msg.payload.data(),1,header.payload_len,m_file);
+
+	m_recorded_cnt++;
+}
+
+ReplayIngest::ReplayIngest(const std::string &filename, double speed, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args) {
+	m_filename=filename;
+	m_speed=speed>0 ? speed : 0;
+	m_format=REPLAYINGEST_FORMAT_UNKNOWN;
+
+	m_rx_fcn=rx_fcn;
+	m_additional_args=additional_args;
+
+	m_first_replayed=false;
+	m_first_recorded_us=0;
+	m_first_replayed_us=0;
+
+	m_stop=false;
+	m_replayed_cnt=0;
+	m_skipped_cnt=0;
+}
+
+ReplayIngest::replayIngestFormat_t
+ReplayIngest::detectFormat(const std::string &filename) {
+	FILE *file=fopen(filename.c_str(),"rb");
+	char magic[8];
+
+	if(file==nullptr) {
+		return REPLAYINGEST_FORMAT_UNKNOWN;
+	}
+
+	size_t len=fread(magic,1,sizeof(magic),file);
+	fclose(file);
+
+	if(len==sizeof(magic) && memcmp(magic,INGESTRECORDER_FILE_MAGIC,sizeof(magic))==0) {
+		return REPLAYINGEST_FORMAT_RECORDING;
+	}
+
+	if(len>=4) {
+		uint32_t magic32;
+		memcpy(&magic32,magic,sizeof(magic32));
+
+		if(magic32==PCAP_MAGIC_US || magic32==PCAP_MAGIC_US_SWAPPED || magic32==PCAP_MAGIC_NS ||
+			magic32==PCAP_MAGIC_NS_SWAPPED || magic32==PCAPNG_MAGIC) {
+			return REPLAYINGEST_FORMAT_PCAP;
+		}
+	}
+
+	return REPLAYINGEST_FORMAT_UNKNOWN;
+}
+
+bool
+ReplayIngest::run() {
+	m_format=detectFormat(m_filename);
+	m_first_replayed=false;
+
+	switch(m_format) {
+		case REPLAYINGEST_FORMAT_PCAP:
+			return runPcap();
+		case REPLAYINGEST_FORMAT_RECORDING:
+			return runRecording();
+		default:
+			std::cerr << "[ReplayIngest] Error: cannot open " << m_filename << ", or unsupported file format." << std::endl;
+			return false;
+	}
+}
+
+void
+ReplayIngest::replayMessage(ingestMessage_t &msg, uint64_t recorded_us) {
+	if(m_speed>0) {
+		if(m_first_replayed==false) {
+			m_first_replayed=true;
+			m_first_recorded_us=recorded_us;
+			m_first_replayed_us=get_timestamp_us();
+		} else if(recorded_us>m_first_recorded_us) {
+			// Messages recorded out of order are replayed immediately
+			uint64_t target_us=m_first_replayed_us+static_cast<uint64_t>((recorded_us-m_first_recorded_us)/m_speed);
+			uint64_t now_us=get_timestamp_us();
+
+			if(target_us>now_us) {
+				std::this_thread::sleep_for(std::chrono::microseconds(target_us-now_us));
+			}
+		}
+	}
+
+	uint64_t rx_timestamp_ns=get_timestamp_ns();
+
+	msg.owner=nullptr;
+	msg.on_msg_timestamp_us=rx_timestamp_ns/1000;
+	msg.rx_timestamp_ns=rx_timestamp_ns;
+
+	m_rx_fcn(msg,m_additional_args);
+	m_replayed_cnt++;
+}
+
+bool
+ReplayIngest::runPcap() {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t *pcap_hnd=pcap_open_offline(m_filename.c_str(),errbuf);
+
+	if(pcap_hnd==nullptr) {
+		std::cerr << "[ReplayIngest] Error: cannot open " << m_filename << ": " << errbuf << std::endl;
+		return false;
+	}
+
+	int linktype=pcap_datalink(pcap_hnd);
+
+	if(linktype!=DLT_EN10MB && linktype!=DLT_LINUX_SLL) {
+		std::cerr << "[ReplayIngest] Error: unsupported link type in " << m_filename << " (only Ethernet and Linux cooked captures are supported)." << std::endl;
+		pcap_close(pcap_hnd);
+		return false;
+	}
+
+	struct pcap_pkthdr *pkthdr;
+	const u_char *pktdata;
+
+	while(m_stop==false && pcap_next_ex(pcap_hnd,&pkthdr,&pktdata)==1) {
+		size_t offset;
+		uint16_t ethertype;
+
+		if(linktype==DLT_EN10MB) {
+			if(pkthdr->caplen<ETHERNET_HEADER_LEN) {
+				m_skipped_cnt++;
+				continue;
+			}
+
+			offset=ETHERNET_HEADER_LEN;
+			ethertype=(pktdata[12]<<8) | pktdata[13];
+
+			if(ethertype==ETHERTYPE_VLAN && pkthdr->caplen>=ETHERNET_HEADER_LEN+VLAN_TAG_LEN) {
+				offset+=VLAN_TAG_LEN;
+				ethertype=(pktdata[16]<<8) | pktdata[17];
+			}
+		} else {
+			if(pkthdr->caplen<LINUX_SLL_HEADER_LEN) {
+				m_skipped_cnt++;
+				continue;
+			}
+
+			offset=LINUX_SLL_HEADER_LEN;
+			ethertype=(pktdata[14]<<8) | pktdata[15];
+		}
+
+		if(ethertype!=ETHERTYPE_GEONETWORKING || pkthdr->caplen<=offset) {
+			m_skipped_cnt++;
+			continue;
+		}
+
+		ingestMessage_t msg;
+
+		msg.payload.assign(pktdata+offset,pktdata+pkthdr->caplen);
+		msg.properties_available=false;
+		msg.gn_timestamp_available=false;
+		msg.gn_timestamp=0;
+		msg.quadkey="";
+
+		replayMessage(msg,static_cast<uint64_t>(pkthdr->ts.tv_sec)*1000000+pkthdr->ts.tv_usec);
+	}
+
+	pcap_close(pcap_hnd);
+
+	return true;
+}
+
+bool
+ReplayIngest::runRecording() {
+	FILE *file=fopen(m_filename.c_str(),"rb");
+
+	if(file==nullptr) {
+		std::cerr << "[ReplayIngest] Error: cannot open " << m_filename << "." << std::endl;
+		return false;
+	}
+
+	// The magic string has already been checked by detectFormat()
+	fseek(file,strlen(INGESTRECORDER_FILE_MAGIC),SEEK_SET);
+
+	ingestRecordHeader_t header;
+
+	while(m_stop==false && fread(&header,sizeof(header),1,file)==1) {
+		ingestMessage_t msg;
+
+		msg.quadkey.resize(header.quadkey_len);
+		msg.payload.resize(header.payload_len);
+
+		if((header.quadkey_len>0 && fread(&msg.quadkey[0],1,header.quadkey_len,file)!=header.quadkey_len) ||
+			fread(msg.payload.data(),1,header.payload_len,file)!=header.payload_len) {
+			// Truncated record (e.g., the recording S-LDM has been terminated while writing it)
+			m_skipped_cnt++;
+			break;
+		}
+
+		msg.properties_available=(header.flags & INGESTRECORDER_FLAG_PROPERTIES_AVAILABLE)!=0;
+		msg.gn_timestamp_available=(header.flags & INGESTRECORDER_FLAG_GN_TIMESTAMP_AVAILABLE)!=0;
+		msg.gn_timestamp=header.gn_timestamp;
+
+		replayMessage(msg,header.rx_timestamp_us);
+	}
+
+	fclose(file);
+
+	return true;
+}
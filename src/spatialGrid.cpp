@@ -0,0 +1,183 @@
+#include "spatialGrid.h"
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+
+// Length of one degree of latitude (or one degree of longitude at the equator), in meters
+// 111194.93 m is computed as 2*pi*6371000/360, where 6371000 m is the mean Earth radius
+#define METERS_PER_DEGREE 111194.93
+
+namespace ldmmap {
+	SpatialGrid::SpatialGrid() {
+		m_cell_size_m = SPATIALGRID_DEFAULT_CELL_SIZE_M;
+		m_cell_size_deg = m_cell_size_m/METERS_PER_DEGREE;
+	}
+
+	SpatialGrid::SpatialGrid(double cell_size_m) {
+		m_cell_size_m = cell_size_m < SPATIALGRID_MIN_CELL_SIZE_M ? SPATIALGRID_MIN_CELL_SIZE_M : cell_size_m;
+		m_cell_size_deg = m_cell_size_m/METERS_PER_DEGREE;
+	}
+
+	inline int32_t
+	SpatialGrid::latToRow(double lat) {
+		return static_cast<int32_t>(std::floor(lat/m_cell_size_deg));
+	}
+
+	inline int32_t
+	SpatialGrid::lonToCol(double lon) {
+		return static_cast<int32_t>(std::floor(lon/m_cell_size_deg));
+	}
+
+	void
+	SpatialGrid::removeFromCell(uint64_t cellKey, uint64_t id) {
+		auto cellit = m_cells.find(cellKey);
+
+		if(cellit == m_cells.end()) {
+			return;
+		}
+
+		std::vector<uint64_t> &cellids = cellit->second;
+		auto idit = std::find(cellids.begin(),cellids.end(),id);
+
+		if(idit != cellids.end()) {
+			// The order of the IDs inside a cell is not relevant: swap with the last element and pop it
+			*idit = cellids.back();
+			cellids.pop_back();
+		}
+
+		if(cellids.empty()) {
+			m_cells.erase(cellit);
+		}
+	}
+
+	void
+	SpatialGrid::update(uint64_t id, double lat, double lon) {
+		uint64_t cellKey = composeCellKey(latToRow(lat),lonToCol(lon));
+
+		std::lock_guard<std::shared_mutex> lk(m_gridmut);
+
+		auto entryit = m_entries.find(id);
+
+		if(entryit == m_entries.end()) {
+			m_entries[id] = {cellKey,lat,lon};
+			m_cells[cellKey].push_back(id);
+		} else {
+			entryit->second.lat = lat;
+			entryit->second.lon = lon;
+
+			// Move the object only if it has entered a different cell
+			if(entryit->second.cellKey != cellKey) {
+				removeFromCell(entryit->second.cellKey,id);
+				m_cells[cellKey].push_back(id);
+				entryit->second.cellKey = cellKey;
+			}
+		}
+	}
+
+	bool
+	SpatialGrid::remove(uint64_t id) {
+		std::lock_guard<std::shared_mutex> lk(m_gridmut);
+
+		auto entryit = m_entries.find(id);
+
+		if(entryit == m_entries.end()) {
+			return false;
+		}
+
+		removeFromCell(entryit->second.cellKey,id);
+		m_entries.erase(entryit);
+
+		return true;
+	}
+
+	void
+	SpatialGrid::query(double lat, double lon, double range_m, std::vector<uint64_t> &ids) {
+		double range_lat_deg = range_m/METERS_PER_DEGREE;
+		double max_abs_lat = std::min(std::fabs(lat)+range_lat_deg,90.0);
+		double cos_max_lat = std::cos(max_abs_lat*M_PI/180.0);
+		bool full_scan = false;
+		double range_lon_deg = 0.0;
+
+		// The longitude extent of the bounding box is computed at the latitude (among the ones inside the box) closest to
+		// the poles, where one degree of longitude is the shortest, to never miss any object
+		// Near the poles, or when the box crosses the antimeridian, all the cells are considered
+		if(cos_max_lat < 1e-6) {
+			full_scan = true;
+		} else {
+			range_lon_deg = range_m/(METERS_PER_DEGREE*cos_max_lat);
+
+			if(lon-range_lon_deg < -180.0 || lon+range_lon_deg > 180.0) {
+				full_scan = true;
+			}
+		}
+
+		int32_t min_row = latToRow(lat-range_lat_deg);
+		int32_t max_row = latToRow(lat+range_lat_deg);
+		int32_t min_col = full_scan ? 0 : lonToCol(lon-range_lon_deg);
+		int32_t max_col = full_scan ? 0 : lonToCol(lon+range_lon_deg);
+
+		std::shared_lock<std::shared_mutex> lk(m_gridmut);
+
+		uint64_t num_query_cells = full_scan ? UINT64_MAX : static_cast<uint64_t>(max_row-min_row+1)*static_cast<uint64_t>(max_col-min_col+1);
+
+		if(num_query_cells <= m_cells.size()) {
+			// Look up directly the cells overlapping the bounding box
+			for(int32_t row=min_row;row<=max_row;row++) {
+				for(int32_t col=min_col;col<=max_col;col++) {
+					auto cellit = m_cells.find(composeCellKey(row,col));
+
+					if(cellit != m_cells.end()) {
+						ids.insert(ids.end(),cellit->second.begin(),cellit->second.end());
+					}
+				}
+			}
+		} else {
+			// The bounding box covers more cells than the non-empty ones: it is cheaper to iterate over the non-empty cells only
+			for(auto const& [cellKey, cellids] : m_cells) {
+				int32_t row = cellKeyRow(cellKey);
+				int32_t col = cellKeyCol(cellKey);
+
+				if(row>=min_row && row<=max_row && (full_scan || (col>=min_col && col<=max_col))) {
+					ids.insert(ids.end(),cellids.begin(),cellids.end());
+				}
+			}
+		}
+	}
+
+	void
+	SpatialGrid::clear() {
+		std::lock_guard<std::shared_mutex> lk(m_gridmut);
+
+		m_cells.clear();
+		m_entries.clear();
+	}
+
+	bool
+	SpatialGrid::setCellSize(double cell_size_m) {
+		if(cell_size_m < SPATIALGRID_MIN_CELL_SIZE_M) {
+			return false;
+		}
+
+		std::lock_guard<std::shared_mutex> lk(m_gridmut);
+
+		m_cell_size_m = cell_size_m;
+		m_cell_size_deg = m_cell_size_m/METERS_PER_DEGREE;
+
+		// Rebuild the whole index with the new cell size
+		m_cells.clear();
+
+		for(auto& [id, entry] : m_entries) {
+			entry.cellKey = composeCellKey(latToRow(entry.lat),lonToCol(entry.lon));
+			m_cells[entry.cellKey].push_back(id);
+		}
+
+		return true;
+	}
+
+	size_t
+	SpatialGrid::getCardinality() {
+		std::shared_lock<std::shared_mutex> lk(m_gridmut);
+
+		return m_entries.size();
+	}
+}
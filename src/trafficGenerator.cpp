@@ -0,0 +1,676 @@
+#include "trafficGenerator.h"
+#include "packetBuffer.h"
+#include "utils.h"
+#include "btp.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+extern "C" {
+	#include "CAM.h"
+	#include "DENM.h"
+	#include "CPM.h"
+	#include "VAM.h"
+}
+
+// Epoch time at 2004-01-01 (in ms)
+#define TIME_SHIFT_MILLI 1072915200000
+
+// Length of one degree of latitude (or one degree of longitude at the equator), in meters
+#define METERS_PER_DEGREE 111194.93
+
+#define DEG_2_RAD(val) ((val)*M_PI/180.0)
+#define RAD_2_DEG(val) ((val)*180.0/M_PI)
+
+// Messages IDs and protocol versions of the CPMs (TS 103 324) and VAMs (TS 103 300-3)
+#define TRAFFICGEN_CPM_MESSAGE_ID 14
+#define TRAFFICGEN_CPM_PROTOCOL_VERSION 2
+#define TRAFFICGEN_VAM_MESSAGE_ID 16
+#define TRAFFICGEN_VAM_PROTOCOL_VERSION 3
+
+// Relevance distance of the generated DENMs, also used as radius of the GeoNetworking GBC area
+#define TRAFFICGEN_DENM_RELEVANCE_DISTANCE RelevanceDistance_lessThan200m
+#define TRAFFICGEN_DENM_GBC_RADIUS_M 200
+
+// Cause codes of the generated DENMs (one after the other, for each station)
+static const long denm_cause_codes[]={CauseCodeType_trafficCondition,CauseCodeType_accident,CauseCodeType_roadworks,
+	CauseCodeType_slowVehicle,CauseCodeType_stationaryVehicle};
+
+static void
+setReferencePosition(ReferencePosition_t &refpos, double lat, double lon) {
+	refpos.latitude=static_cast<Latitude_t>(lround(lat*10000000.0));
+	refpos.longitude=static_cast<Longitude_t>(lround(lon*10000000.0));
+	refpos.positionConfidenceEllipse.semiMajorConfidence=100;
+	refpos.positionConfidenceEllipse.semiMinorConfidence=100;
+	refpos.positionConfidenceEllipse.semiMajorOrientation=HeadingValue_wgs84North;
+	refpos.altitude.altitudeValue=AltitudeValue_unavailable;
+	refpos.altitude.altitudeConfidence=AltitudeConfidence_unavailable;
+}
+
+// 0.1 degrees, in [0,3599]
+static long
+headingToValue(double heading) {
+	long value=lround(heading*10.0);
+
+	return value>=3600 ? value-3600 : value;
+}
+
+TrafficGenerator::TrafficGenerator(const trafficGenConfig_t &config, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args) {
+	m_config=config;
+
+	m_rx_fcn=rx_fcn;
+	m_additional_args=additional_args;
+
+	m_rng.seed(config.seed);
+
+	m_center_lat=(m_config.min_lat+m_config.max_lat)/2.0;
+	m_center_lon=(m_config.min_lon+m_config.max_lon)/2.0;
+	m_start_us=0;
+
+	m_next_vehicle=0;
+	m_next_vru=0;
+
+	// The weights of the message types which cannot be sent by any station are set to 0 by createStations()
+	createStations();
+
+	unsigned int weights_sum=0;
+	for(unsigned int i=0;i<TRAFFICGEN_NUM_MSGTYPES;i++) {
+		weights_sum+=m_config.weights[i];
+	}
+
+	if(weights_sum==0) {
+		m_config.weights[TRAFFICGEN_CAM]=1;
+	}
+
+	m_type_dist=std::discrete_distribution<int>(m_config.weights,m_config.weights+TRAFFICGEN_NUM_MSGTYPES);
+
+	m_encbuf.resize(TRAFFICGEN_MAX_ENCODED_SIZE);
+	allocateMessages();
+
+	m_stop=false;
+	m_generated_cnt=0;
+	for(unsigned int i=0;i<TRAFFICGEN_NUM_MSGTYPES;i++) {
+		m_generated_type_cnt[i]=0;
+	}
+	m_encode_error_cnt=0;
+}
+
+TrafficGenerator::~TrafficGenerator() {
+	ASN_STRUCT_FREE(asn_DEF_CAM,m_cam);
+	ASN_STRUCT_FREE(asn_DEF_CPM,m_cpm);
+	ASN_STRUCT_FREE(asn_DEF_VAM,m_vam);
+	ASN_STRUCT_FREE(asn_DEF_DENM,m_denm);
+}
+
+const char *
+TrafficGenerator::getMsgTypeName(trafficGenMsgType_t type) {
+	switch(type) {
+		case TRAFFICGEN_CAM:
+			return "CAM";
+		case TRAFFICGEN_CPM:
+			return "CPM";
+		case TRAFFICGEN_VAM:
+			return "VAM";
+		case TRAFFICGEN_DENM:
+			return "DENM";
+		default:
+			return "Unknown";
+	}
+}
+
+void
+TrafficGenerator::createStations() {
+	unsigned int vehicle_weight=m_config.weights[TRAFFICGEN_CAM]+m_config.weights[TRAFFICGEN_CPM]+m_config.weights[TRAFFICGEN_DENM];
+	unsigned int vru_weight=m_config.weights[TRAFFICGEN_VAM];
+	unsigned int num_vrus=0;
+
+	// The number of VRUs is proportional to the share of VAMs, keeping at least one station of each kind, if possible
+	if(vru_weight>0 && m_config.num_stations>0) {
+		num_vrus=static_cast<unsigned int>(lround(m_config.num_stations*static_cast<double>(vru_weight)/(vehicle_weight+vru_weight)));
+
+		if(num_vrus==0) {
+			num_vrus=1;
+		}
+
+		if(vehicle_weight>0 && num_vrus>=m_config.num_stations) {
+			num_vrus=m_config.num_stations-1;
+		}
+	}
+
+	m_num_vehicles=m_config.num_stations-num_vrus;
+
+	if(m_num_vehicles==0) {
+		m_config.weights[TRAFFICGEN_CAM]=0;
+		m_config.weights[TRAFFICGEN_CPM]=0;
+		m_config.weights[TRAFFICGEN_DENM]=0;
+	}
+
+	if(num_vrus==0) {
+		m_config.weights[TRAFFICGEN_VAM]=0;
+	}
+
+	// Half width and half height of the area, in meters
+	double half_width=(m_config.max_lon-m_config.min_lon)/2.0*METERS_PER_DEGREE*cos(DEG_2_RAD(m_center_lat));
+	double half_height=(m_config.max_lat-m_config.min_lat)/2.0*METERS_PER_DEGREE;
+
+	std::uniform_real_distribution<double> unit_dist(0.0,1.0);
+
+	m_stations.resize(m_config.num_stations);
+
+	for(unsigned int i=0;i<m_config.num_stations;i++) {
+		trafficGenStation_t &station=m_stations[i];
+
+		station.stationID=TRAFFICGEN_FIRST_STATION_ID+i;
+		station.vru=i>=m_num_vehicles;
+		station.denm_seq=0;
+
+		if(station.vru==false) {
+			// 10% of trucks, 90% of cars
+			station.stationType=unit_dist(m_rng)<0.1 ? StationType_heavyTruck : StationType_passengerCar;
+			station.speed_ms=8.0+12.0*unit_dist(m_rng);
+		} else if(unit_dist(m_rng)<0.7) {
+			station.stationType=StationType_pedestrian;
+			station.speed_ms=1.0+1.0*unit_dist(m_rng);
+		} else {
+			station.stationType=StationType_cyclist;
+			station.speed_ms=3.0+4.0*unit_dist(m_rng);
+		}
+
+		if(m_config.trajectory==TRAFFICGEN_TRAJECTORY_CIRCULAR) {
+			double max_radius=std::min(300.0,0.9*std::min(half_width,half_height));
+			double min_radius=std::min(20.0,max_radius);
+
+			station.radius=min_radius+(max_radius-min_radius)*unit_dist(m_rng);
+			station.x0=(2.0*unit_dist(m_rng)-1.0)*std::max(0.0,half_width-station.radius);
+			station.y0=(2.0*unit_dist(m_rng)-1.0)*std::max(0.0,half_height-station.radius);
+			station.x1=station.x0;
+			station.y1=station.y0;
+			station.phase=2.0*M_PI*unit_dist(m_rng);
+		} else {
+			station.x0=(2.0*unit_dist(m_rng)-1.0)*half_width;
+			station.y0=(2.0*unit_dist(m_rng)-1.0)*half_height;
+			station.x1=(2.0*unit_dist(m_rng)-1.0)*half_width;
+			station.y1=(2.0*unit_dist(m_rng)-1.0)*half_height;
+			station.radius=0.0;
+			station.phase=2.0*hypot(station.x1-station.x0,station.y1-station.y0)*unit_dist(m_rng);
+		}
+	}
+}
+
+void
+TrafficGenerator::allocateMessages() {
+	// CAM
+	m_cam=static_cast<CAM_t *>(calloc(1,sizeof(CAM_t)));
+	m_cam->header.protocolVersion=protocolVersion_currentVersion;
+	m_cam->header.messageID=messageID_cam;
+
+	BasicVehicleContainerHighFrequency_t &hf=m_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency;
+	m_cam->cam.camParameters.highFrequencyContainer.present=HighFrequencyContainer_PR_basicVehicleContainerHighFrequency;
+	hf.heading.headingConfidence=HeadingConfidence_equalOrWithinOneDegree;
+	hf.speed.speedConfidence=10; // 10 cm/s
+	hf.driveDirection=DriveDirection_forward;
+	hf.vehicleLength.vehicleLengthConfidenceIndication=VehicleLengthConfidenceIndication_noTrailerPresent;
+	hf.longitudinalAcceleration.longitudinalAccelerationValue=0;
+	hf.longitudinalAcceleration.longitudinalAccelerationConfidence=AccelerationConfidence_pointOneMeterPerSecSquared;
+	hf.curvature.curvatureConfidence=CurvatureConfidence_onePerMeter_0_0001;
+	hf.curvatureCalculationMode=CurvatureCalculationMode_yawRateUsed;
+	hf.yawRate.yawRateConfidence=YawRateConfidence_degSec_000_10;
+
+	// CPM: the originating vehicle container, followed by the perceived object container (if any object is generated)
+	m_cpm=static_cast<CPM_t *>(calloc(1,sizeof(CPM_t)));
+	m_cpm->header.protocolVersion=TRAFFICGEN_CPM_PROTOCOL_VERSION;
+	m_cpm->header.messageID=TRAFFICGEN_CPM_MESSAGE_ID;
+
+	WrappedCpmContainer_t *vehicleContainer=static_cast<WrappedCpmContainer_t *>(calloc(1,sizeof(WrappedCpmContainer_t)));
+	vehicleContainer->containerId=CpmContainerId_originatingVehicleContainer;
+	vehicleContainer->containerData.present=WrappedCpmContainer__containerData_PR_OriginatingVehicleContainer;
+	vehicleContainer->containerData.choice.OriginatingVehicleContainer.orientationAngle.confidence=10;
+	ASN_SEQUENCE_ADD(&m_cpm->payload.cpmContainers.list,vehicleContainer);
+
+	if(m_config.perceived_objects>0) {
+		WrappedCpmContainer_t *POContainer=static_cast<WrappedCpmContainer_t *>(calloc(1,sizeof(WrappedCpmContainer_t)));
+		PerceivedObjectContainer_t &objects=POContainer->containerData.choice.PerceivedObjectContainer;
+
+		POContainer->containerId=CpmContainerId_perceivedObjectContainer;
+		POContainer->containerData.present=WrappedCpmContainer__containerData_PR_PerceivedObjectContainer;
+		objects.numberOfPerceivedObjects=m_config.perceived_objects;
+
+		for(unsigned int j=0;j<m_config.perceived_objects;j++) {
+			PerceivedObject_t *PO=static_cast<PerceivedObject_t *>(calloc(1,sizeof(PerceivedObject_t)));
+
+			PO->objectId=static_cast<Identifier2B_t *>(calloc(1,sizeof(Identifier2B_t)));
+			PO->position.xCoordinate.confidence=100;
+			PO->position.yCoordinate.confidence=100;
+
+			PO->velocity=static_cast<Velocity3dWithConfidence *>(calloc(1,sizeof(Velocity3dWithConfidence_t)));
+			PO->velocity->present=Velocity3dWithConfidence_PR_cartesianVelocity;
+			PO->velocity->choice.cartesianVelocity.xVelocity.confidence=SpeedConfidence_equalOrWithinOneMeterPerSec;
+			PO->velocity->choice.cartesianVelocity.yVelocity.confidence=SpeedConfidence_equalOrWithinOneMeterPerSec;
+
+			PO->acceleration=static_cast<Acceleration3dWithConfidence *>(calloc(1,sizeof(Acceleration3dWithConfidence_t)));
+			PO->acceleration->present=Acceleration3dWithConfidence_PR_cartesianAcceleration;
+			PO->acceleration->choice.cartesianAcceleration.xAcceleration.confidence=10; // 1 m/s^2
+			PO->acceleration->choice.cartesianAcceleration.yAcceleration.confidence=10; // 1 m/s^2
+
+			PO->angles=static_cast<EulerAnglesWithConfidence *>(calloc(1,sizeof(EulerAnglesWithConfidence_t)));
+			PO->angles->zAngle.confidence=20;
+
+			// Dimensions of a car, in decimeters
+			PO->objectDimensionX=static_cast<ObjectDimension *>(calloc(1,sizeof(ObjectDimension_t)));
+			PO->objectDimensionX->value=45;
+			PO->objectDimensionX->confidence=5;
+			PO->objectDimensionY=static_cast<ObjectDimension *>(calloc(1,sizeof(ObjectDimension_t)));
+			PO->objectDimensionY->value=18;
+			PO->objectDimensionY->confidence=5;
+
+			ASN_SEQUENCE_ADD(&objects.perceivedObjects.list,PO);
+		}
+
+		ASN_SEQUENCE_ADD(&m_cpm->payload.cpmContainers.list,POContainer);
+	}
+
+	// VAM
+	m_vam=static_cast<VAM_t *>(calloc(1,sizeof(VAM_t)));
+	m_vam->header.protocolVersion=TRAFFICGEN_VAM_PROTOCOL_VERSION;
+	m_vam->header.messageID=TRAFFICGEN_VAM_MESSAGE_ID;
+
+	VruHighFrequencyContainer_t &vruhf=m_vam->vam.vamParameters.vruHighFrequencyContainer;
+	vruhf.heading.confidence=10;
+	vruhf.speed.speedConfidence=10; // 10 cm/s
+	vruhf.longitudinalAcceleration.longitudinalAccelerationValue=0;
+	vruhf.longitudinalAcceleration.longitudinalAccelerationConfidence=AccelerationConfidence_pointOneMeterPerSecSquared;
+
+	// DENM
+	m_denm=static_cast<DENM_t *>(calloc(1,sizeof(DENM_t)));
+	m_denm->header.protocolVersion=protocolVersion_currentVersion;
+	m_denm->header.messageID=messageID_denm;
+
+	m_denm->denm.management.relevanceDistance=static_cast<RelevanceDistance_t *>(calloc(1,sizeof(RelevanceDistance_t)));
+	*m_denm->denm.management.relevanceDistance=TRAFFICGEN_DENM_RELEVANCE_DISTANCE;
+	m_denm->denm.situation=static_cast<SituationContainer *>(calloc(1,sizeof(SituationContainer_t)));
+	m_denm->denm.situation->informationQuality=InformationQuality_lowest+2;
+}
+
+TrafficGenerator::trafficGenKinematics_t
+TrafficGenerator::getKinematics(const trafficGenStation_t &station, uint64_t t_us) {
+	trafficGenKinematics_t kin;
+	double t_s=(t_us-m_start_us)/1e6;
+	double x,y;
+	double vx,vy;
+
+	kin.speed_ms=station.speed_ms;
+
+	if(m_config.trajectory==TRAFFICGEN_TRAJECTORY_CIRCULAR) {
+		// Counterclockwise motion, i.e., always turning left
+		double angle=station.phase+station.speed_ms/station.radius*t_s;
+
+		x=station.x0+station.radius*cos(angle);
+		y=station.y0+station.radius*sin(angle);
+		vx=-sin(angle);
+		vy=cos(angle);
+
+		kin.yaw_rate=RAD_2_DEG(station.speed_ms/station.radius);
+		kin.curvature=1.0/station.radius;
+	} else {
+		// Back and forth along the segment: the distance travelled is folded over twice the length of the segment
+		double length=hypot(station.x1-station.x0,station.y1-station.y0);
+
+		if(length<=0.0) {
+			x=station.x0;
+			y=station.y0;
+			vx=0.0;
+			vy=1.0;
+		} else {
+			double s=fmod(station.phase+station.speed_ms*t_s,2.0*length);
+
+			vx=(station.x1-station.x0)/length;
+			vy=(station.y1-station.y0)/length;
+
+			if(s>length) {
+				s=2.0*length-s;
+				vx=-vx;
+				vy=-vy;
+				x=station.x1+vx*(length-s);
+				y=station.y1+vy*(length-s);
+			} else {
+				x=station.x0+vx*s;
+				y=station.y0+vy*s;
+			}
+		}
+
+		kin.yaw_rate=0.0;
+		kin.curvature=0.0;
+	}
+
+	kin.heading=RAD_2_DEG(atan2(vx,vy));
+	if(kin.heading<0.0) {
+		kin.heading+=360.0;
+	}
+
+	kin.lat=m_center_lat+y/METERS_PER_DEGREE;
+	kin.lon=m_center_lon+x/(METERS_PER_DEGREE*cos(DEG_2_RAD(m_center_lat)));
+
+	return kin;
+}
+
+TrafficGenerator::trafficGenStation_t &
+TrafficGenerator::nextStation(bool vru) {
+	if(vru==true) {
+		unsigned int num_vrus=m_config.num_stations-m_num_vehicles;
+		unsigned int idx=m_num_vehicles+m_next_vru;
+
+		m_next_vru=(m_next_vru+1)%num_vrus;
+
+		return m_stations[idx];
+	} else {
+		unsigned int idx=m_next_vehicle;
+
+		m_next_vehicle=(m_next_vehicle+1)%m_num_vehicles;
+
+		return m_stations[idx];
+	}
+}
+
+ssize_t
+TrafficGenerator::encodeCAM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us) {
+	BasicVehicleContainerHighFrequency_t &hf=m_cam->cam.camParameters.highFrequencyContainer.choice.basicVehicleContainerHighFrequency;
+	bool truck=station.stationType==StationType_heavyTruck;
+
+	m_cam->header.stationID=station.stationID;
+	m_cam->cam.generationDeltaTime=(t_us/1000-TIME_SHIFT_MILLI)%65536;
+	m_cam->cam.camParameters.basicContainer.stationType=station.stationType;
+	setReferencePosition(m_cam->cam.camParameters.basicContainer.referencePosition,kin.lat,kin.lon);
+
+	hf.heading.headingValue=headingToValue(kin.heading);
+	hf.speed.speedValue=lround(kin.speed_ms*100.0);
+	hf.vehicleLength.vehicleLengthValue=truck ? 120 : 45;
+	hf.vehicleWidth=truck ? 25 : 18;
+	hf.curvature.curvatureValue=std::min(1022L,lround(kin.curvature*10000.0));
+	hf.yawRate.yawRateValue=lround(kin.yaw_rate*100.0);
+
+	asn_enc_rval_t retval=uper_encode_to_buffer(&asn_DEF_CAM,nullptr,m_cam,m_encbuf.data(),m_encbuf.size());
+
+	return retval.encoded<0 ? -1 : (retval.encoded+7)/8;
+}
+
+ssize_t
+TrafficGenerator::encodeCPM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us) {
+	uint64_t timestamp_its=t_us/1000-TIME_SHIFT_MILLI;
+
+	m_cpm->header.stationID=station.stationID;
+	if(asn_imax2INTEGER(&m_cpm->payload.managementContainer.referenceTime,static_cast<intmax_t>(timestamp_its))!=0) {
+		return -1;
+	}
+	setReferencePosition(m_cpm->payload.managementContainer.referencePosition,kin.lat,kin.lon);
+
+	m_cpm->payload.cpmContainers.list.array[0]->containerData.choice.OriginatingVehicleContainer.orientationAngle.value=headingToValue(kin.heading);
+
+	if(m_config.perceived_objects>0) {
+		PerceivedObjectContainer_t &objects=m_cpm->payload.cpmContainers.list.array[1]->containerData.choice.PerceivedObjectContainer;
+
+		// The objects surround the sender (each one at a fixed distance and bearing) and move with it
+		long vx=std::max(-16382L,std::min(16382L,lround(kin.speed_ms*sin(DEG_2_RAD(kin.heading))*100.0)));
+		long vy=std::max(-16382L,std::min(16382L,lround(kin.speed_ms*cos(DEG_2_RAD(kin.heading))*100.0)));
+		unsigned int station_idx=station.stationID-TRAFFICGEN_FIRST_STATION_ID;
+
+		for(unsigned int j=0;j<m_config.perceived_objects;j++) {
+			PerceivedObject_t *PO=objects.perceivedObjects.list.array[j];
+			double bearing=2.0*M_PI*j/m_config.perceived_objects+station.phase;
+			double distance=15.0+10.0*(j%6);
+
+			*PO->objectId=(station_idx*m_config.perceived_objects+j)%65536;
+			PO->measurementDeltaTime=(j*7)%50;
+			PO->position.xCoordinate.value=lround(distance*sin(bearing)*100.0);
+			PO->position.yCoordinate.value=lround(distance*cos(bearing)*100.0);
+			PO->velocity->choice.cartesianVelocity.xVelocity.value=vx;
+			PO->velocity->choice.cartesianVelocity.yVelocity.value=vy;
+			PO->acceleration->choice.cartesianAcceleration.xAcceleration.value=0;
+			PO->acceleration->choice.cartesianAcceleration.yAcceleration.value=0;
+			PO->angles->zAngle.value=headingToValue(kin.heading);
+		}
+	}
+
+	asn_enc_rval_t retval=uper_encode_to_buffer(&asn_DEF_CPM,nullptr,m_cpm,m_encbuf.data(),m_encbuf.size());
+
+	return retval.encoded<0 ? -1 : (retval.encoded+7)/8;
+}
+
+ssize_t
+TrafficGenerator::encodeVAM(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us) {
+	VruHighFrequencyContainer_t &vruhf=m_vam->vam.vamParameters.vruHighFrequencyContainer;
+
+	m_vam->header.stationID=station.stationID;
+	m_vam->vam.generationDeltaTime=(t_us/1000-TIME_SHIFT_MILLI)%65536;
+	m_vam->vam.vamParameters.basicContainer.stationType=station.stationType;
+	setReferencePosition(m_vam->vam.vamParameters.basicContainer.referencePosition,kin.lat,kin.lon);
+
+	vruhf.heading.value=headingToValue(kin.heading);
+	vruhf.speed.speedValue=lround(kin.speed_ms*100.0);
+
+	asn_enc_rval_t retval=uper_encode_to_buffer(&asn_DEF_VAM,nullptr,m_vam,m_encbuf.data(),m_encbuf.size());
+
+	return retval.encoded<0 ? -1 : (retval.encoded+7)/8;
+}
+
+ssize_t
+TrafficGenerator::encodeDENM(trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us) {
+	uint64_t timestamp_its=t_us/1000-TIME_SHIFT_MILLI;
+
+	// Each DENM notifies a new event at the current position of the sender
+	station.denm_seq=(station.denm_seq+1)%65536;
+
+	m_denm->header.stationID=station.stationID;
+	m_denm->denm.management.actionID.originatingStationID=station.stationID;
+	m_denm->denm.management.actionID.sequenceNumber=station.denm_seq;
+	if(asn_imax2INTEGER(&m_denm->denm.management.detectionTime,static_cast<intmax_t>(timestamp_its))!=0 ||
+		asn_imax2INTEGER(&m_denm->denm.management.referenceTime,static_cast<intmax_t>(timestamp_its))!=0) {
+		return -1;
+	}
+	setReferencePosition(m_denm->denm.management.eventPosition,kin.lat,kin.lon);
+	m_denm->denm.management.stationType=station.stationType;
+
+	m_denm->denm.situation->eventType.causeCode=denm_cause_codes[station.denm_seq%(sizeof(denm_cause_codes)/sizeof(denm_cause_codes[0]))];
+	m_denm->denm.situation->eventType.subCauseCode=0;
+
+	asn_enc_rval_t retval=uper_encode_to_buffer(&asn_DEF_DENM,nullptr,m_denm,m_encbuf.data(),m_encbuf.size());
+
+	return retval.encoded<0 ? -1 : (retval.encoded+7)/8;
+}
+
+void
+TrafficGenerator::wrapGNBTP(const trafficGenStation_t &station, const trafficGenKinematics_t &kin, uint64_t t_us, uint16_t btp_port,
+	uint16_t gbc_radius_m, size_t len, std::vector<uint8_t> &packet) {
+	bool gbc=gbc_radius_m>0;
+	uint32_t lat=static_cast<uint32_t>(static_cast<int32_t>(lround(kin.lat*10000000.0)));
+	uint32_t lon=static_cast<uint32_t>(static_cast<int32_t>(lround(kin.lon*10000000.0)));
+	// GeoNetworking address: manual configuration, station type and MID derived from the station ID
+	uint8_t gnaddr[8]={static_cast<uint8_t>(0x80 | ((station.stationType & 0x1F)<<2)),0x00,0x02,0x00,
+		static_cast<uint8_t>(station.stationID>>24),static_cast<uint8_t>(station.stationID>>16),
+		static_cast<uint8_t>(station.stationID>>8),static_cast<uint8_t>(station.stationID)};
+
+	packetBuffer header(gbc ? 60 : 44);
+
+	// Basic header: version 1, next header: common header, lifetime (1 s for SHB, 60 s for GBC), remaining hop limit
+	header.addU8(0x11);
+	header.addU8(0x00);
+	header.addU8(gbc ? 0xF1 : 0x50);
+	header.addU8(0x01);
+
+	// Common header: next header: BTP-B, header type (GBC with circular area, or TSB-SHB), traffic class, flags (mobile station),
+	// payload length (BTP and Facilities layer), maximum hop limit
+	header.addU8(0x20);
+	header.addU8(gbc ? 0x40 : 0x50);
+	header.addU8(0x02);
+	header.addU8(0x80);
+	header.addHtonU16(static_cast<uint16_t>(len+4));
+	header.addU8(0x01);
+	header.addU8(0x00);
+
+	// GBC extended header: sequence number and reserved field
+	if(gbc==true) {
+		header.addHtonU16(static_cast<uint16_t>(station.denm_seq));
+		header.addHtonU16(0);
+	}
+
+	// Source long position vector
+	header.addGNAddress(gnaddr);
+	header.addHtonU32(static_cast<uint32_t>((t_us/1000-TIME_SHIFT_MILLI)%4294967296));
+	header.addHtonU32(lat);
+	header.addHtonU32(lon);
+	header.addHtonU16(static_cast<uint16_t>(lround(kin.speed_ms*100.0)) & 0x7FFF);
+	header.addHtonU16(static_cast<uint16_t>(headingToValue(kin.heading)));
+
+	if(gbc==true) {
+		// Circular destination area, centered on the sender
+		header.addHtonU32(lat);
+		header.addHtonU32(lon);
+		header.addHtonU16(gbc_radius_m);
+		header.addHtonU16(0);
+		header.addHtonU16(0);
+		header.addHtonU16(0);
+	} else {
+		// SHB extended header: reserved field
+		header.addHtonU32(0);
+	}
+
+	// BTP-B header: destination port, destination port info
+	header.addHtonU16(btp_port);
+	header.addHtonU16(0);
+
+	packetBuffer pkt(reinterpret_cast<const char *>(m_encbuf.data()),len);
+	pkt.addHeader(header);
+
+	packet=pkt.getBufferVector();
+}
+
+bool
+TrafficGenerator::generateMessage(uint64_t t_us, ingestMessage_t &msg) {
+	trafficGenMsgType_t type=static_cast<trafficGenMsgType_t>(m_type_dist(m_rng));
+	trafficGenStation_t &station=nextStation(type==TRAFFICGEN_VAM);
+	trafficGenKinematics_t kin=getKinematics(station,t_us);
+	ssize_t len;
+	uint16_t btp_port;
+	uint16_t gbc_radius_m=0;
+
+	switch(type) {
+		case TRAFFICGEN_CAM:
+			len=encodeCAM(station,kin,t_us);
+			btp_port=CA_PORT;
+			break;
+		case TRAFFICGEN_CPM:
+			len=encodeCPM(station,kin,t_us);
+			btp_port=CP_PORT;
+			break;
+		case TRAFFICGEN_VAM:
+			len=encodeVAM(station,kin,t_us);
+			btp_port=VA_PORT;
+			break;
+		default:
+			len=encodeDENM(station,kin,t_us);
+			btp_port=DEN_PORT;
+			gbc_radius_m=TRAFFICGEN_DENM_GBC_RADIUS_M;
+			break;
+	}
+
+	if(len<0) {
+		m_encode_error_cnt++;
+		return false;
+	}
+
+	msg.owner=nullptr;
+	msg.quadkey="";
+
+	// The decoder supports Facilities-only CAMs and DENMs only: the other messages are always wrapped in GeoNetworking and BTP
+	if(m_config.facility_only==true && (type==TRAFFICGEN_CAM || type==TRAFFICGEN_DENM)) {
+		msg.payload.assign(m_encbuf.begin(),m_encbuf.begin()+len);
+		// The GeoNetworking timestamp is passed as a property, as done by the AMQP brokers for the Facilities-only messages
+		msg.properties_available=true;
+		msg.gn_timestamp_available=true;
+		msg.gn_timestamp=(t_us/1000-TIME_SHIFT_MILLI)%4294967296;
+	} else {
+		wrapGNBTP(station,kin,t_us,btp_port,gbc_radius_m,len,msg.payload);
+		msg.properties_available=false;
+		msg.gn_timestamp_available=false;
+		msg.gn_timestamp=0;
+	}
+
+	m_generated_type_cnt[type]++;
+	m_generated_cnt++;
+
+	return true;
+}
+
+bool
+TrafficGenerator::run() {
+	if(m_config.num_stations==0) {
+		return false;
+	}
+
+	m_start_us=get_timestamp_us();
+
+	for(uint64_t k=0;m_stop==false;k++) {
+		uint64_t t_us;
+
+		if(m_config.rate>0) {
+			// The messages are scheduled at fixed times from the start: when late, they are generated immediately, to catch up
+			t_us=m_start_us+static_cast<uint64_t>(k*1e6/m_config.rate);
+
+			uint64_t now_us=get_timestamp_us();
+			if(t_us>now_us) {
+				std::this_thread::sleep_for(std::chrono::microseconds(t_us-now_us));
+			}
+		} else {
+			t_us=get_timestamp_us();
+		}
+
+		if(m_config.duration_s>0 && t_us-m_start_us>=m_config.duration_s*1e6) {
+			break;
+		}
+
+		ingestMessage_t msg;
+
+		if(generateMessage(t_us,msg)==false) {
+			continue;
+		}
+
+		uint64_t rx_timestamp_ns=get_timestamp_ns();
+
+		msg.on_msg_timestamp_us=rx_timestamp_ns/1000;
+		msg.rx_timestamp_ns=rx_timestamp_ns;
+
+		m_rx_fcn(msg,m_additional_args);
+	}
+
+	return true;
+}
+
+bool
+TrafficGenerator::dump(IngestRecorder &recorder) {
+	if(m_config.num_stations==0 || m_config.duration_s<=0 || m_config.rate<=0) {
+		std::cerr << "[TrafficGenerator] Error: the number of stations, the duration and the rate must be set to write the messages to a file." << std::endl;
+		return false;
+	}
+
+	m_start_us=get_timestamp_us();
+
+	uint64_t num_messages=static_cast<uint64_t>(m_config.duration_s*m_config.rate);
+
+	for(uint64_t k=0;k<num_messages && m_stop==false;k++) {
+		uint64_t t_us=m_start_us+static_cast<uint64_t>(k*1e6/m_config.rate);
+		ingestMessage_t msg;
+
+		if(generateMessage(t_us,msg)==false) {
+			continue;
+		}
+
+		// The recorded reception time is the generation time, so that the messages are replayed at the configured rate
+		msg.on_msg_timestamp_us=t_us;
+		msg.rx_timestamp_ns=t_us*1000;
+
+		recorder.record(msg);
+	}
+
+	return true;
+}
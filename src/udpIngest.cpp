@@ -0,0 +1,151 @@
+#include "udpIngest.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+UDPIngest::UDPIngest(const std::string &bind_address, uint16_t port, void (*rx_fcn)(ingestMessage_t &,void *), void *additional_args) {
+	m_bind_address=bind_address;
+	m_port=port;
+	m_sockfd=-1;
+
+	m_rx_fcn=rx_fcn;
+	m_additional_args=additional_args;
+
+	m_running=false;
+
+	m_rx_cnt=0;
+	m_batch_cnt=0;
+	m_truncated_cnt=0;
+}
+
+UDPIngest::~UDPIngest() {
+	stop();
+}
+
+bool
+UDPIngest::start() {
+	if(m_running==true) {
+		return true;
+	}
+
+	struct sockaddr_in address;
+	memset(&address,0,sizeof(address));
+	address.sin_family=AF_INET;
+	address.sin_port=htons(m_port);
+
+	if(m_bind_address=="") {
+		address.sin_addr.s_addr=htonl(INADDR_ANY);
+	} else if(inet_pton(AF_INET,m_bind_address.c_str(),&address.sin_addr)!=1) {
+		std::cerr << "[UDPIngest] Error: invalid bind address: " << m_bind_address << std::endl;
+		return false;
+	}
+
+	m_sockfd=socket(AF_INET,SOCK_DGRAM,0);
+
+	if(m_sockfd<0) {
+		std::cerr << "[UDPIngest] Error: cannot create the socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	// A larger receive buffer is only a hint: the kernel may limit it to net.core.rmem_max
+	int rcvbuf=UDPINGEST_SOCKET_RCVBUF_SIZE;
+	setsockopt(m_sockfd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf));
+
+	// The receive timeout lets the receiving thread periodically check if it has been stopped
+	struct timeval tv;
+	tv.tv_sec=UDPINGEST_RECV_TIMEOUT_MS/1000;
+	tv.tv_usec=(UDPINGEST_RECV_TIMEOUT_MS%1000)*1000;
+	setsockopt(m_sockfd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+
+	if(bind(m_sockfd,(struct sockaddr *) &address,sizeof(address))<0) {
+		std::cerr << "[UDPIngest] Error: cannot bind to " << (m_bind_address=="" ? "0.0.0.0" : m_bind_address) << ":" << m_port << ": " << strerror(errno) << std::endl;
+		close(m_sockfd);
+		m_sockfd=-1;
+		return false;
+	}
+
+	m_running=true;
+	m_receiver=std::thread(&UDPIngest::receiverLoop,this);
+
+	return true;
+}
+
+void
+UDPIngest::stop() {
+	if(m_running.exchange(false)==false) {
+		return;
+	}
+
+	if(m_receiver.joinable()) {
+		m_receiver.join();
+	}
+
+	close(m_sockfd);
+	m_sockfd=-1;
+}
+
+void
+UDPIngest::receiverLoop() {
+	// The datagrams are received directly into the buffers of the batch, which are then copied into the payload of each message
+	std::unique_ptr<uint8_t[]> buffers(new uint8_t[UDPINGEST_BATCH_SIZE*UDPINGEST_MAX_DATAGRAM_SIZE]);
+	struct mmsghdr msgs[UDPINGEST_BATCH_SIZE];
+	struct iovec iovecs[UDPINGEST_BATCH_SIZE];
+
+	memset(msgs,0,sizeof(msgs));
+
+	for(unsigned int i=0;i<UDPINGEST_BATCH_SIZE;i++) {
+		iovecs[i].iov_base=buffers.get()+i*UDPINGEST_MAX_DATAGRAM_SIZE;
+		iovecs[i].iov_len=UDPINGEST_MAX_DATAGRAM_SIZE;
+		msgs[i].msg_hdr.msg_iov=&iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen=1;
+	}
+
+	while(m_running==true) {
+		// MSG_WAITFORONE: wait (up to the receive timeout) only for the first datagram, then return all the datagrams
+		// which are already queued, up to UDPINGEST_BATCH_SIZE
+		int num_msgs=recvmmsg(m_sockfd,msgs,UDPINGEST_BATCH_SIZE,MSG_WAITFORONE,nullptr);
+
+		if(num_msgs<=0) {
+			if(num_msgs<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR) {
+				std::cerr << "[UDPIngest] Error: recvmmsg() failed: " << strerror(errno) << std::endl;
+				std::this_thread::sleep_for(std::chrono::milliseconds(UDPINGEST_RECV_TIMEOUT_MS));
+			}
+			continue;
+		}
+
+		// All the datagrams of the batch have been received by the time recvmmsg() returns: a single timestamp is used for all of them
+		uint64_t rx_timestamp_ns=get_timestamp_ns();
+
+		m_batch_cnt++;
+		m_rx_cnt+=num_msgs;
+
+		for(int i=0;i<num_msgs;i++) {
+			if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				m_truncated_cnt++;
+				msgs[i].msg_hdr.msg_flags=0;
+				continue;
+			}
+
+			const uint8_t *buf=static_cast<const uint8_t *>(iovecs[i].iov_base);
+			ingestMessage_t ingestmsg;
+
+			ingestmsg.owner=nullptr;
+			ingestmsg.payload.assign(buf,buf+msgs[i].msg_len);
+			ingestmsg.on_msg_timestamp_us=rx_timestamp_ns/1000;
+			ingestmsg.rx_timestamp_ns=rx_timestamp_ns;
+			ingestmsg.properties_available=false;
+			ingestmsg.gn_timestamp_available=false;
+			ingestmsg.gn_timestamp=0;
+			ingestmsg.quadkey="";
+
+			m_rx_fcn(ingestmsg,m_additional_args);
+		}
+	}
+}
@@ -0,0 +1,72 @@
+// SLDM-binlog-decoder: offline decoder of the binary log files written by the S-LDM when started with --log-binary
+// Usage: SLDM-binlog-decoder <binary log file> [output text file (default: stdout)]
+// The records are converted into the same text lines which the S-LDM would have written without --log-binary
+#include "binLogger.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if(argc<2 || argc>3 || !strcmp(argv[1],"-h") || !strcmp(argv[1],"--help")) {
+		fprintf(stderr,"Usage: %s <binary log file> [output text file (default: stdout)]\n",argv[0]);
+		return 1;
+	}
+
+	FILE *infile=fopen(argv[1],"rb");
+	if(infile==nullptr) {
+		fprintf(stderr,"Error: cannot open the binary log file %s.\n",argv[1]);
+		return 1;
+	}
+
+	FILE *outfile=stdout;
+	if(argc==3) {
+		outfile=fopen(argv[2],"w");
+
+		if(outfile==nullptr) {
+			fprintf(stderr,"Error: cannot open the output file %s.\n",argv[2]);
+			fclose(infile);
+			return 1;
+		}
+	}
+
+	binLogFileHeader_t header;
+
+	if(fread(&header,sizeof(header),1,infile)!=1 || memcmp(header.magic,BINLOGGER_FILE_MAGIC,sizeof(header.magic))!=0) {
+		fprintf(stderr,"Error: %s is not an S-LDM binary log file.\n",argv[1]);
+		return 1;
+	}
+
+	if(header.version!=BINLOGGER_FILE_VERSION || header.record_size!=sizeof(binLogRecord_t)) {
+		fprintf(stderr,"Error: unsupported binary log file version (%u, record size: %u bytes).\n",header.version,header.record_size);
+		return 1;
+	}
+
+	std::vector<std::string> sources(BINLOGGER_MAX_SOURCES,"unknown");
+	binLogRecord_t rec;
+	uint64_t num_records=0;
+
+	while(fread(&rec,sizeof(rec),1,infile)==1) {
+		if(rec.type==BINLOG_SOURCE_NAME) {
+			rec.name[sizeof(rec.name)-1]='\0';
+			sources[rec.source]=rec.name;
+		} else {
+			BinLogger::formatRecord(outfile,rec,sources[rec.source].c_str(),header.tai_offset_ns);
+			num_records++;
+		}
+	}
+
+	// A truncated record at the end of the file (e.g., if the S-LDM was killed while writing it) is ignored
+	if(!feof(infile)) {
+		fprintf(stderr,"Error: cannot read the binary log file %s.\n",argv[1]);
+	}
+
+	fprintf(stderr,"Decoded %lu records.\n",num_records);
+
+	fclose(infile);
+	if(outfile!=stdout) {
+		fclose(outfile);
+	}
+
+	return 0;
+}